@@ -6,8 +6,11 @@
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <memory>
 #include <optional>
+#include <sstream>
 
+#include <bcc/bcc_syms.h>
 #include <fcntl.h>
 #include <gelf.h>
 #include <libelf.h>
@@ -16,11 +19,16 @@
 
 #include <cereal/archives/binary.hpp>
 #include <cereal/archives/json.hpp>
+#include <cereal/types/map.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/types/unordered_map.hpp>
+#include <cereal/types/utility.hpp>
 #include <cereal/types/vector.hpp>
 
+#include "btf.h"
+#include "dwarf/dwunwind.h"
 #include "log.h"
+#include "usyms_cache.h"
 #include "util/paths.h"
 #include "version.h"
 
@@ -42,14 +50,54 @@ struct Header {
   uint64_t rr_len;     // RequiredResources length
   uint64_t elf_off;    // ELF offset from start of file
   uint64_t elf_len;    // ELF length
+  uint64_t objs_off;   // Embedded objects offset from start of file
+  uint64_t objs_len;   // Embedded objects length
 };
 
-static_assert(sizeof(Header) == 48);
+static_assert(sizeof(Header) == 64);
 static_assert(sizeof(std::size_t) <= sizeof(uint64_t));
 
-namespace bpftrace::aot {
+namespace bpftrace {
+
+namespace util {
+template <typename Archive>
+void serialize(Archive &archive, elf_symbol &sym)
+{
+  archive(sym.name, sym.start, sym.end);
+}
+} // namespace util
+
+template <typename Archive>
+void serialize(Archive &archive, ElfSymbols::Segment &segment)
+{
+  archive(segment.vaddr, segment.offset, segment.size);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ElfSymbols &symbols)
+{
+  archive(symbols.segments, symbols.symbols, symbols.bytes);
+}
+
+namespace aot {
 namespace {
 
+// The symbol and unwind tables of a user space object, computed when the
+// program is compiled so that the runtime does not have to read them from the
+// object. Objects are matched by build id.
+struct EmbeddedObject {
+  std::string path;
+  std::string build_id;
+  ElfSymbols symbols;
+  ObjectUnwindInfo unwind;
+
+  template <typename Archive>
+  void serialize(Archive &archive)
+  {
+    archive(path, build_id, symbols, unwind);
+  }
+};
+
 uint32_t rs_hash(std::string_view str)
 {
   unsigned int b = 378551;
@@ -76,8 +124,100 @@ int load_required_resources(BPFtrace &bpftrace, uint8_t *ptr, size_t len)
   return 0;
 }
 
+std::optional<EmbeddedObject> embed_object(const std::string &path)
+{
+  static struct bcc_symbol_option symopts = {
+    .use_debug_file = 1,
+    .check_debug_file_crc = 1,
+    .lazy_symbolize = 0,
+    .use_symbol_type = BCC_SYM_ALL_TYPES,
+  };
+
+  EmbeddedObject obj{ .path = path };
+  auto symbols = read_elf_symbols(path, symopts, obj.build_id);
+  if (!symbols) {
+    LOG(ERROR) << "Failed to read ELF object " << path;
+    return std::nullopt;
+  }
+  if (obj.build_id.empty()) {
+    LOG(ERROR) << "Cannot embed " << path
+               << ": it has no build id to be matched by";
+    return std::nullopt;
+  }
+  obj.symbols = std::move(*symbols);
+
+  // Not every object has unwind information (and it can't be parsed with
+  // older LLVM), but the symbols are still worth embedding.
+  auto err = DWARFUnwind::parse_object_file(path, obj.unwind);
+  if (err != DWARFError::Success) {
+    LOG(V1) << "No unwind information embedded for " << path << ": " << err;
+    obj.unwind = ObjectUnwindInfo{};
+  }
+
+  LOG(V1) << "Embedding " << obj.symbols.symbols.size() << " symbols and "
+          << obj.unwind.rows.size() << " unwind rows for " << path
+          << " (build id " << obj.build_id << ")";
+  return obj;
+}
+
+int load_embedded_objects(BPFtrace &bpftrace, uint8_t *ptr, size_t len)
+{
+  std::vector<EmbeddedObject> objects;
+  try {
+    std::istringstream in(std::string(reinterpret_cast<char *>(ptr), len),
+                          std::ios::binary);
+    cereal::BinaryInputArchive archive(in);
+    archive(objects);
+  } catch (const std::exception &ex) {
+    LOG(ERROR) << "Failed to deserialize embedded objects: " << ex.what();
+    return 1;
+  }
+
+  // Embedded symbols are only used through the shared symbol cache, so that
+  // is what resolves user addresses whenever there are any, unless the user
+  // chose otherwise.
+  if (!objects.empty()) {
+    auto &config = *bpftrace.config_;
+    for (const auto *key : { "use_blazesym", "cache_user_symbols" }) {
+      auto ok = config.load_environment(key);
+      if (!ok) {
+        LOG(ERROR) << "Invalid configuration: " << ok.takeError();
+        return 1;
+      }
+    }
+    if (!config.is_set("use_blazesym") && config.use_blazesym) {
+      LOG(V1) << "Disabling blazesym to use the embedded symbol tables";
+      config.use_blazesym = false;
+    }
+    if (!config.is_set("cache_user_symbols") &&
+        config.user_symbol_cache_type != UserSymbolCacheType::per_pid) {
+      LOG(V1) << "Caching user symbols per pid to use the embedded symbol "
+                 "tables";
+      config.user_symbol_cache_type = UserSymbolCacheType::per_pid;
+    }
+    if (config.use_blazesym ||
+        config.user_symbol_cache_type != UserSymbolCacheType::per_pid) {
+      LOG(V1) << "The embedded symbol tables are unused with this "
+                 "configuration";
+    }
+  }
+
+  for (auto &obj : objects) {
+    LOG(V1) << "Loaded embedded tables for " << obj.path << " (build id "
+            << obj.build_id << ")";
+    bpftrace.add_precomputed_symbols(
+        obj.build_id, std::make_shared<ElfSymbols>(std::move(obj.symbols)));
+    if (!obj.unwind.rows.empty()) {
+      bpftrace.precomputed_unwind_[obj.build_id] =
+          std::make_shared<ObjectUnwindInfo>(std::move(obj.unwind));
+    }
+  }
+  return 0;
+}
+
 std::optional<std::vector<uint8_t>> generate_btaot_section(
     const RequiredResources &resources,
+    const std::vector<EmbeddedObject> &objects,
     void *const elf,
     size_t elf_size)
 {
@@ -92,6 +232,20 @@ std::optional<std::vector<uint8_t>> generate_btaot_section(
     return std::nullopt;
   }
 
+  // Serialize embedded objects
+  std::string serialized_objects;
+  try {
+    std::ostringstream serialized(std::ios::binary);
+    {
+      cereal::BinaryOutputArchive archive(serialized);
+      archive(objects);
+    }
+    serialized_objects = serialized.str();
+  } catch (const std::exception &ex) {
+    LOG(ERROR) << "Failed to serialize embedded objects: " << ex.what();
+    return std::nullopt;
+  }
+
   // Construct the header
   auto hdr_len = sizeof(Header);
   Header hdr = {
@@ -103,11 +257,13 @@ std::optional<std::vector<uint8_t>> generate_btaot_section(
     .rr_len = serialized_metadata.size(),
     .elf_off = hdr_len + serialized_metadata.size(),
     .elf_len = elf_size,
+    .objs_off = hdr_len + serialized_metadata.size() + elf_size,
+    .objs_len = serialized_objects.size(),
   };
 
   // Resize the output buffer appropriately
   std::vector<uint8_t> out;
-  out.resize(sizeof(Header) + hdr.rr_len + hdr.elf_len);
+  out.resize(sizeof(Header) + hdr.rr_len + hdr.elf_len + hdr.objs_len);
   uint8_t *p = out.data();
 
   // Write out header
@@ -122,6 +278,10 @@ std::optional<std::vector<uint8_t>> generate_btaot_section(
   memcpy(p, elf, hdr.elf_len);
   p += hdr.elf_len;
 
+  // Write out embedded objects
+  memcpy(p, serialized_objects.data(), hdr.objs_len);
+  p += hdr.objs_len;
+
   return out;
 }
 
@@ -182,12 +342,59 @@ out:
 
 } // namespace
 
+int relocate_fields(BPFtrace &bpftrace)
+{
+  auto &relocations = bpftrace.resources.field_relocations;
+  if (relocations.empty())
+    return 0;
+
+  if (!bpftrace.has_btf_data()) {
+    LOG(ERROR) << "Kernel BTF is required to relocate " << relocations.size()
+               << " kernel type field(s)";
+    return 1;
+  }
+
+  int err = 0;
+  for (auto &reloc : relocations) {
+    auto layout = bpftrace.btf_->vmlinux_field(reloc.type_name, reloc.field);
+    if (!layout) {
+      LOG(ERROR) << "Incompatible kernel: " << reloc.type_name
+                 << " has no field " << reloc.field;
+      err = 1;
+      continue;
+    }
+    if (layout->bitfield || layout->size != reloc.size) {
+      LOG(ERROR) << "Incompatible kernel: " << reloc.type_name << "."
+                 << reloc.field << " is " << layout->size
+                 << (layout->bitfield ? " bytes (bitfield)" : " bytes")
+                 << ", expected " << reloc.size;
+      err = 1;
+      continue;
+    }
+    if (layout->offset != reloc.offset) {
+      LOG(V1) << "Relocating " << reloc.type_name << "." << reloc.field
+              << " from offset " << reloc.offset << " to " << layout->offset;
+      reloc.offset = layout->offset;
+    }
+  }
+  return err;
+}
+
 int generate(const RequiredResources &resources,
              const std::string &out,
              void *const elf,
-             size_t elf_size)
+             size_t elf_size,
+             const std::vector<std::string> &embed)
 {
-  auto section = generate_btaot_section(resources, elf, elf_size);
+  std::vector<EmbeddedObject> objects;
+  for (const auto &path : embed) {
+    auto obj = embed_object(path);
+    if (!obj)
+      return 1;
+    objects.emplace_back(std::move(*obj));
+  }
+
+  auto section = generate_btaot_section(resources, objects, elf, elf_size);
   if (!section)
     return 1;
 
@@ -326,7 +533,8 @@ int load(BPFtrace &bpftrace, const std::string &in)
     goto out;
   }
   if ((hdr->rr_off + hdr->rr_len) > static_cast<uint64_t>(in_file_size) ||
-      (hdr->elf_off + hdr->elf_len) > static_cast<uint64_t>(in_file_size)) {
+      (hdr->elf_off + hdr->elf_len) > static_cast<uint64_t>(in_file_size) ||
+      (hdr->objs_off + hdr->objs_len) > static_cast<uint64_t>(in_file_size)) {
     LOG(ERROR) << "Corrupted AOT bpftrace file: incomplete payload";
     err = 1;
     goto out;
@@ -339,6 +547,16 @@ int load(BPFtrace &bpftrace, const std::string &in)
   if (err)
     goto out;
 
+  err = relocate_fields(bpftrace);
+  if (err)
+    goto out;
+
+  err = load_embedded_objects(bpftrace,
+                              btaot_section + hdr->objs_off,
+                              hdr->objs_len);
+  if (err)
+    goto out;
+
   bpftrace.bytecode_ = BpfBytecode{ std::span<uint8_t>{
       btaot_section + hdr->elf_off, hdr->elf_len } };
   if (err)
@@ -352,4 +570,5 @@ out:
   return err;
 }
 
-} // namespace bpftrace::aot
+} // namespace aot
+} // namespace bpftrace
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "bpftrace.h"
 #include "required_resources.h"
@@ -9,11 +10,19 @@ namespace bpftrace::aot {
 
 static constexpr std::string_view AOT_SHIM_NAME = "bpftrace-aotrt";
 
+// Builds an AOT binary. The symbol and unwind tables of the objects in `embed`
+// are embedded, and used at runtime for objects with the same build id.
 int generate(const RequiredResources &resources,
              const std::string &out,
              void *elf,
-             size_t elf_size);
+             size_t elf_size,
+             const std::vector<std::string> &embed = {});
 
 int load(BPFtrace &bpftrace, const std::string &in);
 
+// Checks the fields that the program reads against the running kernel's BTF,
+// and relocates them to their offsets there. The offsets are written to the
+// program's globals before it is loaded.
+int relocate_fields(BPFtrace &bpftrace);
+
 } // namespace bpftrace::aot
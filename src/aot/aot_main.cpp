@@ -1,12 +1,15 @@
 #include <filesystem>
 #include <getopt.h>
 #include <iostream>
+#include <optional>
 #include <string>
 
 #include "aot.h"
 #include "bpftrace.h"
 #include "log.h"
 #include "run_bpftrace.h"
+#include "util/int_parser.h"
+#include "util/proc.h"
 #include "version.h"
 
 using namespace bpftrace;
@@ -17,8 +20,9 @@ void usage(std::ostream& out, std::string_view filename)
   out << "USAGE: " << filename << " [options]" << std::endl;
   out << std::endl;
   out << "OPTIONS:" << std::endl;
-  out << "    -f FORMAT      output format ('text', 'json')" << std::endl;
+  out << "    -f FORMAT      output format ('text', 'json', 'binary')" << std::endl;
   out << "    -o file        redirect bpftrace output to file" << std::endl;
+  out << "    -p, --pid PID  filter actions and enable USDT probes on PID" << std::endl;
   out << "    -q,            keep messages quiet" << std::endl;
   out << "    -v,            verbose messages" << std::endl;
   out << "    -d STAGE       debug info for various stages of bpftrace execution" << std::endl;
@@ -32,12 +36,13 @@ void usage(std::ostream& out, std::string_view filename)
 int main(int argc, char* argv[])
 {
   std::string output_file, output_format;
+  std::optional<pid_t> pid;
   int c;
 
   std::vector<std::string> named_params;
 
   // TODO: which other options from `bpftrace` should be included?
-  const char* const short_opts = "d:f:hVo:qv";
+  const char* const short_opts = "d:f:hVo:p:qv";
   option long_opts[] = {
     option{
         .name = "help",
@@ -45,6 +50,12 @@ int main(int argc, char* argv[])
         .flag = nullptr,
         .val = 'h',
     },
+    option{
+        .name = "pid",
+        .has_arg = required_argument,
+        .flag = nullptr,
+        .val = 'p',
+    },
     option{
         .name = "version",
         .has_arg = no_argument,
@@ -75,6 +86,15 @@ int main(int argc, char* argv[])
       case 'f':
         output_format = optarg;
         break;
+      case 'p': {
+        auto maybe_pid = util::to_uint(optarg);
+        if (!maybe_pid || *maybe_pid == 0) {
+          LOG(ERROR) << "USAGE: invalid pid: " << optarg;
+          return 1;
+        }
+        pid = static_cast<pid_t>(*maybe_pid);
+        break;
+      }
       case 'h':
         usage(std::cout, argv[0]);
         return 0;
@@ -128,6 +148,16 @@ int main(int argc, char* argv[])
 
   BPFtrace bpftrace;
 
+  // The pid filter of the program is set from this when it's loaded.
+  if (pid) {
+    auto proc = util::create_proc(*pid);
+    if (!proc) {
+      LOG(ERROR) << "Failed to attach to pid: " << proc.takeError();
+      return 1;
+    }
+    bpftrace.procmon_ = std::move(*proc);
+  }
+
   int err = aot::load(bpftrace, argv[0]);
   if (err) {
     LOG(ERROR) << "Failed to load AOT script";
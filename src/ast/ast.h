@@ -78,7 +78,8 @@ std::strong_ordering ptr_deref_compare(const T *lhs, const T *rhs)
 
 class Node {
 public:
-  Node(ASTContext &ctx, Location &&loc) : state_(*ctx.state_), loc(loc) {};
+  Node(ASTContext &ctx, Location &&loc)
+      : state_(*ctx.state_), loc(std::move(loc)) {};
   virtual ~Node() = default;
 
   Node(const Node &) = delete;
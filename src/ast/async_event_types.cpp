@@ -93,6 +93,14 @@ std::vector<llvm::Type*> Exit::asLLVMType(ast::IRBuilderBPF& b)
   };
 }
 
+std::vector<llvm::Type*> SnapshotMappings::asLLVMType(ast::IRBuilderBPF& b)
+{
+  return {
+    b.getInt64Ty(), // asyncid
+    b.getInt32Ty(), // pid
+  };
+}
+
 std::vector<llvm::Type*> Join::asLLVMType(ast::IRBuilderBPF& b, uint32_t length)
 {
   return {
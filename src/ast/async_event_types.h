@@ -99,6 +99,13 @@ struct Exit {
   std::vector<llvm::Type*> asLLVMType(ast::IRBuilderBPF& b);
 } __attribute__((packed));
 
+struct SnapshotMappings {
+  uint64_t action_id;
+  uint32_t pid;
+
+  std::vector<llvm::Type*> asLLVMType(ast::IRBuilderBPF& b);
+} __attribute__((packed));
+
 struct Join {
   uint64_t action_id;
   uint64_t join_id;
@@ -9,7 +9,6 @@ namespace bpftrace::ast {
   DO(call_stack)                                                               \
   DO(map_key)                                                                  \
   DO(read_map_value)                                                           \
-  DO(runtime_error)                                                            \
   DO(str)                                                                      \
   DO(anon_struct)                                                              \
   DO(variable)                                                                 \
@@ -2,6 +2,7 @@
 
 #include "ast/ast.h"
 #include "ast/diagnostic.h"
+#include "util/hash.h"
 
 namespace bpftrace::ast {
 
@@ -91,15 +92,75 @@ ASTContext::ASTContext() : ASTContext("", "")
 {
 }
 
+Location ASTContext::location(const SourceLocation &loc)
+{
+  // Occasionally, the parse default-constructs SourceLocation objects,
+  // which therefore do not reference the original source. We fix up this
+  // case and bind a location to the current source from this context.
+  auto bound_loc = loc;
+  if (bound_loc.source_ == nullptr) {
+    bound_loc.source_ = source_;
+  }
+
+  // The chains handed out here have no parent, and are never modified after
+  // creation (expansion always produces a new link), so they can be shared.
+  State::LocationKey key = { .source = bound_loc.source_.get(),
+                             .begin = bound_loc.begin,
+                             .end = bound_loc.end };
+  auto [it, inserted] = state_->locations_.try_emplace(key);
+  if (inserted) {
+    it->second = std::make_shared<LocationChain>(std::move(bound_loc));
+  }
+  return it->second;
+}
+
 void ASTContext::clear()
 {
   root = nullptr;
-  state_->nodes_.clear();
+  state_->clear_nodes();
   state_->diagnostics_->clear();
 }
 
-ASTContext::State::State() : diagnostics_(std::make_unique<Diagnostics>())
+// The first block is sized to hold a typical script without going back to
+// the allocator; subsequent blocks grow geometrically.
+static constexpr size_t ARENA_INITIAL_SIZE = 64 * 1024;
+
+ASTContext::State::State()
+    : arena_(ARENA_INITIAL_SIZE), diagnostics_(std::make_unique<Diagnostics>())
+{
+}
+
+ASTContext::State::~State()
+{
+  clear_nodes();
+}
+
+void ASTContext::State::clear_nodes()
+{
+  // Nodes may refer to each other, but never from their destructors. They
+  // are destroyed in reverse order of creation for good measure.
+  for (auto it = nodes_.rbegin(); it != nodes_.rend(); ++it) {
+    (*it)->~Node();
+  }
+  nodes_.clear();
+  arena_.release();
+}
+
+bool ASTContext::State::LocationKey::operator==(const LocationKey &other) const
+{
+  return source == other.source && begin == other.begin && end == other.end;
+}
+
+size_t ASTContext::State::LocationKeyHash::operator()(
+    const LocationKey &key) const
 {
+  std::size_t seed = 0;
+  util::hash_combine(seed, key.source);
+  util::hash_combine(seed, key.begin.line);
+  util::hash_combine(seed, key.begin.column);
+  util::hash_combine(seed, key.end.line);
+  util::hash_combine(seed, key.end.column);
+  return seed;
 }
 
 } // namespace bpftrace::ast
@@ -2,6 +2,9 @@
 
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -86,6 +89,10 @@ private:
 // Nodes allocated by an ASTContext will be kept alive for the duration of the
 // owning ASTContext object. The ASTContext also owns the canonical instance of
 // the ASTSource, which is used by the Diagnostics to contextualize errors.
+//
+// Nodes are bump-allocated from an arena owned by the context, and are never
+// freed individually: their destructors are run and the arena is released in
+// one go when the context is cleared or destroyed.
 class ASTContext : public ast::State<"ast"> {
 public:
   ASTContext(std::string &&filename, std::string &&contents);
@@ -96,12 +103,9 @@ public:
   template <NodeType T, typename... Args>
   constexpr T *make_node(Location &&loc, Args... args)
   {
-    auto uniq_ptr = std::make_unique<T>(*this,
-                                        std::move(loc),
-                                        std::forward<Args>(args)...);
-    auto *raw_ptr = uniq_ptr.get();
-    state_->nodes_.push_back(std::move(uniq_ptr));
-    return raw_ptr;
+    return state_->allocate<T>(*this,
+                               std::move(loc),
+                               std::forward<Args>(args)...);
   }
 
   template <NodeType T, typename... Args>
@@ -116,17 +120,9 @@ public:
     return make_node<T, Args...>(Location(loc), std::forward<Args>(args)...);
   }
 
-  Location location(const SourceLocation &loc)
-  {
-    // Occasionally, the parse default-constructs SourceLocation objects,
-    // which therefore do not reference the original source. We fix up this
-    // case and bind a location to the current source from this context.
-    auto bound_loc = loc;
-    if (bound_loc.source_ == nullptr) {
-      bound_loc.source_ = source_;
-    }
-    return std::make_shared<LocationChain>(std::move(bound_loc));
-  }
+  // Returns the canonical location for the given source range. Locations are
+  // interned, so all nodes covering the same range share a single chain.
+  Location location(const SourceLocation &loc);
 
   template <NodeType T>
   T *clone_node(const Location &loc, const T *other)
@@ -134,10 +130,7 @@ public:
     if (other == nullptr) {
       return nullptr;
     }
-    auto uniq_ptr = std::make_unique<T>(*this, loc, *other);
-    auto *raw_ptr = uniq_ptr.get();
-    state_->nodes_.push_back(std::move(uniq_ptr));
-    return raw_ptr;
+    return state_->allocate<T>(*this, loc, *other);
   }
 
   unsigned int node_count()
@@ -179,8 +172,8 @@ public:
   }
 
   // clears all the nodes and diagnostics, but does not affect the underlying
-  // `ASTSource` object. This is useful if you want to e.g. reparse the full
-  // syntax tree in place.
+  // `ASTSource` object or the interned locations. This is useful if you want
+  // to e.g. reparse the full syntax tree in place.
   void clear();
 
   // Root points to a node in `state_.nodes_`.
@@ -192,7 +185,36 @@ private:
   class State {
   public:
     State();
-    std::vector<std::unique_ptr<Node>> nodes_;
+    ~State();
+    State(const State &) = delete;
+    State &operator=(const State &) = delete;
+
+    template <NodeType T, typename... Args>
+    T *allocate(Args &&...args)
+    {
+      void *mem = arena_.allocate(sizeof(T), alignof(T));
+      auto *node = new (mem) T(std::forward<Args>(args)...);
+      nodes_.push_back(node);
+      return node;
+    }
+
+    // Runs the destructors for all nodes, and releases the arena.
+    void clear_nodes();
+
+    // Interned locations are keyed by the source and the exact range.
+    struct LocationKey {
+      const ASTSource *source;
+      SourceLocation::Position begin;
+      SourceLocation::Position end;
+      bool operator==(const LocationKey &other) const;
+    };
+    struct LocationKeyHash {
+      size_t operator()(const LocationKey &key) const;
+    };
+
+    std::pmr::monotonic_buffer_resource arena_;
+    std::vector<Node *> nodes_;
+    std::unordered_map<LocationKey, Location, LocationKeyHash> locations_;
     std::unique_ptr<Diagnostics> diagnostics_;
     MetadataIndex::InternalMap metadata_;
   };
@@ -8,8 +8,8 @@ namespace bpftrace::ast {
 
 std::stringstream& Diagnostic::addContext(Location loc)
 {
-  loc_->contexts.emplace_back(std::make_shared<LocationChain>(loc->current));
-  return loc_->contexts.back().msg;
+  contexts_.emplace_back(std::make_shared<LocationChain>(loc->current));
+  return contexts_.back().msg;
 }
 
 void Diagnostics::emit(std::ostream& out) const
@@ -37,7 +37,7 @@ void Diagnostics::emit(std::ostream& out, Severity s, const Diagnostic& d) const
   if (loc) {
     msgs.emplace_back(d.msg(), loc->current);
 
-    for (const auto& context : loc->contexts) {
+    for (const auto& context : d.contexts()) {
       msgs.emplace_back(context.msg.str(), context.loc->current);
     }
 
@@ -46,8 +46,13 @@ public:
     return hints_.emplace_back();
   }
 
-  // Add additional context for the error.
+  // Add additional context for the error. This is held by the diagnostic
+  // itself, as locations may be shared between many nodes.
   std::stringstream& addContext(Location loc);
+  const std::vector<LocationChain::Context>& contexts() const
+  {
+    return contexts_;
+  }
 
   template <typename T>
   Diagnostic& operator<<(const T& t)
@@ -59,6 +64,7 @@ public:
 private:
   std::stringstream msg_;
   std::vector<std::stringstream> hints_;
+  std::vector<LocationChain::Context> contexts_;
   Location loc_;
 };
 
@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <sstream>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Module.h>
 
@@ -268,6 +269,11 @@ void IRBuilderBPF::CreateLifetimeEnd(Value *val)
     IRBuilder::CreateLifetimeEnd(val);
 }
 
+void IRBuilderBPF::SetRingbufSize(uint64_t size)
+{
+  ringbuf_size_ = size;
+}
+
 AllocaInst *IRBuilderBPF::CreateAllocaBPF(llvm::Type *ty,
                                           const std::string &name)
 {
@@ -598,14 +604,6 @@ Value *IRBuilderBPF::CreateGetStrAllocation(const std::string &name,
                           [](AsyncIds &async_ids) { return async_ids.str(); });
 }
 
-Value *IRBuilderBPF::CreateGetFmtStringArgsAllocation(StructType *struct_type,
-                                                      const std::string &name,
-                                                      const Location &loc)
-{
-  return createAllocation(
-      bpftrace::globalvars::FMT_STRINGS_BUFFER, struct_type, name, loc);
-}
-
 Value *IRBuilderBPF::CreateAnonStructAllocation(const SizedType &tuple_type,
                                                 const std::string &name,
                                                 const Location &loc)
@@ -632,11 +630,6 @@ Value *IRBuilderBPF::CreateCallStackAllocation(const SizedType &stack_type,
                           });
 }
 
-Value *IRBuilderBPF::CreateJoinAllocation(const Location &loc)
-{
-  return createScratchBuffer(bpftrace::globalvars::JOIN_BUFFER, loc, 0);
-}
-
 Value *IRBuilderBPF::CreateReadMapValueAllocation(const SizedType &value_type,
                                                   const std::string &name,
                                                   const Location &loc)
@@ -1108,6 +1101,24 @@ void IRBuilderBPF::CreateMapUpdateElem(const std::string &map_ident,
                                        Value *val,
                                        const Location &loc,
                                        int64_t flags)
+{
+  CallInst *call = createMapUpdateCall(map_ident, key, val, flags);
+  CreateHelperErrorCond(call, BPF_FUNC_map_update_elem, loc);
+}
+
+Value *IRBuilderBPF::CreateMapInsertElem(const std::string &map_ident,
+                                         Value *key,
+                                         Value *val)
+{
+  // Failing to insert is expected (the key is already present, or an LRU map
+  // had to evict), so the result is returned rather than reported.
+  return createMapUpdateCall(map_ident, key, val, BPF_NOEXIST);
+}
+
+CallInst *IRBuilderBPF::createMapUpdateCall(const std::string &map_ident,
+                                            Value *key,
+                                            Value *val,
+                                            int64_t flags)
 {
   Value *map_ptr = GetMapVar(map_ident);
 
@@ -1127,11 +1138,10 @@ void IRBuilderBPF::CreateMapUpdateElem(const std::string &map_ident,
                                                 getInt64(
                                                     BPF_FUNC_map_update_elem),
                                                 update_func_ptr_type);
-  CallInst *call = createCall(update_func_type,
-                              update_func,
-                              { map_ptr, key, val, flags_val },
-                              "update_elem");
-  CreateHelperErrorCond(call, BPF_FUNC_map_update_elem, loc);
+  return createCall(update_func_type,
+                    update_func,
+                    { map_ptr, key, val, flags_val },
+                    "update_elem");
 }
 
 Value *IRBuilderBPF::CreateForRange(Value *iters,
@@ -1274,7 +1284,7 @@ void IRBuilderBPF::CreateCheckSetRecursion(const Location &loc,
   // Most of the time this will happen for the functions that can lead
   // to a crash e.g. "queued_spin_lock_slowpath" but it can also happen
   // for nested probes e.g. "page_fault_user" -> "print".
-  CreateIncEventLossCounter(loc);
+  CreateIncEventLossCounter(0, loc);
   CreateRet(getInt64(early_exit_ret));
 
   SetInsertPoint(lookup_failure_block);
@@ -1852,53 +1862,119 @@ CallInst *IRBuilderBPF::CreateGetSocketCookie(Value *var, const Location &loc)
                           loc);
 }
 
-void IRBuilderBPF::CreateOutput(Value *data, size_t size, const Location &loc)
-{
-  assert(data && data->getType()->isPointerTy());
-  CreateRingbufOutput(data, size, loc);
-}
-
-void IRBuilderBPF::CreateRingbufOutput(Value *data,
-                                       size_t size,
-                                       const Location &loc)
+void IRBuilderBPF::CreateOutput(size_t size,
+                                const std::function<void(Value *)> &fill,
+                                size_t loss_id,
+                                const Location &loc)
 {
-  Value *map_ptr = GetMapVar(to_string(MapType::Ringbuf));
-
-  // long bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
-  FunctionType *ringbuf_output_func_type = FunctionType::get(
-      getInt64Ty(),
-      { map_ptr->getType(), data->getType(), getInt64Ty(), getInt64Ty() },
-      false);
-
-  Value *ret = CreateHelperCall(BPF_FUNC_ringbuf_output,
-                                ringbuf_output_func_type,
-                                { map_ptr, data, getInt64(size), getInt64(0) },
-                                false,
-                                "ringbuf_output",
-                                loc);
+  // The event is built directly in ring buffer memory rather than in a stack
+  // or scratch buffer that is then copied into the ring. Anything that is
+  // needed to fill the event should be evaluated before calling this, so that
+  // the reservation is only held across the stores into it.
+  Value *data = CreateRingbufReserve(size, loc);
 
   llvm::Function *parent = GetInsertBlock()->getParent();
+  BasicBlock *reserved_block = BasicBlock::Create(module_.getContext(),
+                                                  "ringbuf_reserved",
+                                                  parent);
   BasicBlock *loss_block = BasicBlock::Create(module_.getContext(),
                                               "event_loss_counter",
                                               parent);
   BasicBlock *merge_block = BasicBlock::Create(module_.getContext(),
                                                "counter_merge",
                                                parent);
-  Value *condition = CreateICmpSLT(ret, getInt64(0), "ringbuf_loss");
-  CreateCondBr(condition, loss_block, merge_block);
+  Value *condition = CreateICmpEQ(data, GetNull(), "ringbuf_loss");
+  CreateCondBr(condition, loss_block, reserved_block);
 
   SetInsertPoint(loss_block);
-  CreateIncEventLossCounter(loc);
+  CreateIncEventLossCounter(loss_id, loc);
+  CreateBr(merge_block);
+
+  SetInsertPoint(reserved_block);
+  fill(data);
+  CreateRingbufSubmit(data, loc);
   CreateBr(merge_block);
 
   SetInsertPoint(merge_block);
 }
 
-void IRBuilderBPF::CreateIncEventLossCounter(const Location &loc)
+Value *IRBuilderBPF::CreateRingbufReserve(size_t size, const Location &loc)
+{
+  Value *map_ptr = GetMapVar(to_string(MapType::Ringbuf));
+
+  // void *bpf_ringbuf_reserve(void *ringbuf, u64 size, u64 flags)
+  // Return:
+  //    Valid pointer with size bytes of memory available; NULL, otherwise.
+  FunctionType *ringbuf_reserve_func_type = FunctionType::get(
+      getPtrTy(), { map_ptr->getType(), getInt64Ty(), getInt64Ty() }, false);
+  return CreateHelperCall(BPF_FUNC_ringbuf_reserve,
+                          ringbuf_reserve_func_type,
+                          { map_ptr, getInt64(size), getInt64(0) },
+                          false,
+                          "ringbuf_reserve",
+                          loc);
+}
+
+void IRBuilderBPF::CreateRingbufSubmit(Value *data, const Location &loc)
+{
+  // void bpf_ringbuf_submit(void *data, u64 flags)
+  FunctionType *ringbuf_submit_func_type = FunctionType::get(
+      getVoidTy(), { data->getType(), getInt64Ty() }, false);
+  CreateHelperCall(BPF_FUNC_ringbuf_submit,
+                   ringbuf_submit_func_type,
+                   { data, CreateRingbufWakeupFlags(loc) },
+                   false,
+                   "",
+                   loc);
+}
+
+Value *IRBuilderBPF::CreateRingbufQuery(uint64_t flags, const Location &loc)
+{
+  Value *map_ptr = GetMapVar(to_string(MapType::Ringbuf));
+
+  // u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+  // Return:
+  //    Requested value, or 0, if flags are not recognized.
+  FunctionType *ringbuf_query_func_type = FunctionType::get(
+      getInt64Ty(), { map_ptr->getType(), getInt64Ty() }, false);
+  return CreateHelperCall(BPF_FUNC_ringbuf_query,
+                          ringbuf_query_func_type,
+                          { map_ptr, getInt64(flags) },
+                          false,
+                          "ringbuf_query",
+                          loc);
+}
+
+Value *IRBuilderBPF::CreateRingbufWakeupFlags(const Location &loc)
+{
+  // A percentage, which the config parser keeps to at most 100.
+  uint64_t threshold = bpftrace_.config_->ringbuf_wakeup_threshold;
+  if (threshold == 0) {
+    // Let the kernel decide, which wakes up the consumer for every record
+    // submitted to an otherwise drained ring buffer.
+    return getInt64(0);
+  }
+
+  // Only wake up the consumer once the ring buffer is filled past the
+  // threshold (as a percentage of its size). Anything below it is picked up
+  // by userspace when its poll times out. The size of the ring buffer is
+  // fixed when its map is defined, so the threshold is folded into a constant.
+  uint64_t threshold_bytes = (ringbuf_size_ * threshold + 99) / 100;
+  Value *avail = CreateRingbufQuery(BPF_RB_AVAIL_DATA, loc);
+  Value *condition = CreateICmpUGE(avail,
+                                   getInt64(threshold_bytes),
+                                   "ringbuf_wakeup_cond");
+  return CreateSelect(condition,
+                      getInt64(BPF_RB_FORCE_WAKEUP),
+                      getInt64(BPF_RB_NO_WAKEUP));
+}
+
+void IRBuilderBPF::CreateIncEventLossCounter(size_t loss_id,
+                                             const Location &loc)
 {
   auto *value = createScratchBuffer(bpftrace::globalvars::EVENT_LOSS_COUNTER,
                                     loc,
-                                    0);
+                                    loss_id);
   CreateStore(CreateAdd(CreateLoad(getInt64Ty(), value), getInt64(1)), value);
 }
 
@@ -2200,30 +2276,46 @@ void IRBuilderBPF::CreateRuntimeError(RuntimeErrorId rte_id,
       return;
   }
 
-  int error_id = async_ids_.runtime_error();
-  bpftrace_.resources.runtime_error_info.try_emplace(
-      error_id, RuntimeErrorInfo(rte_id, func_id, loc));
+  // Ids are assigned by what's being reported rather than in generation
+  // order, so that code which is generated more than once (unrolled loops,
+  // probes sharing a program) always gets the same ids.
+  RuntimeErrorInfo info(rte_id, func_id, loc);
+  std::stringstream key;
+  key << static_cast<int>(rte_id) << ":" << func_id;
+  for (const auto &location : info.locations) {
+    key << ":" << location.filename << ":" << location.line << ":"
+        << location.column;
+  }
+  auto &runtime_error_info = bpftrace_.resources.runtime_error_info;
+  auto [id, inserted] = runtime_error_ids_.try_emplace(
+      key.str(), static_cast<int>(runtime_error_info.size()));
+  int error_id = id->second;
+  if (inserted) {
+    runtime_error_info.emplace(error_id, std::move(info));
+  }
   auto elements = AsyncEvent::RuntimeError().asLLVMType(*this);
   StructType *runtime_error_struct = GetStructType("runtime_error_t",
                                                    elements,
                                                    true);
-  AllocaInst *buf = CreateAllocaBPF(runtime_error_struct, "runtime_error_t");
-  CreateStore(
-      GetIntSameSize(static_cast<int64_t>(
-                         async_action::AsyncAction::runtime_error),
-                     elements.at(0)),
-      CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(0) }));
-  CreateStore(
-      GetIntSameSize(error_id, elements.at(1)),
-      CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(1) }));
-  CreateStore(
-      return_value,
-      CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(2) }));
-
   const auto &layout = module_.getDataLayout();
   auto struct_size = layout.getTypeAllocSize(runtime_error_struct);
-  CreateOutput(buf, struct_size, loc);
-  CreateLifetimeEnd(buf);
+  CreateOutput(
+      struct_size,
+      [&](Value *buf) {
+        CreateStore(
+            GetIntSameSize(static_cast<int64_t>(
+                               async_action::AsyncAction::runtime_error),
+                           elements.at(0)),
+            CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(0) }));
+        CreateStore(
+            GetIntSameSize(error_id, elements.at(1)),
+            CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(1) }));
+        CreateStore(
+            return_value,
+            CreateGEP(runtime_error_struct, buf, { getInt64(0), getInt32(2) }));
+      },
+      0,
+      loc);
 }
 
 void IRBuilderBPF::CreateHelperErrorCond(Value *return_value,
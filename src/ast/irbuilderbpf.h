@@ -3,6 +3,7 @@
 #include <llvm/Config/llvm-config.h>
 #include <llvm/IR/IRBuilder.h>
 #include <optional>
+#include <unordered_map>
 
 #include "ast/ast.h"
 #include "ast/async_ids.h"
@@ -41,6 +42,10 @@ public:
   void SetInsertPoint(BasicBlock::iterator ip);
   void restoreIP(InsertPoint ip);
 
+  // The size of the ring buffer map in bytes, as defined by codegen. Used to
+  // compute the wakeup threshold of ring buffer submissions.
+  void SetRingbufSize(uint64_t size);
+
   AllocaInst *CreateAllocaBPF(llvm::Type *ty, const std::string &name = "");
   AllocaInst *CreateAllocaBPF(const SizedType &stype,
                               const std::string &name = "");
@@ -71,6 +76,11 @@ public:
                            Value *val,
                            const Location &loc,
                            int64_t flags = 0);
+  // Inserts the key unless it is already present. Returns zero if the key was
+  // inserted.
+  Value *CreateMapInsertElem(const std::string &map_ident,
+                             Value *key,
+                             Value *val);
   Value *CreateForRange(Value *iters,
                         Value *callback,
                         Value *callback_ctx,
@@ -133,16 +143,12 @@ public:
   CallInst *CreateThisCpuPtr(Value *var, const Location &loc);
   CallInst *CreateGetSocketCookie(Value *var, const Location &loc);
   Value *CreateGetStrAllocation(const std::string &name, const Location &loc);
-  Value *CreateGetFmtStringArgsAllocation(StructType *struct_type,
-                                          const std::string &name,
-                                          const Location &loc);
   Value *CreateAnonStructAllocation(const SizedType &tuple_type,
                                     const std::string &name,
                                     const Location &loc);
   Value *CreateCallStackAllocation(const SizedType &stack_type,
                                    const std::string &name,
                                    const Location &loc);
-  Value *CreateJoinAllocation(const Location &loc);
   Value *CreateWriteMapValueAllocation(const SizedType &value_type,
                                        const std::string &name,
                                        const Location &loc);
@@ -165,8 +171,14 @@ public:
                        ArrayRef<Value *> args,
                        const Twine &Name);
   void CreateGetCurrentComm(AllocaInst *buf, size_t size, const Location &loc);
-  void CreateOutput(Value *data, size_t size, const Location &loc);
-  void CreateIncEventLossCounter(const Location &loc);
+  // Reserves an event of the given size in the ring buffer, calls `fill` to
+  // populate it in place and submits it. If the reservation fails, the event
+  // loss counter slot `loss_id` is incremented instead.
+  void CreateOutput(size_t size,
+                    const std::function<void(Value *)> &fill,
+                    size_t loss_id,
+                    const Location &loc);
+  void CreateIncEventLossCounter(size_t loss_id, const Location &loc);
   void CreatePerCpuMapElemInit(const std::string &map_ident,
                                Value *key,
                                Value *val,
@@ -270,6 +282,9 @@ private:
   Module &module_;
   BPFtrace &bpftrace_;
   AsyncIds &async_ids_;
+  uint64_t ringbuf_size_ = 0;
+  // Runtime error ids, keyed by the error and its location.
+  std::unordered_map<std::string, int> runtime_error_ids_;
 
   CallInst *CreateGetPidTgid(const Location &loc);
   void CreateGetNsPidTgid(Value *dev,
@@ -280,6 +295,10 @@ private:
   CallInst *createMapLookup(const std::string &map_name,
                             Value *key,
                             const std::string &name = "lookup_elem");
+  CallInst *createMapUpdateCall(const std::string &map_ident,
+                                Value *key,
+                                Value *val,
+                                int64_t flags);
   CallInst *createPerCpuMapLookup(
       const std::string &map_name,
       Value *key,
@@ -306,7 +325,10 @@ private:
                              size_t key);
   bpf_func_id selectProbeReadHelper(AddrSpace as, bool str);
 
-  void CreateRingbufOutput(Value *data, size_t size, const Location &loc);
+  Value *CreateRingbufReserve(size_t size, const Location &loc);
+  void CreateRingbufSubmit(Value *data, const Location &loc);
+  Value *CreateRingbufQuery(uint64_t flags, const Location &loc);
+  Value *CreateRingbufWakeupFlags(const Location &loc);
 
   void createPerCpuSum(AllocaInst *ret, CallInst *call, const SizedType &type);
   void createPerCpuMinMax(AllocaInst *ret,
@@ -126,7 +126,9 @@ using Location = std::shared_ptr<LocationChain>;
 // annotated by some additional amount of context.
 //
 // Note that each LocationChain should be wrapped as a `shared_ptr`, and the
-// `Location` alias should be the way that it is referred to broadly.
+// `Location` alias should be the way that it is referred to broadly. Chains
+// are shared between nodes (see `ASTContext::location`), and therefore should
+// not be modified once they have been attached to a node.
 class LocationChain {
 public:
   struct Context {
@@ -165,7 +167,6 @@ public:
   // diagnostics, they are unpacked in reverse.
   std::optional<Context> parent;
   const SourceLocation current;
-  std::vector<Context> contexts;
 };
 
 Location operator+(const Location &orig, const Location &expansion);
@@ -1,6 +1,7 @@
 #include "ast/passes/ap_probe_expansion.h"
 
 #include <algorithm>
+#include <unordered_set>
 
 #include "ast/passes/attachpoint_passes.h"
 #include "ast/visitor.h"
@@ -289,11 +290,23 @@ void ProbeAndApExpander::visit(Program &prog)
     if (probe->attach_points.size() < 2) {
       new_probe_list.emplace_back(probe);
     } else {
+      std::string group_name;
+      std::unordered_set<std::string> seen;
+      for (auto *ap : probe->attach_points) {
+        if (seen.insert(ap->raw_input).second) {
+          if (!group_name.empty())
+            group_name += ",";
+          group_name += ap->raw_input;
+        }
+      }
+      auto group = result_.add_probe_group(std::move(group_name));
+
       for (auto *ap : probe->attach_points) {
         auto *new_probe = ast_.make_node<Probe>(
             probe->loc,
             AttachPointList{ ap },
             clone(ast_, probe->block->loc, probe->block));
+        result_.set_probe_group(*new_probe, group);
         new_probe_list.emplace_back(new_probe);
       }
     }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <set>
 
 #include "ast/ast.h"
@@ -8,7 +9,9 @@
 namespace bpftrace::ast {
 
 // There are 3 kinds of attach point expansion:
-// - full expansion  - separate LLVM function is generated for each match
+// - full expansion  - separate LLVM function is generated for each match,
+//                     although matches which produce identical code end up
+//                     sharing a single BPF program
 // - multi expansion - one LLVM function and BPF program is generated for all
 //                     matches, the list of expanded functions is attached to
 //                     the BPF program using the k(u)probe.multi mechanism
@@ -61,9 +64,35 @@ public:
     return funcs->second;
   }
 
+  // Probes with multiple attach points are split into one probe per attach
+  // point, each with a clone of the original body. The clones form a group,
+  // named after the attach points as written in the source.
+  size_t add_probe_group(std::string name)
+  {
+    probe_group_names.push_back(std::move(name));
+    return probe_group_names.size() - 1;
+  }
+  void set_probe_group(Probe &probe, size_t group)
+  {
+    probe_groups[&probe] = group;
+  }
+  std::optional<size_t> get_probe_group(Probe &probe) const
+  {
+    auto group = probe_groups.find(&probe);
+    if (group == probe_groups.end())
+      return std::nullopt;
+    return group->second;
+  }
+  const std::string &get_probe_group_name(size_t group) const
+  {
+    return probe_group_names.at(group);
+  }
+
 private:
   std::unordered_map<AttachPoint *, ExpansionType> expansions;
   std::unordered_map<AttachPoint *, std::set<std::string>> expanded_funcs;
+  std::unordered_map<Probe *, size_t> probe_groups;
+  std::vector<std::string> probe_group_names;
 };
 
 Pass CreateProbeAndApExpansionPass();
@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <bpf/bpf.h>
 #include <cassert>
+#include <map>
+#include <set>
 
 #include "arch/arch.h"
 #include "ast/passes/args_resolver.h"
@@ -8,25 +11,30 @@
 #include "ast/visitor.h"
 #include "bpftrace.h"
 #include "dwarf_parser.h"
+#include "log.h"
 #include "probe_matcher.h"
 #include "probe_types.h"
 #include "util/result.h"
 
 namespace bpftrace::ast {
 
-char ArgParseError::ID;
+namespace {
 
-void ArgParseError::log(llvm::raw_ostream &OS) const
-{
-  if (arg_name_.empty()) {
-    OS << "Could not parse arguments of \"" << probe_name_ << "\": " << detail_;
-  } else {
-    OS << "Could not parse argument \"" << arg_name_ << "\" of \""
-       << probe_name_ << "\": " << detail_;
+// Collects the fields of `args` that a probe uses.
+class ArgsFieldCollector : public Visitor<ArgsFieldCollector> {
+public:
+  using Visitor<ArgsFieldCollector>::visit;
+  void visit(FieldAccess &acc)
+  {
+    if (auto *builtin = acc.expr.as<Builtin>();
+        builtin && builtin->ident == "args") {
+      fields.insert(acc.field);
+    }
+    visit(acc.expr);
   }
-}
 
-namespace {
+  std::set<std::string> fields;
+};
 
 class ArgsResolver : public Visitor<ArgsResolver> {
 public:
@@ -39,9 +47,24 @@ public:
 private:
   void resolve_args(Probe &probe);
   Result<std::shared_ptr<Struct>> resolve_args(const AttachPoint &ap);
+  Result<std::shared_ptr<Struct>> resolve_tracepoint_args(
+      const std::string &category,
+      const std::string &event);
 
   BPFtrace &bpftrace_;
   Probe *probe_ = nullptr;
+  // The fields of `args` used by the current probe.
+  std::set<std::string> args_fields_;
+
+  struct TracepointArgs {
+    std::shared_ptr<Struct> args;
+    bool from_format_file;
+  };
+  // Resolved tracepoint arguments, by category and event. A probe resolves
+  // its arguments for every use of `args`, and wildcard probes often share
+  // the same events.
+  std::map<std::string, std::map<std::string, TracepointArgs>>
+      tracepoint_args_;
 };
 
 } // namespace
@@ -65,13 +88,8 @@ Result<std::shared_ptr<Struct>> ArgsResolver::resolve_args(
                                           false);
     case ProbeType::rawtracepoint:
       return bpftrace_.btf_->resolve_raw_tracepoint_args(ap.func);
-    case ProbeType::tracepoint: {
-      TracepointFormatParser parser(ap.target, ap.func, bpftrace_);
-      auto ok = parser.parse_format_file();
-      if (!ok)
-        return ok.takeError();
-      return parser.get_tracepoint_struct();
-    }
+    case ProbeType::tracepoint:
+      return resolve_tracepoint_args(ap.target, ap.func);
     case ProbeType::uprobe: {
       Dwarf *dwarf = bpftrace_.get_dwarf(ap.target);
       if (dwarf) {
@@ -93,6 +111,54 @@ Result<std::shared_ptr<Struct>> ArgsResolver::resolve_args(
   }
 }
 
+Result<std::shared_ptr<Struct>> ArgsResolver::resolve_tracepoint_args(
+    const std::string &category,
+    const std::string &event)
+{
+  auto has_fields = [&](const Struct &args) {
+    return std::ranges::all_of(args_fields_, [&](const std::string &field) {
+      return args.HasField(field);
+    });
+  };
+
+  auto &events = tracepoint_args_[category];
+  auto it = events.find(event);
+  if (it != events.end() &&
+      (it->second.from_format_file || has_fields(*it->second.args))) {
+    return it->second.args;
+  }
+
+  // Prefer BTF, which avoids reading and parsing a tracefs format file for
+  // every event. The format file remains the fallback for events that BTF
+  // does not describe, e.g. those defined from a shared event class. BTF
+  // doesn't record the category of the event either, so if the record lacks
+  // a field that the probe uses, the format file has the final say.
+  if (it == events.end()) {
+    auto args = bpftrace_.btf_->resolve_tracepoint_args(category, event);
+    if (!args) {
+      LOG(V1) << "Parsing tracefs format of " << category << ":" << event
+              << ", BTF: " << args.takeError();
+    } else if (!has_fields(**args)) {
+      LOG(V1) << "Parsing tracefs format of " << category << ":" << event
+              << ", BTF: missing fields used by the probe";
+    } else {
+      events.emplace(event, TracepointArgs{ *args, false });
+      return args;
+    }
+  }
+
+  TracepointFormatParser parser(category, event, bpftrace_);
+  auto ok = parser.parse_format_file();
+  if (!ok)
+    return ok.takeError();
+  auto args = parser.get_tracepoint_struct();
+  if (!args)
+    return args.takeError();
+
+  events.insert_or_assign(event, TracepointArgs{ *args, true });
+  return args;
+}
+
 void ArgsResolver::resolve_args(Probe &probe)
 {
   if (probe.attach_points.empty())
@@ -120,6 +186,9 @@ void ArgsResolver::resolve_args(Probe &probe)
 void ArgsResolver::visit(Probe &probe)
 {
   probe_ = &probe;
+  ArgsFieldCollector collector;
+  collector.visit(probe.block);
+  args_fields_ = std::move(collector.fields);
   visit(probe.block);
 }
 
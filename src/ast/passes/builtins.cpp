@@ -124,6 +124,7 @@ std::optional<Expression> Builtins::check(const std::string &ident, Node &node)
     add_bool("print_maps_on_exit", cfg->print_maps_on_exit);
     add_bool("use_blazesym", cfg->use_blazesym);
     add_bool("show_debug_info", cfg->show_debug_info);
+    add_bool("snapshot_user_mappings", cfg->snapshot_user_mappings);
 
     // Integers
     add_int("log_size", cfg->log_size);
@@ -132,6 +133,7 @@ std::optional<Expression> Builtins::check(const std::string &ident, Node &node)
     add_int("max_map_keys", cfg->max_map_keys);
     add_int("max_probes", cfg->max_probes);
     add_int("max_strlen", cfg->max_strlen);
+    add_int("max_user_symbol_cache_bytes", cfg->max_user_symbol_cache_bytes);
     add_int("on_stack_limit", cfg->on_stack_limit);
     add_int("perf_rb_pages", cfg->perf_rb_pages);
 
@@ -364,7 +366,7 @@ Pass CreateBuiltinsPass()
   auto fn = [&](ASTContext &ast, BPFtrace &bpftrace) {
     Builtins builtins(ast,
                       bpftrace,
-                      !bpftrace.cmd_.empty() || bpftrace.child_ != nullptr);
+                      !bpftrace.cmd_.empty() || bpftrace.has_child());
     builtins.visit(ast.root);
   };
 
@@ -1,15 +1,22 @@
 #include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <csignal>
 #include <cstdio>
 #include <ctime>
+#include <set>
+#include <thread>
+#include <unordered_set>
 
 // Required for LLVM_VERSION_MAJOR.
 #include <llvm/IR/GlobalValue.h>
 
 #include <llvm/ADT/FunctionExtras.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/CodeGen/UnreachableBlockElim.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DebugInfo.h>
@@ -23,12 +30,14 @@
 #include <llvm/Linker/Linker.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/MemoryBufferRef.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/IPO/StripSymbols.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/FunctionComparator.h>
 
 #include "arch/arch.h"
 #include "ast/ast.h"
@@ -68,34 +77,39 @@ using namespace llvm;
 static constexpr char LLVMTargetTriple[] = "bpf";
 static constexpr auto LICENSE = "LICENSE";
 
-static auto getTargetMachine()
+static llvm::TargetMachine *createTargetMachine()
 {
-  static auto *target = []() {
-    std::string error_str;
-    const auto *target = llvm::TargetRegistry::lookupTarget(
+  std::string error_str;
+  const auto *target = llvm::TargetRegistry::lookupTarget(
 #if LLVM_VERSION_MAJOR >= 22
-        Triple(LLVMTargetTriple),
+      Triple(LLVMTargetTriple),
 #else
-        LLVMTargetTriple,
+      LLVMTargetTriple,
 #endif
-        error_str);
-    if (!target) {
-      throw util::FatalUserException(
-          "Could not find bpf llvm target, does your llvm support it?");
-    }
-    auto *machine = target->createTargetMachine(
+      error_str);
+  if (!target) {
+    throw util::FatalUserException(
+        "Could not find bpf llvm target, does your llvm support it?");
+  }
+  auto *machine = target->createTargetMachine(
 #if LLVM_VERSION_MAJOR >= 21
-        Triple(LLVMTargetTriple),
+      Triple(LLVMTargetTriple),
 #else
-        LLVMTargetTriple,
+      LLVMTargetTriple,
 #endif
-        "generic",
-        "",
-        TargetOptions(),
-        std::optional<Reloc::Model>());
-    machine->setOptLevel(llvm::CodeGenOptLevel::Aggressive);
-    return machine;
-  }();
+      "generic",
+      "",
+      TargetOptions(),
+      std::optional<Reloc::Model>());
+  machine->setOptLevel(llvm::CodeGenOptLevel::Aggressive);
+  return machine;
+}
+
+// The shared target machine must only be used from the main thread; see
+// `CreateParallelObjectPass` for compiling on other threads.
+static auto getTargetMachine()
+{
+  static auto *target = createTargetMachine();
   return target;
 }
 
@@ -295,13 +309,27 @@ private:
   // Generate a probe for `current_attach_point_`
   // This is used to progress state (eg. asyncids) in this class instance for
   // invalid probes that still need to be visited.
-  void generateProbe(Probe &probe,
-                     const std::string &name,
-                     FunctionType *func_type);
+  llvm::Function *generateProbe(Probe &probe,
+                                const std::string &name,
+                                FunctionType *func_type);
 
   // Generate a probe and register it to the BPFtrace class.
   void add_probe(AttachPoint &ap, Probe &probe, FunctionType *func_type);
 
+  // Emit the cheap filters leading the probe body (predicates and pid
+  // filters) and return the remainder of the body. See generateProbe.
+  Expression generateProbeFilters(BlockExpr &block, ProbeType probe_type);
+  bool isCheapFilter(const Expression &expr, ProbeType probe_type);
+
+  // Generate a probe which is a member of a probe group (see
+  // ExpansionResult). If its code is identical to that of an earlier member,
+  // the function is dropped and the name of the earlier member's function is
+  // returned, so that both probes are attached with the same program.
+  std::optional<std::string> generateGroupProbe(Probe &probe,
+                                                size_t group,
+                                                FunctionType *func_type);
+  bool canShareProgram(AttachPoint &ap);
+
   [[nodiscard]] ScopedExpr getMapKey(Map &map, Expression &key_expr);
   [[nodiscard]] ScopedExpr getMultiMapKey(
       Map &map,
@@ -329,6 +357,7 @@ private:
   ScopedExpr kstack(const SizedType &stype, const Location &loc);
   ScopedExpr ustack(const SizedType &stype, const Location &loc);
   ScopedExpr dw_ustack(const SizedType &stype, const Location &loc);
+  void snapshot_mappings(const Location &loc);
 
   int get_probe_id();
 
@@ -390,6 +419,7 @@ private:
   Value *createFmtString(int print_id);
 
   bool canAggPerCpuMapElems(bpf_map_type map_type, const SizedType &val_type);
+  bool isArrayMap(bpf_map_type map_type);
 
   void maybeAllocVariable(const std::string &var_ident,
                           const SizedType &var_type,
@@ -440,11 +470,34 @@ private:
   llvm::Function *log2_func_ = nullptr;
   MDNode *loop_metadata_ = nullptr;
 
+  // Distinct functions generated for each probe group so far, by hash.
+  struct GroupFunction {
+    ProbeType type;
+    llvm::Function *func;
+    // Restores the async ids to their values from before `func` was
+    // generated.
+    std::function<void()> reset_ids;
+  };
+  std::unordered_map<
+      size_t,
+      std::unordered_multimap<FunctionComparator::FunctionHash, GroupFunction>>
+      probe_groups_;
+
   size_t getStructSize(StructType *s)
   {
     return module_->getDataLayout().getTypeAllocSize(s);
   }
 
+  // Returns the event loss counter slot for an output call, falling back to
+  // the shared slot 0 for calls that resource analysis didn't register.
+  size_t getEventLossId(Call &call)
+  {
+    auto found_id = bpftrace_.resources.event_loss_sources_id_map.find(&call);
+    if (found_id == bpftrace_.resources.event_loss_sources_id_map.end())
+      return 0;
+    return found_id->second;
+  }
+
   // The `loops_` vector holds the stack of loops, with a set of functions for
   // `continue` and `break` respectively. These are functions as they might
   // lazily initialize state and avoid creating basic blocks if they are not
@@ -677,6 +730,8 @@ ScopedExpr CodegenLLVM::ustack(const SizedType &stype, const Location &loc)
                  b_.CreateGEP(stack_struct_type,
                               stack,
                               { b_.getInt64(0), b_.getInt32(1) }));
+  if (bpftrace_.resources.needs_mapping_snapshots)
+    snapshot_mappings(loc);
   b_.CreateBr(merge_block);
   b_.SetInsertPoint(merge_block);
 
@@ -765,12 +820,71 @@ ScopedExpr CodegenLLVM::dw_ustack(const SizedType &stype, const Location &loc)
                  b_.CreateGEP(stack_struct_type,
                               stack,
                               { b_.getInt64(0), b_.getInt32(1) }));
+  if (bpftrace_.resources.needs_mapping_snapshots)
+    snapshot_mappings(loc);
   b_.CreateBr(merge_block);
   b_.SetInsertPoint(merge_block);
 
   return ScopedExpr(stack);
 }
 
+// The first time a user stack is captured in a process, ask bpftrace to
+// snapshot its mappings so that the stack can be symbolized after the process
+// has exited. Processes are keyed by their comm as well as their pid, so that
+// a process is snapshotted again after it execs.
+void CodegenLLVM::snapshot_mappings(const Location &loc)
+{
+  const size_t comm_size = 16;
+  llvm::Function *parent = b_.GetInsertBlock()->getParent();
+  BasicBlock *snapshot_block = BasicBlock::Create(module_->getContext(),
+                                                  "snapshot_mappings",
+                                                  parent);
+  BasicBlock *done_block = BasicBlock::Create(module_->getContext(),
+                                              "snapshot_done",
+                                              parent);
+
+  Value *pid = b_.CreateGetPid(loc, false);
+  AllocaInst *key = b_.CreateAllocaBPF(comm_size + sizeof(uint32_t),
+                                       "snapshot_key");
+  b_.CreateMemsetBPF(key, b_.getInt8(0), comm_size + sizeof(uint32_t));
+  b_.CreateGetCurrentComm(key, comm_size, loc);
+  b_.CreateStore(pid,
+                 b_.CreateGEP(b_.getInt8Ty(), key, b_.getInt64(comm_size)));
+  AllocaInst *val = b_.CreateAllocaBPF(b_.getInt8Ty(), "snapshot_val");
+  b_.CreateStore(b_.getInt8(1), val);
+  Value *ret = b_.CreateMapInsertElem(to_string(MapType::MappingSnapshots),
+                                      key,
+                                      val);
+  b_.CreateLifetimeEnd(val);
+  b_.CreateLifetimeEnd(key);
+  b_.CreateCondBr(b_.CreateICmpEQ(ret, b_.getInt64(0)),
+                  snapshot_block,
+                  done_block);
+
+  b_.SetInsertPoint(snapshot_block);
+  auto elements = AsyncEvent::SnapshotMappings().asLLVMType(b_);
+  StructType *snapshot_struct = b_.GetStructType("snapshot_mappings_t",
+                                                 elements,
+                                                 true);
+  b_.CreateOutput(
+      datalayout().getTypeAllocSize(snapshot_struct),
+      [&](Value *buf) {
+        b_.CreateStore(b_.getInt64(static_cast<int64_t>(
+                           async_action::AsyncAction::snapshot_mappings)),
+                       b_.CreateGEP(snapshot_struct,
+                                    buf,
+                                    { b_.getInt64(0), b_.getInt32(0) }));
+        b_.CreateStore(pid,
+                       b_.CreateGEP(snapshot_struct,
+                                    buf,
+                                    { b_.getInt64(0), b_.getInt32(1) }));
+      },
+      0,
+      loc);
+  b_.CreateBr(done_block);
+  b_.SetInsertPoint(done_block);
+}
+
 int CodegenLLVM::get_probe_id()
 {
   auto begin = bpftrace_.resources.probe_ids.begin();
@@ -911,6 +1025,11 @@ ScopedExpr CodegenLLVM::visit(Builtin &builtin)
                                     module_->getGlobalVariable(std::string(
                                         bpftrace::globalvars::CHILD_PID)),
                                     "child_pid.cmp"));
+  } else if (builtin.ident == "__builtin_filter_pid") {
+    return ScopedExpr(b_.CreateLoad(b_.getInt64Ty(),
+                                    module_->getGlobalVariable(std::string(
+                                        bpftrace::globalvars::FILTER_PID)),
+                                    "filter_pid"));
   } else {
     LOG(BUG) << "unknown builtin \"" << builtin.ident << "\"";
     __builtin_unreachable();
@@ -1806,25 +1925,32 @@ ScopedExpr CodegenLLVM::visit(Call &call)
   } else if (call.func == "exit") {
     auto elements = AsyncEvent::Exit().asLLVMType(b_);
     StructType *exit_struct = b_.GetStructType("exit_t", elements, true);
-    AllocaInst *buf = b_.CreateAllocaBPF(exit_struct, "exit");
     size_t struct_size = datalayout().getTypeAllocSize(exit_struct);
 
-    // Fill in exit struct.
-    b_.CreateStore(
-        b_.getInt64(static_cast<int64_t>(async_action::AsyncAction::exit)),
-        b_.CreateGEP(exit_struct, buf, { b_.getInt64(0), b_.getInt32(0) }));
-
+    ScopedExpr scoped_expr;
     Value *code = b_.getInt8(0);
     if (call.vargs.size() == 1) {
-      auto scoped_expr = visit(call.vargs.at(0));
+      scoped_expr = visit(call.vargs.at(0));
       code = scoped_expr.value();
     }
-    b_.CreateStore(
-        code,
-        b_.CreateGEP(exit_struct, buf, { b_.getInt64(0), b_.getInt32(1) }));
 
-    b_.CreateOutput(buf, struct_size, call.loc);
-    b_.CreateLifetimeEnd(buf);
+    // Fill in exit struct.
+    b_.CreateOutput(
+        struct_size,
+        [&](Value *buf) {
+          b_.CreateStore(
+              b_.getInt64(
+                  static_cast<int64_t>(async_action::AsyncAction::exit)),
+              b_.CreateGEP(exit_struct,
+                           buf,
+                           { b_.getInt64(0), b_.getInt32(0) }));
+          b_.CreateStore(code,
+                         b_.CreateGEP(exit_struct,
+                                      buf,
+                                      { b_.getInt64(0), b_.getInt32(1) }));
+        },
+        getEventLossId(call),
+        call.loc);
 
     return ScopedExpr();
   } else if (call.func == "print") {
@@ -1870,34 +1996,30 @@ ScopedExpr CodegenLLVM::visit(Call &call)
     auto &arg = call.vargs.at(0);
     auto &map = *arg.as<Map>();
 
-    AllocaInst *buf = b_.CreateAllocaBPF(event_struct,
-                                         call.func + "_" + map.ident);
-
-    auto *aa_ptr = b_.CreateGEP(event_struct,
-                                buf,
-                                { b_.getInt64(0), b_.getInt32(0) });
-    if (call.func == "clear")
-      b_.CreateStore(b_.GetIntSameSize(static_cast<int64_t>(
-                                           async_action::AsyncAction::clear),
-                                       elements.at(0)),
-                     aa_ptr);
-    else
-      b_.CreateStore(b_.GetIntSameSize(static_cast<int64_t>(
-                                           async_action::AsyncAction::zero),
-                                       elements.at(0)),
-                     aa_ptr);
-
     int id = bpftrace_.resources.maps_info.at(map.ident).id;
     if (id == -1) {
       LOG(BUG) << "map id for map \"" << map.ident << "\" not found";
     }
-    auto *ident_ptr = b_.CreateGEP(event_struct,
-                                   buf,
-                                   { b_.getInt64(0), b_.getInt32(1) });
-    b_.CreateStore(b_.GetIntSameSize(id, elements.at(1)), ident_ptr);
+    auto action_id = call.func == "clear" ? async_action::AsyncAction::clear
+                                          : async_action::AsyncAction::zero;
 
-    b_.CreateOutput(buf, getStructSize(event_struct), call.loc);
-    return ScopedExpr(buf, [this, buf] { b_.CreateLifetimeEnd(buf); });
+    b_.CreateOutput(
+        getStructSize(event_struct),
+        [&](Value *buf) {
+          auto *aa_ptr = b_.CreateGEP(event_struct,
+                                      buf,
+                                      { b_.getInt64(0), b_.getInt32(0) });
+          b_.CreateStore(b_.GetIntSameSize(static_cast<int64_t>(action_id),
+                                           elements.at(0)),
+                         aa_ptr);
+          auto *ident_ptr = b_.CreateGEP(event_struct,
+                                         buf,
+                                         { b_.getInt64(0), b_.getInt32(1) });
+          b_.CreateStore(b_.GetIntSameSize(id, elements.at(1)), ident_ptr);
+        },
+        getEventLossId(call),
+        call.loc);
+    return ScopedExpr();
   } else if (call.func == "stack_len") {
     auto &arg = call.vargs.at(0);
     auto scoped_arg = visit(arg);
@@ -1921,23 +2043,29 @@ ScopedExpr CodegenLLVM::visit(Call &call)
                                                elements,
                                                true);
 
-    AllocaInst *buf = b_.CreateAllocaBPF(time_struct, call.func + "_t");
-
-    b_.CreateStore(
-        b_.GetIntSameSize(static_cast<int64_t>(async_action::AsyncAction::time),
-                          elements.at(0)),
-        b_.CreateGEP(time_struct, buf, { b_.getInt64(0), b_.getInt32(0) }));
-
     auto found_id = bpftrace_.resources.time_args_id_map.find(&call);
     if (found_id == bpftrace_.resources.time_args_id_map.end()) {
       LOG(BUG) << "No id found for time call";
     }
-    b_.CreateStore(
-        b_.GetIntSameSize(found_id->second, elements.at(1)),
-        b_.CreateGEP(time_struct, buf, { b_.getInt64(0), b_.getInt32(1) }));
 
-    b_.CreateOutput(buf, getStructSize(time_struct), call.loc);
-    return ScopedExpr(buf, [this, buf] { b_.CreateLifetimeEnd(buf); });
+    b_.CreateOutput(
+        getStructSize(time_struct),
+        [&](Value *buf) {
+          b_.CreateStore(
+              b_.GetIntSameSize(static_cast<int64_t>(
+                                    async_action::AsyncAction::time),
+                                elements.at(0)),
+              b_.CreateGEP(time_struct,
+                           buf,
+                           { b_.getInt64(0), b_.getInt32(0) }));
+          b_.CreateStore(b_.GetIntSameSize(found_id->second, elements.at(1)),
+                         b_.CreateGEP(time_struct,
+                                      buf,
+                                      { b_.getInt64(0), b_.getInt32(1) }));
+        },
+        getEventLossId(call),
+        call.loc);
+    return ScopedExpr();
   } else if (call.func == "strftime") {
     auto elements = AsyncEvent::Strftime().asLLVMType(b_);
     StructType *strftime_struct = b_.GetStructType(call.func + "_t",
@@ -2728,8 +2856,16 @@ ScopedExpr CodegenLLVM::visit(FieldAccess &acc)
         return ScopedExpr(value);
       }
     } else {
+      Value *offset = b_.getInt64(field.offset);
+      if (const auto *reloc = bpftrace_.resources.find_field_relocation(
+              type.GetName(), acc.field)) {
+        // The offset on the running kernel is only known at load time.
+        offset = b_.CreateLoad(b_.getInt64Ty(),
+                               module_->getGlobalVariable(reloc->global_var),
+                               "field_offset");
+      }
       return probereadDatastructElem(std::move(scoped_arg),
-                                     b_.getInt64(field.offset),
+                                     offset,
                                      type,
                                      field.type,
                                      acc.loc,
@@ -3326,9 +3462,9 @@ ScopedExpr CodegenLLVM::visit(BlockExpr &block_expr)
   return value;
 }
 
-void CodegenLLVM::generateProbe(Probe &probe,
-                                const std::string &name,
-                                FunctionType *func_type)
+llvm::Function *CodegenLLVM::generateProbe(Probe &probe,
+                                           const std::string &name,
+                                           FunctionType *func_type)
 {
   auto probe_type = probetype(current_attach_point_->provider);
   int index = probe.index();
@@ -3344,14 +3480,258 @@ void CodegenLLVM::generateProbe(Probe &probe,
 
   // check: do the following 8 lines need to be in the wildcard loop?
   ctx_ = func->arg_begin();
+  variables_.clear();
+
+  // Filters are evaluated first so that events they reject return before
+  // any of the work below, such as the recursion map lookup.
+  Expression body = generateProbeFilters(*probe.block, probe_type);
 
   if (bpftrace_.need_recursion_check_) {
     b_.CreateCheckSetRecursion(current_attach_point_->loc,
                                getReturnValueForProbe(probe_type));
   }
 
-  variables_.clear();
-  visit(*probe.block);
+  visit(body);
+  return func;
+}
+
+// Whether the statements only contain imports, which generate no code.
+static bool is_import_only(const StatementList &stmts)
+{
+  return std::ranges::all_of(stmts, [](const Statement &stmt) {
+    return stmt.is<StatementImport>();
+  });
+}
+
+// Whether the expression does nothing but return from the probe with its
+// default return value, e.g. the `else` branch of a predicate once the
+// control flow pass has injected the implicit return.
+static bool is_bare_return(const Expression &expr)
+{
+  auto *block = expr.as<BlockExpr>();
+  if (!block || !block->expr.is<None>() || block->stmts.empty())
+    return false;
+
+  for (size_t i = 0; i < block->stmts.size(); ++i) {
+    const auto &stmt = block->stmts[i];
+    if (auto *jump = stmt.as<Jump>()) {
+      return jump->ident == JumpType::RETURN && !jump->return_value &&
+             i == block->stmts.size() - 1;
+    }
+    if (auto *expr_stmt = stmt.as<ExprStatement>()) {
+      if (!expr_stmt->expr.is<None>())
+        return false;
+    } else if (!stmt.is<StatementImport>()) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Filters are cheap if they have no side effects and only read the current
+// task (pid, comm, cgroup, ...), the pid filter set, probe arguments held in
+// the context or constants.
+bool CodegenLLVM::isCheapFilter(const Expression &expr, ProbeType probe_type)
+{
+  if (expr.is<Integer>() || expr.is<NegativeInteger>() ||
+      expr.is<Boolean>() || expr.is<String>())
+    return true;
+
+  if (auto *builtin = expr.as<Builtin>()) {
+    static const std::unordered_set<std::string> cheap_builtins = {
+      "pid",           "tid",            "__builtin_comm",
+      "__builtin_cpu", "__builtin_cpid", "__builtin_retval",
+      "__builtin_filter_pid",
+    };
+    return builtin->is_argx() || cheap_builtins.contains(builtin->ident);
+  }
+
+  if (auto *call = expr.as<Call>()) {
+    static const std::unordered_set<std::string> cheap_calls = {
+      "__get_cgroup",
+      "__get_current_uid_gid",
+      "__pid_filter_match",
+    };
+    return call->vargs.empty() && cheap_calls.contains(call->func);
+  }
+
+  if (auto *binop = expr.as<Binop>()) {
+    // Division may emit a runtime error.
+    if (binop->op == Operator::DIV || binop->op == Operator::MOD)
+      return false;
+    return isCheapFilter(binop->left, probe_type) &&
+           isCheapFilter(binop->right, probe_type);
+  }
+
+  if (auto *unop = expr.as<Unop>()) {
+    if (unop->op != Operator::LNOT && unop->op != Operator::BNOT &&
+        unop->op != Operator::MINUS)
+      return false;
+    return isCheapFilter(unop->expr, probe_type);
+  }
+
+  if (auto *cast = expr.as<Cast>()) {
+    return type_map_.type(cast).IsIntTy() &&
+           isCheapFilter(cast->expr, probe_type);
+  }
+
+  // Expanded macros, e.g. `cgroup`.
+  if (auto *block = expr.as<BlockExpr>()) {
+    return is_import_only(block->stmts) &&
+           isCheapFilter(block->expr, probe_type);
+  }
+
+  // Integer fields which are loaded straight from the context.
+  if (auto *field_access = expr.as<FieldAccess>()) {
+    auto *builtin = field_access->expr.as<Builtin>();
+    if (!builtin || builtin->ident != "args" ||
+        !type_map_.type(field_access).IsIntTy())
+      return false;
+    switch (probe_type) {
+      case ProbeType::tracepoint:
+      case ProbeType::rawtracepoint:
+      case ProbeType::fentry:
+      case ProbeType::fexit:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  return false;
+}
+
+// A probe body which starts with filters, i.e. `if` expressions where one of
+// the branches only returns, has them emitted before the rest of the probe.
+// This is the shape of predicates and of the pid filter. Events which are
+// filtered out then return immediately, without the recursion check or any
+// of the values used by the probe body being computed.
+Expression CodegenLLVM::generateProbeFilters(BlockExpr &block,
+                                             ProbeType probe_type)
+{
+  Expression body(&block);
+  while (auto *block_expr = body.as<BlockExpr>()) {
+    auto *if_expr = block_expr->expr.as<IfExpr>();
+    if (!if_expr || !is_import_only(block_expr->stmts) ||
+        !isCheapFilter(if_expr->cond, probe_type))
+      break;
+
+    bool return_if_true = is_bare_return(if_expr->left);
+    if (!return_if_true && !is_bare_return(if_expr->right))
+      break;
+
+    llvm::Function *parent = b_.GetInsertBlock()->getParent();
+    BasicBlock *filtered = BasicBlock::Create(module_->getContext(),
+                                              "filtered",
+                                              parent);
+    BasicBlock *passed = BasicBlock::Create(module_->getContext(),
+                                            "filter_passed",
+                                            parent);
+    {
+      auto scoped_cond = visit(if_expr->cond);
+      Value *cond = scoped_cond.value();
+      Value *zero_value = Constant::getNullValue(cond->getType());
+      Value *is_true = b_.CreateICmpNE(cond, zero_value, "filter_cond");
+      if (return_if_true) {
+        b_.CreateCondBr(is_true, filtered, passed);
+      } else {
+        b_.CreateCondBr(is_true, passed, filtered);
+      }
+      b_.SetInsertPoint(passed);
+    }
+
+    // Nothing needs to be undone yet, so this is a plain return.
+    auto saved_ip = b_.saveIP();
+    b_.SetInsertPoint(filtered);
+    b_.CreateRet(b_.getInt64(getReturnValueForProbe(probe_type)));
+    b_.restoreIP(saved_ip);
+
+    body = return_if_true ? if_expr->right : if_expr->left;
+  }
+  return body;
+}
+
+// Compares the code of two probe functions. Each probe function has its own
+// section, so sections are left out of the comparison.
+static bool is_same_probe_code(llvm::Function &a, llvm::Function &b)
+{
+  auto section_a = a.getSection().str();
+  auto section_b = b.getSection().str();
+  a.setSection("");
+  b.setSection("");
+
+  GlobalNumberState global_numbers;
+  bool same = FunctionComparator(&a, &b, &global_numbers).compare() == 0;
+
+  a.setSection(section_a);
+  b.setSection(section_b);
+  return same;
+}
+
+bool CodegenLLVM::canShareProgram(AttachPoint &ap)
+{
+  // Only programs which are attached by target name can be shared. Others,
+  // e.g. fentry or raw tracepoints, are bound to the BTF id of their target
+  // when loaded. Multi-attach probes are already a single program.
+  auto expansion = expansions_.get_expansion(ap);
+  if (expansion != ExpansionType::NONE && expansion != ExpansionType::FULL)
+    return false;
+
+  switch (probetype(ap.provider)) {
+    case ProbeType::kprobe:
+    case ProbeType::kretprobe:
+    case ProbeType::uprobe:
+    case ProbeType::uretprobe:
+    case ProbeType::tracepoint:
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::optional<std::string> CodegenLLVM::generateGroupProbe(
+    Probe &probe,
+    size_t group,
+    FunctionType *func_type)
+{
+  auto probe_type = probetype(current_attach_point_->provider);
+  auto &funcs = probe_groups_[group];
+
+  auto reset_ids = async_ids_.create_reset_ids();
+  auto *func = generateProbe(probe, probefull_, func_type);
+
+  // The hash only covers the shape of the code, not the values of constants
+  // such as async ids. For each earlier function of the same shape, generate
+  // the probe again with the ids that function was generated with and check
+  // whether the result is identical.
+  auto hash = FunctionComparator::functionHash(*func);
+  auto [begin, end] = funcs.equal_range(hash);
+  for (auto it = begin; it != end; ++it) {
+    const auto &other = it->second;
+    if (other.type != probe_type)
+      continue;
+
+    if (func) {
+      func->eraseFromParent();
+      func = nullptr;
+    }
+    other.reset_ids();
+    auto *candidate = generateProbe(probe, probefull_, func_type);
+    bool same = is_same_probe_code(*other.func, *candidate);
+    candidate->eraseFromParent();
+    reset_ids();
+    if (same)
+      return other.func->getName().str();
+  }
+
+  // Nothing to share with, so keep a version with ids of its own.
+  if (!func)
+    func = generateProbe(probe, probefull_, func_type);
+  funcs.emplace(hash,
+                GroupFunction{ .type = probe_type,
+                               .func = func,
+                               .reset_ids = std::move(reset_ids) });
+  return std::nullopt;
 }
 
 void CodegenLLVM::add_probe(AttachPoint &ap,
@@ -3360,11 +3740,23 @@ void CodegenLLVM::add_probe(AttachPoint &ap,
 {
   current_attach_point_ = &ap;
   probefull_ = ap.name();
-  generateProbe(probe, probefull_, func_type);
+
+  std::optional<std::string> shared_prog_name;
+  auto group = expansions_.get_probe_group(probe);
+  if (group && canShareProgram(ap)) {
+    shared_prog_name = generateGroupProbe(probe, *group, func_type);
+  } else {
+    generateProbe(probe, probefull_, func_type);
+  }
+
   bpftrace_.add_probe(ap,
                       probe,
                       expansions_.get_expansion(ap),
                       expansions_.get_expanded_funcs(ap));
+  if (shared_prog_name) {
+    // Shareable probes always end up in the main probe list.
+    bpftrace_.resources.probes.back().shared_prog_name = *shared_prog_name;
+  }
   current_attach_point_ = nullptr;
 }
 
@@ -3562,6 +3954,22 @@ void CodegenLLVM::createMapBufferStore(const SizedType &src_type,
 ScopedExpr CodegenLLVM::getMapKey(Map &map, Expression &key_expr)
 {
   const auto &expr_type = type_map_.type(key_expr);
+
+  // Array maps are always indexed by a u32, whatever the script's key type.
+  auto map_info = bpftrace_.resources.maps_info.find(map.ident);
+  if (map_info != bpftrace_.resources.maps_info.end() &&
+      isArrayMap(map_info->second.bpf_type)) {
+    auto scoped_key_expr = visit(key_expr);
+    AllocaInst *key = b_.CreateAllocaBPF(b_.getInt32Ty(), map.ident + "_key");
+    b_.CreateStore(b_.CreateIntCast(scoped_key_expr.value(),
+                                    b_.getInt32Ty(),
+                                    false),
+                   key);
+    return ScopedExpr(key, [this, key, k = std::move(scoped_key_expr)] {
+      b_.CreateLifetimeEnd(key);
+    });
+  }
+
   const auto alloca_created_here = needMapAllocation(
       type_map_.map_key_type(map.ident), expr_type);
 
@@ -4026,41 +4434,47 @@ void CodegenLLVM::createFormatStringCall(Call &call,
                                                   call_name + "_t",
                                                   false);
 
-  int struct_size = datalayout().getTypeAllocSize(ringbuf_struct);
-  Value *fmt_args = b_.CreateGetFmtStringArgsAllocation(ringbuf_struct,
-                                                        call_name + "_args",
-                                                        call.loc);
-  // The struct is not packed so we need to memset it
-  b_.CreateMemsetBPF(fmt_args, b_.getInt8(0), struct_size);
-
-  Value *id_offset = b_.CreateGEP(ringbuf_struct,
-                                  fmt_args,
-                                  { b_.getInt32(0), b_.getInt32(0) });
-  b_.CreateStore(b_.getInt64(id + static_cast<int>(async_action)), id_offset);
-  Value *fmt_offset = nullptr;
-  if (fmt_struct) {
-    fmt_offset = b_.CreateGEP(ringbuf_struct,
-                              fmt_args,
-                              { b_.getInt32(0), b_.getInt32(1) });
-  }
-
+  // Evaluate all arguments up front: the event is built in place in the ring
+  // buffer, and the reservation should not be held across their evaluation.
+  std::vector<ScopedExpr> scoped_args;
   for (size_t i = 1; i < call.vargs.size(); i++) {
-    Expression &arg = call.vargs.at(i);
-    auto scoped_arg = visit(arg);
-    Value *offset = b_.CreateGEP(fmt_struct,
-                                 fmt_offset,
-                                 { b_.getInt32(0), b_.getInt32(i - 1) });
-    if (needMemcpy(type_map_.type(arg)))
-      b_.CreateMemcpyBPF(offset,
-                         scoped_arg.value(),
-                         type_map_.type(arg).GetSize());
-    else
-      b_.CreateStore(scoped_arg.value(), offset);
+    scoped_args.emplace_back(visit(call.vargs.at(i)));
   }
 
-  b_.CreateOutput(fmt_args, struct_size, call.loc);
-  if (dyn_cast<AllocaInst>(fmt_args))
-    b_.CreateLifetimeEnd(fmt_args);
+  int struct_size = datalayout().getTypeAllocSize(ringbuf_struct);
+  b_.CreateOutput(
+      struct_size,
+      [&](Value *fmt_args) {
+        // The struct is not packed so we need to memset it
+        b_.CreateMemsetBPF(fmt_args, b_.getInt8(0), struct_size);
+
+        Value *id_offset = b_.CreateGEP(ringbuf_struct,
+                                        fmt_args,
+                                        { b_.getInt32(0), b_.getInt32(0) });
+        b_.CreateStore(b_.getInt64(id + static_cast<int>(async_action)),
+                       id_offset);
+        Value *fmt_offset = nullptr;
+        if (fmt_struct) {
+          fmt_offset = b_.CreateGEP(ringbuf_struct,
+                                    fmt_args,
+                                    { b_.getInt32(0), b_.getInt32(1) });
+        }
+
+        for (size_t i = 1; i < call.vargs.size(); i++) {
+          Expression &arg = call.vargs.at(i);
+          Value *offset = b_.CreateGEP(fmt_struct,
+                                       fmt_offset,
+                                       { b_.getInt32(0), b_.getInt32(i - 1) });
+          if (needMemcpy(type_map_.type(arg)))
+            b_.CreateMemcpyBPF(offset,
+                               scoped_args.at(i - 1).value(),
+                               type_map_.type(arg).GetSize());
+          else
+            b_.CreateStore(scoped_args.at(i - 1).value(), offset);
+        }
+      },
+      getEventLossId(call),
+      call.loc);
 }
 
 void CodegenLLVM::createPrintMapCall(Call &call)
@@ -4071,46 +4485,55 @@ void CodegenLLVM::createPrintMapCall(Call &call)
   auto &arg = call.vargs.at(0);
   auto &map = *arg.as<Map>();
 
-  AllocaInst *buf = b_.CreateAllocaBPF(print_struct,
-                                       call.func + "_" + map.ident);
-
-  // store asyncactionid:
-  b_.CreateStore(
-      b_.getInt64(static_cast<int64_t>(async_action::AsyncAction::print)),
-      b_.CreateGEP(print_struct, buf, { b_.getInt64(0), b_.getInt32(0) }));
-
   int id = bpftrace_.resources.maps_info.at(map.ident).id;
   if (id == -1) {
     LOG(BUG) << "map id for map \"" << map.ident << "\" not found";
   }
-  auto *ident_ptr = b_.CreateGEP(print_struct,
-                                 buf,
-                                 { b_.getInt64(0), b_.getInt32(1) });
-  b_.CreateStore(b_.GetIntSameSize(id, elements.at(1)), ident_ptr);
 
   // top, div
-  // first loops sets the arguments as passed by user. The second one zeros
-  // the rest
-  size_t arg_idx = 1;
-  for (; arg_idx < call.vargs.size(); arg_idx++) {
+  std::vector<Value *> print_args;
+  for (size_t arg_idx = 1; arg_idx < call.vargs.size(); arg_idx++) {
     auto scoped_arg = visit(call.vargs.at(arg_idx));
-
-    b_.CreateStore(
-        b_.CreateIntCast(scoped_arg.value(), elements.at(arg_idx), false),
-        b_.CreateGEP(print_struct,
-                     buf,
-                     { b_.getInt64(0), b_.getInt32(arg_idx + 1) }));
+    print_args.push_back(
+        b_.CreateIntCast(scoped_arg.value(), elements.at(arg_idx), false));
   }
 
-  for (; arg_idx < 3; arg_idx++) {
-    b_.CreateStore(b_.GetIntSameSize(0, elements.at(arg_idx)),
-                   b_.CreateGEP(print_struct,
-                                buf,
-                                { b_.getInt64(0), b_.getInt32(arg_idx + 1) }));
-  }
+  b_.CreateOutput(
+      getStructSize(print_struct),
+      [&](Value *buf) {
+        // store asyncactionid:
+        b_.CreateStore(
+            b_.getInt64(static_cast<int64_t>(async_action::AsyncAction::print)),
+            b_.CreateGEP(print_struct,
+                         buf,
+                         { b_.getInt64(0), b_.getInt32(0) }));
+
+        auto *ident_ptr = b_.CreateGEP(print_struct,
+                                       buf,
+                                       { b_.getInt64(0), b_.getInt32(1) });
+        b_.CreateStore(b_.GetIntSameSize(id, elements.at(1)), ident_ptr);
+
+        // first loops sets the arguments as passed by user. The second one
+        // zeros the rest
+        size_t arg_idx = 1;
+        for (; arg_idx < call.vargs.size(); arg_idx++) {
+          b_.CreateStore(print_args.at(arg_idx - 1),
+                         b_.CreateGEP(print_struct,
+                                      buf,
+                                      { b_.getInt64(0),
+                                        b_.getInt32(arg_idx + 1) }));
+        }
 
-  b_.CreateOutput(buf, getStructSize(print_struct), call.loc);
-  b_.CreateLifetimeEnd(buf);
+        for (; arg_idx < 3; arg_idx++) {
+          b_.CreateStore(b_.GetIntSameSize(0, elements.at(arg_idx)),
+                         b_.CreateGEP(print_struct,
+                                      buf,
+                                      { b_.getInt64(0),
+                                        b_.getInt32(arg_idx + 1) }));
+        }
+      },
+      getEventLossId(call),
+      call.loc);
 }
 
 void CodegenLLVM::createJoinCall(Call &call, int id)
@@ -4119,60 +4542,59 @@ void CodegenLLVM::createJoinCall(Call &call, int id)
   auto scoped_arg = visit(arg0);
   auto addrspace = type_map_.type(arg0).GetAS();
 
-  llvm::Function *parent = b_.GetInsertBlock()->getParent();
-  BasicBlock *failure_callback = BasicBlock::Create(module_->getContext(),
-                                                    "failure_callback",
-                                                    parent);
-  Value *perfdata = b_.CreateJoinAllocation(call.loc);
-
   uint32_t content_size = bpftrace_.join_argnum_ * bpftrace_.join_argsize_;
 
   auto elements = AsyncEvent::Join().asLLVMType(b_, content_size);
   StructType *join_struct = b_.GetStructType("join_t", elements, true);
 
-  Value *join_data = b_.CreateBitCast(perfdata, PointerType::get(llvm_ctx_, 0));
-
-  b_.CreateStore(
-      b_.getInt64(static_cast<int>(async_action::AsyncAction::join)),
-      b_.CreateGEP(join_struct, join_data, { b_.getInt64(0), b_.getInt32(0) }));
-
-  b_.CreateStore(
-      b_.getInt64(id),
-      b_.CreateGEP(join_struct, join_data, { b_.getInt64(0), b_.getInt32(1) }));
-
-  Value *content_ptr = b_.CreateGEP(join_struct,
-                                    join_data,
-                                    { b_.getInt64(0), b_.getInt32(2) });
-
   SizedType elem_type = CreatePointer(CreateInt8(), addrspace);
-
-  Value *value = scoped_arg.value();
   AllocaInst *arr = b_.CreateAllocaBPF(b_.getInt64Ty(), call.func + "_r0");
 
-  for (unsigned int i = 0; i < bpftrace_.join_argnum_; i++) {
-    if (i > 0) {
-      value = b_.CreateGEP(b_.GetType(elem_type), value, b_.getInt32(1));
-    }
-
-    b_.CreateProbeRead(arr, elem_type, value, call.loc);
-    Value *str_offset = b_.getInt64(
-        static_cast<uint64_t>(i) *
-        static_cast<uint64_t>(bpftrace_.join_argsize_));
-    Value *str_ptr = b_.CreateGEP(b_.getInt8Ty(), content_ptr, str_offset);
-
-    b_.CreateProbeReadStr(str_ptr,
-                          bpftrace_.join_argsize_,
-                          b_.CreateLoad(b_.getInt64Ty(), arr),
-                          addrspace,
-                          call.loc);
-  }
   size_t header_size = offsetof(AsyncEvent::Join, content); // action_id +
                                                             // join_id
   size_t total_size = header_size + content_size;
-  b_.CreateOutput(perfdata, total_size, call.loc);
+  b_.CreateOutput(
+      total_size,
+      [&](Value *join_data) {
+        b_.CreateStore(
+            b_.getInt64(static_cast<int>(async_action::AsyncAction::join)),
+            b_.CreateGEP(join_struct,
+                         join_data,
+                         { b_.getInt64(0), b_.getInt32(0) }));
+
+        b_.CreateStore(b_.getInt64(id),
+                       b_.CreateGEP(join_struct,
+                                    join_data,
+                                    { b_.getInt64(0), b_.getInt32(1) }));
+
+        Value *content_ptr = b_.CreateGEP(join_struct,
+                                          join_data,
+                                          { b_.getInt64(0), b_.getInt32(2) });
 
-  b_.CreateBr(failure_callback);
-  b_.SetInsertPoint(failure_callback);
+        Value *value = scoped_arg.value();
+        for (unsigned int i = 0; i < bpftrace_.join_argnum_; i++) {
+          if (i > 0) {
+            value = b_.CreateGEP(b_.GetType(elem_type), value, b_.getInt32(1));
+          }
+
+          b_.CreateProbeRead(arr, elem_type, value, call.loc);
+          Value *str_offset = b_.getInt64(
+              static_cast<uint64_t>(i) *
+              static_cast<uint64_t>(bpftrace_.join_argsize_));
+          Value *str_ptr = b_.CreateGEP(b_.getInt8Ty(),
+                                        content_ptr,
+                                        str_offset);
+
+          b_.CreateProbeReadStr(str_ptr,
+                                bpftrace_.join_argsize_,
+                                b_.CreateLoad(b_.getInt64Ty(), arr),
+                                addrspace,
+                                call.loc);
+        }
+      },
+      getEventLossId(call),
+      call.loc);
+  b_.CreateLifetimeEnd(arr);
 }
 
 void CodegenLLVM::createPrintNonMapCall(Call &call)
@@ -4189,45 +4611,54 @@ void CodegenLLVM::createPrintNonMapCall(Call &call)
   StructType *print_struct = b_.GetStructType(struct_name.str(),
                                               elements,
                                               true);
-  Value *buf = b_.CreateGetFmtStringArgsAllocation(print_struct,
-                                                   struct_name.str(),
-                                                   call.loc);
   size_t struct_size = datalayout().getTypeAllocSize(print_struct);
 
-  // Store asyncactionid:
-  b_.CreateStore(
-      b_.getInt64(
-          static_cast<int64_t>(async_action::AsyncAction::print_non_map)),
-      b_.CreateGEP(print_struct, buf, { b_.getInt64(0), b_.getInt32(0) }));
-
-  // Store print id
   auto found_id = bpftrace_.resources.non_map_print_args_id_map.find(&call);
   if (found_id == bpftrace_.resources.non_map_print_args_id_map.end()) {
     LOG(BUG) << "No id found for non_map_print call";
   }
-  b_.CreateStore(
-      b_.getInt64(found_id->second),
-      b_.CreateGEP(print_struct, buf, { b_.getInt64(0), b_.getInt32(1) }));
-
-  // Store content
-  Value *content_offset = b_.CreateGEP(print_struct,
-                                       buf,
-                                       { b_.getInt32(0), b_.getInt32(2) });
-  b_.CreateMemsetBPF(content_offset,
-                     b_.getInt8(0),
-                     type_map_.type(arg).GetSize());
-  if (needMemcpy(type_map_.type(arg))) {
-    if (inBpfMemory(type_map_.type(arg)))
-      b_.CreateMemcpyBPF(content_offset, value, type_map_.type(arg).GetSize());
-    else
-      b_.CreateProbeRead(content_offset, type_map_.type(arg), value, call.loc);
-  } else {
-    b_.CreateStore(value, content_offset);
-  }
 
-  b_.CreateOutput(buf, struct_size, call.loc);
-  if (dyn_cast<AllocaInst>(buf))
-    b_.CreateLifetimeEnd(buf);
+  b_.CreateOutput(
+      struct_size,
+      [&](Value *buf) {
+        // Store asyncactionid:
+        b_.CreateStore(
+            b_.getInt64(static_cast<int64_t>(
+                async_action::AsyncAction::print_non_map)),
+            b_.CreateGEP(print_struct,
+                         buf,
+                         { b_.getInt64(0), b_.getInt32(0) }));
+
+        // Store print id
+        b_.CreateStore(b_.getInt64(found_id->second),
+                       b_.CreateGEP(print_struct,
+                                    buf,
+                                    { b_.getInt64(0), b_.getInt32(1) }));
+
+        // Store content
+        Value *content_offset = b_.CreateGEP(print_struct,
+                                             buf,
+                                             { b_.getInt32(0),
+                                               b_.getInt32(2) });
+        b_.CreateMemsetBPF(content_offset,
+                           b_.getInt8(0),
+                           type_map_.type(arg).GetSize());
+        if (needMemcpy(type_map_.type(arg))) {
+          if (inBpfMemory(type_map_.type(arg)))
+            b_.CreateMemcpyBPF(content_offset,
+                               value,
+                               type_map_.type(arg).GetSize());
+          else
+            b_.CreateProbeRead(content_offset,
+                               type_map_.type(arg),
+                               value,
+                               call.loc);
+        } else {
+          b_.CreateStore(value, content_offset);
+        }
+      },
+      getEventLossId(call),
+      call.loc);
 }
 
 void CodegenLLVM::createMapDefinition(const std::string &name,
@@ -4290,7 +4721,7 @@ void CodegenLLVM::generate_maps(const RequiredResources &required_resources)
   // User-defined maps
   for (const auto &[name, info] : required_resources.maps_info) {
     const auto &val_type = info.value_type;
-    const auto &key_type = info.key_type;
+    auto key_type = isArrayMap(info.bpf_type) ? CreateUInt32() : info.key_type;
     createMapDefinition(
         name, info.bpf_type, info.max_entries, key_type, val_type);
   }
@@ -4304,6 +4735,15 @@ void CodegenLLVM::generate_maps(const RequiredResources &required_resources)
                         CreateUInt64());
   }
 
+  if (required_resources.needs_mapping_snapshots) {
+    // Keyed by the comm and the pid, see snapshot_mappings().
+    createMapDefinition(to_string(MapType::MappingSnapshots),
+                        BPF_MAP_TYPE_LRU_HASH,
+                        Usyms::MAX_SNAPSHOTS,
+                        CreateArray(20, CreateUInt8()),
+                        CreateUInt8());
+  }
+
   if (bpftrace_.need_recursion_check_) {
     createMapDefinition(to_string(MapType::RecursionPrevention),
                         BPF_MAP_TYPE_PERCPU_ARRAY,
@@ -4333,6 +4773,7 @@ void CodegenLLVM::generate_maps(const RequiredResources &required_resources)
   } else {
     buffer_size = *num_pages * sysconf(_SC_PAGE_SIZE);
   }
+  b_.SetRingbufSize(buffer_size);
 
   createMapDefinition(to_string(MapType::Ringbuf),
                       BPF_MAP_TYPE_RINGBUF,
@@ -4828,7 +5269,14 @@ ScopedExpr CodegenLLVM::visit(For &f, Map &map)
 bool CodegenLLVM::canAggPerCpuMapElems(const bpf_map_type map_type,
                                        const SizedType &val_type)
 {
-  return val_type.IsCastableMapTy() && map_type == BPF_MAP_TYPE_PERCPU_HASH;
+  return val_type.IsCastableMapTy() && (map_type == BPF_MAP_TYPE_PERCPU_HASH ||
+                                        map_type == BPF_MAP_TYPE_PERCPU_ARRAY);
+}
+
+bool CodegenLLVM::isArrayMap(const bpf_map_type map_type)
+{
+  return map_type == BPF_MAP_TYPE_ARRAY ||
+         map_type == BPF_MAP_TYPE_PERCPU_ARRAY;
 }
 
 // BPF helpers that use fmt strings (bpf_trace_printk, bpf_seq_printf) expect
@@ -5012,35 +5460,54 @@ Pass CreateVerifyPass()
   });
 }
 
+static void optimize(llvm::Module &module, llvm::TargetMachine *machine)
+{
+  PipelineTuningOptions pto;
+  pto.LoopUnrolling = false;
+  pto.LoopInterleaving = false;
+  pto.LoopVectorization = false;
+  pto.SLPVectorization = false;
+
+  llvm::PassBuilder pb(machine, pto);
+
+  // ModuleAnalysisManager must be destroyed first.
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  // Register all the basic analyses with the managers.
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(
+      llvm::OptimizationLevel::O3);
+
+  mpm.addPass(llvm::StripDeadDebugInfoPass());
+  mpm.run(module, mam);
+}
+
+static std::vector<char> emit_object(llvm::Module &module,
+                                     llvm::TargetMachine *machine)
+{
+  SmallVector<char, 0> output;
+  raw_svector_ostream os(output);
+
+  legacy::PassManager PM;
+  auto type = CodeGenFileType::ObjectFile;
+  if (machine->addPassesToEmitFile(PM, os, nullptr, type))
+    LOG(BUG) << "Cannot emit a file of this type";
+  PM.run(module);
+  return { output.begin(), output.end() };
+}
+
 Pass CreateOptimizePass()
 {
   return Pass::create("optimize", [](CompiledModule &cm) {
-    PipelineTuningOptions pto;
-    pto.LoopUnrolling = false;
-    pto.LoopInterleaving = false;
-    pto.LoopVectorization = false;
-    pto.SLPVectorization = false;
-
-    llvm::PassBuilder pb(getTargetMachine(), pto);
-
-    // ModuleAnalysisManager must be destroyed first.
-    llvm::LoopAnalysisManager lam;
-    llvm::FunctionAnalysisManager fam;
-    llvm::CGSCCAnalysisManager cgam;
-    llvm::ModuleAnalysisManager mam;
-
-    // Register all the basic analyses with the managers.
-    pb.registerModuleAnalyses(mam);
-    pb.registerCGSCCAnalyses(cgam);
-    pb.registerFunctionAnalyses(fam);
-    pb.registerLoopAnalyses(lam);
-    pb.crossRegisterProxies(lam, fam, cgam, mam);
-
-    ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(
-        llvm::OptimizationLevel::O3);
-
-    mpm.addPass(llvm::StripDeadDebugInfoPass());
-    mpm.run(*cm.module, mam);
+    optimize(*cm.module, getTargetMachine());
   });
 }
 
@@ -5057,18 +5524,185 @@ Pass CreateDumpIRPass(std::ostream &out)
 Pass CreateObjectPass()
 {
   return Pass::create("object", [](CompiledModule &cm) {
-    SmallVector<char, 0> output;
-    raw_svector_ostream os(output);
-
-    legacy::PassManager PM;
-    auto type = CodeGenFileType::ObjectFile;
-    if (getTargetMachine()->addPassesToEmitFile(PM, os, nullptr, type))
-      LOG(BUG) << "Cannot emit a file of this type";
-    PM.run(*cm.module);
+    auto output = emit_object(*cm.module, getTargetMachine());
     return BpfObject(output);
   });
 }
 
+// Below this, splitting the module costs more than is gained from compiling
+// the partitions in parallel: every partition starts by reading the module.
+static constexpr size_t MIN_PROGRAMS_PER_PARTITION = 8;
+// The partitioning must not depend on the host (e.g. its number of CPUs), or
+// neither would the object. Hosts with fewer threads compile several
+// partitions on each of them.
+static constexpr size_t MAX_PARTITIONS = 16;
+
+static bool is_program(const llvm::Function &fn)
+{
+  return !fn.isDeclaration() && fn.hasExternalLinkage() &&
+         fn.getSection() == util::get_section_name(fn.getName().str());
+}
+
+// Splits the programs of the module into groups of similar size. Programs stay
+// in module order, so the partitions only depend on the module and programs
+// expanded from the same probe stay together.
+static std::vector<std::set<std::string>> partition_programs(
+    const llvm::Module &module)
+{
+  std::vector<std::pair<std::string, size_t>> programs;
+  size_t total_size = 0;
+  for (const auto &fn : module) {
+    if (is_program(fn)) {
+      programs.emplace_back(fn.getName().str(), fn.getInstructionCount());
+      total_size += fn.getInstructionCount();
+    }
+  }
+
+  size_t count = std::min(MAX_PARTITIONS,
+                          programs.size() / MIN_PROGRAMS_PER_PARTITION);
+  if (count <= 1) {
+    return {};
+  }
+  std::vector<std::set<std::string>> partitions(1);
+  size_t target_size = (total_size / count) + 1;
+  size_t size = 0;
+  for (auto &[name, program_size] : programs) {
+    if (size >= target_size && partitions.size() < count) {
+      partitions.emplace_back();
+      size = 0;
+    }
+    partitions.back().insert(std::move(name));
+    size += program_size;
+  }
+  return partitions;
+}
+
+// Reduces a copy of the module to the programs of a single partition. Every
+// partition keeps all the maps and global variables, which become weak so
+// that the linker merges the copies from each partition into one.
+static void extract_partition(llvm::Module &module,
+                              const std::set<std::string> &programs)
+{
+  for (auto &var : module.globals()) {
+    if (!var.isDeclaration() && var.hasExternalLinkage()) {
+      var.setLinkage(GlobalValue::WeakODRLinkage);
+    }
+  }
+
+  std::vector<llvm::Function *> dropped;
+  for (auto &fn : module) {
+    if (is_program(fn)) {
+      if (!programs.contains(fn.getName().str())) {
+        dropped.push_back(&fn);
+      }
+    } else if (!fn.isDeclaration() && fn.hasExternalLinkage()) {
+      fn.setLinkage(GlobalValue::WeakODRLinkage);
+    }
+  }
+  for (auto *fn : dropped) {
+    if (fn->use_empty()) {
+      fn->eraseFromParent();
+    } else {
+      fn->deleteBody();
+    }
+  }
+}
+
+Pass CreateParallelObjectPass(size_t max_threads)
+{
+  return Pass::create(
+      "parallel-object",
+      [max_threads](CompiledModule &cm,
+                    CompileContext &ctx) -> Result<BpfObject> {
+        ctx.partitions.clear();
+        auto partitions = partition_programs(*cm.module);
+        if (partitions.empty()) {
+          optimize(*cm.module, getTargetMachine());
+          auto output = emit_object(*cm.module, getTargetMachine());
+          return BpfObject(output);
+        }
+
+        // LLVM contexts can't be shared between threads, so each partition
+        // reads its own copy of the module from bitcode.
+        SmallVector<char, 0> bitcode;
+        raw_svector_ostream os(bitcode);
+        WriteBitcodeToFile(*cm.module, os);
+
+        std::vector<std::vector<char>> objects(partitions.size());
+        std::vector<std::string> errors(partitions.size());
+        ctx.partitions.resize(partitions.size());
+        auto compile = [&](size_t i) {
+          auto start = std::chrono::steady_clock::now();
+          llvm::LLVMContext context;
+          auto module = parseBitcodeFile(
+              MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()),
+                              "partition"),
+              context);
+          if (!module) {
+            errors[i] = toString(module.takeError());
+            return;
+          }
+          extract_partition(**module, partitions[i]);
+
+          std::unique_ptr<llvm::TargetMachine> machine(createTargetMachine());
+          optimize(**module, machine.get());
+          auto optimized = std::chrono::steady_clock::now();
+          objects[i] = emit_object(**module, machine.get());
+
+          auto &stats = ctx.partitions[i];
+          stats.programs = partitions[i].size();
+          stats.optimize = optimized - start;
+          stats.emit = std::chrono::steady_clock::now() - optimized;
+        };
+
+        // Each thread takes the next partition which hasn't been started.
+        std::atomic<size_t> next = 0;
+        auto worker = [&]() {
+          for (size_t i = next++; i < partitions.size(); i = next++) {
+            compile(i);
+          }
+        };
+        size_t num_threads = std::clamp<size_t>(max_threads,
+                                                1,
+                                                partitions.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < num_threads; i++) {
+          threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread : threads) {
+          thread.join();
+        }
+
+        for (const auto &err : errors) {
+          if (!err.empty()) {
+            return make_error<SystemError>(
+                "failed to read module partition: " + err, 0);
+          }
+        }
+        for (size_t i = 0; i < partitions.size(); i++) {
+          const auto &stats = ctx.partitions[i];
+          LOG(V1) << "Partition " << i << ": " << stats.programs
+                  << " programs, optimized in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         stats.optimize)
+                         .count()
+                  << "ms, emitted in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         stats.emit)
+                         .count()
+                  << "ms";
+        }
+
+        // Partitions are linked in order, so the output is deterministic.
+        auto output = link_objects(objects, {});
+        if (!output) {
+          return output.takeError();
+        }
+        return BpfObject(*output);
+      });
+}
+
 Pass CreateDumpASMPass([[maybe_unused]] std::ostream &out)
 {
   return Pass::create("dump-asm", [](BpfObject &bpf) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <llvm/IR/LLVMContext.h>
+#include <chrono>
 #include <llvm/IR/Module.h>
 #include <memory>
 #include <optional>
@@ -16,6 +17,15 @@ class CompileContext : public ast::State<"compile-context"> {
 public:
   CompileContext() : context(std::make_unique<llvm::LLVMContext>()) {};
   std::unique_ptr<llvm::LLVMContext> context;
+
+  // Wall time spent on each partition by the last parallel object pass, for
+  // benchmarking. Empty if the module was not partitioned.
+  struct PartitionStats {
+    size_t programs = 0;
+    std::chrono::nanoseconds optimize{ 0 };
+    std::chrono::nanoseconds emit{ 0 };
+  };
+  std::vector<PartitionStats> partitions;
 };
 
 // LLVMInit will create the required LLVM context which can be subsequently
@@ -57,6 +67,17 @@ public:
 // required by the Link pass below.
 Pass CreateObjectPass();
 
+// Optimizes the `CompiledModule` and produces a `BpfObject`, like the optimize
+// and object passes above, but splits the programs into groups that are
+// optimized and emitted in parallel, on up to `max_threads` threads. The
+// partitions don't depend on the number of threads and the resulting objects
+// are linked in a fixed order, so the output only depends on the module.
+// Small modules are not split.
+//
+// The module is left unoptimized when it is split, so this should not be
+// combined with passes that inspect the optimized module.
+Pass CreateParallelObjectPass(size_t max_threads);
+
 // Dumps `BpfObject` as disassembled bytecode.
 Pass CreateDumpASMPass(std::ostream &out);
 
@@ -0,0 +1,191 @@
+#include <optional>
+#include <unordered_map>
+
+#include "ast/passes/field_relocation.h"
+#include "ast/codegen_helper.h"
+#include "ast/passes/types/type_map.h"
+#include "ast/visitor.h"
+#include "bpftrace.h"
+#include "btf.h"
+#include "required_resources.h"
+
+namespace bpftrace::ast {
+
+namespace {
+
+class FieldRelocator : public Visitor<FieldRelocator> {
+public:
+  FieldRelocator(BPFtrace &bpftrace, const TypeMap &type_map)
+      : bpftrace_(bpftrace), type_map_(type_map)
+  {
+  }
+
+  using Visitor<FieldRelocator>::visit;
+  void visit(Expression &expr);
+  void visit(FieldAccess &acc);
+  void visit(ArrayAccess &arr);
+  void visit(Binop &binop);
+  void visit(Unop &unop);
+  void visit(Typeof &typeof);
+
+private:
+  BPFtrace &bpftrace_;
+  const TypeMap &type_map_;
+  // Sizes of vmlinux types by name, as looking them up scans all of BTF.
+  std::unordered_map<std::string, std::optional<uint64_t>> sizes_;
+
+  bool is_kernel_type(const SizedType &type);
+  bool is_kernel_ptr(const SizedType &type);
+};
+
+// Returns whether the layout of the type is that of the build host's kernel.
+bool FieldRelocator::is_kernel_type(const SizedType &type)
+{
+  if (!type.IsCTypeTy() || type.is_funcarg || type.IsCtxAccess() ||
+      inBpfMemory(type)) {
+    return false;
+  }
+  if (type.IsAnonTy() &&
+      type.GetName().find(BTF_ANON_STRUCT_PREFIX) != std::string::npos) {
+    return true;
+  }
+  auto it = sizes_.find(type.GetName());
+  if (it == sizes_.end()) {
+    it = sizes_
+             .emplace(type.GetName(),
+                      bpftrace_.btf_->vmlinux_type_size(type.GetName()))
+             .first;
+  }
+  // The script may have declared its own version of a kernel type.
+  return it->second && *it->second == type.GetSize();
+}
+
+bool FieldRelocator::is_kernel_ptr(const SizedType &type)
+{
+  return type.IsPtrTy() && is_kernel_type(type.GetPointeeTy());
+}
+
+// Only fields are relocated, so kernel structs and unions may only be read
+// field by field: copying or printing a whole one would use the size of the
+// type on the build host.
+void FieldRelocator::visit(Expression &expr)
+{
+  const SizedType &type = type_map_.type(expr);
+  if (is_kernel_type(type) ||
+      (type.IsArrayTy() && is_kernel_type(type.GetElementTy()))) {
+    expr.node().addError()
+        << "AOT does not yet support reading whole kernel structs or unions, "
+           "only their fields";
+  }
+  Visitor<FieldRelocator>::visit(expr);
+}
+
+void FieldRelocator::visit(ArrayAccess &arr)
+{
+  visit(arr.expr);
+  visit(arr.indexpr);
+
+  // The stride is the size of the element on the build host.
+  const SizedType &type = type_map_.type(arr.expr);
+  if (is_kernel_ptr(type) ||
+      (type.IsArrayTy() && is_kernel_type(type.GetElementTy()))) {
+    arr.addError() << "AOT does not yet support indexing arrays of kernel "
+                      "structs or unions";
+  }
+}
+
+void FieldRelocator::visit(Binop &binop)
+{
+  visit(binop.left);
+  visit(binop.right);
+
+  if ((binop.op == Operator::PLUS || binop.op == Operator::MINUS) &&
+      (is_kernel_ptr(type_map_.type(binop.left)) ||
+       is_kernel_ptr(type_map_.type(binop.right)))) {
+    binop.addError() << "AOT does not yet support pointer arithmetic on "
+                        "kernel structs or unions";
+  }
+}
+
+void FieldRelocator::visit(Unop &unop)
+{
+  visit(unop.expr);
+
+  if ((unop.op == Operator::PRE_INCREMENT ||
+       unop.op == Operator::PRE_DECREMENT ||
+       unop.op == Operator::POST_INCREMENT ||
+       unop.op == Operator::POST_DECREMENT) &&
+      is_kernel_ptr(type_map_.type(unop.expr))) {
+    unop.addError() << "AOT does not yet support pointer arithmetic on "
+                       "kernel structs or unions";
+  }
+}
+
+void FieldRelocator::visit([[maybe_unused]] Typeof &typeof)
+{
+  // Not evaluated.
+}
+
+void FieldRelocator::visit(FieldAccess &acc)
+{
+  // The struct itself isn't read, so skip the check in visit(Expression &).
+  visit(acc.expr.value);
+
+  // Only fields read from kernel memory are relocated. Records are our own,
+  // and the context and function arguments are laid out by the kernel.
+  const SizedType &type = type_map_.type(acc.expr);
+  if (!type.IsCTypeTy() || type.is_funcarg || type.IsCtxAccess() ||
+      inBpfMemory(type) || !type.HasField(acc.field)) {
+    return;
+  }
+  auto &resources = bpftrace_.resources;
+  if (resources.find_field_relocation(type.GetName(), acc.field)) {
+    return;
+  }
+
+  // Anonymous kernel types are named after their BTF id, which differs
+  // between kernels, so they can't be found again.
+  if (type.IsAnonTy() &&
+      type.GetName().find(BTF_ANON_STRUCT_PREFIX) != std::string::npos) {
+    acc.addError() << "AOT does not yet support fields of anonymous kernel "
+                      "types";
+    return;
+  }
+
+  // Types that aren't in vmlinux are either declared by the script, in which
+  // case their layout is fixed, or come from a module, which isn't checked.
+  auto layout = bpftrace_.btf_->vmlinux_field(type.GetName(), acc.field);
+  if (!layout) {
+    return;
+  }
+  if (layout->bitfield) {
+    acc.addError() << "AOT does not yet support bitfields of kernel types";
+    return;
+  }
+  // The script may have declared its own version of a kernel type.
+  const auto &field = type.GetField(acc.field);
+  if (layout->offset != static_cast<uint64_t>(field.offset)) {
+    return;
+  }
+
+  resources.field_relocations.push_back(FieldRelocation{
+      .type_name = type.GetName(),
+      .field = acc.field,
+      .offset = layout->offset,
+      .size = layout->size,
+      .global_var = resources.global_vars.add_field_offset(),
+  });
+}
+
+} // namespace
+
+Pass CreateFieldRelocationPass()
+{
+  return Pass::create("FieldRelocation",
+                      [](ASTContext &ast, BPFtrace &b, TypeMap &type_map) {
+                        FieldRelocator relocator(b, type_map);
+                        relocator.visit(ast.root);
+                      });
+}
+
+} // namespace bpftrace::ast
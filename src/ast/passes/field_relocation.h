@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ast/pass_manager.h"
+
+namespace bpftrace::ast {
+
+// Finds the fields of vmlinux types that an AOT program reads, so that their
+// offsets can be relocated to those of the running kernel when the program is
+// loaded. Other uses of the layout of kernel types (whole struct copies, array
+// strides and pointer arithmetic) are rejected. This must run after the
+// resource analyser.
+Pass CreateFieldRelocationPass();
+
+} // namespace bpftrace::ast
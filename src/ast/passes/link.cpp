@@ -27,83 +27,90 @@ Pass CreateExternObjectPass()
   });
 }
 
-Pass CreateLinkPass()
+Result<std::vector<char>> link_objects(
+    const std::vector<std::vector<char>> &objects,
+    const std::vector<std::filesystem::path> &files)
 {
-  return Pass::create(
-      "link", [](BpfObject &obj, BpfExternObjects &ext) -> Result<BpfBytecode> {
-        // If there are no other objects to link, then just return our own.
-        if (ext.objects.empty()) {
-          return BpfBytecode{ obj.data };
-        }
+  // Create a working directory.
+  auto dir = util::TempDir::create();
+  if (!dir) {
+    return dir.takeError();
+  }
 
-        // Create a working directory.
-        auto dir = util::TempDir::create();
-        if (!dir) {
-          return dir.takeError();
-        }
+  // Create an output file on disk. In the future, we may want to accept
+  // some flags that allow this file to persist.
+  auto output = dir->create_file();
+  if (!output) {
+    return output.takeError();
+  }
 
-        // Otherwise, dump the intermediate object.
-        auto object = dir->create_file();
-        if (!object) {
-          return object.takeError();
-        }
-        auto ok = object->write_all(obj.data);
-        if (!ok) {
-          return ok.takeError();
-        }
+  // In order to craft the final output, since we may have external maps and
+  // probes, we delegate the heavy lifting to libbpf.
+  struct bpf_linker *linker = bpf_linker__new(output->path().c_str(), nullptr);
+  if (linker == nullptr) {
+    // Hopefully an empty 'origin' here is sufficient to distinguish the case
+    // where this failed. I believe that it's likely to be ENOMEM or something
+    // equally obvious to the user?
+    return make_error<LinkError>("", errno);
+  }
+  SCOPE_EXIT
+  {
+    bpf_linker__free(linker);
+  };
 
-        // Create an output file on disk. In the future, we may want to accept
-        // some flags that allow this file to persist.
-        auto output = dir->create_file();
-        if (!output) {
-          return output.takeError();
-        }
-
-        // In order to craft the final output, since we may have external maps
-        // and probes, we delegate the heavy lifting to libbpf. First, we open a
-        // new memfd as output, and add our top-level output to the linker.
-        struct bpf_linker *linker = bpf_linker__new(output->path().c_str(),
-                                                    nullptr);
-        if (linker == nullptr) {
-          // Hopefully an empty 'origin' here is sufficient to distinguish the
-          // case where this failed. I believe that it's likely to be ENOMEM or
-          // something equally obvious to the user?
-          return make_error<LinkError>("", errno);
-        }
-        SCOPE_EXIT
-        {
-          bpf_linker__free(linker);
-        };
+  // The linker only accepts files, so the in-memory objects are dumped
+  // first.
+  for (const auto &data : objects) {
+    auto object = dir->create_file();
+    if (!object) {
+      return object.takeError();
+    }
+    auto ok = object->write_all(data);
+    if (!ok) {
+      return ok.takeError();
+    }
+    int rc = bpf_linker__add_file(linker, object->path().c_str(), nullptr);
+    if (rc != 0) {
+      return make_error<LinkError>(object->path().string(), errno);
+    }
+  }
+  for (const auto &path : files) {
+    int rc = bpf_linker__add_file(linker, path.c_str(), nullptr);
+    if (rc != 0) {
+      return make_error<LinkError>(path.string(), errno);
+    }
+  }
 
-        // Link in our own program.
-        int rc = bpf_linker__add_file(linker, object->path().c_str(), nullptr);
-        if (rc != 0) {
-          return make_error<LinkError>(output->path().string(), errno);
-        }
+  // Finalize the linking, and free our underlying library handle.
+  int rc = bpf_linker__finalize(linker);
+  if (rc != 0) {
+    return make_error<LinkError>(output->path().string(), errno);
+  }
 
-        // Next, we iterate through the list of link targets that we collected
-        // from import statements. These are added to the link target one at a
-        // time.
-        for (auto &path : ext.objects) {
-          int rc = bpf_linker__add_file(linker, path.c_str(), nullptr);
-          if (rc != 0) {
-            return make_error<LinkError>(path.string(), errno);
-          }
-        }
+  // Reload the final output and return it.
+  std::ifstream file(output->path(), std::ios::binary);
+  if (!file.is_open()) {
+    return make_error<LinkError>(output->path().string(), errno);
+  }
+  return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
 
-        // Finalize the linking, and free our underlying library handle.
-        rc = bpf_linker__finalize(linker);
-        if (rc != 0) {
-          return make_error<LinkError>(output->path().string(), errno);
+Pass CreateLinkPass()
+{
+  return Pass::create(
+      "link", [](BpfObject &obj, BpfExternObjects &ext) -> Result<BpfBytecode> {
+        // If there are no other objects to link, then just return our own.
+        if (ext.objects.empty()) {
+          return BpfBytecode{ obj.data };
         }
 
-        // Reload the final output and return it.
-        std::ifstream file(output->path(), std::ios::binary);
-        if (!file.is_open()) {
-          return make_error<LinkError>(output->path().string(), errno);
+        // Link in our own program first, followed by the list of link targets
+        // that we collected from import statements.
+        auto data = link_objects({ obj.data }, ext.objects);
+        if (!data) {
+          return data.takeError();
         }
-        std::vector<char> data(std::istreambuf_iterator<char>(file), {});
-        return BpfBytecode{ data };
+        return BpfBytecode{ *data };
       });
 }
 
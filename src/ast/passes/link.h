@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 
 #include "ast/pass_manager.h"
 #include "util/result.h"
@@ -27,6 +28,12 @@ private:
   int err_;
 };
 
+// Links in-memory objects and object files into a single object with libbpf.
+// Objects are added in the given order, in-memory objects first.
+Result<std::vector<char>> link_objects(
+    const std::vector<std::vector<char>> &objects,
+    const std::vector<std::filesystem::path> &files);
+
 // Produces the final output `BpfBytecode` object from `BpfObject` and the
 // `BpfExternObjects` provided.
 Pass CreateLinkPass();
@@ -0,0 +1,20 @@
+#include "ast/passes/parse_btf.h"
+#include "ast/context.h"
+#include "ast/passes/attachpoint_passes.h"
+#include "bpftrace.h"
+#include "probe_matcher.h"
+
+namespace bpftrace::ast {
+
+Pass CreateParseBTFPass()
+{
+  return Pass::create(
+      "btf", [](ASTContext &ast, BPFtrace &b, FunctionInfo &func_info) {
+        ProbeMatcher probe_matcher(&b,
+                                   func_info.kernel_info(),
+                                   func_info.user_info());
+        b.parse_module_btf(b.list_modules(ast, probe_matcher));
+      });
+}
+
+} // namespace bpftrace::ast
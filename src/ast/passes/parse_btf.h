@@ -0,0 +1,10 @@
+#pragma once
+
+#include "ast/pass_manager.h"
+
+namespace bpftrace::ast {
+
+// Loads BTF for vmlinux and every module that the probes may attach to.
+Pass CreateParseBTFPass();
+
+} // namespace bpftrace::ast
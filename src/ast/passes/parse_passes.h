@@ -17,11 +17,13 @@
 #include "ast/passes/macro_expansion.h"
 #include "ast/passes/map_sugar.h"
 #include "ast/passes/named_param.h"
+#include "ast/passes/parse_btf.h"
 #include "ast/passes/pid_filter_pass.h"
 #include "ast/passes/probe_prune.h"
 #include "ast/passes/resolve_imports.h"
 #include "ast/passes/unstable_feature.h"
 #include "ast/passes/usdt_arguments.h"
+#include "ast/passes/watch_filter.h"
 #include "btf.h"
 #include "parser.h"
 
@@ -44,6 +46,7 @@ inline std::vector<Pass> AllParsePasses(
   passes.emplace_back(CreateImportExternalScriptsPass());
   passes.emplace_back(CreateUnstableFeaturePass());
   passes.emplace_back(CreateDeprecatedPass());
+  passes.emplace_back(CreatePidTreePass());
   passes.emplace_back(CreateParseAttachpointsPass());
   passes.emplace_back(CreateCheckAttachpointsPass());
   passes.emplace_back(CreateUSDTImportPass());
@@ -64,6 +67,7 @@ inline std::vector<Pass> AllParsePasses(
   passes.emplace_back(CreateMapSugarPass());
   passes.emplace_back(CreateNamedParamsPass());
   passes.emplace_back(CreatePidFilterPass());
+  passes.emplace_back(CreateWatchFilterPass());
   // This comes after the MacroExpansion pass to conditionally
   // import standard library C files
   passes.emplace_back(CreateResolveStatementImportsPass());
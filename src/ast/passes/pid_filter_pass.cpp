@@ -7,6 +7,8 @@ namespace bpftrace::ast {
 
 namespace {
 
+constexpr auto PID_FILTER_IMPORT = "stdlib/process/pid_filter.bpf.c";
+
 class PidFilterPass : public Visitor<PidFilterPass> {
 public:
   explicit PidFilterPass(ASTContext &ast, BPFtrace &bpftrace)
@@ -24,9 +26,9 @@ private:
 
 // If the probe can't filter by pid when attaching
 // then we inject custom AST to filter by pid.
-// Note: this doesn't work for AOT as the code has already
-// been generated
-bool probe_needs_pid_filter(AttachPoint *ap)
+// Note: AOT programs are compiled before the pid is known, so they
+// filter on a global instead, see CreateAotPidFilterPass.
+bool probe_needs_pid_filter(AttachPoint *ap, bool pid_tree)
 {
   ProbeType type = probetype(ap->provider);
 
@@ -38,9 +40,12 @@ bool probe_needs_pid_filter(AttachPoint *ap)
     case ProbeType::tracepoint:
     case ProbeType::rawtracepoint:
       return true;
-    // These probe types support passing the pid during attachment
+    // When following a process tree these are attached system-wide and
+    // filtered on the pid set instead, so that descendants are covered.
     case ProbeType::uprobe:
     case ProbeType::uretprobe:
+      return pid_tree;
+    // These probe types support passing the pid during attachment
     case ProbeType::usdt:
     case ProbeType::watchpoint:
     case ProbeType::invalid:
@@ -61,9 +66,10 @@ bool probe_needs_pid_filter(AttachPoint *ap)
 
 } // namespace
 
-static BlockExpr *create_pid_filter(ASTContext &ast,
-                                    int pid,
-                                    BlockExpr *orig_block)
+static BlockExpr *create_filter(ASTContext &ast,
+                                Expression skip_cond,
+                                StatementList &&stmts,
+                                BlockExpr *orig_block)
 {
   auto *ret_block = ast.make_node<BlockExpr>(
       orig_block->loc,
@@ -73,32 +79,98 @@ static BlockExpr *create_pid_filter(ASTContext &ast,
 
   return ast.make_node<BlockExpr>(
       orig_block->loc,
+      std::move(stmts),
+      ast.make_node<IfExpr>(orig_block->loc, skip_cond, ret_block, orig_block));
+}
+
+static BlockExpr *create_pid_filter(ASTContext &ast,
+                                    int pid,
+                                    BlockExpr *orig_block)
+{
+  return create_filter(
+      ast,
+      ast.make_node<Binop>(orig_block->loc,
+                           ast.make_node<Builtin>(orig_block->loc, "pid"),
+                           Operator::NE,
+                           ast.make_node<Integer>(orig_block->loc, pid)),
+      StatementList({}),
+      orig_block);
+}
+
+// Filters on the pid held in a read-only global, which is set when the program
+// is loaded. Zero disables the filter.
+static BlockExpr *create_aot_pid_filter(ASTContext &ast, BlockExpr *orig_block)
+{
+  const auto &loc = orig_block->loc;
+  return create_filter(
+      ast,
+      ast.make_node<Binop>(
+          loc,
+          ast.make_node<Binop>(
+              loc,
+              ast.make_node<Builtin>(loc, "__builtin_filter_pid"),
+              Operator::NE,
+              ast.make_node<Integer>(loc, 0)),
+          Operator::LAND,
+          ast.make_node<Binop>(
+              loc,
+              ast.make_node<Builtin>(loc, "pid"),
+              Operator::NE,
+              ast.make_node<Builtin>(loc, "__builtin_filter_pid"))),
       StatementList({}),
-      ast.make_node<IfExpr>(
-          orig_block->loc,
-          ast.make_node<Binop>(orig_block->loc,
-                               ast.make_node<Builtin>(orig_block->loc, "pid"),
-                               Operator::NE,
-                               ast.make_node<Integer>(orig_block->loc, pid)),
-          ret_block,
-          orig_block));
+      orig_block);
+}
+
+// Filters on the tgid set held in the `pid_filter` map, see
+// stdlib/process/pid_filter.bpf.c.
+static BlockExpr *create_pid_tree_filter(ASTContext &ast, BlockExpr *orig_block)
+{
+  return create_filter(
+      ast,
+      ast.make_node<Unop>(orig_block->loc,
+                          ast.make_node<Call>(orig_block->loc,
+                                              "__pid_filter_match",
+                                              ExpressionList({})),
+                          Operator::LNOT),
+      StatementList({ ast.make_node<StatementImport>(orig_block->loc,
+                                                     PID_FILTER_IMPORT) }),
+      orig_block);
 }
 
 void PidFilterPass::visit(Probe &probe)
 {
   const auto pid = bpftrace_.pid();
-  if (!pid.has_value()) {
+  if (!pid.has_value() && !bpftrace_.pid_tree_) {
     return;
   }
 
   for (AttachPoint *ap : probe.attach_points) {
-    if (probe_needs_pid_filter(ap)) {
-      probe.block = create_pid_filter(ast_, *pid, probe.block);
+    if (probe_needs_pid_filter(ap, bpftrace_.pid_tree_)) {
+      probe.block = bpftrace_.pid_tree_
+                        ? create_pid_tree_filter(ast_, probe.block)
+                        : create_pid_filter(ast_, *pid, probe.block);
       return;
     }
   }
 }
 
+// Adds the probes which keep the pid set up to date as the process tree
+// forks and exits. These are filtered on the set like any other kernel
+// probe, so they only run for members of the tree.
+static Probe *create_pid_tree_probe(ASTContext &ast,
+                                    const std::string &tracepoint,
+                                    Expression call)
+{
+  auto loc = ast.root->loc;
+  auto *ap = ast.make_node<AttachPoint>(loc, tracepoint, false);
+  auto *block = ast.make_node<BlockExpr>(
+      loc,
+      StatementList({ ast.make_node<StatementImport>(loc, PID_FILTER_IMPORT),
+                      ast.make_node<ExprStatement>(loc, call) }),
+      ast.make_node<None>(loc));
+  return ast.make_node<Probe>(loc, AttachPointList({ ap }), block);
+}
+
 Pass CreatePidFilterPass()
 {
   return Pass::create("PidFilter", [](ASTContext &ast, BPFtrace &b) {
@@ -107,4 +179,41 @@ Pass CreatePidFilterPass()
   });
 };
 
+Pass CreateAotPidFilterPass()
+{
+  return Pass::create("AotPidFilter", [](ASTContext &ast) {
+    for (Probe *probe : ast.root->probes) {
+      for (AttachPoint *ap : probe->attach_points) {
+        if (probe_needs_pid_filter(ap, false)) {
+          probe->block = create_aot_pid_filter(ast, probe->block);
+          break;
+        }
+      }
+    }
+  });
+};
+
+Pass CreatePidTreePass()
+{
+  return Pass::create("PidTree", [](ASTContext &ast, BPFtrace &b) {
+    if (!b.pid_tree_) {
+      return;
+    }
+
+    auto loc = ast.root->loc;
+    auto *child_pid = ast.make_node<FieldAccess>(
+        loc, ast.make_node<Builtin>(loc, "args"), "child_pid");
+    ast.root->probes.push_back(create_pid_tree_probe(
+        ast,
+        "tracepoint:sched:sched_process_fork",
+        ast.make_node<Call>(loc,
+                            "__pid_filter_add",
+                            ExpressionList({ child_pid }))));
+    ast.root->probes.push_back(create_pid_tree_probe(
+        ast,
+        "tracepoint:sched:sched_process_exit",
+        ast.make_node<Call>(loc, "__pid_filter_remove", ExpressionList({}))));
+  });
+};
+
 } // namespace bpftrace::ast
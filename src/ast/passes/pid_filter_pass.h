@@ -6,4 +6,12 @@ namespace bpftrace::ast {
 
 Pass CreatePidFilterPass();
 
+// Like CreatePidFilterPass, but filters on a pid that is only known when an
+// AOT program is loaded.
+Pass CreateAotPidFilterPass();
+
+// Injects the probes that track forks and exits of the filtered process tree
+// when running with --pid-tree. This must run before attachpoints are parsed.
+Pass CreatePidTreePass();
+
 } // namespace bpftrace::ast
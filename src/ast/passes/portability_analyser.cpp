@@ -2,6 +2,8 @@
 
 #include "ast/passes/portability_analyser.h"
 #include "ast/visitor.h"
+#include "bpftrace.h"
+#include "btf.h"
 #include "types.h"
 
 namespace bpftrace::ast {
@@ -15,10 +17,18 @@ namespace {
 // features.
 class PortabilityAnalyser : public Visitor<PortabilityAnalyser> {
 public:
+  explicit PortabilityAnalyser(BPFtrace &bpftrace) : bpftrace_(bpftrace) {};
+
   using Visitor<PortabilityAnalyser>::visit;
   void visit(PositionalParameter &param);
   void visit(Call &call);
-  void visit(Cast &cast);
+  void visit(Sizeof &szof);
+  void visit(Offsetof &offof);
+
+private:
+  BPFtrace &bpftrace_;
+
+  void check_layout(Node &node, Typeof &typeof, std::string_view func);
 };
 
 void PortabilityAnalyser::visit(PositionalParameter &param)
@@ -55,33 +65,79 @@ void PortabilityAnalyser::visit(Call &call)
     call.addError() << "AOT does not yet support " << call.func << "()";
   }
 
-  // `curtask` is implemented via the `bpf_get_current_task` helper, which
-  // returns a `struct task_struct *`. This struct is unstable across kernel
-  // versions and configurations. This makes it inherently unportable. We must
-  // block it until we support field access relocations.
-  if (call.func == "__get_current_task") {
-    call.addError() << "AOT does not yet support accessing `curtask`";
-  }
+  // N.B. `curtask` and struct casts are portable: fields of kernel types are
+  // relocated when the program is loaded, see CreateFieldRelocationPass. That
+  // pass also rejects other uses of the layout of kernel types, which need
+  // type information.
+}
+
+void PortabilityAnalyser::visit(Sizeof &szof)
+{
+  visit(szof.type_of);
+  check_layout(szof, *szof.type_of, "sizeof");
+}
+
+void PortabilityAnalyser::visit(Offsetof &offof)
+{
+  visit(offof.type_of);
+  check_layout(offof, *offof.type_of, "offsetof");
 }
 
-void PortabilityAnalyser::visit(Cast &cast)
+// sizeof() and offsetof() are folded into constants while types are resolved,
+// using the layout of kernel types on the build host, and so before
+// FieldRelocation can tell which types they apply to.
+void PortabilityAnalyser::check_layout(Node &node,
+                                       Typeof &typeof,
+                                       std::string_view func)
 {
-  visit(cast.expr);
-
-  // The goal here is to block arbitrary field accesses but still allow `args`
-  // access. `args` for tracepoint is fairly stable and should be considered
-  // portable. `args` for k[ret]funcs are type checked by the kernel and may
-  // also be considered stable. For AOT to fully support field accesses, we
-  // need to relocate field access at runtime.
-  cast.addError() << "AOT does not yet support struct casts";
+  if (auto *const *parsed = std::get_if<ParsedType *>(&typeof.record)) {
+    // Pointers are the same size on all kernels, arrays are not.
+    const ParsedType *type = *parsed;
+    while (type->kind == ParsedType::Kind::Array && type->inner) {
+      type = type->inner;
+    }
+    if (type->kind != ParsedType::Kind::Pointer &&
+        bpftrace_.btf_->vmlinux_type_size(type->type_name())) {
+      node.addError() << "AOT does not yet support " << func
+                      << "() of kernel types";
+    }
+    return;
+  }
+
+  // Typedef names are only known to be types once they are resolved.
+  const auto *expr = &std::get<Expression>(typeof.record);
+  if (const auto *ident = expr->as<Identifier>()) {
+    if (bpftrace_.btf_->vmlinux_type_size(ident->ident)) {
+      node.addError() << "AOT does not yet support " << func
+                      << "() of kernel types";
+    }
+    return;
+  }
+
+  // Variables and maps can't hold kernel structs, see FieldRelocation, and
+  // calls return their own values. Anything else may be of a kernel type.
+  while (true) {
+    if (const auto *acc = expr->as<ArrayAccess>()) {
+      expr = &acc->expr;
+    } else if (const auto *acc = expr->as<TupleAccess>()) {
+      expr = &acc->expr;
+    } else {
+      break;
+    }
+  }
+  if (!expr->as<Variable>() && !expr->as<Map>() && !expr->as<MapAccess>() &&
+      !expr->as<Call>() && !expr->as<Integer>() && !expr->as<String>()) {
+    node.addError() << "AOT does not yet support " << func
+                    << "() of expressions other than variables and maps";
+  }
 }
 
 } // namespace
 
 Pass CreatePortabilityPass()
 {
-  auto fn = [](ASTContext &ast) {
-    PortabilityAnalyser analyser;
+  auto fn = [](ASTContext &ast, BPFtrace &b) {
+    PortabilityAnalyser analyser(b);
     analyser.visit(ast.root);
     if (!ast.diagnostics().ok()) {
       // Used by runtime test framework to know when to skip an AOT test
@@ -292,17 +292,6 @@ Result<OK> Imports::import_any(Node &node,
   return OK();
 }
 
-static void mark_stdlib_macros(ASTContext &ast)
-{
-  if (!ast.root) {
-    return;
-  }
-
-  for (auto *macro : ast.root->macros) {
-    macro->is_stdlib = true;
-  }
-}
-
 Result<OK> Imports::import_stdlib(
     Node &node,
     const std::string &name,
@@ -320,25 +309,41 @@ Result<OK> Imports::import_stdlib(
 
   seen_stdlib_macros_.insert(macro_name);
 
-  auto result = import_bt_file(node, name, std::string(data), true, scripts);
-  if (!result) {
-    return result.takeError();
+  auto defs = Stdlib::macro_defs.find(macro_name);
+  if (defs == Stdlib::macro_defs.end()) {
+    LOG(BUG) << macro_name << " should be also in Stdlib::macro_defs";
+    return OK();
   }
 
-  if (*result == nullptr) {
-    // Even though we imported and parsed the stdlib file, we may still need to
-    // resolve other nested macros
-    auto found = scripts.find(name);
-    if (found != scripts.end()) {
-      ResolveStdlibMacroImports resolver(*this, macro_name, paths);
-      auto &ast = found->second.ast;
-      resolver.visit(ast.root);
-    }
+  // All macros from the same file share a single context. This holds the full
+  // source of the file, so diagnostics are reported as usual, but the tree
+  // only contains the macros that have been used so far.
+  auto it = scripts.find(name);
+  if (it == scripts.end()) {
+    it = scripts
+             .emplace(name,
+                      ScriptObject(node,
+                                   ASTContext(name, std::string(data)),
+                                   true))
+             .first;
+    auto &ast = it->second.ast;
+    ast.root = ast.make_node<Program>(SourceLocation(),
+                                      CStatementList(),
+                                      nullptr,
+                                      RootImportList(),
+                                      RootStatements());
+  }
+  auto &ast = it->second.ast;
 
-    return OK();
+  Parser parser(ast);
+  for (const auto &def : defs->second) {
+    auto *macro = parser.parse_macro_at(def.offset, def.line, def.column);
+    if (macro == nullptr) {
+      break; // Error is in the diagnostics.
+    }
+    macro->is_stdlib = true;
+    ast.root->macros.push_back(macro);
   }
-  auto &ast = **result;
-  mark_stdlib_macros(ast);
 
   ResolveStdlibMacroImports resolver(*this, macro_name, paths);
   resolver.visit(ast.root);
@@ -554,11 +559,17 @@ Pass CreateResolveRootImportsPass(std::vector<std::string> &&import_paths)
                         // unconditionally because it contains macro calls that
                         // are created in future passes
                         auto internal = Stdlib::bt_files.find(INTERNAL_BT);
-                        if (internal != Stdlib::bt_files.end()) {
+                        if (internal == Stdlib::bt_files.end()) {
+                          return imports;
+                        }
+                        for (const auto &[name, file] : Stdlib::macro_to_file) {
+                          if (file != INTERNAL_BT) {
+                            continue;
+                          }
                           ok = imports.import_stdlib(*ast.root,
                                                      INTERNAL_BT,
                                                      internal->second,
-                                                     INTERNAL_BT,
+                                                     name,
                                                      updated_paths);
                           if (!ok) {
                             return ok.takeError();
@@ -1,8 +1,8 @@
 #include <algorithm>
 #include <bpf/bpf.h>
 
-#include "ast/async_event_types.h"
 #include "ast/codegen_helper.h"
+#include "ast/passes/ap_probe_expansion.h"
 #include "ast/passes/map_sugar.h"
 #include "ast/passes/named_param.h"
 #include "ast/passes/resource_analyser.h"
@@ -32,7 +32,8 @@ public:
   ResourceAnalyser(BPFtrace &bpftrace,
                    MapMetadata &mm,
                    NamedParamInfo &named_param_info,
-                   const TypeMap &type_map);
+                   const TypeMap &type_map,
+                   const ExpansionResult &expansions);
 
   using Visitor<ResourceAnalyser>::visit;
   void visit(Probe &probe);
@@ -67,6 +68,30 @@ private:
   void update_map_info(Map &map);
   void update_variable_info(Variable &var);
 
+  // Assigns the call site a slot in the event loss counter. Only the clones of
+  // a call in the members of a probe group share a slot.
+  void add_event_loss_source(Call &call);
+
+  // Appends the async arguments of a call and returns their id. In a probe
+  // group (see ExpansionResult), the calls of each member are visited in the
+  // same order, so the ids handed out for the first member are reused for the
+  // others whenever the arguments are equal. This keeps the clones' code
+  // identical so that codegen can share a single program between them.
+  template <typename T>
+  size_t add_call_args(std::vector<T> &args, T value);
+
+  // Static bound on the keys used with a map. `entries` is one more than the
+  // largest possible key, other than those from the `cpu` builtin: these are
+  // marked with `keyed_by_cpu`, as their bound depends on the host the
+  // program runs on.
+  struct KeyBound {
+    uint64_t entries = 0;
+    bool keyed_by_cpu = false;
+  };
+  std::optional<KeyBound> get_key_bound(Expression &key_expr);
+  void update_key_bound(const Map &map, Expression *key_expr);
+  void maybe_use_array_map(const std::string &name, MapInfo &map_info);
+
   RequiredResources resources_;
   BPFtrace &bpftrace_;
   MapMetadata map_metadata_;
@@ -75,9 +100,22 @@ private:
 
   // Current probe we're analysing
   Probe *probe_{ nullptr };
+  const ExpansionResult &expansions_;
+  // Ids handed out in each probe group, as (argument vector, id) pairs in the
+  // order they were assigned to the group's first member.
+  using CallIds = std::vector<std::pair<const void *, size_t>>;
+  std::unordered_map<size_t, CallIds> group_call_ids_;
+  CallIds *recording_call_ids_ = nullptr;
+  const CallIds *replaying_call_ids_ = nullptr;
+  size_t replay_pos_ = 0;
   std::unordered_map<std::string, std::pair<bpf_map_type, int>> map_decls_;
 
   int next_map_id_ = 0;
+  // Event loss slots by (probe name, call site).
+  std::map<std::pair<std::string, std::string>, size_t> event_loss_source_ids_;
+  // Maps whose keys can all be statically bounded. A map is dropped from
+  // here (nullopt) as soon as it's used in a way an array can't support.
+  std::unordered_map<std::string, std::optional<KeyBound>> map_key_bounds_;
 };
 
 } // namespace
@@ -85,20 +123,21 @@ private:
 ResourceAnalyser::ResourceAnalyser(BPFtrace &bpftrace,
                                    MapMetadata &mm,
                                    NamedParamInfo &named_param_info,
-                                   const TypeMap &type_map)
+                                   const TypeMap &type_map,
+                                   const ExpansionResult &expansions)
     : bpftrace_(bpftrace),
       map_metadata_(mm),
       named_param_info_(named_param_info),
-      type_map_(type_map)
+      type_map_(type_map),
+      expansions_(expansions)
 {
+  // Slot 0 collects losses that can't be attributed to a specific output
+  // call, e.g. runtime errors or events dropped by the recursion check.
+  resources_.event_loss_sources.emplace_back("", "other", "");
 }
 
 RequiredResources ResourceAnalyser::resources()
 {
-  if (resources_.max_fmtstring_args_size > 0) {
-    resources_.global_vars.add_known(bpftrace::globalvars::FMT_STRINGS_BUFFER);
-  }
-
   if (resources_.max_anon_struct_size > 0) {
     assert(resources_.anon_struct_buffers > 0);
     resources_.global_vars.add_known(bpftrace::globalvars::ANON_STRUCT_BUFFER);
@@ -134,28 +173,62 @@ RequiredResources ResourceAnalyser::resources()
     resources_.global_vars.add_known(bpftrace::globalvars::MAP_KEY_BUFFER);
   }
 
-  if (resources_.join_value_size > 0) {
-    resources_.global_vars.add_known(bpftrace::globalvars::JOIN_BUFFER);
-  }
-
   resources_.global_vars.add_known(bpftrace::globalvars::MAX_CPU_ID);
   resources_.global_vars.add_known(bpftrace::globalvars::EVENT_LOSS_COUNTER);
 
+  for (auto &[name, map_info] : resources_.maps_info) {
+    maybe_use_array_map(name, map_info);
+  }
+
   return std::move(resources_);
 }
 
 void ResourceAnalyser::visit(Probe &probe)
 {
   probe_ = &probe;
+  recording_call_ids_ = nullptr;
+  replaying_call_ids_ = nullptr;
+  replay_pos_ = 0;
+  if (auto group = expansions_.get_probe_group(probe)) {
+    auto [call_ids, first] = group_call_ids_.try_emplace(*group);
+    if (first)
+      recording_call_ids_ = &call_ids->second;
+    else
+      replaying_call_ids_ = &call_ids->second;
+  }
+
   Visitor<ResourceAnalyser>::visit(probe);
 }
 
 void ResourceAnalyser::visit(Subprog &subprog)
 {
   probe_ = nullptr;
+  recording_call_ids_ = nullptr;
+  replaying_call_ids_ = nullptr;
   Visitor<ResourceAnalyser>::visit(subprog);
 }
 
+template <typename T>
+size_t ResourceAnalyser::add_call_args(std::vector<T> &args, T value)
+{
+  if (replaying_call_ids_) {
+    if (replay_pos_ < replaying_call_ids_->size()) {
+      auto [vec, id] = (*replaying_call_ids_)[replay_pos_++];
+      if (vec == &args && args.at(id) == value)
+        return id;
+    }
+    // This member diverged from the first one, so the remaining calls can't
+    // be matched up anymore.
+    replaying_call_ids_ = nullptr;
+  }
+
+  size_t id = args.size();
+  args.push_back(std::move(value));
+  if (recording_call_ids_)
+    recording_call_ids_->emplace_back(&args, id);
+  return id;
+}
+
 void ResourceAnalyser::visit(Builtin &builtin)
 {
   if (uses_usym_table(builtin.ident)) {
@@ -168,6 +241,8 @@ void ResourceAnalyser::visit(Builtin &builtin)
     resources_.global_vars.add_known(bpftrace::globalvars::NUM_CPUS);
   } else if (builtin.ident == "__builtin_cpid") {
     resources_.global_vars.add_known(bpftrace::globalvars::CHILD_PID);
+  } else if (builtin.ident == "__builtin_filter_pid") {
+    resources_.global_vars.add_known(bpftrace::globalvars::FILTER_PID);
   } else if (builtin.ident == "ustack" || builtin.ident == "kstack" ||
              builtin.ident == "__builtin_dw_ustack") {
     const auto &ty = type_map_.type(&builtin);
@@ -176,6 +251,10 @@ void ResourceAnalyser::visit(Builtin &builtin)
       resources_.max_call_stack_size = std::max(resources_.max_call_stack_size,
                                                 ty.GetSize());
     }
+    if (builtin.ident != "kstack" &&
+        bpftrace_.config_->snapshot_user_mappings) {
+      resources_.needs_mapping_snapshots = true;
+    }
   } else if (builtin.ident == "__builtin_elapsed") {
     resources_.needs_elapsed_map = true;
   }
@@ -203,55 +282,39 @@ void ResourceAnalyser::visit(Call &call)
     // creation to generate offsets for each argument in the args "tuple".
     auto tuple = Struct::CreateTuple(args);
 
-    // Keep track of max "tuple" size needed for fmt string args. Codegen
-    // will use this information to create a percpu array map of large
-    // enough size for all fmt string calls to use. Note that since this
-    // will end up being aligned differently than the arguments themselves,
-    // we need to ensure that it is aligned to the size of the largest type.
-    uint64_t args_size = sizeof(uint64_t) + static_cast<uint64_t>(tuple->size);
-    if (args_size % sizeof(uint64_t) != 0) {
-      args_size += sizeof(uint64_t) - (args_size % sizeof(uint64_t));
-    }
-    if (exceeds_stack_limit(args_size)) {
-      resources_.max_fmtstring_args_size = std::max(
-          resources_.max_fmtstring_args_size, args_size);
-    }
-
     auto fmtstr = call.vargs.at(0).as<String>()->value;
+    auto add_printf_args = [&](PrintfSeverity severity) {
+      resources_.printf_args_id_map[&call] = add_call_args(
+          resources_.printf_args,
+          { fmtstr, tuple->fields, severity, SourceInfo(call.loc) });
+    };
     if (call.func == "printf") {
       if (probe_ != nullptr && probe_->get_probetype() == ProbeType::iter) {
-        resources_.bpf_print_fmts_id_map[&call] =
-            resources_.bpf_print_fmts.size();
-        resources_.bpf_print_fmts.emplace_back(fmtstr);
+        resources_.bpf_print_fmts_id_map[&call] = add_call_args(
+            resources_.bpf_print_fmts, FormatString(fmtstr));
       } else {
-        resources_.printf_args_id_map[&call] = resources_.printf_args.size();
-        resources_.printf_args.emplace_back(
-            fmtstr, tuple->fields, PrintfSeverity::NONE, SourceInfo(call.loc));
+        add_printf_args(PrintfSeverity::NONE);
       }
     } else if (call.func == "errorf") {
-      resources_.printf_args_id_map[&call] = resources_.printf_args.size();
-      resources_.printf_args.emplace_back(
-          fmtstr, tuple->fields, PrintfSeverity::ERROR, SourceInfo(call.loc));
+      add_printf_args(PrintfSeverity::ERROR);
     } else if (call.func == "warnf") {
-      resources_.printf_args_id_map[&call] = resources_.printf_args.size();
-      resources_.printf_args.emplace_back(
-          fmtstr, tuple->fields, PrintfSeverity::WARNING, SourceInfo(call.loc));
+      add_printf_args(PrintfSeverity::WARNING);
     } else if (call.func == "debugf") {
-      resources_.bpf_print_fmts_id_map[&call] =
-          resources_.bpf_print_fmts.size();
-      resources_.bpf_print_fmts.emplace_back(fmtstr);
+      resources_.bpf_print_fmts_id_map[&call] = add_call_args(
+          resources_.bpf_print_fmts, FormatString(fmtstr));
     } else if (call.func == "system") {
-      resources_.system_args_id_map[&call] = resources_.system_args.size();
-      resources_.system_args.emplace_back(fmtstr, tuple->fields);
+      resources_.system_args_id_map[&call] = add_call_args(
+          resources_.system_args, { fmtstr, tuple->fields });
     } else {
-      resources_.cat_args_id_map[&call] = resources_.cat_args.size();
-      resources_.cat_args.emplace_back(fmtstr, tuple->fields);
+      resources_.cat_args_id_map[&call] = add_call_args(resources_.cat_args,
+                                                        { fmtstr,
+                                                          tuple->fields });
     }
   } else if (call.func == "join") {
     auto delim = call.vargs.size() > 1 ? call.vargs.at(1).as<String>()->value
                                        : " ";
-    resources_.join_args_id_map[&call] = resources_.join_args.size();
-    resources_.join_args.push_back(delim);
+    resources_.join_args_id_map[&call] = add_call_args(resources_.join_args,
+                                                       delim);
   } else if (call.func == "count" || call.func == "sum" || call.func == "min" ||
              call.func == "max" || call.func == "avg") {
     resources_.global_vars.add_known(bpftrace::globalvars::NUM_CPUS);
@@ -341,46 +404,62 @@ void ResourceAnalyser::visit(Call &call)
       resources_.max_call_stack_size = std::max(resources_.max_call_stack_size,
                                                 ty.GetSize());
     }
+    if (call.func != "kstack" && bpftrace_.config_->snapshot_user_mappings) {
+      resources_.needs_mapping_snapshots = true;
+    }
   } else if (call.func == "time") {
-    resources_.time_args_id_map[&call] = resources_.time_args.size();
-    if (!call.vargs.empty())
-      resources_.time_args.push_back(call.vargs.at(0).as<String>()->value);
-    else
-      resources_.time_args.emplace_back("%H:%M:%S\n");
+    std::string fmt = !call.vargs.empty()
+                          ? call.vargs.at(0).as<String>()->value
+                          : "%H:%M:%S\n";
+    resources_.time_args_id_map[&call] = add_call_args(resources_.time_args,
+                                                       std::move(fmt));
   } else if (call.func == "strftime") {
-    resources_.strftime_args_id_map[&call] = resources_.strftime_args.size();
-    resources_.strftime_args.push_back(call.vargs.at(0).as<String>()->value);
+    resources_.strftime_args_id_map[&call] = add_call_args(
+        resources_.strftime_args, call.vargs.at(0).as<String>()->value);
   } else if (call.func == "print") {
-    constexpr auto nonmap_headroom = sizeof(AsyncEvent::PrintNonMap);
     auto &arg = call.vargs.at(0);
     if (!arg.is<Map>()) {
       const auto &arg_type = type_map_.type(arg);
-      resources_.non_map_print_args_id_map[&call] =
-          resources_.non_map_print_args.size();
-      resources_.non_map_print_args.push_back(arg_type);
-      const size_t fmtstring_args_size = nonmap_headroom + arg_type.GetSize();
-      if (exceeds_stack_limit(fmtstring_args_size)) {
-        resources_.max_fmtstring_args_size = std::max<uint64_t>(
-            resources_.max_fmtstring_args_size, fmtstring_args_size);
-      }
+      resources_.non_map_print_args_id_map[&call] = add_call_args(
+          resources_.non_map_print_args, arg_type);
     }
   } else if (call.func == "cgroup_path") {
-    resources_.cgroup_path_args_id_map[&call] =
-        resources_.cgroup_path_args.size();
-    if (call.vargs.size() > 1)
-      resources_.cgroup_path_args.push_back(
-          call.vargs.at(1).as<String>()->value);
-    else
-      resources_.cgroup_path_args.emplace_back("*");
+    std::string filter = call.vargs.size() > 1
+                             ? call.vargs.at(1).as<String>()->value
+                             : "*";
+    resources_.cgroup_path_args_id_map[&call] = add_call_args(
+        resources_.cgroup_path_args, std::move(filter));
   } else if (call.func == "skboutput") {
-    resources_.skboutput_args_id_map[&call] = resources_.skboutput_args_.size();
     const auto &file = call.vargs.at(0).as<String>()->value;
     const auto &offset = call.vargs.at(3).as<Integer>()->value;
 
-    resources_.skboutput_args_.emplace_back(file, offset);
+    resources_.skboutput_args_id_map[&call] = add_call_args(
+        resources_.skboutput_args_, { file, static_cast<long>(offset) });
     resources_.using_skboutput = true;
   }
 
+  if (call.func == "printf" || call.func == "errorf" || call.func == "warnf" ||
+      call.func == "system" || call.func == "cat" || call.func == "exit" ||
+      call.func == "print" || call.func == "clear" || call.func == "zero" ||
+      call.func == "time" || call.func == "join") {
+    add_event_loss_source(call);
+  }
+
+  if (call.func == "count" || call.func == "sum") {
+    if (auto *map = call.vargs.at(0).as<Map>()) {
+      update_key_bound(*map, &call.vargs.at(1));
+    }
+  } else if (call.func != "print" && call.func != "clear" &&
+             call.func != "zero") {
+    // Anything else that takes a whole map, e.g. delete() or len(), may
+    // rely on keys being absent, which array maps can't express.
+    for (auto &arg : call.vargs) {
+      if (auto *map = arg.as<Map>()) {
+        update_key_bound(*map, nullptr);
+      }
+    }
+  }
+
   if (call.func == "print" || call.func == "clear" || call.func == "zero") {
     if (auto *map = call.vargs.at(0).as<Map>()) {
       auto &name = map->ident;
@@ -396,12 +475,6 @@ void ResourceAnalyser::visit(Call &call)
       resources_.str_buffers++;
   }
 
-  if (call.func == "join") {
-    resources_.join_value_size = offsetof(AsyncEvent::Join, content) +
-                                 (bpftrace_.join_argnum_ *
-                                  bpftrace_.join_argsize_);
-  }
-
   // These functions, some of which are desugared AssignMapStatements (e.g.,
   // `@a[1, 2, 3] = count(); -> count(@a, (1, 2, 3));`) might require
   // additional map key scratch buffers because the map key type might be
@@ -478,6 +551,7 @@ void ResourceAnalyser::visit(MapAccess &acc)
         resources_.max_read_map_value_size, val_type.GetSize());
   }
   maybe_allocate_map_key_buffer(*acc.map, acc.key);
+  update_key_bound(*acc.map, &acc.key);
 }
 
 void ResourceAnalyser::visit(Tuple &tuple)
@@ -508,6 +582,11 @@ void ResourceAnalyser::visit(For &f)
 {
   Visitor<ResourceAnalyser>::visit(f);
 
+  // Iterating over an array map would visit every index, used or not.
+  if (auto *map = f.iterable.as<Map>()) {
+    update_key_bound(*map, nullptr);
+  }
+
   // Need tuple per for loop to store key and value
   const auto &ty = type_map_.type(f.decl);
   if (exceeds_stack_limit(ty.GetSize())) {
@@ -607,6 +686,131 @@ bool ResourceAnalyser::exceeds_stack_limit(size_t size)
   return size > bpftrace_.config_->on_stack_limit;
 }
 
+void ResourceAnalyser::add_event_loss_source(Call &call)
+{
+  // printf in iter probes goes through bpf_seq_printf, not the ring buffer.
+  if (resources_.bpf_print_fmts_id_map.contains(&call)) {
+    return;
+  }
+
+  // Members of a probe group are reported under the group's name, as they
+  // may end up sharing a single program.
+  std::string probe_name;
+  if (auto group = probe_ ? expansions_.get_probe_group(*probe_)
+                          : std::nullopt) {
+    probe_name = expansions_.get_probe_group_name(*group);
+  } else if (probe_ != nullptr) {
+    for (auto *ap : probe_->attach_points) {
+      if (!probe_name.empty())
+        probe_name += ",";
+      probe_name += ap->name();
+    }
+  }
+
+  // The call site is identified by its whole location chain, so that calls
+  // expanded from the same macro at different places get their own slots.
+  // Clones made for the members of a probe group all have the same chain.
+  std::string site;
+  for (auto loc = call.loc; loc;
+       loc = loc->parent ? loc->parent->loc : nullptr) {
+    site += loc->source_location();
+    site += ";";
+  }
+
+  auto key = std::make_pair(probe_name, std::move(site));
+  auto it = event_loss_source_ids_.find(key);
+  if (it == event_loss_source_ids_.end()) {
+    it = event_loss_source_ids_
+             .emplace(std::move(key), resources_.event_loss_sources.size())
+             .first;
+    resources_.event_loss_sources.emplace_back(std::move(probe_name),
+                                               call.func,
+                                               call.loc->source_location());
+  }
+  resources_.event_loss_sources_id_map[&call] = it->second;
+}
+
+std::optional<ResourceAnalyser::KeyBound> ResourceAnalyser::get_key_bound(
+    Expression &key_expr)
+{
+  if (auto *integer = key_expr.as<Integer>()) {
+    // Larger keys wouldn't fit in an array anyway, and would overflow.
+    if (integer->value >= bpftrace_.config_->max_map_keys) {
+      return std::nullopt;
+    }
+    return KeyBound{ .entries = integer->value + 1 };
+  }
+  if (auto *builtin = key_expr.as<Builtin>();
+      builtin && builtin->ident == "__builtin_cpu") {
+    return KeyBound{ .keyed_by_cpu = true };
+  }
+
+  // Small unsigned types (e.g. from a cast) are bounded by their width.
+  const auto &ty = type_map_.type(key_expr);
+  if (ty.IsBoolTy()) {
+    return KeyBound{ .entries = 2 };
+  }
+  if (ty.IsIntTy() && !ty.IsSigned() && ty.GetSize() <= 2) {
+    return KeyBound{ .entries = 1ULL << (8 * ty.GetSize()) };
+  }
+  return std::nullopt;
+}
+
+void ResourceAnalyser::update_key_bound(const Map &map, Expression *key_expr)
+{
+  auto it = map_key_bounds_.try_emplace(map.ident, KeyBound{}).first;
+  if (!it->second) {
+    return;
+  }
+
+  std::optional<KeyBound> bound;
+  if (key_expr) {
+    bound = get_key_bound(*key_expr);
+  }
+  if (!bound) {
+    it->second = std::nullopt;
+    return;
+  }
+
+  it->second->entries = std::max(it->second->entries, bound->entries);
+  it->second->keyed_by_cpu |= bound->keyed_by_cpu;
+}
+
+void ResourceAnalyser::maybe_use_array_map(const std::string &name,
+                                           MapInfo &map_info)
+{
+  // Only count() is eligible: its touched entries are never zero, so they
+  // can be told apart from the untouched ones when printing. Explicitly
+  // declared maps keep the type they were given.
+  if (!map_info.value_type.IsCountTy()) {
+    return;
+  }
+  if (map_decls_.contains(name) || !map_info.key_type.IsIntTy()) {
+    return;
+  }
+
+  auto bound = map_key_bounds_.find(name);
+  if (bound == map_key_bounds_.end() || !bound->second) {
+    return;
+  }
+  uint64_t entries = bound->second->entries;
+  if (bound->second->keyed_by_cpu) {
+    entries = std::max<uint64_t>(entries,
+                                 static_cast<uint64_t>(bpftrace_.max_cpu_id_) +
+                                     1);
+  }
+  if (entries == 0 || entries > bpftrace_.config_->max_map_keys) {
+    return;
+  }
+
+  map_info.bpf_type = BPF_MAP_TYPE_PERCPU_ARRAY;
+  map_info.max_entries = entries;
+  map_info.keyed_by_cpu = bound->second->keyed_by_cpu;
+  if (map_info.keyed_by_cpu) {
+    map_info.min_entries = bound->second->entries;
+  }
+}
+
 bool ResourceAnalyser::uses_usym_table(const std::string &fun)
 {
   return fun == "usym" || fun == "__builtin_func" || fun == "ustack" ||
@@ -659,8 +863,9 @@ Pass CreateResourcePass()
                BPFtrace &b,
                MapMetadata &mm,
                NamedParamInfo &named_param_info,
-               TypeMap &type_map) {
-    ResourceAnalyser analyser(b, mm, named_param_info, type_map);
+               TypeMap &type_map,
+               ExpansionResult &expansions) {
+    ResourceAnalyser analyser(b, mm, named_param_info, type_map, expansions);
     analyser.visit(ast.root);
     b.resources = analyser.resources();
   };
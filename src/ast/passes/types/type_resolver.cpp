@@ -47,6 +47,7 @@ std::unordered_map<std::string, SizedType (*)()> SIMPLE_BUILTIN_TYPES = {
   { "__builtin_ncpus", CreateUInt64 },
   { "__builtin_usermode", CreateUInt8 },
   { "__builtin_cpid", CreateUInt64 },
+  { "__builtin_filter_pid", CreateUInt64 },
 };
 
 std::unordered_map<std::string, SizedType (*)()> SIMPLE_CALL_TYPES = {
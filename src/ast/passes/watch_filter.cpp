@@ -0,0 +1,46 @@
+#include "ast/passes/watch_filter.h"
+#include "ast/ast.h"
+#include "bpftrace.h"
+
+namespace bpftrace::ast {
+
+constexpr auto WATCH_IMPORT = "stdlib/watch/watch.bpf.c";
+
+// Returns early unless the given version of the script is the active one, see
+// stdlib/watch/watch.bpf.c.
+static BlockExpr *create_watch_filter(ASTContext &ast,
+                                      uint64_t version,
+                                      BlockExpr *orig_block)
+{
+  const auto &loc = orig_block->loc;
+  auto *ret_block = ast.make_node<BlockExpr>(
+      loc,
+      StatementList({ ast.make_node<Jump>(loc, ast::JumpType::RETURN) }),
+      ast.make_node<None>(loc));
+  auto *inactive = ast.make_node<Unop>(
+      loc,
+      ast.make_node<Call>(loc,
+                          "__watch_active",
+                          ExpressionList(
+                              { ast.make_node<Integer>(loc, version) })),
+      Operator::LNOT);
+
+  return ast.make_node<BlockExpr>(
+      loc,
+      StatementList({ ast.make_node<StatementImport>(loc, WATCH_IMPORT) }),
+      ast.make_node<IfExpr>(loc, inactive, ret_block, orig_block));
+}
+
+Pass CreateWatchFilterPass()
+{
+  return Pass::create("WatchFilter", [](ASTContext &ast, BPFtrace &b) {
+    if (b.watch_version_ == 0) {
+      return;
+    }
+    for (Probe *probe : ast.root->probes) {
+      probe->block = create_watch_filter(ast, b.watch_version_, probe->block);
+    }
+  });
+};
+
+} // namespace bpftrace::ast
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "ast/pass_manager.h"
+
+namespace bpftrace::ast {
+
+// Filters every probe on the version of the script that is active, when
+// running with --watch. This lets a new version be attached before the
+// previous one is detached without handling events twice.
+Pass CreateWatchFilterPass();
+
+} // namespace bpftrace::ast
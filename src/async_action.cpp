@@ -170,6 +170,11 @@ Result<> AsyncHandlers::clear_map(const OpaqueValue &data)
 {
   auto mapevent = data.bitcast<AsyncEvent::MapEvent>();
   const auto &map = bpftrace.bytecode_.getMap(mapevent.mapid);
+  if (map.is_array_type()) {
+    // Array map entries can't be deleted, but zeroed entries aren't printed.
+    uint64_t nvalues = map.is_per_cpu_type() ? bpftrace.ncpus_ : 1;
+    return map.zero_out(nvalues);
+  }
   return map.clear();
 }
 
@@ -188,6 +193,13 @@ Result<> AsyncHandlers::skboutput(const OpaqueValue &data)
   return OK();
 }
 
+Result<> AsyncHandlers::snapshot_mappings(const OpaqueValue &data)
+{
+  auto snapshot = data.bitcast<AsyncEvent::SnapshotMappings>();
+  bpftrace.snapshot_usym_mappings(snapshot.pid);
+  return OK();
+}
+
 Result<> AsyncHandlers::syscall(const OpaqueValue &data)
 {
   if (bpftrace.safe_mode_) {
@@ -263,7 +275,9 @@ Result<> AsyncHandlers::printf(const OpaqueValue &data)
     return OK();
   }
 
-  out->printf(fmt.format(*vals), source_info, severity);
+  if (!out->printf_args(id, *vals)) {
+    out->printf(fmt.format(*vals), source_info, severity);
+  }
   return OK();
 }
 
@@ -24,6 +24,7 @@ enum class AsyncAction {
   print_non_map,
   strftime,
   skboutput,
+  snapshot_mappings,
   // clang-format on
 };
 
@@ -45,6 +46,7 @@ public:
   Result<> zero_map(const OpaqueValue &data);
   Result<> clear_map(const OpaqueValue &data);
   Result<> skboutput(const OpaqueValue &data);
+  Result<> snapshot_mappings(const OpaqueValue &data);
   Result<> syscall(const OpaqueValue &data);
   Result<> cat(const OpaqueValue &data);
   Result<> printf(const OpaqueValue &data);
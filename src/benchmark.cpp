@@ -6,6 +6,7 @@
 
 #include "ast/ast.h"
 #include "ast/context.h"
+#include "ast/passes/codegen_llvm.h"
 #include "benchmark.h"
 #include "util/time.h"
 
@@ -82,6 +83,9 @@ Result<> benchmark(std::ostream &out, ast::PassManager &mgr)
                        .count();
     std::vector<int64_t> samples;
     int64_t total = 0;
+    // Passes that compile in parallel report the wall time of each
+    // partition, which are emitted after the pass itself.
+    std::vector<std::vector<int64_t>> partition_samples;
     while (true) {
       auto start = processor_time();
       if (!start) {
@@ -98,6 +102,15 @@ Result<> benchmark(std::ostream &out, ast::PassManager &mgr)
       int64_t current = delta(*start, *end);
       samples.push_back(current);
       total += current;
+      if (ctx.has<ast::CompileContext>()) {
+        auto &partitions = ctx.get<ast::CompileContext>().partitions;
+        partition_samples.resize(partitions.size());
+        for (size_t i = 0; i < partitions.size(); i++) {
+          auto wall = partitions[i].optimize + partitions[i].emit;
+          partition_samples[i].push_back(wall.count());
+        }
+        partitions.clear();
+      }
 
       // Do we have enough (or too much)?
       if (samples.size() >= 10000 || (samples.size() > 3 && total >= goal)) {
@@ -111,12 +124,30 @@ Result<> benchmark(std::ostream &out, ast::PassManager &mgr)
     }
 
     // Compute the variance of the samples.
+    auto variance_of = [](const std::vector<int64_t> &samples, int64_t mean) {
+      double variance = 0;
+      for (const auto &sample : samples) {
+        variance += std::pow(static_cast<double>(sample - mean), 2);
+      }
+      return variance;
+    };
     int64_t mean = total / samples.size();
-    double variance = 0;
-    for (const auto &sample : samples) {
-      variance += std::pow(static_cast<double>(sample - mean), 2);
-    }
+    double variance = variance_of(samples, mean);
     emit(pass.name(), total, samples.size(), variance);
+    for (size_t i = 0; i < partition_samples.size(); i++) {
+      const auto &partition = partition_samples[i];
+      if (partition.empty()) {
+        continue;
+      }
+      int64_t partition_total = 0;
+      for (const auto &sample : partition) {
+        partition_total += sample;
+      }
+      emit("  partition " + std::to_string(i),
+           partition_total,
+           partition.size(),
+           variance_of(partition, partition_total / partition.size()));
+    }
 
     // Aggregate for printing the final stats. Note that we treat each pass as
     // independent, therefore the final variance is the sum of the variances.
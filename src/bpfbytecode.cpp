@@ -8,7 +8,7 @@
 #include "bpftrace.h"
 #include "globalvars.h"
 #include "log.h"
-#include "util/bpf_names.h"
+#include "util/cpus.h"
 #include "util/exceptions.h"
 #include "util/wildcard.h"
 
@@ -96,8 +96,7 @@ BpfBytecode::BpfBytecode(std::span<const std::byte> elf)
 
 const BpfProgram &BpfBytecode::getProgramForProbe(const Probe &probe) const
 {
-  auto prog = programs_.find(
-      util::get_function_name_for_probe(probe.name, probe.index));
+  auto prog = programs_.find(get_program_name(probe));
   if (prog == programs_.end()) {
     throw std::runtime_error("Code not generated for probe: " + probe.name);
   }
@@ -114,6 +113,9 @@ BpfProgram &BpfBytecode::getProgramForProbe(const Probe &probe)
 void BpfBytecode::update_global_vars(BPFtrace &bpftrace,
                                      globalvars::GlobalVarMap &&global_var_vals)
 {
+  for (const auto &reloc : bpftrace.resources.field_relocations) {
+    global_var_vals[reloc.global_var] = reloc.offset;
+  }
   bpftrace.resources.global_vars.update_global_vars(
       bpf_object_.get(),
       section_names_to_global_vars_map_,
@@ -121,22 +123,32 @@ void BpfBytecode::update_global_vars(BPFtrace &bpftrace,
       bpftrace.ncpus_,
       bpftrace.max_cpu_id_,
       bpftrace.child_ ? std::make_optional<pid_t>(bpftrace.child_->pid())
-                      : std::nullopt);
+                      : std::nullopt,
+      bpftrace.pid());
 }
 
-uint64_t BpfBytecode::get_event_loss_counter(BPFtrace &bpftrace, int max_cpu_id)
+std::vector<uint64_t> BpfBytecode::get_event_loss_counters(BPFtrace &bpftrace,
+                                                          int max_cpu_id)
 {
-  auto *current_values = bpftrace.resources.global_vars.get_global_var(
-      bpf_object_.get(),
-      globalvars::EVENT_LOSS_COUNTER_SECTION_NAME,
-      section_names_to_global_vars_map_);
-  uint64_t current_value = 0;
-  for (int i = 0; i < max_cpu_id; ++i) {
-    current_value += *current_values;
-    current_values++;
+  if (!event_loss_counters_) {
+    event_loss_counters_ = bpftrace.resources.global_vars.get_global_var(
+        bpf_object_.get(),
+        globalvars::EVENT_LOSS_COUNTER_SECTION_NAME,
+        section_names_to_global_vars_map_);
   }
 
-  return current_value;
+  // The counters are laid out as [MAX_CPU_ID + 1][num_slots].
+  size_t num_slots = std::max<size_t>(
+      bpftrace.resources.event_loss_sources.size(), 1);
+  std::vector<uint64_t> values(num_slots, 0);
+  for (int cpu = 0; cpu <= max_cpu_id; ++cpu) {
+    const uint64_t *cpu_values = event_loss_counters_ + (cpu * num_slots);
+    for (size_t slot = 0; slot < num_slots; ++slot) {
+      values[slot] += cpu_values[slot];
+    }
+  }
+
+  return values;
 }
 
 // Searches the verifier's log for err_pattern. If a match is found, extracts
@@ -213,6 +225,19 @@ Result<> BpfBytecode::load_progs(const RequiredResources &resources,
     bpf_program__set_log_buf(prog.bpf_prog(), log_buf.data(), log_buf.size());
   }
 
+  // Maps indexed by CPU id were sized on the host that compiled the script,
+  // which isn't necessarily this one (e.g. for AOT). Maps reusing an existing
+  // map (see `reuse_maps`) already have the right size and can't be resized.
+  for (const auto &[name, map_info] : resources.maps_info) {
+    if (map_info.keyed_by_cpu && hasMap(name) && getMap(name).fd() < 0) {
+      auto ok = getMap(name).resize(
+          std::max(util::get_max_cpu_id() + 1, map_info.min_entries));
+      if (!ok) {
+        return ok.takeError();
+      }
+    }
+  }
+
   prepare_progs(resources.begin_probes, btf, feature, config);
   prepare_progs(resources.end_probes, btf, feature, config);
   prepare_progs(resources.test_probes, btf, feature, config);
@@ -344,6 +369,47 @@ bool BpfBytecode::all_progs_loaded()
   });
 }
 
+static bool same_map_layout(const MapInfo &a, const MapInfo &b)
+{
+  return a.key_type == b.key_type && a.value_type == b.value_type &&
+         a.detail == b.detail && a.max_entries == b.max_entries &&
+         a.bpf_type == b.bpf_type && a.is_scalar == b.is_scalar &&
+         a.keyed_by_cpu == b.keyed_by_cpu && a.min_entries == b.min_entries;
+}
+
+std::vector<std::string> BpfBytecode::reusable_maps(
+    const RequiredResources &resources,
+    const BpfBytecode &previous,
+    const RequiredResources &previous_resources) const
+{
+  std::vector<std::string> reusable;
+  for (const auto &[name, map_info] : resources.maps_info) {
+    auto prev_info = previous_resources.maps_info.find(name);
+    if (prev_info == previous_resources.maps_info.end() ||
+        !same_map_layout(map_info, prev_info->second) || !hasMap(name) ||
+        !previous.hasMap(name)) {
+      continue;
+    }
+    reusable.push_back(name);
+  }
+  return reusable;
+}
+
+Result<std::vector<std::string>> BpfBytecode::reuse_maps(
+    const RequiredResources &resources,
+    const BpfBytecode &previous,
+    const RequiredResources &previous_resources)
+{
+  auto reused = reusable_maps(resources, previous, previous_resources);
+  for (const auto &name : reused) {
+    auto ok = getMap(name).reuse_fd(previous.getMap(name).fd());
+    if (!ok) {
+      return ok.takeError();
+    }
+  }
+  return reused;
+}
+
 bool BpfBytecode::hasMap(const std::string &name) const
 {
   return maps_.contains(name);
@@ -63,12 +63,29 @@ public:
 
   void update_global_vars(BPFtrace &bpftrace,
                           globalvars::GlobalVarMap &&global_var_vals);
-  uint64_t get_event_loss_counter(BPFtrace &bpftrace, int max_cpu_id);
+  // Returns the number of lost events for each slot of
+  // `RequiredResources::event_loss_sources`, summed over all CPUs.
+  std::vector<uint64_t> get_event_loss_counters(BPFtrace &bpftrace,
+                                                int max_cpu_id);
   Result<> load_progs(const RequiredResources &resources,
                       const BTF &btf,
                       BPFfeature &feature,
                       const Config &config);
   void attach_external();
+  // Returns the user maps which can share the maps of a previous version of
+  // the same script (for --watch), i.e. those with the same name and layout
+  // in both versions.
+  std::vector<std::string> reusable_maps(
+      const RequiredResources &resources,
+      const BpfBytecode &previous,
+      const RequiredResources &previous_resources) const;
+  // Makes the `reusable_maps` share the maps of a previously loaded version
+  // of the same script, so that their contents are kept. Must be called
+  // before `load_progs`. Returns the names of the shared maps.
+  Result<std::vector<std::string>> reuse_maps(
+      const RequiredResources &resources,
+      const BpfBytecode &previous,
+      const RequiredResources &previous_resources);
 
   const BpfProgram &getProgramForProbe(const Probe &probe) const;
   BpfProgram &getProgramForProbe(const Probe &probe);
@@ -107,6 +124,9 @@ private:
   std::map<std::string, BpfProgram> programs_;
   std::unordered_map<std::string, struct bpf_map *>
       section_names_to_global_vars_map_;
+  // The event loss counters are polled on every iteration of the event loop,
+  // so the mmap'd section is looked up once and then read directly.
+  uint64_t *event_loss_counters_ = nullptr;
 };
 
 } // namespace bpftrace
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <sstream>
 #include <unordered_map>
 
@@ -37,6 +38,10 @@ std::string BpfMap::name() const
 
 uint32_t BpfMap::max_entries() const
 {
+  // The map may have been resized since it was discovered.
+  if (bpf_map_) {
+    return bpf_map__max_entries(bpf_map_);
+  }
   return max_entries_;
 }
 
@@ -48,7 +53,13 @@ bool BpfMap::is_stack_map() const
 bool BpfMap::is_per_cpu_type() const
 {
   return type() == BPF_MAP_TYPE_PERCPU_HASH ||
-         type() == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+         type() == BPF_MAP_TYPE_LRU_PERCPU_HASH ||
+         type() == BPF_MAP_TYPE_PERCPU_ARRAY;
+}
+
+bool BpfMap::is_array_type() const
+{
+  return type() == BPF_MAP_TYPE_ARRAY || type() == BPF_MAP_TYPE_PERCPU_ARRAY;
 }
 
 bool BpfMap::is_printable() const
@@ -130,16 +141,27 @@ Result<> BpfMap::resize(uint32_t new_size) const
   return OK();
 }
 
+Result<> BpfMap::reuse_fd(int fd) const
+{
+  auto err = bpf_map__reuse_fd(bpf_map_, fd);
+  if (err != 0) {
+    return make_error<BpfMapError>(name_, "reuse", err);
+  }
+  return OK();
+}
+
 Result<MapElements> BpfMap::collect_elements(int nvalues) const
 {
-  auto keys = collect_keys();
   MapElements values_by_key;
+  auto value_size = static_cast<size_t>(value_size_) *
+                    static_cast<size_t>(nvalues);
 
+  auto keys = collect_keys();
   for (auto &key : keys) {
     int err = 0;
-    auto value = OpaqueValue::alloc(
-        static_cast<size_t>(value_size_) * static_cast<size_t>(nvalues),
-        [&](void *data) { err = bpf_map_lookup_elem(fd(), key.data(), data); });
+    auto value = OpaqueValue::alloc(value_size, [&](void *data) {
+      err = bpf_map_lookup_elem(fd(), key.data(), data);
+    });
     if (err == -ENOENT) {
       // key was removed by the eBPF program during bpf_map_get_next_key() and
       // bpf_map_lookup_elem(), let's skip this key.
@@ -232,6 +254,8 @@ std::string to_string(MapType t)
       return "event_loss_counter";
     case MapType::RecursionPrevention:
       return "recursion_prevention";
+    case MapType::MappingSnapshots:
+      return "mapping_snapshots";
   }
   return {}; // unreached
 }
@@ -71,6 +71,7 @@ public:
 
   bool is_stack_map() const;
   bool is_per_cpu_type() const;
+  bool is_array_type() const;
   bool is_printable() const;
 
   std::vector<OpaqueValue> collect_keys() const;
@@ -84,9 +85,12 @@ public:
   Result<> update_elem(const void *key, const void *value) const;
   Result<> lookup_elem(const void *key, void *value) const;
   Result<> resize(uint32_t new_size) const;
+  // Makes the map use an existing map instead of creating a new one when its
+  // object is loaded. The existing map must have the same layout.
+  Result<> reuse_fd(int fd) const;
 
 private:
-  struct bpf_map *bpf_map_;
+  struct bpf_map *bpf_map_ = nullptr;
   bpf_map_type type_;
   std::string name_;
   uint32_t key_size_;
@@ -102,6 +106,7 @@ enum class MapType {
   Ringbuf,
   EventLossCounter,
   RecursionPrevention,
+  MappingSnapshots,
 };
 
 std::string to_string(MapType t);
@@ -66,6 +66,11 @@ bool dry_run = false;
 volatile sig_atomic_t BPFtrace::exitsig_recv = false;
 volatile sig_atomic_t BPFtrace::sigusr1_recv = false;
 
+// Defined by stdlib/process/pid_filter.bpf.c.
+static constexpr auto PID_FILTER_MAP = "pid_filter";
+// Defined by stdlib/watch/watch.bpf.c.
+static constexpr auto WATCH_VERSION_MAP = "watch_version";
+
 static void log_probe_attach_failure(const std::string &err_msg,
                                      const std::string &name,
                                      ConfigMissingProbes missing_probes)
@@ -115,6 +120,7 @@ static void set_rlimit_nofile(size_t num_probes, size_t num_maps)
 
 BPFtrace::~BPFtrace()
 {
+  teardown_output();
   close_pcaps();
 }
 
@@ -198,12 +204,18 @@ void BPFtrace::request_finalize()
 // PerfEventContext is our callback wrapper.
 struct PerfEventContext {
   PerfEventContext(BPFtrace &b,
-                   async_action::AsyncHandlers &handlers,
+                   const ast::CDefinitions &c_definitions,
                    output::Output &o)
-      : bpftrace(b), handlers(handlers), output(o) {};
+      : bpftrace(b), handlers(b, c_definitions, o), output(&o) {};
   BPFtrace &bpftrace;
-  async_action::AsyncHandlers &handlers;
-  output::Output &output;
+  async_action::AsyncHandlers handlers;
+  output::Output *output;
+
+  void change_output(output::Output &o)
+  {
+    handlers.change_output(o);
+    output = &o;
+  }
 };
 
 static Result<> event_printer(void *cb_cookie, void *raw_data, int size)
@@ -247,6 +259,8 @@ static Result<> event_printer(void *cb_cookie, void *raw_data, int size)
     return ctx->handlers.runtime_error(data);
   } else if (printf_id == async_action::AsyncAction::skboutput) {
     return ctx->handlers.skboutput(data);
+  } else if (printf_id == async_action::AsyncAction::snapshot_mappings) {
+    return ctx->handlers.snapshot_mappings(data);
   } else if (printf_id >= async_action::AsyncAction::syscall &&
              printf_id <= async_action::AsyncAction::syscall_end) {
     return ctx->handlers.syscall(data);
@@ -285,7 +299,7 @@ static void skb_output_printer(void *ctx,
 void skb_output_lost(void *ctx, [[maybe_unused]] int cpu, __u64 cnt)
 {
   auto *perf_ctx = static_cast<PerfEventContext *>(ctx);
-  perf_ctx->output.lost_events(cnt);
+  perf_ctx->output->lost_events({ .count = cnt });
 }
 
 void BPFtrace::add_param(const std::string &param)
@@ -306,6 +320,39 @@ size_t BPFtrace::num_params() const
   return params_.size();
 }
 
+int BPFtrace::seed_pid_filter()
+{
+  std::optional<pid_t> target = child_ ? std::make_optional(child_->pid())
+                                       : this->pid();
+  if (!target) {
+    LOG(ERROR) << "--pid-tree requires a target process";
+    return -1;
+  }
+
+  std::vector<int> pids = { *target };
+  auto descendants = util::get_process_descendants(*target);
+  if (!descendants) {
+    LOG(WARNING) << "Unable to find descendants of pid " << *target << ": "
+                 << descendants.takeError();
+  } else {
+    pids.insert(pids.end(), descendants->begin(), descendants->end());
+  }
+
+  const auto &map = bytecode_.getMap(PID_FILTER_MAP);
+  uint8_t one = 1;
+  for (int pid : pids) {
+    uint32_t key = pid;
+    auto ok = map.update_elem(&key, &one);
+    if (!ok) {
+      LOG(ERROR) << "Failed to add pid " << pid
+                 << " to the pid filter: " << ok.takeError();
+      return -1;
+    }
+  }
+  LOG(V1) << "Filtering on " << pids.size() << " processes of pid " << *target;
+  return 0;
+}
+
 Result<std::unique_ptr<AttachedProbe>> BPFtrace::attach_probe(
     Probe &probe,
     const BpfBytecode &bytecode)
@@ -313,6 +360,11 @@ Result<std::unique_ptr<AttachedProbe>> BPFtrace::attach_probe(
   const auto &program = bytecode.getProgramForProbe(probe);
   std::optional<pid_t> pid = child_ ? std::make_optional(child_->pid())
                                     : this->pid();
+  // With --pid-tree, user probes must also fire in descendants of the target,
+  // so they are attached system-wide and filtered on the pid set instead.
+  if (pid_tree_ &&
+      (probe.type == ProbeType::uprobe || probe.type == ProbeType::uretprobe))
+    pid = std::nullopt;
 
   auto ap = AttachedProbe::make(probe, program, pid, safe_mode_);
   if (!ap) {
@@ -437,6 +489,11 @@ int BPFtrace::run(output::Output &out,
   bytecode_ = std::move(bytecode);
   bytecode_.set_map_ids(resources);
 
+  // With --watch, this may be a new version of a script that is still
+  // running. The child process has already been started and the begin probes
+  // have already run, but the maps are carried over where possible.
+  bool reload = previous_ != nullptr;
+
   if (!probe_filter_.empty()) {
     std::regex filter_re;
     try {
@@ -447,13 +504,18 @@ int BPFtrace::run(output::Output &out,
       return -1;
     }
 
+    // A program may be shared by several probes, so it's only skipped if none
+    // of the probes using it are left.
+    std::map<std::string, BpfProgram *> filtered_progs;
+    std::set<std::string> kept_progs;
     auto filter = [&](std::vector<Probe> &probes) {
       std::erase_if(probes, [&](const Probe &probe) {
         if (!std::regex_search(probe.name, filter_re)) {
-          auto &prog = bytecode_.getProgramForProbe(probe);
-          prog.set_no_autoload();
+          filtered_progs.emplace(get_program_name(probe),
+                                 &bytecode_.getProgramForProbe(probe));
           return true;
         }
+        kept_progs.insert(get_program_name(probe));
         return false;
       });
     };
@@ -462,6 +524,11 @@ int BPFtrace::run(output::Output &out,
     filter(resources.test_probes);
     filter(resources.benchmark_probes);
     filter(resources.watchpoint_probes);
+
+    for (auto &[name, prog] : filtered_progs) {
+      if (!kept_progs.contains(name))
+        prog->set_no_autoload();
+    }
   }
 
   int err = prerun();
@@ -484,7 +551,7 @@ int BPFtrace::run(output::Output &out,
     }
   }
 
-  if (!(run_tests_ || run_benchmarks_) && child_ &&
+  if (!(run_tests_ || run_benchmarks_) && child_ && !reload &&
       (has_usdt_ || needs_dwarf_unwind)) {
     auto result = child_->run(true);
     if (!result) {
@@ -513,7 +580,42 @@ int BPFtrace::run(output::Output &out,
   }
 
   if (needs_dwarf_unwind)
-    parse_dwarf_unwind(bytecode_, dwarf_pids_, unwind_data, unwind_mappings);
+    parse_dwarf_unwind(bytecode_,
+                       dwarf_pids_,
+                       precomputed_unwind_,
+                       unwind_data,
+                       unwind_mappings);
+
+  // The output of the previous version has been closed by now, so whatever it
+  // still buffers is written to ours (see `drain_previous`). Our output doesn't
+  // know its printf call sites, and the capture doesn't pass on raw printf
+  // arguments, so these are always formatted.
+  std::optional<output::CaptureOutput> previous_out;
+  if (reload) {
+    previous_out.emplace(out);
+    previous_->event_ctx_->change_output(*previous_out);
+
+    auto reused = bytecode_.reuse_maps(resources,
+                                       previous_->bytecode_,
+                                       previous_->resources);
+    if (!reused) {
+      LOG(ERROR) << "Failed to reuse maps: " << reused.takeError();
+      return -1;
+    }
+    for (const auto &name : *reused) {
+      LOG(V1) << "Keeping contents of map " << name;
+    }
+    if (bytecode_.hasMap(WATCH_VERSION_MAP) &&
+        previous_->bytecode_.hasMap(WATCH_VERSION_MAP)) {
+      auto ok = bytecode_.getMap(WATCH_VERSION_MAP)
+                    .reuse_fd(previous_->bytecode_.getMap(WATCH_VERSION_MAP)
+                                  .fd());
+      if (!ok) {
+        LOG(ERROR) << "Failed to share the active version: " << ok.takeError();
+        return -1;
+      }
+    }
+  }
 
   auto ok = bytecode_.load_progs(resources, *btf_, *feature_, *config_);
   if (!ok) {
@@ -547,20 +649,43 @@ int BPFtrace::run(output::Output &out,
     return -1;
   }
 
+  // Loading may take a while, during which the previous version keeps
+  // running.
+  drain_previous();
+
   if (needs_dwarf_unwind) {
     int ret = feed_dwarf_unwind(bytecode_, unwind_data, unwind_mappings);
     if (ret)
       return ret;
   }
 
-  async_action::AsyncHandlers handlers(*this, c_definitions, out);
-  PerfEventContext ctx(*this, handlers, out);
-  err = setup_output(&ctx);
+  // map PID_FILTER_MAP is only present if running with --pid-tree.
+  if (bytecode_.hasMap(PID_FILTER_MAP)) {
+    err = seed_pid_filter();
+    if (err)
+      return err;
+  }
+
+  // map WATCH_VERSION_MAP is only present if running with --watch. A new
+  // version is only activated once its probes are attached.
+  if (bytecode_.hasMap(WATCH_VERSION_MAP) && !reload) {
+    err = activate_watch_version();
+    if (err)
+      return err;
+  }
+
+  event_ctx_ = std::make_shared<PerfEventContext>(*this, c_definitions, out);
+  auto &handlers = event_ctx_->handlers;
+  err = setup_output(event_ctx_.get());
   if (err)
     return err;
   SCOPE_EXIT
   {
-    teardown_output();
+    // When reloading, the next version drains the output once it has taken
+    // over, see `drain_previous`.
+    if (!reloading_) {
+      teardown_output();
+    }
   };
 
   err = create_pcaps();
@@ -574,6 +699,16 @@ int BPFtrace::run(output::Output &out,
     clock_gettime(CLOCK_BOOTTIME, &ts);
     auto nsec = (1000000000ULL * ts.tv_sec) + ts.tv_nsec;
     uint64_t key = 0;
+    // Elapsed time stays relative to the start of the first version.
+    if (reload && previous_->bytecode_.hasMap(MapType::Elapsed)) {
+      auto ok = previous_->bytecode_.getMap(MapType::Elapsed)
+                    .lookup_elem(&key, &nsec);
+      if (!ok) {
+        LOG(ERROR) << "Failed to read start time from elapsed map: "
+                   << ok.takeError();
+        return -1;
+      }
+    }
     auto map = bytecode_.getMap(MapType::Elapsed);
     auto ok = map.update_elem(&key, &nsec);
     if (!ok) {
@@ -591,7 +726,7 @@ int BPFtrace::run(output::Output &out,
 
   for (const auto &begin_probe : resources.begin_probes) {
     auto &begin_prog = bytecode_.getProgramForProbe(begin_probe);
-    if (::bpf_prog_test_run_opts(begin_prog.fd(), nullptr))
+    if (!reload && ::bpf_prog_test_run_opts(begin_prog.fd(), nullptr))
       return -1;
 
     LOG(V1) << "Attaching 'begin' probe";
@@ -758,6 +893,7 @@ int BPFtrace::run(output::Output &out,
         request_finalize();
         return -1;
       }
+      drain_previous();
       if (!attach_reverse(probe)) {
         auto ap = attach_probe(probe, bytecode_);
         if (!ap) {
@@ -775,6 +911,7 @@ int BPFtrace::run(output::Output &out,
         request_finalize();
         return -1;
       }
+      drain_previous();
       if (attach_reverse(probe)) {
         auto ap = attach_probe(probe, bytecode_);
         if (!ap) {
@@ -787,13 +924,29 @@ int BPFtrace::run(output::Output &out,
       }
     }
 
+    // The previous version stays attached and active until now, so that no
+    // events are missed while reloading. Activating this version switches
+    // every probe over at once, so that no event is handled twice, and then
+    // the previous version's remaining output is drained.
+    if (reload) {
+      if (bytecode_.hasMap(WATCH_VERSION_MAP)) {
+        err = activate_watch_version();
+        if (err)
+          return err;
+      }
+      drain_previous();
+      previous_->attached_probes_.clear();
+      drain_previous();
+      previous_.reset();
+    }
+
     if (dry_run) {
       request_finalize();
       return rval;
     }
 
     // Kick the child to execute the command.
-    if (child_) {
+    if (child_ && !reload) {
       if (has_usdt_ || needs_dwarf_unwind) {
         auto result = child_->resume();
         if (!result) {
@@ -837,6 +990,10 @@ int BPFtrace::run(output::Output &out,
     out.attached_probes(total_attached);
   }
 
+  if (profile_probes_) {
+    enable_probe_stats();
+  }
+
   // Used by runtime test framework to know when to run AFTER directive
   if (std::getenv("__BPFTRACE_NOTIFY_PROBES_ATTACHED"))
     std::cout << "__BPFTRACE_NOTIFY_PROBES_ATTACHED" << std::endl;
@@ -856,7 +1013,29 @@ int BPFtrace::run(output::Output &out,
     bool should_drain = (num_begin_attached > 0 || num_end_attached > 0 ||
                          run_tests_ || run_benchmarks_) &&
                         num_signal_attached == 0 && num_attached == 0;
+    auto poll_start = std::chrono::steady_clock::now();
     poll_output(out, should_drain);
+    auto poll_secs = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - poll_start)
+                         .count();
+    if (poll_secs > 0) {
+      LOG(V1) << "Ring buffer wakeups: " << ringbuf_wakeups_ << " ("
+              << static_cast<uint64_t>(ringbuf_wakeups_ / poll_secs)
+              << "/s), timer flushes: " << ringbuf_timer_flushes_;
+    }
+  }
+
+  // A new version of the script is taking over: leave the probes attached
+  // and the maps in place for it. The probes keep firing, so rather than
+  // draining, consume what is currently buffered. The next version reads the
+  // rest, and detaches the probes, once its own are attached.
+  if (reloading_) {
+    ring_buffer__consume(ringbuf_);
+    if (profile_probes_) {
+      close(probe_stats_fd_);
+      probe_stats_fd_ = -1;
+    }
+    return rval;
   }
 
 #ifdef HAVE_LIBSYSTEMD
@@ -882,8 +1061,16 @@ int BPFtrace::run(output::Output &out,
 
   poll_output(out, /* drain */ true);
 
-  uint64_t total_lost_events = bytecode_.get_event_loss_counter(*this,
-                                                                max_cpu_id_);
+  if (profile_probes_) {
+    poll_probe_stats(out, /* total */ true);
+    close(probe_stats_fd_);
+    probe_stats_fd_ = -1;
+  }
+
+  uint64_t total_lost_events = 0;
+  for (auto count : bytecode_.get_event_loss_counters(*this, max_cpu_id_)) {
+    total_lost_events += count;
+  }
   if (total_lost_events > 0) {
     // We incrementally log lost event counts to stdout via `output`
     // so users can get a record of it in their txt/json output
@@ -951,14 +1138,51 @@ void BPFtrace::setup_ringbuf(void *ctx)
 {
   ringbuf_ = ring_buffer__new(
       bytecode_.getMap(MapType::Ringbuf).fd(), ringbuf_printer, ctx, nullptr);
+  event_loss_report_time_ = std::chrono::steady_clock::now();
 }
 
 void BPFtrace::teardown_output()
 {
   ring_buffer__free(ringbuf_);
+  ringbuf_ = nullptr;
 
   if (resources.using_skboutput)
     perf_buffer__free(skb_perfbuf_);
+  skb_perfbuf_ = nullptr;
+}
+
+// Reads what the previous version of the script has output since its event
+// loop stopped, see --watch.
+void BPFtrace::drain_previous()
+{
+  if (!previous_) {
+    return;
+  }
+  if (previous_->ringbuf_) {
+    ring_buffer__consume(previous_->ringbuf_);
+  }
+  if (previous_->skb_perfbuf_) {
+    perf_buffer__consume(previous_->skb_perfbuf_);
+  }
+  // The previous version may have called exit() in the meantime.
+  if (previous_->finalize_ && !finalize_) {
+    exit_code = previous_->exit_code;
+    request_finalize();
+  }
+}
+
+int BPFtrace::activate_watch_version()
+{
+  const auto &map = bytecode_.getMap(WATCH_VERSION_MAP);
+  uint32_t key = 0;
+  auto ok = map.update_elem(&key, &watch_version_);
+  if (!ok) {
+    LOG(ERROR) << "Failed to activate version " << watch_version_
+               << " of the script: " << ok.takeError();
+    return -1;
+  }
+  LOG(V1) << "Activated version " << watch_version_ << " of the script";
+  return 0;
 }
 
 void BPFtrace::poll_output(output::Output &out, bool drain)
@@ -998,8 +1222,22 @@ void BPFtrace::poll_output(output::Output &out, bool drain)
     // Handle lost events, if any
     poll_event_loss(out);
 
+    if (profile_probes_) {
+      poll_probe_stats(out, /* total */ false);
+    }
+
     if (do_poll_ringbuf) {
       ready = ring_buffer__poll(ringbuf_, timeout_ms);
+      if (ready > 0) {
+        ringbuf_wakeups_++;
+      } else if (ready == 0 && config_->ringbuf_wakeup_threshold > 0) {
+        // Events submitted below the wakeup threshold don't wake us up, so
+        // drain them whenever the poll times out.
+        ready = ring_buffer__consume(ringbuf_);
+        if (ready > 0) {
+          ringbuf_timer_flushes_++;
+        }
+      }
       if (should_retry(ready)) {
         continue;
       }
@@ -1018,6 +1256,11 @@ void BPFtrace::poll_output(output::Output &out, bool drain)
       return;
     }
 
+    if (watch_ && !drain && watch_()) {
+      reloading_ = true;
+      return;
+    }
+
     if (BPFtrace::sigusr1_recv) {
       BPFtrace::sigusr1_recv = false;
 
@@ -1032,17 +1275,158 @@ void BPFtrace::poll_output(output::Output &out, bool drain)
   }
 }
 
+void BPFtrace::enable_probe_stats()
+{
+  // Stats stay enabled for as long as the returned fd is open. This has a
+  // small cost for every BPF program on the system, not just ours.
+  probe_stats_fd_ = bpf_enable_stats(BPF_STATS_RUN_TIME);
+  if (probe_stats_fd_ < 0) {
+    LOG(WARNING) << "Failed to enable BPF program stats, --profile-probes "
+                    "will only report zeroes: "
+                 << strerror(-probe_stats_fd_);
+  }
+  probe_stats_start_ = std::chrono::steady_clock::now();
+  probe_stats_time_ = probe_stats_start_;
+}
+
+void BPFtrace::poll_probe_stats(output::Output &out, bool total)
+{
+  constexpr auto interval = std::chrono::seconds(1);
+
+  auto now = std::chrono::steady_clock::now();
+  if (!total && now - probe_stats_time_ < interval) {
+    return;
+  }
+  auto since = total ? probe_stats_start_ : probe_stats_time_;
+  probe_stats_time_ = now;
+
+  output::ProbeStats stats;
+  stats.total = total;
+  stats.interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          now - since)
+                          .count();
+  if (stats.interval_ns == 0) {
+    return;
+  }
+
+  std::set<std::string> seen;
+  auto collect = [&](const std::vector<Probe> &probes) {
+    for (const auto &probe : probes) {
+      // Several probes may share a single program, e.g. attach points of the
+      // same probe which generated identical code. Report each program once.
+      auto prog_name = get_program_name(probe);
+      if (!seen.insert(prog_name).second) {
+        continue;
+      }
+      int fd = bytecode_.getProgramForProbe(probe).fd();
+      if (fd < 0) {
+        continue;
+      }
+
+      struct bpf_prog_info info = {};
+      __u32 info_len = sizeof(info);
+      if (bpf_prog_get_info_by_fd(fd, &info, &info_len) != 0) {
+        continue;
+      }
+
+      auto &last = prog_run_stats_[prog_name];
+      ProgRunStats current = { .run_time_ns = info.run_time_ns,
+                               .run_cnt = info.run_cnt,
+                               .recursion_misses = info.recursion_misses };
+      ProgRunStats base = total ? ProgRunStats{} : last;
+      last = current;
+
+      uint64_t events = current.run_cnt - base.run_cnt;
+      uint64_t run_time_ns = current.run_time_ns - base.run_time_ns;
+      stats.probes.push_back({
+          .name = probe.name,
+          .events = events,
+          .run_time_ns = run_time_ns,
+          .recursion_misses = current.recursion_misses -
+                              base.recursion_misses,
+          .ns_per_event = events > 0 ? run_time_ns / events : 0,
+          .events_per_sec = events * 1000000000 / stats.interval_ns,
+          .cpu_share = 100.0 * static_cast<double>(run_time_ns) /
+                       static_cast<double>(stats.interval_ns),
+      });
+    }
+  };
+  collect(resources.begin_probes);
+  collect(resources.probes);
+  collect(resources.signal_probes);
+  collect(resources.watchpoint_probes);
+  collect(resources.end_probes);
+
+  auto wakeups_base = total ? 0 : ringbuf_wakeups_reported_;
+  auto flushes_base = total ? 0 : ringbuf_timer_flushes_reported_;
+  stats.ringbuf_wakeups = ringbuf_wakeups_ - wakeups_base;
+  stats.ringbuf_wakeups_per_sec = stats.ringbuf_wakeups * 1000000000 /
+                                  stats.interval_ns;
+  stats.ringbuf_timer_flushes = ringbuf_timer_flushes_ - flushes_base;
+  ringbuf_wakeups_reported_ = ringbuf_wakeups_;
+  ringbuf_timer_flushes_reported_ = ringbuf_timer_flushes_;
+
+  out.probe_stats(stats);
+}
+
 void BPFtrace::poll_event_loss(output::Output &out)
 {
-  uint64_t current_value = bytecode_.get_event_loss_counter(*this, max_cpu_id_);
+  auto current_values = bytecode_.get_event_loss_counters(*this, max_cpu_id_);
+  event_loss_counts_.resize(current_values.size(), 0);
+
+  output::LostEvents lost;
+  std::vector<size_t> lost_slots;
+  for (size_t slot = 0; slot < current_values.size(); ++slot) {
+    if (current_values[slot] > event_loss_counts_[slot]) {
+      lost.count += current_values[slot] - event_loss_counts_[slot];
+      lost_slots.push_back(slot);
+    } else if (current_values[slot] < event_loss_counts_[slot]) {
+      LOG(ERROR) << "Invalid event loss count value: " << current_values[slot]
+                 << ", last seen: " << event_loss_counts_[slot];
+    }
+  }
+  if (lost.count == 0) {
+    return;
+  }
 
-  if (current_value > event_loss_count_) {
-    out.lost_events(current_value - event_loss_count_);
-    event_loss_count_ = current_value;
-  } else if (current_value < event_loss_count_) {
-    LOG(ERROR) << "Invalid event loss count value: " << current_value
-               << ", last seen: " << event_loss_count_;
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        now - event_loss_report_time_)
+                        .count();
+  event_loss_report_time_ = now;
+
+  for (auto slot : lost_slots) {
+    uint64_t delta = current_values[slot] - event_loss_counts_[slot];
+    event_loss_counts_[slot] = current_values[slot];
+
+    std::string probe;
+    std::string event = "other";
+    std::string location;
+    if (slot < resources.event_loss_sources.size()) {
+      std::tie(probe, event, location) = resources.event_loss_sources[slot];
+    }
+    uint64_t rate = elapsed_ms > 0 ? delta * 1000 / elapsed_ms : delta;
+    LOG(V1) << "Lost " << delta << " events (" << rate << "/s) from " << event
+            << (location.empty() ? "" : " at " + location)
+            << (probe.empty() ? "" : " in " + probe);
+    lost.sources.push_back({ .probe = std::move(probe),
+                             .event = std::move(event),
+                             .location = std::move(location),
+                             .count = delta,
+                             .rate = rate });
+  }
+
+  if (ringbuf_) {
+    if (auto *ring = ring_buffer__ring(ringbuf_, 0)) {
+      size_t ring_size = ring__size(ring);
+      if (ring_size > 0) {
+        lost.ring_occupancy = ring__avail_data_size(ring) * 100 / ring_size;
+        LOG(V1) << "Ring buffer occupancy: " << *lost.ring_occupancy << "%";
+      }
+    }
   }
+
+  out.lost_events(lost);
 }
 
 std::optional<std::string> BPFtrace::get_watchpoint_binary_path() const
@@ -1371,6 +1755,17 @@ std::string BPFtrace::resolve_usym(uint64_t addr, int32_t pid, int32_t probe_id)
   return syms.front();
 }
 
+void BPFtrace::snapshot_usym_mappings(int32_t pid)
+{
+  usyms_.snapshot(pid);
+}
+
+void BPFtrace::add_precomputed_symbols(const std::string &build_id,
+                                       std::shared_ptr<const ElfSymbols> symbols)
+{
+  usyms_.add_precomputed(build_id, std::move(symbols));
+}
+
 std::vector<std::string> BPFtrace::resolve_usym_stack(uint64_t addr,
                                                       int32_t pid,
                                                       int32_t probe_id,
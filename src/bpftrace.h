@@ -1,7 +1,9 @@
 #pragma once
 
 #include <bcc/bcc_syms.h>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <limits>
 #include <map>
 #include <memory>
@@ -38,8 +40,12 @@
 #include "util/proc.h"
 #include "util/result.h"
 
+struct ObjectUnwindInfo;
+
 namespace bpftrace {
 
+struct PerfEventContext;
+
 using util::Symbol;
 
 const int timeout_ms = 100;
@@ -132,6 +138,11 @@ public:
                         int indent = 0);
   std::string resolve_ksym(uint64_t addr);
   std::string resolve_usym(uint64_t addr, int32_t pid, int32_t probe_id);
+  void snapshot_usym_mappings(int32_t pid);
+  // Uses the given symbol table for objects with this build id, rather than
+  // reading their symbols.
+  void add_precomputed_symbols(const std::string &build_id,
+                               std::shared_ptr<const ElfSymbols> symbols);
   std::string resolve_inet(int af, const char *inet) const;
   std::string resolve_uid(uint64_t addr) const;
   std::chrono::time_point<std::chrono::system_clock> resolve_timestamp(
@@ -212,21 +223,53 @@ public:
   std::unordered_set<std::string> btf_set_;
   std::unique_ptr<util::ChildProc> child_;
   std::unique_ptr<util::Proc> procmon_;
+  // Filter on the target process and all of its descendants, using a pid set
+  // that follows forks, rather than on the single target pid.
+  bool pid_tree_ = false;
   std::vector<pid_t> dwarf_pids_;
+  // Unwind information for objects with these build ids, used instead of
+  // parsing the objects.
+  std::unordered_map<std::string, std::shared_ptr<const ObjectUnwindInfo>>
+      precomputed_unwind_;
   std::optional<pid_t> pid() const
   {
     if (procmon_) {
       return procmon_->pid();
     }
-    return std::nullopt;
+    return watch_target_.pid;
+  }
+  bool has_child() const
+  {
+    return child_ != nullptr || watch_target_.child;
   }
   int ncpus_;
   int max_cpu_id_;
   std::unique_ptr<Config> config_;
   bool run_tests_ = false;
   bool run_benchmarks_ = false;
+  bool profile_probes_ = false;
   std::string probe_filter_;
   std::string debuginfo_path_;
+  // State for --watch. `watch_` is called from the event loop and returns
+  // true once the next version of the script has been compiled (in the
+  // background), which stops the loop with the probes still attached. The
+  // next version then takes over from `previous_`: it reuses its maps where
+  // possible, attaches its own probes, activates its version (see
+  // CreateWatchFilterPass) and only then detaches the previous probes. Until
+  // then, it keeps reading the previous ring buffer.
+  std::function<bool()> watch_;
+  std::unique_ptr<BPFtrace> previous_;
+  // The version of the script, starting from 1. Zero without --watch.
+  uint64_t watch_version_ = 0;
+  // The target of the running version of the script, while the next version
+  // is compiled. `procmon_` and `child_` are only moved to the next version
+  // when it takes over, so that the running one can still notice the target
+  // exiting and terminate the child.
+  struct WatchTarget {
+    std::optional<pid_t> pid;
+    bool child = false;
+  };
+  WatchTarget watch_target_;
 
 private:
   Ksyms ksyms_;
@@ -252,7 +295,12 @@ private:
                                               bool show_debug_info);
   void teardown_output();
   void poll_output(output::Output &out, bool drain = false);
+  void drain_previous();
+  int activate_watch_version();
   void poll_event_loss(output::Output &out);
+  void enable_probe_stats();
+  int seed_pid_filter();
+  void poll_probe_stats(output::Output &out, bool total);
   static uint64_t read_address_from_output(std::string output);
   struct bcc_symbol_option &get_symbol_opts();
   Probe generate_probe(const ast::AttachPoint &ap,
@@ -260,9 +308,34 @@ private:
                        ast::ExpansionType expansion,
                        std::set<std::string> expanded_funcs);
   bool has_iter_ = false;
+  bool reloading_ = false;
+  // The context of the output callbacks, which outlives `run` when reloading
+  // so that the next version can drain the ring buffer. This is shared as the
+  // type is private to bpftrace.cpp.
+  std::shared_ptr<PerfEventContext> event_ctx_;
   struct ring_buffer *ringbuf_ = nullptr;
+  uint64_t ringbuf_wakeups_ = 0;
+  uint64_t ringbuf_timer_flushes_ = 0;
+  // The counts as of the last periodic probe stats report.
+  uint64_t ringbuf_wakeups_reported_ = 0;
+  uint64_t ringbuf_timer_flushes_reported_ = 0;
   struct perf_buffer *skb_perfbuf_ = nullptr;
-  uint64_t event_loss_count_ = 0;
+  // Last seen value of each event loss counter slot, and when the last
+  // report was made so that loss rates can be computed.
+  std::vector<uint64_t> event_loss_counts_;
+  std::chrono::steady_clock::time_point event_loss_report_time_;
+
+  // State for --profile-probes. The stats fd keeps BPF_ENABLE_STATS in effect
+  // for as long as it's open; the last seen stats are kept per program.
+  struct ProgRunStats {
+    uint64_t run_time_ns = 0;
+    uint64_t run_cnt = 0;
+    uint64_t recursion_misses = 0;
+  };
+  int probe_stats_fd_ = -1;
+  std::map<std::string, ProgRunStats> prog_run_stats_;
+  std::chrono::steady_clock::time_point probe_stats_start_;
+  std::chrono::steady_clock::time_point probe_stats_time_;
 
   std::unordered_map<std::string, std::unique_ptr<Dwarf>> dwarves_;
 };
@@ -23,14 +23,10 @@
 #include <bpf/libbpf.h>
 
 #include "arch/arch.h"
-#include "ast/context.h"
-#include "ast/pass_manager.h"
 #include "ast/passes/args_resolver.h"
-#include "ast/passes/attachpoint_passes.h"
 #include "bpftrace.h"
 #include "btf.h"
 #include "log.h"
-#include "probe_matcher.h"
 #include "symbols/kernel.h"
 #include "tracefs/tracefs.h"
 #include "types.h"
@@ -40,6 +36,20 @@ using namespace std::literals::string_view_literals;
 
 namespace bpftrace {
 
+// Defined here rather than with the args resolver pass, since BTF parsing is
+// also needed by the runtime, which doesn't link the passes.
+char ast::ArgParseError::ID;
+
+void ast::ArgParseError::log(llvm::raw_ostream &OS) const
+{
+  if (arg_name_.empty()) {
+    OS << "Could not parse arguments of \"" << probe_name_ << "\": " << detail_;
+  } else {
+    OS << "Could not parse argument \"" << arg_name_ << "\" of \""
+       << probe_name_ << "\": " << detail_;
+  }
+}
+
 static __u32 type_cnt(const struct btf *btf)
 {
   const auto count = btf__type_cnt(btf);
@@ -643,6 +653,95 @@ Result<std::shared_ptr<Struct>> BTF::resolve_raw_tracepoint_args(
       func, "BTF data for the tracepoint not found");
 }
 
+Result<std::shared_ptr<Struct>> BTF::resolve_tracepoint_args(
+    std::string_view category,
+    std::string_view event)
+{
+  std::string tracepoint = std::string(category) + ":" + std::string(event);
+  if (!has_data()) {
+    return make_error<ast::ArgParseError>(tracepoint, "BTF data not available");
+  }
+
+  // The syscall exit events all share the record of the syscalls subsystem,
+  // with `nr` shown as `__syscall_nr` in the format file. The enter events
+  // have per-syscall arguments which are not described in BTF.
+  bool syscall_exit = category == "syscalls" && event.starts_with("sys_exit_");
+  auto type_id = syscall_exit
+                     ? find_id("syscall_trace_exit", BTF_KIND_STRUCT)
+                     : find_id("trace_event_raw_" + std::string(event),
+                               BTF_KIND_STRUCT);
+  if (!type_id.btf) {
+    return make_error<ast::ArgParseError>(
+        tracepoint, "BTF data for the tracepoint not found");
+  }
+
+  auto result = std::make_shared<Struct>(0, false);
+  auto add_field = [&](std::string name, const BTFId &field_id, __u32 offset) {
+    Field field;
+    field.name = std::move(name);
+    field.offset = offset;
+    field.type = get_stype(field_id);
+    // As in the format file, tracepoint fields refer to kernel space unless
+    // they are explicitly tagged.
+    if (field.type.GetAS() == AddrSpace::none) {
+      field.type.SetAS(AddrSpace::kernel);
+    }
+    result->fields.push_back(std::move(field));
+  };
+
+  const auto *t = btf__type_by_id(type_id.btf, type_id.id);
+  const auto *members = btf_members(t);
+  for (__u16 i = 0; i < btf_vlen(t); i++) {
+    std::string name = btf_str(type_id.btf, members[i].name_off);
+    BTFId field_id{ .btf = type_id.btf, .id = members[i].type };
+    __u32 offset = btf_member_bit_offset(t, i) / 8;
+
+    if (btf_member_bitfield_size(t, i) != 0 || name.starts_with("__rel_loc_")) {
+      return make_error<ast::ArgParseError>(tracepoint,
+                                            "unsupported field " + name);
+    }
+
+    if (i == 0 && name == "ent") {
+      // The common fields, from struct trace_entry.
+      const auto *ent = btf__type_by_id(type_id.btf, members[i].type);
+      if (!ent || !btf_is_struct(ent)) {
+        return make_error<ast::ArgParseError>(tracepoint,
+                                              "unexpected trace entry type");
+      }
+      const auto *ent_members = btf_members(ent);
+      for (__u16 j = 0; j < btf_vlen(ent); j++) {
+        std::string ent_name = btf_str(type_id.btf, ent_members[j].name_off);
+        add_field("common_" + ent_name,
+                  BTFId{ .btf = type_id.btf, .id = ent_members[j].type },
+                  offset + (btf_member_bit_offset(ent, j) / 8));
+      }
+    } else if (name.starts_with("__data_loc_")) {
+      Field field;
+      field.name = name.substr("__data_loc_"sv.length());
+      field.offset = offset;
+      field.is_data_loc = true;
+      field.type = CreateInt64();
+      field.type.SetAS(AddrSpace::kernel);
+      result->fields.push_back(std::move(field));
+    } else if (name == "__data") {
+      // The variable length data which the __data_loc fields point into.
+      continue;
+    } else {
+      add_field(syscall_exit && name == "nr" ? "__syscall_nr" : name,
+                field_id,
+                offset);
+    }
+  }
+
+  if (result->fields.empty()) {
+    return make_error<ast::ArgParseError>(tracepoint, "no fields found");
+  }
+  result->is_tracepoint_args = true;
+  result->size = result->fields.back().offset +
+                 result->fields.back().type.GetSize();
+  return result;
+}
+
 std::string BTF::get_all_traceable_funcs_from_btf(
     const symbols::KernelInfo &kernel_func_info,
     const BTFObj &btf_obj) const
@@ -1294,6 +1393,94 @@ void BTF::resolve_fields(const BTFId &type_id,
   }
 }
 
+static std::optional<BTF::FieldLayout> find_field(const struct btf *btf,
+                                                 __u32 id,
+                                                 std::string_view field,
+                                                 __u32 start_bit_offset)
+{
+  const auto *btf_type = btf__type_by_id(btf, id);
+  if (!btf_type || !btf_is_composite(btf_type))
+    return std::nullopt;
+
+  const auto *members = btf_members(btf_type);
+  for (__u32 i = 0; i < btf_vlen(btf_type); i++) {
+    __u32 bit_offset = start_bit_offset + btf_member_bit_offset(btf_type, i);
+    std::string_view name = btf__name_by_offset(btf, members[i].name_off);
+    if (name.empty()) {
+      __s32 member_id = btf__resolve_type(btf, members[i].type);
+      if (member_id < 0)
+        continue;
+      if (auto layout = find_field(btf, member_id, field, bit_offset))
+        return layout;
+      continue;
+    }
+    if (name != field)
+      continue;
+
+    __s64 size = btf__resolve_size(btf, members[i].type);
+    if (size < 0)
+      return std::nullopt;
+    return BTF::FieldLayout{
+      .offset = bit_offset / 8,
+      .size = static_cast<uint64_t>(size),
+      .bitfield = btf_member_bitfield_size(btf_type, i) != 0 ||
+                  bit_offset % 8 != 0,
+    };
+  }
+  return std::nullopt;
+}
+
+std::optional<BTF::FieldLayout> BTF::vmlinux_field(std::string_view type_name,
+                                                   std::string_view field)
+{
+  if (!has_data())
+    return std::nullopt;
+
+  __u32 kind;
+  if (type_name.starts_with(STRUCT_PREFIX)) {
+    kind = BTF_KIND_STRUCT;
+  } else if (type_name.starts_with(UNION_PREFIX)) {
+    kind = BTF_KIND_UNION;
+  } else {
+    return std::nullopt;
+  }
+
+  auto name = std::string(btf_type_str(type_name));
+  __s32 id = btf__find_by_name_kind(vmlinux_btf, name.c_str(), kind);
+  if (id < 0)
+    return std::nullopt;
+  return find_field(vmlinux_btf, id, field, 0);
+}
+
+std::optional<uint64_t> BTF::vmlinux_type_size(std::string_view type_name)
+{
+  if (!has_data())
+    return std::nullopt;
+
+  __u32 kind;
+  if (type_name.starts_with(STRUCT_PREFIX)) {
+    kind = BTF_KIND_STRUCT;
+  } else if (type_name.starts_with(UNION_PREFIX)) {
+    kind = BTF_KIND_UNION;
+  } else {
+    kind = BTF_KIND_TYPEDEF;
+  }
+
+  auto name = std::string(btf_type_str(type_name));
+  __s32 id = btf__find_by_name_kind(vmlinux_btf, name.c_str(), kind);
+  if (id < 0)
+    return std::nullopt;
+  if (kind == BTF_KIND_TYPEDEF) {
+    id = btf__resolve_type(vmlinux_btf, id);
+    if (id < 0)
+      return std::nullopt;
+  }
+  const auto *btf_type = btf__type_by_id(vmlinux_btf, id);
+  if (!btf_type || !btf_is_composite(btf_type))
+    return std::nullopt;
+  return btf_type->size;
+}
+
 static char user_pointer[] = R"(__attribute__((btf_type_tag("user"))) *)";
 
 SizedType BTF::get_stype(std::string_view type_name)
@@ -1378,16 +1565,4 @@ SizedType BTF::get_var_type(std::string_view var_name)
   return get_stype(BTFId{ .btf = var_id.btf, .id = t->type });
 }
 
-ast::Pass CreateParseBTFPass()
-{
-  return ast::Pass::create(
-      "btf",
-      [](ast::ASTContext &ast, BPFtrace &b, ast::FunctionInfo &func_info) {
-        ProbeMatcher probe_matcher(&b,
-                                   func_info.kernel_info(),
-                                   func_info.user_info());
-        b.parse_module_btf(b.list_modules(ast, probe_matcher));
-      });
-}
-
 } // namespace bpftrace
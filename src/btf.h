@@ -12,7 +12,6 @@
 #include <unistd.h>
 #include <unordered_set>
 
-#include "ast/pass_manager.h"
 #include "symbols/kernel.h"
 #include "util/result.h"
 
@@ -118,12 +117,35 @@ public:
                                                bool skip_first_arg);
   Result<std::shared_ptr<Struct>> resolve_raw_tracepoint_args(
       std::string_view func);
+  // Builds the tracepoint argument struct, as described by the tracefs format
+  // file, from the `trace_event_raw_<event>` type instead. This type only
+  // exists for events that are their own event class; others need to fall
+  // back to the format file. BTF doesn't record the category of the event.
+  Result<std::shared_ptr<Struct>> resolve_tracepoint_args(
+      std::string_view category,
+      std::string_view event);
   void resolve_fields(const SizedType& type);
 
   int get_btf_id(std::string_view func,
                  std::string_view mod,
                  __u32 kind = BTF_KIND_FUNC) const;
 
+  struct FieldLayout {
+    uint64_t offset;
+    uint64_t size;
+    bool bitfield;
+  };
+
+  // Returns the layout of a field of a vmlinux struct or union (given as e.g.
+  // "struct task_struct"), looking through anonymous members. Returns nothing
+  // if the type or field doesn't exist.
+  std::optional<FieldLayout> vmlinux_field(std::string_view type_name,
+                                           std::string_view field);
+  // Returns the size of a vmlinux struct or union, given as e.g. "struct
+  // task_struct" or by a typedef name. Returns nothing if there's no such
+  // struct or union.
+  std::optional<uint64_t> vmlinux_type_size(std::string_view type_name);
+
 private:
   void load_vmlinux_btf();
   SizedType get_stype(const BTFId& btf_id, bool resolve_structs = true);
@@ -196,6 +218,4 @@ inline bool BTF::modules_loaded() const
   return state == VMLINUX_AND_MODULES_LOADED;
 }
 
-ast::Pass CreateParseBTFPass();
-
 } // namespace bpftrace
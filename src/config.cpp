@@ -305,8 +305,41 @@ AnyParser parser(T fn)
   };
 }
 
+// Like `parser`, for integer fields that may not exceed `max`.
+template <typename T>
+AnyParser bounded_parser(T fn, uint64_t max)
+{
+  auto check = [fn, max](const std::string &k,
+                         Config *c,
+                         uint64_t value) -> Result<OK> {
+    if (value > max) {
+      return make_error<ParseError>(k,
+                                    "expecting a number up to " +
+                                        std::to_string(max) + ", got " +
+                                        std::to_string(value));
+    }
+    *fn(c) = value;
+    return OK();
+  };
+  return AnyParser{
+    .integer = check,
+    .string = [check](const std::string &k,
+                      Config *c,
+                      const std::string &s) -> Result<OK> {
+      uint64_t value = 0;
+      auto ok = ConfigParser<uint64_t>().parse(k, &value, s);
+      if (!ok) {
+        return ok.takeError();
+      }
+      return check(k, c, value);
+    },
+  };
+}
+
 // This map construsts all the different parsers.
 #define CONFIG_FIELD_PARSER(x) parser([](Config *config) { return &config->x; })
+#define CONFIG_BOUNDED_PARSER(x, max)                                          \
+  bounded_parser([](Config *config) { return &config->x; }, max)
 const std::map<std::string, AnyParser> CONFIG_KEY_MAP = {
   { "cache_user_symbols", CONFIG_FIELD_PARSER(user_symbol_cache_type) },
   { "cpp_demangle", CONFIG_FIELD_PARSER(cpp_demangle) },
@@ -318,14 +351,19 @@ const std::map<std::string, AnyParser> CONFIG_KEY_MAP = {
   { "max_map_keys", CONFIG_FIELD_PARSER(max_map_keys) },
   { "max_probes", CONFIG_FIELD_PARSER(max_probes) },
   { "max_strlen", CONFIG_FIELD_PARSER(max_strlen) },
+  { "max_user_symbol_cache_bytes",
+    CONFIG_FIELD_PARSER(max_user_symbol_cache_bytes) },
   { "on_stack_limit", CONFIG_FIELD_PARSER(on_stack_limit) },
   { "perf_rb_pages", CONFIG_FIELD_PARSER(perf_rb_pages) },
+  { "ringbuf_wakeup_threshold",
+    CONFIG_BOUNDED_PARSER(ringbuf_wakeup_threshold, 100) },
   { "stack_mode", CONFIG_FIELD_PARSER(stack_mode) },
   { "str_trunc_trailer", CONFIG_FIELD_PARSER(str_trunc_trailer) },
   { "missing_probes", CONFIG_FIELD_PARSER(missing_probes) },
   { "print_maps_on_exit", CONFIG_FIELD_PARSER(print_maps_on_exit) },
   { "use_blazesym", CONFIG_FIELD_PARSER(use_blazesym) },
   { "show_debug_info", CONFIG_FIELD_PARSER(show_debug_info) },
+  { "snapshot_user_mappings", CONFIG_FIELD_PARSER(snapshot_user_mappings) },
   { UNSTABLE_IMPORT_STATEMENT, CONFIG_FIELD_PARSER(unstable_import_statement) },
   { UNSTABLE_TSERIES, CONFIG_FIELD_PARSER(unstable_tseries) },
   { UNSTABLE_TYPEINFO, CONFIG_FIELD_PARSER(unstable_typeinfo) },
@@ -389,7 +427,11 @@ Result<OK> Config::set(const std::string &original_key, const std::string &val)
   if (!parser) {
     return parser.takeError();
   }
-  return parser->string(original_key, this, val);
+  auto ok = parser->string(original_key, this, val);
+  if (ok) {
+    set_keys_.insert(restore(original_key));
+  }
+  return ok;
 }
 
 Result<OK> Config::set(const std::string &original_key, uint64_t val)
@@ -398,7 +440,16 @@ Result<OK> Config::set(const std::string &original_key, uint64_t val)
   if (!parser) {
     return parser.takeError();
   }
-  return parser->integer(original_key, this, val);
+  auto ok = parser->integer(original_key, this, val);
+  if (ok) {
+    set_keys_.insert(restore(original_key));
+  }
+  return ok;
+}
+
+bool Config::is_set(const std::string &original_key) const
+{
+  return set_keys_.contains(restore(original_key));
 }
 
 bool Config::is_unstable(const std::string &original_key)
@@ -413,21 +464,27 @@ Result<OK> Config::load_environment()
   // Scan all known keys by their environment variable name, and if it is
   // present then set from the environment value.
   for (const auto &[key, _] : CONFIG_KEY_MAP) {
-    std::string env = ENV_PREFIX + key;
-    std::ranges::transform(env, env.begin(), [](unsigned char c) {
-      return std::toupper(c);
-    });
-    const auto *cenv = getenv(env.c_str());
-    if (cenv) {
-      auto ok = set(key, std::string(cenv));
-      if (!ok) {
-        return ok.takeError();
-      }
+    auto ok = load_environment(key);
+    if (!ok) {
+      return ok.takeError();
     }
   }
   return OK();
 }
 
+Result<OK> Config::load_environment(const std::string &key)
+{
+  std::string env = ENV_PREFIX + key;
+  std::ranges::transform(env, env.begin(), [](unsigned char c) {
+    return std::toupper(c);
+  });
+  const auto *cenv = getenv(env.c_str());
+  if (cenv) {
+    return set(key, std::string(cenv));
+  }
+  return OK();
+}
+
 std::string Config::get_license_str(CompatibleBPFLicense license)
 {
   for (const auto &[k, v] : BPF_LICENSE_STR) {
@@ -54,6 +54,10 @@ public:
   // Helpers for analysis of variables.
   bool is_unstable(const std::string &key);
   Result<OK> load_environment();
+  // Loads a single key from the environment, if it is set there.
+  Result<OK> load_environment(const std::string &key);
+  // Whether the key has been set, rather than left at its default.
+  bool is_set(const std::string &key) const;
 
   static std::string get_license_str(CompatibleBPFLicense license);
 
@@ -61,6 +65,7 @@ public:
   bool cpp_demangle = true;
   bool lazy_symbolication = true;
   bool print_maps_on_exit = true;
+  bool snapshot_user_mappings = false;
   ConfigUnstable unstable_import_statement = ConfigUnstable::error;
   ConfigUnstable unstable_tseries = ConfigUnstable::warn;
   ConfigUnstable unstable_typeinfo = ConfigUnstable::error;
@@ -78,8 +83,10 @@ public:
   uint64_t max_map_keys = 4096;
   uint64_t max_probes = 1024;
   uint64_t max_strlen = 1024;
+  uint64_t max_user_symbol_cache_bytes = 128 << 20;
   uint64_t on_stack_limit = 32;
   uint64_t perf_rb_pages = 0; // See get_buffer_pages
+  uint64_t ringbuf_wakeup_threshold = 0;
   CompatibleBPFLicense license = CompatibleBPFLicense::GPL;
   std::string str_trunc_trailer = "..";
   ConfigMissingProbes missing_probes = ConfigMissingProbes::error;
@@ -89,6 +96,9 @@ public:
   UserSymbolCacheType user_symbol_cache_type;
 
   uint64_t pad_max_strlen() const;
+
+private:
+  std::unordered_set<std::string> set_keys_;
 };
 
 // Specific key has been renamed, must be handled by caller. This may be
@@ -283,17 +283,17 @@ invalid_expression:
   return std::make_optional<std::string>("invalid expression");
 }
 
-std::optional<uint32_t> DWARFUnwind::add_expression(llvm::DWARFExpression &expr)
+std::optional<uint32_t> DWARFUnwind::add_expression(
+    llvm::DWARFExpression &expr,
+    std::map<std::vector<uint8_t>, uint32_t> &ids,
+    ObjectUnwindInfo &out)
 {
   auto expr_bytes = expr.getData();
   auto expr_u8 = std::vector<uint8_t>(expr_bytes.begin(), expr_bytes.end());
-  auto it = expressions_.find(expr_u8);
-  if (it != expressions_.end())
+  auto it = ids.find(expr_u8);
+  if (it != ids.end())
     return it->second;
 
-  uint32_t id = expressions_.size();
-  expressions_[expr_u8] = id;
-
   //
   // preprocess expression to simplify bpf code
   // mainly we expand all arguments to 64 bits (registers to 8 bits)
@@ -308,8 +308,9 @@ std::optional<uint32_t> DWARFUnwind::add_expression(llvm::DWARFExpression &expr)
   }
   expr_out.resize(256, 0);
 
-  if (table_feed_cb_(TableType::Expressions, id, expr_out))
-    return std::nullopt;
+  uint32_t id = out.expressions.size();
+  ids[expr_u8] = id;
+  out.expressions.emplace_back(std::move(expr_out));
 
   return id;
 }
@@ -342,7 +343,7 @@ std::string DWARFUnwind::file_cache_key(const std::string &filename, int pid)
     if (obj) {
       auto build_id = llvm::object::getBuildID(obj);
       if (!build_id.empty()) {
-        return "buildid:" + llvm::toHex(build_id);
+        return "buildid:" + llvm::toHex(build_id, /*LowerCase=*/true);
       }
     }
   } else {
@@ -372,7 +373,16 @@ DWARFError DWARFUnwind::add_file_nopush(const std::string &filename,
     return DWARFError::Success;
   }
 
-  DWARFError err = add_new_file(filename, pid, out_oid);
+  DWARFError err;
+  auto pre = precomputed_.find(key);
+  if (pre != precomputed_.end()) {
+    LOG(V1) << "Using precomputed unwind information for " << filename;
+    err = next_object_id(out_oid);
+    if (err == DWARFError::Success)
+      err = add_unwind_info(out_oid, *pre->second);
+  } else {
+    err = add_new_file(filename, pid, out_oid);
+  }
   if (err != DWARFError::Success) {
     files_seen_[key] = std::nullopt;
   } else {
@@ -399,9 +409,13 @@ void build_map_offsets(const llvm::object::ELFObjectFile<ELFT> *Obj,
   }
 }
 
-DWARFError DWARFUnwind::add_new_file(const std::string &filename,
-                                     int pid,
-                                     uint32_t &out_oid)
+void DWARFUnwind::add_precomputed(const std::string &build_id,
+                                  std::shared_ptr<const ObjectUnwindInfo> info)
+{
+  precomputed_["buildid:" + build_id] = std::move(info);
+}
+
+DWARFError DWARFUnwind::next_object_id(uint32_t &out_oid)
 {
   auto oid = next_oid_;
   if (oid == UINT16_MAX) {
@@ -416,13 +430,17 @@ DWARFError DWARFUnwind::add_new_file(const std::string &filename,
   }
   ++next_oid_;
   out_oid = oid;
+  return DWARFError::Success;
+}
 
-  auto fn = resolve_path(filename, pid);
-
-  LOG(V1) << "Adding file " << fn << " with OID " << oid;
-  auto ExpectedBinary = llvm::object::createBinary(fn);
+DWARFError DWARFUnwind::parse_object_file(const std::string &filename,
+                                          ObjectUnwindInfo &out)
+{
+  auto ExpectedBinary = llvm::object::createBinary(filename);
   if (!ExpectedBinary) {
-    LOG(ERROR) << "Cannot open " << fn << " to extract stack walk information";
+    llvm::consumeError(ExpectedBinary.takeError());
+    LOG(ERROR) << "Cannot open " << filename
+               << " to extract stack walk information";
     return DWARFError::FileNotFound;
   }
 
@@ -448,7 +466,26 @@ DWARFError DWARFUnwind::add_new_file(const std::string &filename,
     return DWARFError::UnsupportedFormat;
   }
 
-  return read_eh_frame(fn, oid, map_offsets);
+  return read_eh_frame(*Obj, filename, map_offsets, out);
+}
+
+DWARFError DWARFUnwind::add_new_file(const std::string &filename,
+                                     int pid,
+                                     uint32_t &out_oid)
+{
+  auto fn = resolve_path(filename, pid);
+
+  ObjectUnwindInfo info;
+  auto err = parse_object_file(fn, info);
+  if (err != DWARFError::Success)
+    return err;
+
+  err = next_object_id(out_oid);
+  if (err != DWARFError::Success)
+    return err;
+
+  LOG(V1) << "Adding file " << fn << " with OID " << out_oid;
+  return add_unwind_info(out_oid, info);
 }
 
 #if LLVM_VERSION_MAJOR >= 21
@@ -474,22 +511,132 @@ DWARFError DWARFUnwind::push_current_table()
   return DWARFError::Success;
 }
 
+static uint64_t get_le(const std::vector<uint8_t> &buf, size_t pos, size_t size)
+{
+  uint64_t v = 0;
+  for (size_t j = 0; j < size; ++j) {
+    v |= static_cast<uint64_t>(buf[pos + j]) << (j * 8);
+  }
+  return v;
+}
+
+static void set_le(std::vector<uint8_t> &buf,
+                   size_t pos,
+                   size_t size,
+                   uint64_t val)
+{
+  for (size_t j = 0; j < size; ++j) {
+    buf[pos + j] = static_cast<uint8_t>((val >> (j * 8)) & 0xff);
+  }
+}
+
+// Rewrites the expression ids in a CFT entry (laid out as in read_eh_frame:
+// args size, CFA rule, then one rule per register) from local to global ids.
+static bool remap_expressions(std::vector<uint8_t> &entry,
+                              const std::vector<uint32_t> &ids)
+{
+  if (entry.size() != CFT_ENTRY_SIZE)
+    return false;
+
+  auto remap = [&](size_t pos, size_t size) {
+    auto id = get_le(entry, pos, size);
+    if (id >= ids.size())
+      return false;
+    set_le(entry, pos, size, ids[id]);
+    return true;
+  };
+
+  // CFA: u32 type, u32 register or expression, u64 offset
+  if (get_le(entry, 8, 4) == 2 && !remap(12, 4))
+    return false;
+
+  // registers: u32 type, u64 value
+  for (size_t reg = 0; reg < NUM_REGISTERS; reg++) {
+    size_t pos = 24 + (reg * 12);
+    auto type = get_le(entry, pos, 4);
+    if ((type == 6 || type == 7) && !remap(pos + 4, 8))
+      return false;
+  }
+  return true;
+}
+
+DWARFError DWARFUnwind::add_unwind_info(uint32_t oid,
+                                        const ObjectUnwindInfo &info)
+{
+  std::vector<uint32_t> expr_ids;
+  expr_ids.reserve(info.expressions.size());
+  for (const auto &expr : info.expressions) {
+    auto [it, inserted] = expressions_.emplace(expr, expressions_.size());
+    if (inserted && table_feed_cb_(TableType::Expressions, it->second, expr))
+      return DWARFError::InternalError;
+    expr_ids.push_back(it->second);
+  }
+
+  std::vector<uint32_t> entry_ids = { 0 };
+  entry_ids.reserve(info.entries.size() + 1);
+  for (auto entry : info.entries) {
+    if (!remap_expressions(entry, expr_ids)) {
+      LOG(V1) << "Invalid unwind entry for OID " << oid;
+      return DWARFError::ParseError;
+    }
+    // reserve 0 for no entry
+    auto [it, inserted] = entries_.emplace(entry, entries_.size() + 1);
+    if (inserted && table_feed_cb_(TableType::UnwindEntries, it->second, entry))
+      return DWARFError::InternalError;
+    entry_ids.push_back(it->second);
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> table_entries;
+  table_entries.reserve(info.rows.size());
+  for (const auto &[offset, id] : info.rows) {
+    if (id >= entry_ids.size()) {
+      LOG(V1) << "Invalid unwind row for OID " << oid;
+      return DWARFError::ParseError;
+    }
+    table_entries.emplace_back(offset, entry_ids[id]);
+  }
+
+  size_t start = 0;
+  while (start < table_entries.size()) {
+    size_t out_entries = 0;
+    auto sz = CHUNK_SIZE - current_table_.size() - 16;
+    auto table_data = dwunwind_build_table(
+        table_entries, start, sz, out_entries);
+    LOG(V1) << "Built table chunk with " << out_entries << " entries, size "
+            << table_data.size() << " bytes.";
+    auto e = table_mappings_.emplace(oid, std::vector<TableMapping>{});
+    e.first->second.push_back(
+        TableMapping{ .file_offset = table_entries[start].first,
+                      .table_id = current_table_id_,
+                      .table_offset = current_table_.size() });
+    if (current_table_.empty()) {
+      swap(current_table_, table_data);
+    } else {
+      current_table_.insert(current_table_.end(),
+                            table_data.begin(),
+                            table_data.end());
+    }
+    if (current_table_.size() >= CHUNK_SIZE - 200) {
+      auto push_ret = push_current_table();
+      if (push_ret != DWARFError::Success)
+        return push_ret;
+      current_table_.clear();
+      ++current_table_id_;
+    }
+    start += out_entries;
+  }
+
+  return DWARFError::Success;
+}
+
 DWARFError DWARFUnwind::read_eh_frame(
+    const llvm::object::ObjectFile &obj,
     const std::string &filename,
-    uint32_t oid,
-    const std::map<uint64_t, uint64_t> &map_offsets)
+    const std::map<uint64_t, uint64_t> &map_offsets,
+    ObjectUnwindInfo &out)
 {
 #if LLVM_VERSION_MAJOR >= 21
-  auto ExpectedBinary = llvm::object::createBinary(filename);
-  if (!ExpectedBinary)
-    return DWARFError::FileNotFound;
-
-  auto *Bin = ExpectedBinary.get().getBinary();
-  auto *Obj = llvm::dyn_cast<llvm::object::ObjectFile>(Bin);
-  if (!Obj)
-    return DWARFError::UnsupportedFormat;
-
-  auto DICtx = llvm::DWARFContext::create(*Obj);
+  auto DICtx = llvm::DWARFContext::create(obj);
   llvm::Expected<const llvm::DWARFDebugFrame *> FrameOrErr = nullptr;
 
   if (!DICtx->getDWARFObj().getEHFrameSection().Data.empty()) {
@@ -510,6 +657,8 @@ DWARFError DWARFUnwind::read_eh_frame(
   int fdeCount = 0;
   int rowCount = 0;
   std::map<uint64_t, uint32_t> rows;
+  std::map<std::vector<uint8_t>, uint32_t> expr_ids;
+  std::map<std::vector<uint8_t>, uint32_t> entry_ids;
 
   std::vector<uint8_t> s;
   s.reserve(CFT_ENTRY_SIZE);
@@ -575,7 +724,7 @@ DWARFError DWARFUnwind::read_eh_frame(
               LOG(V1) << "Missing DWARF expression bytes for CFA.";
               return DWARFError::ParseError;
             }
-            auto expr_id = add_expression(expr_opt.value());
+            auto expr_id = add_expression(expr_opt.value(), expr_ids, out);
             if (!expr_id.has_value()) {
               return DWARFError::ParseError;
             }
@@ -639,7 +788,7 @@ DWARFError DWARFUnwind::read_eh_frame(
                 LOG(V1) << "Missing DWARF expression bytes for register.";
                 continue;
               }
-              auto expr_id = add_expression(expr_opt.value());
+              auto expr_id = add_expression(expr_opt.value(), expr_ids, out);
               if (!expr_id.has_value()) {
                 return DWARFError::ParseError;
               }
@@ -677,16 +826,14 @@ DWARFError DWARFUnwind::read_eh_frame(
           return DWARFError::InternalError;
         }
 
-        auto it = entries_.find(s);
+        auto it = entry_ids.find(s);
         uint32_t id;
-        if (it != entries_.end()) {
+        if (it != entry_ids.end()) {
           id = it->second;
         } else {
-          id = entries_.size() + 1; // reserve 0 for no entry
-          entries_[s] = id;
-
-          if (table_feed_cb_(TableType::UnwindEntries, id, s))
-            return DWARFError::InternalError;
+          id = entry_ids.size() + 1; // reserve 0 for no entry
+          entry_ids[s] = id;
+          out.entries.push_back(s);
         }
 
         auto start = row.getAddress() - map_offset;
@@ -718,49 +865,17 @@ DWARFError DWARFUnwind::read_eh_frame(
 
   LOG(V1) << "Summary: Found " << fdeCount << " FDEs and " << rowCount
           << " rows.";
-  LOG(V1) << "expressions: " << expressions_.size()
-          << ", entries: " << entries_.size() << ", rows: " << rows.size();
-
-  std::vector<std::pair<uint64_t, uint64_t>> table_entries;
-  for (const auto &row : rows) {
-    table_entries.emplace_back(row.first, row.second);
-  }
-  size_t start = 0;
-  while (start < table_entries.size()) {
-    size_t out_entries = 0;
-    auto sz = CHUNK_SIZE - current_table_.size() - 16;
-    auto table_data = dwunwind_build_table(
-        table_entries, start, sz, out_entries);
-    LOG(V1) << "Built table chunk with " << out_entries << " entries, size "
-            << table_data.size() << " bytes.";
-    auto e = table_mappings_.emplace(oid, std::vector<TableMapping>{});
-    e.first->second.push_back(
-        TableMapping{ .file_offset = table_entries[start].first,
-                      .table_id = current_table_id_,
-                      .table_offset = current_table_.size() });
-    if (current_table_.empty()) {
-      swap(current_table_, table_data);
-    } else {
-      current_table_.insert(current_table_.end(),
-                            table_data.begin(),
-                            table_data.end());
-    }
-    if (current_table_.size() >= CHUNK_SIZE - 200) {
-      auto push_ret = push_current_table();
-      if (push_ret != DWARFError::Success)
-        return push_ret;
-      current_table_.clear();
-      ++current_table_id_;
-    }
-    start += out_entries;
-  }
+  LOG(V1) << "expressions: " << out.expressions.size()
+          << ", entries: " << out.entries.size() << ", rows: " << rows.size();
 
+  out.rows.assign(rows.begin(), rows.end());
   return DWARFError::Success;
 #else
   // avoid unused parameter warnings when DWARF_UNWIND is not defined
+  (void)obj;
   (void)filename;
-  (void)oid;
   (void)map_offsets;
+  (void)out;
   return DWARFError::UnsupportedFormat;
 #endif
 }
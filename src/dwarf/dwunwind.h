@@ -2,12 +2,14 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "llvm/DebugInfo/DWARF/DWARFDebugFrame.h"
+#include "llvm/Object/ObjectFile.h"
 
 #define DWUNWIND_MAPPINGS "dwunwind_mappings"
 #define DWUNWIND_OFFSETMAPS "dwunwind_offsetmaps"
@@ -30,6 +32,25 @@ struct TableMapping {
   uint64_t table_offset;
 };
 
+// The unwind information of a single object, as parsed from its .eh_frame (or
+// .debug_frame). Ids are local to the object: they are mapped to global ids
+// when the object is added, so that the information can be computed once and
+// reused, e.g. embedded in AOT binaries.
+struct ObjectUnwindInfo {
+  // Expressions, as fed to the BPF program, by id.
+  std::vector<std::vector<uint8_t>> expressions;
+  // CFT entries by id, starting at 1 since 0 means no entry.
+  std::vector<std::vector<uint8_t>> entries;
+  // File offsets and the id of the entry that applies from there on, sorted.
+  std::vector<std::pair<uint64_t, uint32_t>> rows;
+
+  template <typename Archive>
+  void serialize(Archive &archive)
+  {
+    archive(expressions, entries, rows);
+  }
+};
+
 enum class TableType {
   UnwindTable,
   UnwindEntries,
@@ -50,18 +71,33 @@ public:
   DWARFError add_object_file(const std::string &filename);
   DWARFError add_pid(pid_t pid);
 
+  // Uses the given information for objects with this build id (in lower case
+  // hex) instead of parsing them.
+  void add_precomputed(const std::string &build_id,
+                       std::shared_ptr<const ObjectUnwindInfo> info);
+
+  static DWARFError parse_object_file(const std::string &filename,
+                                      ObjectUnwindInfo &out);
+
 private:
-  std::optional<uint32_t> add_expression(llvm::DWARFExpression &expr);
+  static std::optional<uint32_t> add_expression(
+      llvm::DWARFExpression &expr,
+      std::map<std::vector<uint8_t>, uint32_t> &ids,
+      ObjectUnwindInfo &out);
+  DWARFError next_object_id(uint32_t &out_oid);
   DWARFError add_new_file(const std::string &filename,
                           int pid,
                           uint32_t &out_oid);
   DWARFError add_file_nopush(const std::string &filename,
                              int pid,
                              uint32_t &out_oid);
+  DWARFError add_unwind_info(uint32_t oid, const ObjectUnwindInfo &info);
   DWARFError push_current_table();
-  DWARFError read_eh_frame(const std::string &filename,
-                           uint32_t oid,
-                           const std::map<uint64_t, uint64_t> &map_offsets);
+  static DWARFError read_eh_frame(
+      const llvm::object::ObjectFile &obj,
+      const std::string &filename,
+      const std::map<uint64_t, uint64_t> &map_offsets,
+      ObjectUnwindInfo &out);
   static std::string resolve_path(const std::string &filename, int pid);
   std::string file_cache_key(const std::string &filename, int pid);
 
@@ -74,4 +110,7 @@ private:
   std::unordered_map<std::string, uint32_t> tables_;
   std::vector<uint8_t> current_table_;
   std::unordered_map<std::string, std::optional<uint32_t>> files_seen_;
+  // Precomputed information by file cache key.
+  std::unordered_map<std::string, std::shared_ptr<const ObjectUnwindInfo>>
+      precomputed_;
 };
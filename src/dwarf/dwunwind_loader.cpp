@@ -15,6 +15,9 @@ namespace bpftrace {
 int parse_dwarf_unwind(
     BpfBytecode &bytecode,
     const std::vector<pid_t> &pids,
+    const std::unordered_map<std::string,
+                             std::shared_ptr<const ObjectUnwindInfo>>
+        &precomputed,
     std::map<TableType, std::vector<std::vector<uint8_t>>> &unwind_data,
     std::map<uint32_t, std::vector<uint8_t>> &unwind_mappings)
 {
@@ -41,6 +44,9 @@ int parse_dwarf_unwind(
         }
         return 0;
       });
+  for (const auto &[build_id, info] : precomputed) {
+    unwind.add_precomputed(build_id, info);
+  }
   for (const auto &pid : pids) {
     auto ret = unwind.add_pid(pid);
     if (ret != DWARFError::Success) {
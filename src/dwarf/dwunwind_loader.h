@@ -2,6 +2,9 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "bpfbytecode.h"
@@ -12,6 +15,9 @@ namespace bpftrace {
 int parse_dwarf_unwind(
     BpfBytecode &bytecode,
     const std::vector<pid_t> &pids,
+    const std::unordered_map<std::string,
+                             std::shared_ptr<const ObjectUnwindInfo>>
+        &precomputed,
     std::map<TableType, std::vector<std::vector<uint8_t>>> &unwind_data,
     std::map<uint32_t, std::vector<uint8_t>> &unwind_mappings);
 
@@ -65,6 +65,11 @@ public:
     return fmt_;
   }
 
+  bool operator==(const FormatString &other) const
+  {
+    return fmt_ == other.fmt_;
+  }
+
   // These may be used by callers to do manual validation. The fragments must be
   // exactly one element larger than the specs, and the sequence that is
   // constructed is: (fragment, spec, fragment, ..., spec, fragment).
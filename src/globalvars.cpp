@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <bpf/bpf.h>
 #include <bpf/btf.h>
 #include <elf.h>
@@ -221,12 +222,6 @@ SizedType GlobalVars::get_sized_type(const std::string &global_var_name,
 {
   const auto &config = get_config(global_var_name);
 
-  if (global_var_name == FMT_STRINGS_BUFFER) {
-    assert(resources.max_fmtstring_args_size > 0);
-    return make_rw_type(
-        1, CreateArray(resources.max_fmtstring_args_size, CreateInt8()));
-  }
-
   if (global_var_name == ANON_STRUCT_BUFFER) {
     assert(resources.max_anon_struct_size > 0);
     assert(resources.anon_struct_buffers > 0);
@@ -279,12 +274,9 @@ SizedType GlobalVars::get_sized_type(const std::string &global_var_name,
   }
 
   if (global_var_name == EVENT_LOSS_COUNTER) {
-    return make_rw_type(1, CreateUInt64());
-  }
-
-  if (global_var_name == JOIN_BUFFER) {
-    return make_rw_type(1,
-                        CreateArray(resources.join_value_size, CreateInt8()));
+    // Slot 0 is always present, even if no output calls were registered.
+    auto slots = std::max<size_t>(resources.event_loss_sources.size(), 1);
+    return make_rw_type(slots, CreateUInt64());
   }
 
   if (!config.type) {
@@ -321,6 +313,8 @@ void GlobalVars::check_index(const std::string &global_var_name,
     assert(index < resources.variable_buffers);
   } else if (global_var_name == MAP_KEY_BUFFER) {
     assert(index < resources.map_key_buffers);
+  } else if (global_var_name == EVENT_LOSS_COUNTER) {
+    assert(index == 0 || index < resources.event_loss_sources.size());
   }
 }
 
@@ -363,6 +357,19 @@ void GlobalVars::add_named_param(const std::string &name,
   });
 }
 
+std::string GlobalVars::add_field_offset()
+{
+  size_t count = std::ranges::count_if(added_global_vars_, [](const auto &var) {
+    return var.first.starts_with(FIELD_OFFSET_PREFIX);
+  });
+  auto name = std::string(FIELD_OFFSET_PREFIX) + std::to_string(count);
+  added_global_vars_[name] = GlobalVarConfig({
+      .section = std::string(RO_SECTION_NAME),
+      .type = GlobalVarConfig::opt_unsigned,
+  });
+  return name;
+}
+
 const GlobalVarConfig &GlobalVars::get_config(const std::string &name) const
 {
   auto it = added_global_vars_.find(name);
@@ -534,7 +541,8 @@ void GlobalVars::update_global_vars(
     GlobalVarMap &&global_var_vals,
     uint64_t ncpus,
     uint64_t max_cpu_id,
-    std::optional<pid_t> child_pid)
+    std::optional<pid_t> child_pid,
+    std::optional<pid_t> filter_pid)
 {
   global_var_vals[std::string(globalvars::NUM_CPUS)] = ncpus;
   global_var_vals[std::string(globalvars::MAX_CPU_ID)] = max_cpu_id;
@@ -545,6 +553,9 @@ void GlobalVars::update_global_vars(
     uint64_t empty_value = 0;
     global_var_vals[std::string(globalvars::CHILD_PID)] = empty_value;
   }
+  // Zero disables the filter, as there is no process with pid 0.
+  global_var_vals[std::string(globalvars::FILTER_PID)] = static_cast<uint64_t>(
+      filter_pid.value_or(0));
 
   verify_maps_found(section_name_to_global_vars_map);
   for (const auto &[section_name, global_vars_map] :
@@ -123,7 +123,6 @@ private:
 // Known global variables
 constexpr std::string_view NUM_CPUS = "__bt__num_cpus";
 constexpr std::string_view MAX_CPU_ID = "__bt__max_cpu_id";
-constexpr std::string_view FMT_STRINGS_BUFFER = "__bt__fmt_str_buf";
 constexpr std::string_view ANON_STRUCT_BUFFER = "__bt__anon_struct_buf";
 constexpr std::string_view CALL_STACK_BUFFER = "__bt__call_stack_buf";
 constexpr std::string_view GET_STR_BUFFER = "__bt__get_str_buf";
@@ -132,13 +131,13 @@ constexpr std::string_view WRITE_MAP_VALUE_BUFFER = "__bt__write_map_val_buf";
 constexpr std::string_view VARIABLE_BUFFER = "__bt__var_buf";
 constexpr std::string_view MAP_KEY_BUFFER = "__bt__map_key_buf";
 constexpr std::string_view EVENT_LOSS_COUNTER = "__bt__event_loss_counter";
-constexpr std::string_view JOIN_BUFFER = "__bt__join_buf";
 constexpr std::string_view CHILD_PID = "__bt__child_pid";
+constexpr std::string_view FILTER_PID = "__bt__filter_pid";
+// Prefix of the globals holding relocated field offsets, see FieldRelocation
+constexpr std::string_view FIELD_OFFSET_PREFIX = "__bt__field_offset_";
 
 // Section names
 constexpr std::string_view RO_SECTION_NAME = ".rodata";
-constexpr std::string_view FMT_STRINGS_BUFFER_SECTION_NAME =
-    ".data.fmt_str_buf";
 constexpr std::string_view ANON_STRUCT_BUFFER_SECTION_NAME =
     ".data.anon_struct_buf";
 constexpr std::string_view CALL_STACK_BUFFER_SECTION_NAME =
@@ -152,7 +151,6 @@ constexpr std::string_view VARIABLE_BUFFER_SECTION_NAME = ".data.var_buf";
 constexpr std::string_view MAP_KEY_BUFFER_SECTION_NAME = ".data.map_key_buf";
 constexpr std::string_view EVENT_LOSS_COUNTER_SECTION_NAME =
     ".data.event_loss_counter";
-constexpr std::string_view JOIN_BUFFER_SECTION_NAME = ".data.join_buf";
 
 struct GlobalVarConfig {
   std::string section;
@@ -184,8 +182,6 @@ const std::unordered_map<std::string_view, GlobalVarConfig>
       { EVENT_LOSS_COUNTER,
         { .section = std::string(EVENT_LOSS_COUNTER_SECTION_NAME),
           .type = GlobalVarConfig::opt_unsigned } },
-      { FMT_STRINGS_BUFFER,
-        { .section = std::string(FMT_STRINGS_BUFFER_SECTION_NAME) } },
       { ANON_STRUCT_BUFFER,
         { .section = std::string(ANON_STRUCT_BUFFER_SECTION_NAME) } },
       { CALL_STACK_BUFFER,
@@ -200,10 +196,12 @@ const std::unordered_map<std::string_view, GlobalVarConfig>
         { .section = std::string(VARIABLE_BUFFER_SECTION_NAME) } },
       { MAP_KEY_BUFFER,
         { .section = std::string(MAP_KEY_BUFFER_SECTION_NAME) } },
-      { JOIN_BUFFER, { .section = std::string(JOIN_BUFFER_SECTION_NAME) } },
       { CHILD_PID,
         { .section = std::string(RO_SECTION_NAME),
           .type = GlobalVarConfig::opt_unsigned } },
+      { FILTER_PID,
+        { .section = std::string(RO_SECTION_NAME),
+          .type = GlobalVarConfig::opt_unsigned } },
     };
 
 class GlobalVars {
@@ -220,6 +218,9 @@ public:
   void add_named_param(const std::string &name,
                        const GlobalVarValue &default_value,
                        const std::string &description);
+  // Adds a global holding the offset of a relocated field, and returns its
+  // name.
+  std::string add_field_offset();
   Result<GlobalVarMap> get_named_param_vals(
       std::vector<std::string> raw_named_params) const;
   const GlobalVarConfig &get_config(const std::string &name) const;
@@ -241,7 +242,8 @@ public:
       GlobalVarMap &&global_var_vals,
       uint64_t ncpus,
       uint64_t max_cpu_id,
-      std::optional<pid_t> child_pid);
+      std::optional<pid_t> child_pid,
+      std::optional<pid_t> filter_pid);
 
   std::unordered_set<std::string> get_global_vars_for_section(
       std::string_view target_section);
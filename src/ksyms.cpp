@@ -1,7 +1,8 @@
-#include <bcc/bcc_syms.h>
+#include <algorithm>
 #include <sstream>
 
 #include "ksyms.h"
+#include "log.h"
 #include "scopeguard.h"
 
 namespace {
@@ -63,28 +64,49 @@ Ksyms::Ksyms(const Config &config) : config_(config)
 
 Ksyms::~Ksyms()
 {
-  if (ksyms_)
-    bcc_free_symcache(ksyms_, -1);
-
 #ifdef HAVE_BLAZESYM
   if (symbolizer_)
     blaze_symbolizer_free(symbolizer_);
 #endif
 }
 
-std::string Ksyms::resolve_bcc(uint64_t addr, bool show_offset)
+std::string Ksyms::resolve_native(uint64_t addr, bool show_offset)
 {
-  struct bcc_symbol ksym;
+  if (!loaded_) {
+    loaded_ = true;
+    auto syms = symbols::load_kernel_symbols();
+    if (syms) {
+      kernel_syms_ = std::move(*syms);
+    } else {
+      LOG(WARNING) << "Unable to load kernel symbols: " << syms.takeError();
+    }
+    bpf_syms_ = symbols::bpf_prog_symbols();
+  }
 
-  if (!ksyms_)
-    ksyms_ = bcc_symcache_new(-1, nullptr);
+  std::ostringstream symbol;
+  // BPF programs have known sizes, so an address is only theirs if it falls
+  // inside one. They live among module text, so they are checked first.
+  auto bpf_sym = std::ranges::upper_bound(bpf_syms_,
+                                          addr,
+                                          {},
+                                          &symbols::BpfProgSymbol::addr);
+  if (bpf_sym != bpf_syms_.begin()) {
+    --bpf_sym;
+    if (addr < bpf_sym->addr + bpf_sym->size) {
+      symbol << bpf_sym->name;
+      if (show_offset)
+        symbol << "+" << addr - bpf_sym->addr;
+      return symbol.str();
+    }
+  }
 
-  if (bcc_symcache_resolve(ksyms_, addr, &ksym) == 0) {
-    std::ostringstream symbol;
-    symbol << ksym.name;
-    if (show_offset)
-      symbol << "+" << ksym.offset;
-    return symbol.str();
+  if (kernel_syms_) {
+    if (auto ksym = kernel_syms_->resolve(addr)) {
+      symbol << ksym->name;
+      if (show_offset)
+        symbol << "+" << ksym->offset;
+      return symbol.str();
+    }
   }
   return stringify_addr(addr);
 }
@@ -176,7 +198,7 @@ std::vector<std::string> Ksyms::resolve(uint64_t addr,
   if (config_.use_blazesym)
     return resolve_blazesym(addr, show_offset, perf_mode, show_debug_info);
 #endif
-  return std::vector<std::string>{ resolve_bcc(addr, show_offset) };
+  return std::vector<std::string>{ resolve_native(addr, show_offset) };
 }
 
 } // namespace bpftrace
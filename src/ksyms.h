@@ -3,12 +3,14 @@
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <vector>
 
 #ifdef HAVE_BLAZESYM
 #include <blazesym.h>
 #endif
 
 #include "config.h"
+#include "symbols/kallsyms.h"
 
 namespace bpftrace {
 class Config;
@@ -27,7 +29,10 @@ public:
 
 private:
   const Config &config_;
-  void *ksyms_{ nullptr };
+  // Loaded on first use. BPF program symbols are those loaded at that point.
+  bool loaded_ = false;
+  std::optional<symbols::KernelSymbols> kernel_syms_;
+  std::vector<symbols::BpfProgSymbol> bpf_syms_;
 
 #ifdef HAVE_BLAZESYM
   blaze_symbolizer *symbolizer_{ nullptr };
@@ -42,6 +47,6 @@ private:
                                             bool show_debug_info);
 #endif
 
-  std::string resolve_bcc(uint64_t addr, bool show_offset);
+  std::string resolve_native(uint64_t addr, bool show_offset);
 };
 } // namespace bpftrace
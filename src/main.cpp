@@ -1,9 +1,11 @@
 #include <bpf/libbpf.h>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <getopt.h>
 #include <iostream>
 #include <limits>
@@ -11,6 +13,7 @@
 #include <optional>
 #include <sys/resource.h>
 #include <sys/utsname.h>
+#include <thread>
 #include <unistd.h>
 
 #include "aot/aot.h"
@@ -22,6 +25,7 @@
 #include "ast/passes/clang_parser.h"
 #include "ast/passes/codegen_llvm.h"
 #include "ast/passes/control_flow_analyser.h"
+#include "ast/passes/field_relocation.h"
 #include "ast/passes/macro_expansion.h"
 #include "ast/passes/map_sugar.h"
 #include "ast/passes/named_param.h"
@@ -54,6 +58,7 @@
 #include "util/strings.h"
 #include "util/temp.h"
 #include "version.h"
+#include "watch.h"
 
 using namespace bpftrace;
 
@@ -77,11 +82,13 @@ enum class BuildMode {
 
 enum Options {
   AOT = 2000,
+  AOT_EMBED,
   BENCH, // Alias for --mode=bench.
   BTF,
   CMD,
   DEBUG,
   DEBUGINFO,
+  DECODE,
   DRY_RUN,
   DWARF_PID,
   EMIT_ELF,
@@ -96,7 +103,9 @@ enum Options {
   MODE,
   OUTPUT,
   PID,
+  PID_TREE,
   PROBE_FILTER,
+  PROFILE_PROBES,
   QUIET,
   TEST, // Alias for --mode=test.
   TRACEABLE_FUNCTIONS,
@@ -106,6 +115,7 @@ enum Options {
   VERIFY_LLVM_IR,
   VERSION,
   WARNINGS,
+  WATCH,
 };
 
 constexpr auto FULL_SEARCH = "*:*";
@@ -133,9 +143,11 @@ void usage(std::ostream& out)
   out << "    -h, --help     show this help message" << std::endl;
   out << "    -V, --version  bpftrace version" << std::endl;
   out << "    --info         print information about kernel BPF support" << std::endl;
+  out << "    --watch        reload the script file whenever it is modified" << std::endl;
   out << std::endl;
   out << "    -p, --pid PID  filter actions and enable USDT probes on PID" << std::endl;
   out << "    -c, --cmd CMD  run CMD and enable USDT probes on resulting process" << std::endl;
+  out << "    --pid-tree     with -p or -c, also filter on all descendant processes" << std::endl;
 #ifdef HAVE_DW_UNWIND
   out << "    --dwarf-pid PID" << std::endl;
   out << "                   add additional pids to the DWARF-unwinder" << std::endl;
@@ -145,7 +157,8 @@ void usage(std::ostream& out)
   out << std::endl;
   out << "    -o, --output FILE" << std::endl;
   out << "                   redirect bpftrace output to FILE" << std::endl;
-  out << "    -f FORMAT      output format ('text', 'json')" << std::endl;
+  out << "    -f FORMAT      output format ('text', 'json', 'binary')" << std::endl;
+  out << "    --decode FILE  convert FILE, written with '-f binary', to the -f format" << std::endl;
   out << "    -B MODE        output buffering mode ('line', 'full', 'none')" << std::endl;
   out << "    -q, --quiet    keep messages quiet" << std::endl;
   out << "    -k, --warnings emit a warning when probe read helpers return an error" << std::endl;
@@ -173,6 +186,8 @@ void usage(std::ostream& out)
   out << std::endl;
   out << "TROUBLESHOOTING OPTIONS:" << std::endl;
   out << "    --dry-run      terminate execution right after attaching all the probes" << std::endl;
+  out << "    --profile-probes" << std::endl;
+  out << "                   periodically report per-probe BPF run time and event rates" << std::endl;
   out << "    --verify-llvm-ir" << std::endl;
   out << "                   check that the generated LLVM IR is valid" << std::endl;
   out << "    -d, --debug STAGE" << std::endl;
@@ -344,6 +359,7 @@ std::vector<std::string> extra_flags(
 
 struct Args {
   std::string pid_str;
+  bool pid_tree = false;
   std::vector<std::string> dwarf_pids_str;
   std::string cmd_str;
   bool listing = false;
@@ -351,6 +367,7 @@ struct Args {
   bool usdt_file_activation = false;
   int warning_level = 1;
   bool verify_llvm_ir = false;
+  bool profile_probes = false;
   Mode mode = Mode::NONE;
   std::string script;
   std::string search;
@@ -358,9 +375,11 @@ struct Args {
   std::string debuginfo_path;
   std::string output_file;
   std::string output_format;
+  std::string decode;
   std::string output_elf;
   std::string output_llvm;
   std::string aot;
+  std::vector<std::string> aot_embed;
   BPFnofeature no_feature;
   OutputBufferConfig obc = OutputBufferConfig::UNSET;
   BuildMode build_mode = BuildMode::DYNAMIC;
@@ -371,6 +390,7 @@ struct Args {
   std::vector<std::string> named_params;
   std::string probe_filter;
   std::string traceable_functions_file;
+  bool watch = false;
 };
 
 void CreateDynamicPasses(std::function<void(ast::Pass&& pass)> add)
@@ -385,11 +405,13 @@ void CreateDynamicPasses(std::function<void(ast::Pass&& pass)> add)
 void CreateAotPasses(std::function<void(ast::Pass&& pass)> add)
 {
   add(ast::CreatePortabilityPass());
+  add(ast::CreateAotPidFilterPass());
   add(ast::CreateClangBuildPass());
   add(ast::CreateTypeSystemPass());
   add(ast::CreatePreTypeCheckPass());
   add(ast::CreateTypeResolverPass());
   add(ast::CreateResourcePass());
+  add(ast::CreateFieldRelocationPass());
 }
 
 ast::Pass printPass(const std::string& name)
@@ -432,6 +454,10 @@ Args parse_args(int argc, char* argv[])
             .has_arg = required_argument,
             .flag = nullptr,
             .val = Options::AOT },
+    option{ .name = "aot-embed",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = Options::AOT_EMBED },
     option{ .name = "bench",
             .has_arg = no_argument,
             .flag = nullptr,
@@ -452,6 +478,10 @@ Args parse_args(int argc, char* argv[])
             .has_arg = required_argument,
             .flag = nullptr,
             .val = Options::DEBUGINFO },
+    option{ .name = "decode",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = Options::DECODE },
     option{ .name = "dry-run",
             .has_arg = no_argument,
             .flag = nullptr,
@@ -500,10 +530,18 @@ Args parse_args(int argc, char* argv[])
             .has_arg = required_argument,
             .flag = nullptr,
             .val = Options::PID },
+    option{ .name = "pid-tree",
+            .has_arg = no_argument,
+            .flag = nullptr,
+            .val = Options::PID_TREE },
     option{ .name = "probe-filter",
             .has_arg = required_argument,
             .flag = nullptr,
             .val = Options::PROBE_FILTER },
+    option{ .name = "profile-probes",
+            .has_arg = no_argument,
+            .flag = nullptr,
+            .val = Options::PROFILE_PROBES },
     option{ .name = "quiet",
             .has_arg = no_argument,
             .flag = nullptr,
@@ -544,6 +582,10 @@ Args parse_args(int argc, char* argv[])
             .has_arg = no_argument,
             .flag = nullptr,
             .val = Options::WARNINGS },
+    option{ .name = "watch",
+            .has_arg = no_argument,
+            .flag = nullptr,
+            .val = Options::WATCH },
     option{ .name = "traceable-functions",
             .has_arg = required_argument,
             .flag = nullptr,
@@ -618,6 +660,9 @@ Args parse_args(int argc, char* argv[])
         args.aot = optarg;
         args.build_mode = BuildMode::AHEAD_OF_TIME;
         break;
+      case Options::AOT_EMBED: // --aot-embed
+        args.aot_embed.emplace_back(optarg);
+        break;
       case Options::NO_FEATURE: // --no-feature
         if (args.no_feature.parse(optarg)) {
           LOG(ERROR) << "USAGE: --no-feature can only have values "
@@ -628,6 +673,12 @@ Args parse_args(int argc, char* argv[])
       case Options::DRY_RUN:
         dry_run = true;
         break;
+      case Options::PROFILE_PROBES:
+        args.profile_probes = true;
+        break;
+      case Options::PID_TREE:
+        args.pid_tree = true;
+        break;
       case Options::VERIFY_LLVM_IR:
         args.verify_llvm_ir = true;
         break;
@@ -664,6 +715,9 @@ Args parse_args(int argc, char* argv[])
       case 'f':
         args.output_format = optarg;
         break;
+      case Options::DECODE: // --decode
+        args.decode = optarg;
+        break;
       case 'e':
         args.script = optarg;
         break;
@@ -731,6 +785,9 @@ Args parse_args(int argc, char* argv[])
       case Options::TRACEABLE_FUNCTIONS:
         args.traceable_functions_file = optarg;
         break;
+      case Options::WATCH:
+        args.watch = true;
+        break;
       default:
         usage(std::cerr);
         exit(1);
@@ -742,12 +799,43 @@ Args parse_args(int argc, char* argv[])
     exit(1);
   }
 
+  if (!args.decode.empty()) {
+    if (optind != argc || args.listing || !args.script.empty() ||
+        args.mode != Mode::NONE ||
+        args.build_mode == BuildMode::AHEAD_OF_TIME) {
+      LOG(ERROR) << "USAGE: --decode only takes -f and -o.";
+      exit(1);
+    }
+    return args;
+  }
+
+  // Binary output has no lines, so stdout is fully buffered unless told
+  // otherwise; run_bpftrace does the same for the stream it writes to.
+  if (args.output_format == "binary" && args.obc == OutputBufferConfig::UNSET) {
+    args.obc = OutputBufferConfig::FULL;
+  }
+
   if (!args.cmd_str.empty() && !args.pid_str.empty()) {
     LOG(ERROR) << "USAGE: Cannot use both -c and -p.";
     usage(std::cerr);
     exit(1);
   }
 
+  if (args.pid_tree && args.cmd_str.empty() && args.pid_str.empty()) {
+    LOG(ERROR) << "USAGE: --pid-tree requires -c or -p.";
+    exit(1);
+  }
+
+  if (!args.aot_embed.empty() && args.build_mode != BuildMode::AHEAD_OF_TIME) {
+    LOG(ERROR) << "USAGE: --aot-embed requires --aot.";
+    exit(1);
+  }
+
+  if (args.pid_tree && args.build_mode == BuildMode::AHEAD_OF_TIME) {
+    LOG(ERROR) << "Cannot use --pid-tree with --aot";
+    exit(1);
+  }
+
   // Difficult to serialize flex generated types
   if (args.warning_level == 2 && args.build_mode == BuildMode::AHEAD_OF_TIME) {
     LOG(ERROR) << "Cannot use -k with --aot";
@@ -798,6 +886,18 @@ Args parse_args(int argc, char* argv[])
       optind++;
     }
   }
+
+  if (args.watch) {
+    if (args.listing || args.mode != Mode::NONE ||
+        args.build_mode == BuildMode::AHEAD_OF_TIME) {
+      LOG(ERROR) << "USAGE: --watch can only be used to run a script.";
+      exit(1);
+    }
+    if (args.filename.empty() || args.filename == "-") {
+      LOG(ERROR) << "USAGE: --watch requires a script file.";
+      exit(1);
+    }
+  }
   return args;
 }
 
@@ -890,6 +990,272 @@ uint64_t parse_pid(std::string const& pid_str)
   return *maybe_pid;
 }
 
+// Applies the options that are common to every version of the script, see
+// --watch. The target process is set up separately, as it is shared.
+static void configure(BPFtrace& bpftrace, const Args& args)
+{
+  bpftrace.usdt_file_activation_ = args.usdt_file_activation;
+  bpftrace.safe_mode_ = args.safe_mode;
+  bpftrace.warning_level_ = args.warning_level;
+  bpftrace.boottime_ = get_boottime();
+  bpftrace.delta_taitime_ = get_delta_taitime();
+  bpftrace.run_tests_ = args.mode == Mode::BPF_TEST;
+  bpftrace.run_benchmarks_ = args.mode == Mode::BPF_BENCHMARK;
+  bpftrace.probe_filter_ = args.probe_filter;
+  bpftrace.profile_probes_ = args.profile_probes;
+  bpftrace.pid_tree_ = args.pid_tree;
+  bpftrace.debuginfo_path_ = args.debuginfo_path + DEFAULT_DEBUG_INFO_PATHS;
+  bpftrace.cmd_ = args.cmd_str;
+
+  for (auto const& pid_str : args.dwarf_pids_str) {
+    auto pid = parse_pid(pid_str);
+    bpftrace.dwarf_pids_.emplace_back(pid);
+  }
+  for (const auto& param : args.params) {
+    bpftrace.add_param(param);
+  }
+}
+
+// Warnings go to stdout along with the output, unless that is binary: any
+// bytes outside of its records make it unreadable.
+static std::ostream& warning_stream(const Args& args)
+{
+  return args.output_format == "binary" ? std::cerr : std::cout;
+}
+
+// Adds all the passes that compile and link the script. The streams for
+// --emit-llvm are opened here, and must outlive the passes.
+static void add_compile_passes(ast::PassManager& pm,
+                               const Args& args,
+                               std::vector<std::string>&& flags,
+                               std::optional<std::ofstream>& output_ir,
+                               std::optional<std::ofstream>& output_ir_opt)
+{
+  // Wrap all added passes in passes that dump the intermediate state. These
+  // could dump intermediate objects from the context as well, but preserve
+  // existing behavior for now.
+  auto addPass = [&pm](ast::Pass&& pass) {
+    auto name = pass.name();
+    pm.add(std::move(pass));
+    if (bt_debug.contains(DebugStage::Ast)) {
+      pm.add(printPass(name));
+    }
+  };
+  // Start with all the basic parsing steps.
+  for (auto& pass : ast::AllParsePasses(std::move(flags),
+                                        {},
+                                        bt_debug.contains(DebugStage::Parse))) {
+    addPass(std::move(pass));
+  }
+  pm.add(ast::CreateLLVMInitPass());
+
+  switch (args.build_mode) {
+    case BuildMode::DYNAMIC:
+      CreateDynamicPasses(addPass);
+      break;
+    case BuildMode::AHEAD_OF_TIME:
+      CreateAotPasses(addPass);
+      break;
+  }
+
+  if (bt_debug.contains(DebugStage::Types)) {
+    pm.add(ast::CreateDumpTypesPass(std::cout));
+  }
+  pm.add(ast::CreateCompilePass());
+  pm.add(ast::CreateLinkBitcodePass());
+  if (bt_debug.contains(DebugStage::Codegen)) {
+    pm.add(ast::Pass::create("dump-ir-prefix", [&] {
+      std::cout << "LLVM IR before optimization\n";
+      std::cout << "---------------------------\n\n";
+    }));
+    pm.add(ast::CreateDumpIRPass(std::cout));
+  }
+  if (!args.output_llvm.empty()) {
+    output_ir = std::ofstream(args.output_llvm + ".original.ll");
+    pm.add(ast::CreateDumpIRPass(*output_ir));
+  }
+  if (args.verify_llvm_ir) {
+    pm.add(ast::CreateVerifyPass());
+  }
+  // The programs are optimized and emitted in parallel, unless the optimized
+  // module is needed as a whole.
+  if (bt_debug.contains(DebugStage::CodegenOpt) || !args.output_llvm.empty()) {
+    pm.add(ast::CreateOptimizePass());
+    if (bt_debug.contains(DebugStage::CodegenOpt)) {
+      pm.add(ast::Pass::create("dump-ir-opt-prefix", [&] {
+        std::cout << "\nLLVM IR after optimization\n";
+        std::cout << "----------------------------\n\n";
+      }));
+      pm.add(ast::CreateDumpIRPass(std::cout));
+    }
+    if (!args.output_llvm.empty()) {
+      output_ir_opt = std::ofstream(args.output_llvm + ".optimized.ll");
+      pm.add(ast::CreateDumpIRPass(*output_ir_opt));
+    }
+    pm.add(ast::CreateObjectPass());
+  } else {
+    pm.add(ast::CreateParallelObjectPass(std::thread::hardware_concurrency()));
+  }
+  if (bt_debug.contains(DebugStage::Disassemble)) {
+    pm.add(ast::Pass::create("dump-asm-prefix", [&] {
+      std::cout << "\nDisassembled bytecode\n";
+      std::cout << "----------------------------\n\n";
+    }));
+    pm.add(ast::CreateDumpASMPass(std::cout));
+  }
+  if (!args.output_elf.empty()) {
+    pm.add(ast::Pass::create("dump-elf", [&](ast::BpfObject& obj) {
+      std::ofstream out(args.output_elf);
+      out.write(obj.data.data(), obj.data.size());
+    }));
+  }
+  pm.add(ast::CreateExternObjectPass());
+  pm.add(ast::CreateLinkPass());
+}
+
+// A version of the script compiled for --watch, with everything that must
+// stay alive while it runs.
+struct WatchedScript {
+  std::unique_ptr<BPFtrace> bpftrace;
+  std::unique_ptr<ast::ASTContext> ast;
+  std::optional<ast::PassContext> result;
+};
+
+// A version of the script that is being compiled in the background.
+struct PendingScript {
+  WatchedScript script;
+  std::string contents;
+  std::future<Result<ast::PassContext>> result;
+};
+
+// Runs the script until exit. Whenever the script file is modified, the new
+// version is compiled on another thread while the current one keeps running,
+// and then takes over from it. If the new version fails to compile, the
+// current one keeps running until the file is modified again.
+static int run_watch(std::unique_ptr<BPFtrace> bpftrace,
+                     const std::string& contents,
+                     const ast::CDefinitions& c_definitions,
+                     BpfBytecode& bytecode,
+                     const Args& args,
+                     ast::FunctionInfo& func_info_state)
+{
+  watch::ScriptWatcher watcher(args.filename, contents);
+  uint64_t version = bpftrace->watch_version_;
+  // The previous version is only released once the next version has taken
+  // over, as its output callbacks refer to its definitions until then.
+  std::optional<WatchedScript> previous;
+  std::optional<WatchedScript> running;
+  std::optional<WatchedScript> next;
+  // Declared last, so that a compilation still in progress on exit is
+  // waited for before anything it uses is released.
+  std::optional<PendingScript> pending;
+
+  auto compile = [&args, &func_info_state](
+                     WatchedScript& script) -> Result<ast::PassContext> {
+    ast::PassManager pm;
+    pm.put(*script.ast);
+    pm.put(*script.bpftrace);
+    pm.put(func_info_state);
+    std::optional<std::ofstream> output_ir;
+    std::optional<std::ofstream> output_ir_opt;
+    add_compile_passes(pm,
+                       args,
+                       extra_flags(*script.bpftrace,
+                                   args.include_dirs,
+                                   args.include_files),
+                       output_ir,
+                       output_ir_opt);
+    return pm.run();
+  };
+
+  auto reload = [&]() {
+    if (!pending) {
+      auto modified = watcher.poll();
+      if (!modified) {
+        return false;
+      }
+
+      // Compiling the script only needs to know the target process. The
+      // running version keeps it until the new version takes over.
+      auto& script = pending.emplace().script;
+      pending->contents = std::move(*modified);
+      script.bpftrace = std::make_unique<BPFtrace>(
+          args.no_feature, std::make_unique<Config>(!args.cmd_str.empty()));
+      script.ast = std::make_unique<ast::ASTContext>(args.filename,
+                                                     pending->contents);
+      configure(*script.bpftrace, args);
+      script.bpftrace->watch_version_ = ++version;
+      script.bpftrace->watch_target_.pid = bpftrace->pid();
+      script.bpftrace->watch_target_.child = bpftrace->has_child();
+      pending->result = std::async(std::launch::async,
+                                   compile,
+                                   std::ref(script));
+      return false;
+    }
+
+    if (pending->result.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+      return false;
+    }
+
+    auto script = std::move(pending->script);
+    auto result = pending->result.get();
+    auto modified = std::move(pending->contents);
+    pending.reset();
+
+    bool ok = result && script.ast->diagnostics().ok();
+    if (!result) {
+      std::cerr << result.takeError() << "\n";
+    } else {
+      script.ast->diagnostics().emit(ok ? warning_stream(args) : std::cerr);
+    }
+    if (!ok) {
+      LOG(WARNING) << "Failed to compile the modified " << args.filename
+                   << ", keeping the previous version running";
+      return false;
+    }
+
+    LOG(V1) << "Reloading " << args.filename;
+    script.result.emplace(std::move(*result));
+    watcher.accept(modified);
+    next.emplace(std::move(script));
+    return true;
+  };
+
+  const ast::CDefinitions* current_c_definitions = &c_definitions;
+  BpfBytecode* current_bytecode = &bytecode;
+  while (true) {
+    bpftrace->watch_ = reload;
+    int err = run_bpftrace(*bpftrace,
+                           args.output_file,
+                           args.output_format,
+                           *current_c_definitions,
+                           *current_bytecode,
+                           std::vector<std::string>(args.named_params),
+                           args.obc);
+    if (!next) {
+      return err;
+    }
+
+    next->bpftrace->child_ = std::move(bpftrace->child_);
+    next->bpftrace->procmon_ = std::move(bpftrace->procmon_);
+    next->bpftrace->watch_target_ = BPFtrace::WatchTarget();
+    next->bpftrace->previous_ = std::move(bpftrace);
+    bpftrace = std::move(next->bpftrace);
+    // The script state is only movable, not assignable. The version before
+    // the previous one has been released by now.
+    previous.reset();
+    if (running) {
+      previous.emplace(std::move(*running));
+      running.reset();
+    }
+    running.emplace(std::move(*next));
+    next.reset();
+    current_c_definitions = &running->result->get<ast::CDefinitions>();
+    current_bytecode = &running->result->get<BpfBytecode>();
+  }
+}
+
 int main(int argc, char* argv[])
 {
   Log::get().set_colorize(is_colorize());
@@ -908,10 +1274,18 @@ int main(int argc, char* argv[])
       break;
   }
 
+  if (!args.decode.empty()) {
+    return decode_binary(args.decode, args.output_file, args.output_format);
+  }
+
   libbpf_set_print(libbpf_print);
 
+  // The instance is owned through a pointer so that, with --watch, it can be
+  // handed over to the next version of the script.
   auto config = std::make_unique<Config>(!args.cmd_str.empty());
-  BPFtrace bpftrace(args.no_feature, std::move(config));
+  auto bpftrace_owner = std::make_unique<BPFtrace>(args.no_feature,
+                                                   std::move(config));
+  BPFtrace& bpftrace = *bpftrace_owner;
 
   // This is our primary program AST context. Initially it is empty, i.e.
   // there is no filename set or source file. The way we set it up depends on
@@ -1005,15 +1379,10 @@ int main(int argc, char* argv[])
   symbols::UserInfoImpl user_func_info;
   ast::FunctionInfo func_info_state(*kernel_func_info, user_func_info);
 
-  bpftrace.usdt_file_activation_ = args.usdt_file_activation;
-  bpftrace.safe_mode_ = args.safe_mode;
-  bpftrace.warning_level_ = args.warning_level;
-  bpftrace.boottime_ = get_boottime();
-  bpftrace.delta_taitime_ = get_delta_taitime();
-  bpftrace.run_tests_ = args.mode == Mode::BPF_TEST;
-  bpftrace.run_benchmarks_ = args.mode == Mode::BPF_BENCHMARK;
-  bpftrace.probe_filter_ = args.probe_filter;
-  bpftrace.debuginfo_path_ = args.debuginfo_path + DEFAULT_DEBUG_INFO_PATHS;
+  configure(bpftrace, args);
+  if (args.watch) {
+    bpftrace.watch_version_ = 1;
+  }
 
   if (!args.pid_str.empty()) {
     auto pid = parse_pid(args.pid_str);
@@ -1025,12 +1394,7 @@ int main(int argc, char* argv[])
     bpftrace.procmon_ = std::move(*proc);
   }
 
-  for (auto const& pid_str : args.dwarf_pids_str) {
-    auto pid = parse_pid(pid_str);
-    bpftrace.dwarf_pids_.emplace_back(pid);
-  }
   if (!args.cmd_str.empty()) {
-    bpftrace.cmd_ = args.cmd_str;
     auto child = util::create_child(args.cmd_str);
     if (!child) {
       LOG(ERROR) << "Failed to fork child: " << child.takeError();
@@ -1045,10 +1409,6 @@ int main(int argc, char* argv[])
     return 0;
   }
 
-  for (const auto& param : args.params) {
-    bpftrace.add_param(param);
-  }
-
   // If we are not running anything, then we don't require privileges.
   if (args.mode == Mode::NONE || args.mode == Mode::BPF_TEST ||
       args.mode == Mode::BPF_BENCHMARK) {
@@ -1100,82 +1460,9 @@ int main(int argc, char* argv[])
     return 0;
   }
 
-  // Wrap all added passes in passes that dump the intermediate state. These
-  // could dump intermediate objects from the context as well, but preserve
-  // existing behavior for now.
-  auto addPass = [&pm](ast::Pass&& pass) {
-    auto name = pass.name();
-    pm.add(std::move(pass));
-    if (bt_debug.contains(DebugStage::Ast)) {
-      pm.add(printPass(name));
-    }
-  };
-  // Start with all the basic parsing steps.
-  for (auto& pass : ast::AllParsePasses(std::move(flags),
-                                        {},
-                                        bt_debug.contains(DebugStage::Parse))) {
-    addPass(std::move(pass));
-  }
-  pm.add(ast::CreateLLVMInitPass());
-
-  switch (args.build_mode) {
-    case BuildMode::DYNAMIC:
-      CreateDynamicPasses(addPass);
-      break;
-    case BuildMode::AHEAD_OF_TIME:
-      CreateAotPasses(addPass);
-      break;
-  }
-
-  if (bt_debug.contains(DebugStage::Types)) {
-    pm.add(ast::CreateDumpTypesPass(std::cout));
-  }
-  pm.add(ast::CreateCompilePass());
-  pm.add(ast::CreateLinkBitcodePass());
-  if (bt_debug.contains(DebugStage::Codegen)) {
-    pm.add(ast::Pass::create("dump-ir-prefix", [&] {
-      std::cout << "LLVM IR before optimization\n";
-      std::cout << "---------------------------\n\n";
-    }));
-    pm.add(ast::CreateDumpIRPass(std::cout));
-  }
   std::optional<std::ofstream> output_ir;
-  if (!args.output_llvm.empty()) {
-    output_ir = std::ofstream(args.output_llvm + ".original.ll");
-    pm.add(ast::CreateDumpIRPass(*output_ir));
-  }
-  if (args.verify_llvm_ir) {
-    pm.add(ast::CreateVerifyPass());
-  }
-  pm.add(ast::CreateOptimizePass());
-  if (bt_debug.contains(DebugStage::CodegenOpt)) {
-    pm.add(ast::Pass::create("dump-ir-opt-prefix", [&] {
-      std::cout << "\nLLVM IR after optimization\n";
-      std::cout << "----------------------------\n\n";
-    }));
-    pm.add(ast::CreateDumpIRPass(std::cout));
-  }
   std::optional<std::ofstream> output_ir_opt;
-  if (!args.output_llvm.empty()) {
-    output_ir_opt = std::ofstream(args.output_llvm + ".optimized.ll");
-    pm.add(ast::CreateDumpIRPass(*output_ir_opt));
-  }
-  pm.add(ast::CreateObjectPass());
-  if (bt_debug.contains(DebugStage::Disassemble)) {
-    pm.add(ast::Pass::create("dump-asm-prefix", [&] {
-      std::cout << "\nDisassembled bytecode\n";
-      std::cout << "----------------------------\n\n";
-    }));
-    pm.add(ast::CreateDumpASMPass(std::cout));
-  }
-  if (!args.output_elf.empty()) {
-    pm.add(ast::Pass::create("dump-elf", [&](ast::BpfObject& obj) {
-      std::ofstream out(args.output_elf);
-      out.write(obj.data.data(), obj.data.size());
-    }));
-  }
-  pm.add(ast::CreateExternObjectPass());
-  pm.add(ast::CreateLinkPass());
+  add_compile_passes(pm, args, std::move(flags), output_ir, output_ir_opt);
 
   if (args.mode == Mode::COMPILER_BENCHMARK) {
     info(args.no_feature);
@@ -1197,14 +1484,17 @@ int main(int argc, char* argv[])
   }
 
   // Emits warnings
-  ast.diagnostics().emit(std::cout);
+  ast.diagnostics().emit(warning_stream(args));
 
   if (args.build_mode == BuildMode::AHEAD_OF_TIME) {
     // Note: this should use the fully-linked version in the future, but
     // presently it is just using the single object.
     auto& out = pmresult->get<ast::BpfObject>();
-    return aot::generate(
-        bpftrace.resources, args.aot, out.data.data(), out.data.size());
+    return aot::generate(bpftrace.resources,
+                         args.aot,
+                         out.data.data(),
+                         out.data.size(),
+                         args.aot_embed);
   }
 
   if (args.mode == Mode::CODEGEN)
@@ -1212,6 +1502,14 @@ int main(int argc, char* argv[])
 
   auto c_definitions = pmresult->get<ast::CDefinitions>();
   auto& bytecode = pmresult->get<BpfBytecode>();
+  if (args.watch) {
+    return run_watch(std::move(bpftrace_owner),
+                     ast.source()->contents,
+                     c_definitions,
+                     bytecode,
+                     args,
+                     func_info_state);
+  }
   return run_bpftrace(bpftrace,
                       args.output_file,
                       args.output_format,
@@ -9,11 +9,11 @@ namespace bpftrace {
 struct HistogramArgs {
   long bits = -1;
   bool scalar = true;
-  bool operator==(const HistogramArgs &other)
+  bool operator==(const HistogramArgs &other) const
   {
     return bits == other.bits && scalar == other.scalar;
   }
-  bool operator!=(const HistogramArgs &other)
+  bool operator!=(const HistogramArgs &other) const
   {
     return !(*this == other);
   }
@@ -33,12 +33,12 @@ struct LinearHistogramArgs {
   long step = -1;
   bool scalar = true;
 
-  bool operator==(const LinearHistogramArgs &other)
+  bool operator==(const LinearHistogramArgs &other) const
   {
     return min == other.min && max == other.max && step == other.step &&
            scalar == other.scalar;
   }
-  bool operator!=(const LinearHistogramArgs &other)
+  bool operator!=(const LinearHistogramArgs &other) const
   {
     return !(*this == other);
   }
@@ -58,13 +58,13 @@ struct TSeriesArgs {
   SizedType value_type;
   TSeriesAggFunc agg;
 
-  bool operator==(const TSeriesArgs &other)
+  bool operator==(const TSeriesArgs &other) const
   {
     return interval_ns == other.interval_ns &&
            num_intervals == other.num_intervals &&
            value_type == other.value_type && agg == other.agg;
   }
-  bool operator!=(const TSeriesArgs &other)
+  bool operator!=(const TSeriesArgs &other) const
   {
     return !(*this == other);
   }
@@ -87,13 +87,26 @@ struct MapInfo {
   int max_entries = -1;
   bpf_map_type bpf_type = BPF_MAP_TYPE_HASH;
   bool is_scalar = false;
+  // Array maps indexed by CPU id are resized to the number of possible CPUs
+  // on the host that loads them, but no smaller than `min_entries`, the bound
+  // of the map's other keys.
+  bool keyed_by_cpu = false;
+  int min_entries = 0;
 
 private:
   friend class cereal::access;
   template <typename Archive>
   void serialize(Archive &archive)
   {
-    archive(key_type, value_type, detail, id, max_entries, bpf_type, is_scalar);
+    archive(key_type,
+            value_type,
+            detail,
+            id,
+            max_entries,
+            bpf_type,
+            is_scalar,
+            keyed_by_cpu,
+            min_entries);
   }
 };
 
@@ -0,0 +1,1124 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+#include "output/binary.h"
+
+namespace bpftrace::output {
+
+using binary::Kind;
+using binary::Tag;
+
+// Values nest (e.g. maps of tuples of arrays), but never this deep. The limit
+// keeps a malformed stream from exhausting the stack of the reader.
+static constexpr int MAX_DEPTH = 64;
+
+namespace {
+
+class Encoder {
+public:
+  Encoder(std::string &buf) : buf_(buf) {};
+
+  template <typename T>
+  void integer(T value)
+  {
+    auto v = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+      buf_ += static_cast<char>(v & 0xff);
+      v >>= 8;
+    }
+  }
+
+  void u8(uint8_t value)
+  {
+    buf_ += static_cast<char>(value);
+  }
+
+  void u32(uint32_t value)
+  {
+    integer(value);
+  }
+
+  void u64(uint64_t value)
+  {
+    integer(value);
+  }
+
+  void i64(int64_t value)
+  {
+    integer(value);
+  }
+
+  void string(std::string_view value)
+  {
+    u32(value.size());
+    buf_.append(value);
+  }
+
+  void strings(const std::vector<std::string> &values)
+  {
+    u32(values.size());
+    for (const auto &value : values) {
+      string(value);
+    }
+  }
+
+  void tag(Tag tag)
+  {
+    u8(static_cast<uint8_t>(tag));
+  }
+
+  void timestamp(const Primitive::Timestamp &ts)
+  {
+    i64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            ts.time_since_epoch())
+            .count());
+  }
+
+  void primitives(const std::vector<Primitive> &values)
+  {
+    u32(values.size());
+    for (const auto &value : values) {
+      primitive(value);
+    }
+  }
+
+  void primitive(const Primitive &p)
+  {
+    std::visit(
+        [&](const auto &v) {
+          using T = std::decay_t<decltype(v)>;
+          if constexpr (std::is_same_v<T, std::monostate>) {
+            tag(Tag::NONE);
+          } else if constexpr (std::is_same_v<T, bool>) {
+            tag(Tag::BOOL);
+            u8(v ? 1 : 0);
+          } else if constexpr (std::is_same_v<T, int64_t>) {
+            tag(Tag::INT64);
+            i64(v);
+          } else if constexpr (std::is_same_v<T, uint64_t>) {
+            tag(Tag::UINT64);
+            u64(v);
+          } else if constexpr (std::is_same_v<T, double>) {
+            tag(Tag::DOUBLE);
+            u64(std::bit_cast<uint64_t>(v));
+          } else if constexpr (std::is_same_v<T, std::string>) {
+            tag(Tag::STRING);
+            string(v);
+          } else if constexpr (std::is_same_v<T, Primitive::Array>) {
+            tag(Tag::ARRAY);
+            primitives(v.values);
+          } else if constexpr (std::is_same_v<T, Primitive::Buffer>) {
+            tag(Tag::BUFFER);
+            string(std::string_view(v.data.data(), v.data.size()));
+          } else if constexpr (std::is_same_v<T, Primitive::Tuple>) {
+            tag(Tag::TUPLE);
+            primitives(v.values);
+          } else if constexpr (std::is_same_v<T, Primitive::Record>) {
+            tag(Tag::RECORD);
+            u32(v.fields.size());
+            for (const auto &[name, field] : v.fields) {
+              string(name);
+              primitive(field);
+            }
+          } else if constexpr (std::is_same_v<T, Primitive::Symbolic>) {
+            tag(Tag::SYMBOLIC);
+            string(v.symbol);
+            u64(v.numeric);
+          } else if constexpr (std::is_same_v<T, Primitive::Timestamp>) {
+            tag(Tag::TIMESTAMP);
+            timestamp(v);
+          } else {
+            static_assert(std::is_same_v<T, Primitive::Duration>);
+            tag(Tag::DURATION);
+            u64(v.count());
+          }
+        },
+        p.variant);
+  }
+
+  void ordered_map(const Value::OrderedMap &m)
+  {
+    tag(Tag::ORDERED_MAP);
+    u32(m.values.size());
+    for (const auto &[key, val] : m.values) {
+      primitive(key);
+      value(val);
+    }
+  }
+
+  void value(const Value &value)
+  {
+    std::visit(
+        [&](const auto &v) {
+          using T = std::decay_t<decltype(v)>;
+          if constexpr (std::is_same_v<T, Primitive>) {
+            primitive(v);
+          } else if constexpr (std::is_same_v<T, Value::Histogram>) {
+            tag(Tag::HISTOGRAM);
+            u8(v.lower_bound ? 1 : 0);
+            if (v.lower_bound) {
+              primitive(*v.lower_bound);
+            }
+            primitives(v.labels);
+            u32(v.counts.size());
+            for (uint64_t count : v.counts) {
+              u64(count);
+            }
+          } else if constexpr (std::is_same_v<T, std::vector<Value>>) {
+            tag(Tag::VECTOR);
+            u32(v.size());
+            for (const auto &elem : v) {
+              this->value(elem);
+            }
+          } else if constexpr (std::is_same_v<T, Value::OrderedMap>) {
+            ordered_map(v);
+          } else if constexpr (std::is_same_v<T, Value::Stats>) {
+            tag(Tag::STATS);
+            if (const auto *m = std::get_if<Value::OrderedMap>(&v.value)) {
+              ordered_map(*m);
+            } else {
+              primitive(std::get<Primitive>(v.value));
+            }
+          } else {
+            static_assert(std::is_same_v<T, Value::TimeSeries>);
+            tag(Tag::TIME_SERIES);
+            u32(v.values.size());
+            for (const auto &[ts, val] : v.values) {
+              timestamp(ts);
+              primitive(val);
+            }
+          }
+        },
+        value.variant);
+  }
+
+  void source_info(const SourceInfo &info)
+  {
+    u32(info.locations.size());
+    for (const auto &loc : info.locations) {
+      string(loc.filename);
+      u32(loc.line);
+      u32(loc.column);
+      string(loc.source_location);
+      strings(loc.source_context);
+    }
+  }
+
+private:
+  std::string &buf_;
+};
+
+class Decoder {
+public:
+  Decoder(std::string_view data) : data_(data) {};
+
+  bool u8(uint8_t &value)
+  {
+    if (data_.empty()) {
+      return false;
+    }
+    value = static_cast<uint8_t>(data_[0]);
+    data_.remove_prefix(1);
+    return true;
+  }
+
+  template <typename T>
+  bool integer(T &value)
+  {
+    if (data_.size() < sizeof(T)) {
+      return false;
+    }
+    std::make_unsigned_t<T> v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      v |= static_cast<std::make_unsigned_t<T>>(
+               static_cast<uint8_t>(data_[i]))
+           << (8 * i);
+    }
+    value = static_cast<T>(v);
+    data_.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  bool u32(uint32_t &value)
+  {
+    return integer(value);
+  }
+
+  bool u64(uint64_t &value)
+  {
+    return integer(value);
+  }
+
+  bool i64(int64_t &value)
+  {
+    return integer(value);
+  }
+
+  bool string(std::string &value)
+  {
+    uint32_t len = 0;
+    if (!u32(len) || data_.size() < len) {
+      return false;
+    }
+    value.assign(data_.substr(0, len));
+    data_.remove_prefix(len);
+    return true;
+  }
+
+  bool strings(std::vector<std::string> &values)
+  {
+    uint32_t count = 0;
+    if (!count_of(count, sizeof(uint32_t))) {
+      return false;
+    }
+    values.resize(count);
+    for (auto &value : values) {
+      if (!string(value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool timestamp(Primitive::Timestamp &ts)
+  {
+    int64_t ns = 0;
+    if (!i64(ns)) {
+      return false;
+    }
+    ts = Primitive::Timestamp(
+        std::chrono::duration_cast<Primitive::Timestamp::duration>(
+            std::chrono::nanoseconds(ns)));
+    return true;
+  }
+
+  bool primitives(std::vector<Primitive> &values, int depth)
+  {
+    uint32_t count = 0;
+    if (!count_of(count, 1)) {
+      return false;
+    }
+    values.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      auto p = primitive(depth);
+      if (!p) {
+        return false;
+      }
+      values.emplace_back(std::move(*p));
+    }
+    return true;
+  }
+
+  std::optional<Primitive> primitive(int depth)
+  {
+    uint8_t tag = 0;
+    if (!u8(tag)) {
+      return std::nullopt;
+    }
+    return primitive(static_cast<Tag>(tag), depth);
+  }
+
+  std::optional<Primitive> primitive(Tag tag, int depth)
+  {
+    if (depth > MAX_DEPTH) {
+      return std::nullopt;
+    }
+    switch (tag) {
+      case Tag::NONE:
+        return Primitive(std::monostate());
+      case Tag::BOOL: {
+        uint8_t v = 0;
+        if (!u8(v)) {
+          return std::nullopt;
+        }
+        return Primitive(v != 0);
+      }
+      case Tag::INT64: {
+        int64_t v = 0;
+        if (!i64(v)) {
+          return std::nullopt;
+        }
+        return Primitive(v);
+      }
+      case Tag::UINT64: {
+        uint64_t v = 0;
+        if (!u64(v)) {
+          return std::nullopt;
+        }
+        return Primitive(v);
+      }
+      case Tag::DOUBLE: {
+        uint64_t v = 0;
+        if (!u64(v)) {
+          return std::nullopt;
+        }
+        return Primitive(std::bit_cast<double>(v));
+      }
+      case Tag::STRING: {
+        std::string v;
+        if (!string(v)) {
+          return std::nullopt;
+        }
+        return Primitive(std::move(v));
+      }
+      case Tag::ARRAY: {
+        Primitive::Array v;
+        if (!primitives(v.values, depth + 1)) {
+          return std::nullopt;
+        }
+        return Primitive(std::move(v));
+      }
+      case Tag::BUFFER: {
+        std::string v;
+        if (!string(v)) {
+          return std::nullopt;
+        }
+        return Primitive(Primitive::Buffer{
+            .data = std::vector<char>(v.begin(), v.end()) });
+      }
+      case Tag::TUPLE: {
+        Primitive::Tuple v;
+        if (!primitives(v.values, depth + 1)) {
+          return std::nullopt;
+        }
+        return Primitive(std::move(v));
+      }
+      case Tag::RECORD: {
+        Primitive::Record v;
+        uint32_t count = 0;
+        if (!count_of(count, sizeof(uint32_t) + 1)) {
+          return std::nullopt;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+          std::string name;
+          if (!string(name)) {
+            return std::nullopt;
+          }
+          auto field = primitive(depth + 1);
+          if (!field) {
+            return std::nullopt;
+          }
+          v.fields.emplace_back(std::move(name), std::move(*field));
+        }
+        return Primitive(std::move(v));
+      }
+      case Tag::SYMBOLIC: {
+        std::string symbol;
+        uint64_t numeric = 0;
+        if (!string(symbol) || !u64(numeric)) {
+          return std::nullopt;
+        }
+        return Primitive(Primitive::Symbolic(std::move(symbol), numeric));
+      }
+      case Tag::TIMESTAMP: {
+        Primitive::Timestamp v;
+        if (!timestamp(v)) {
+          return std::nullopt;
+        }
+        return Primitive(v);
+      }
+      case Tag::DURATION: {
+        uint64_t v = 0;
+        if (!u64(v)) {
+          return std::nullopt;
+        }
+        return Primitive(Primitive::Duration(v));
+      }
+      default:
+        return std::nullopt;
+    }
+  }
+
+  std::optional<Value::OrderedMap> ordered_map(int depth)
+  {
+    Value::OrderedMap m;
+    uint32_t count = 0;
+    if (!count_of(count, 2)) {
+      return std::nullopt;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      auto key = primitive(depth + 1);
+      if (!key) {
+        return std::nullopt;
+      }
+      auto val = value(depth + 1);
+      if (!val) {
+        return std::nullopt;
+      }
+      m.values.emplace_back(std::move(*key), std::move(*val));
+    }
+    return m;
+  }
+
+  std::optional<Value> value(int depth)
+  {
+    uint8_t raw = 0;
+    if (depth > MAX_DEPTH || !u8(raw)) {
+      return std::nullopt;
+    }
+    auto tag = static_cast<Tag>(raw);
+    switch (tag) {
+      case Tag::HISTOGRAM: {
+        Value::Histogram v;
+        uint8_t has_lower_bound = 0;
+        if (!u8(has_lower_bound)) {
+          return std::nullopt;
+        }
+        if (has_lower_bound) {
+          auto lower_bound = primitive(depth + 1);
+          if (!lower_bound) {
+            return std::nullopt;
+          }
+          v.lower_bound.emplace(std::move(*lower_bound));
+        }
+        uint32_t count = 0;
+        // There is a count per label, plus one for the top bucket if it has
+        // no upper bound.
+        if (!primitives(v.labels, depth + 1) ||
+            !count_of(count, sizeof(uint64_t)) || count < v.labels.size() ||
+            count > v.labels.size() + 1) {
+          return std::nullopt;
+        }
+        v.counts.resize(count);
+        for (auto &c : v.counts) {
+          if (!u64(c)) {
+            return std::nullopt;
+          }
+        }
+        return Value(std::move(v));
+      }
+      case Tag::VECTOR: {
+        std::vector<Value> v;
+        uint32_t count = 0;
+        if (!count_of(count, 1)) {
+          return std::nullopt;
+        }
+        v.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+          auto elem = value(depth + 1);
+          if (!elem) {
+            return std::nullopt;
+          }
+          v.emplace_back(std::move(*elem));
+        }
+        return Value(std::move(v));
+      }
+      case Tag::ORDERED_MAP: {
+        auto m = ordered_map(depth);
+        if (!m) {
+          return std::nullopt;
+        }
+        return Value(std::move(*m));
+      }
+      case Tag::STATS: {
+        uint8_t inner = 0;
+        if (!u8(inner)) {
+          return std::nullopt;
+        }
+        if (static_cast<Tag>(inner) == Tag::ORDERED_MAP) {
+          auto m = ordered_map(depth);
+          if (!m) {
+            return std::nullopt;
+          }
+          return Value(Value::Stats(std::move(*m)));
+        }
+        auto p = primitive(static_cast<Tag>(inner), depth + 1);
+        if (!p) {
+          return std::nullopt;
+        }
+        return Value(Value::Stats(std::move(*p)));
+      }
+      case Tag::TIME_SERIES: {
+        Value::TimeSeries v;
+        uint32_t count = 0;
+        if (!count_of(count, sizeof(int64_t) + 1)) {
+          return std::nullopt;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+          Primitive::Timestamp ts;
+          if (!timestamp(ts)) {
+            return std::nullopt;
+          }
+          auto val = primitive(depth + 1);
+          if (!val) {
+            return std::nullopt;
+          }
+          v.values.emplace_back(ts, std::move(*val));
+        }
+        return Value(std::move(v));
+      }
+      default: {
+        auto p = primitive(tag, depth);
+        if (!p) {
+          return std::nullopt;
+        }
+        return Value(std::move(*p));
+      }
+    }
+  }
+
+  bool source_info(SourceInfo &info)
+  {
+    uint32_t count = 0;
+    if (!count_of(count, 4 * sizeof(uint32_t))) {
+      return false;
+    }
+    info.locations.resize(count);
+    for (auto &loc : info.locations) {
+      uint32_t line = 0;
+      uint32_t column = 0;
+      if (!string(loc.filename) || !u32(line) || !u32(column) ||
+          !string(loc.source_location) || !strings(loc.source_context)) {
+        return false;
+      }
+      loc.line = static_cast<int>(line);
+      loc.column = static_cast<int>(column);
+    }
+    return true;
+  }
+
+  bool done() const
+  {
+    return data_.empty();
+  }
+
+private:
+  std::string_view data_;
+
+  // Reads the number of entries of a list, each taking at least `min_size`
+  // bytes, so that a bogus count can't make us allocate more than the record.
+  bool count_of(uint32_t &count, size_t min_size)
+  {
+    return u32(count) && count <= data_.size() / min_size;
+  }
+};
+
+} // namespace
+
+BinaryOutput::BinaryOutput(std::ostream &out, std::vector<PrintfSchema> schemas)
+    : out_(out), schemas_(std::move(schemas)), written_(schemas_.size())
+{
+  buf_.reserve(4096);
+  begin(Kind::START);
+  buf_.append(binary::MAGIC, sizeof(binary::MAGIC));
+  Encoder(buf_).u32(binary::VERSION);
+  write();
+}
+
+void BinaryOutput::begin(Kind kind)
+{
+  // The length is filled in by `write`.
+  buf_.append(sizeof(uint32_t), '\0');
+  buf_ += static_cast<char>(kind);
+}
+
+void BinaryOutput::write()
+{
+  std::string len;
+  Encoder(len).u32(buf_.size() - sizeof(uint32_t));
+  std::memcpy(buf_.data(), len.data(), sizeof(uint32_t));
+  out_.write(buf_.data(), buf_.size());
+  buf_.clear();
+}
+
+void BinaryOutput::map(const std::string &name, const Value &value)
+{
+  begin(Kind::MAP);
+  Encoder enc(buf_);
+  enc.string(name);
+  enc.value(value);
+  write();
+}
+
+void BinaryOutput::value(const Value &value)
+{
+  begin(Kind::VALUE);
+  Encoder(buf_).value(value);
+  write();
+}
+
+void BinaryOutput::printf(const std::string &str,
+                          const SourceInfo &info,
+                          PrintfSeverity severity)
+{
+  begin(Kind::PRINTF_STRING);
+  Encoder enc(buf_);
+  enc.u8(static_cast<uint8_t>(severity));
+  enc.string(str);
+  enc.source_info(info);
+  write();
+}
+
+bool BinaryOutput::printf_args(size_t id, const std::vector<Primitive> &args)
+{
+  if (id >= schemas_.size()) {
+    return false;
+  }
+  Encoder enc(buf_);
+  if (!written_[id]) {
+    const auto &schema = schemas_[id];
+    begin(Kind::PRINTF_SCHEMA);
+    enc.u32(id);
+    enc.string(schema.format);
+    enc.strings(schema.types);
+    enc.u8(static_cast<uint8_t>(schema.severity));
+    enc.source_info(schema.info);
+    write();
+    written_[id] = true;
+  }
+  begin(Kind::PRINTF);
+  enc.u32(id);
+  enc.primitives(args);
+  write();
+  return true;
+}
+
+void BinaryOutput::time(const std::string &time)
+{
+  begin(Kind::TIME);
+  Encoder(buf_).string(time);
+  write();
+}
+
+void BinaryOutput::cat(const std::string &cat)
+{
+  begin(Kind::CAT);
+  Encoder(buf_).string(cat);
+  write();
+}
+
+void BinaryOutput::join(const std::string &join)
+{
+  begin(Kind::JOIN);
+  Encoder(buf_).string(join);
+  write();
+}
+
+void BinaryOutput::syscall(const std::string &syscall)
+{
+  begin(Kind::SYSCALL);
+  Encoder(buf_).string(syscall);
+  write();
+}
+
+// u64 count, list of (string probe, string event, string location, u64 count,
+// u64 rate),
+// u8 has occupancy, [u64 occupancy]
+void BinaryOutput::lost_events(const LostEvents &lost)
+{
+  begin(Kind::LOST_EVENTS);
+  Encoder enc(buf_);
+  enc.u64(lost.count);
+  enc.u32(lost.sources.size());
+  for (const auto &source : lost.sources) {
+    enc.string(source.probe);
+    enc.string(source.event);
+    enc.string(source.location);
+    enc.u64(source.count);
+    enc.u64(source.rate);
+  }
+  enc.u8(lost.ring_occupancy ? 1 : 0);
+  if (lost.ring_occupancy) {
+    enc.u64(*lost.ring_occupancy);
+  }
+  write();
+}
+
+void BinaryOutput::attached_probes(uint64_t num_probes)
+{
+  begin(Kind::ATTACHED_PROBES);
+  Encoder(buf_).u64(num_probes);
+  write();
+}
+
+// u64 interval, u8 total, list of (string name, u64 events, u64 run time,
+// u64 recursion misses, u64 ns per event, u64 events per sec, double share),
+// u64 ring buffer wakeups, u64 wakeups per sec, u64 timer flushes
+void BinaryOutput::probe_stats(const ProbeStats &stats)
+{
+  begin(Kind::PROBE_STATS);
+  Encoder enc(buf_);
+  enc.u64(stats.interval_ns);
+  enc.u8(stats.total ? 1 : 0);
+  enc.u32(stats.probes.size());
+  for (const auto &probe : stats.probes) {
+    enc.string(probe.name);
+    enc.u64(probe.events);
+    enc.u64(probe.run_time_ns);
+    enc.u64(probe.recursion_misses);
+    enc.u64(probe.ns_per_event);
+    enc.u64(probe.events_per_sec);
+    enc.u64(std::bit_cast<uint64_t>(probe.cpu_share));
+  }
+  enc.u64(stats.ringbuf_wakeups);
+  enc.u64(stats.ringbuf_wakeups_per_sec);
+  enc.u64(stats.ringbuf_timer_flushes);
+  write();
+}
+
+void BinaryOutput::runtime_error(int retcode, const RuntimeErrorInfo &info)
+{
+  begin(Kind::RUNTIME_ERROR);
+  Encoder enc(buf_);
+  enc.integer(static_cast<int32_t>(retcode));
+  enc.u8(static_cast<uint8_t>(info.error_id));
+  enc.u32(static_cast<uint32_t>(info.func_id));
+  enc.source_info(info);
+  write();
+}
+
+void BinaryOutput::end()
+{
+  begin(Kind::END);
+  write();
+  out_.flush();
+}
+
+// list of test names, u64 index, i64 duration, list of u8 passed, string output
+void BinaryOutput::test_result(const std::vector<std::string> &all_tests,
+                               size_t index,
+                               std::chrono::nanoseconds duration,
+                               const std::vector<bool> &passed,
+                               std::string output)
+{
+  begin(Kind::TEST_RESULT);
+  Encoder enc(buf_);
+  enc.strings(all_tests);
+  enc.u64(index);
+  enc.i64(duration.count());
+  enc.u32(passed.size());
+  for (bool p : passed) {
+    enc.u8(p ? 1 : 0);
+  }
+  enc.string(output);
+  write();
+}
+
+// list of benchmark names, u64 index, i64 average, u64 iterations
+void BinaryOutput::benchmark_result(const std::vector<std::string> &all_benches,
+                                    size_t index,
+                                    std::chrono::nanoseconds average,
+                                    size_t iters)
+{
+  begin(Kind::BENCHMARK_RESULT);
+  Encoder enc(buf_);
+  enc.strings(all_benches);
+  enc.u64(index);
+  enc.i64(average.count());
+  enc.u64(iters);
+  write();
+}
+
+char BinaryFormatError::ID;
+void BinaryFormatError::log(llvm::raw_ostream &OS) const
+{
+  OS << "malformed binary output: " << msg_;
+}
+
+// Warnings and errors are reported with their location, so they must have one.
+static bool valid_severity(uint8_t severity, const SourceInfo &info)
+{
+  switch (static_cast<PrintfSeverity>(severity)) {
+    case PrintfSeverity::NONE:
+      return true;
+    case PrintfSeverity::ERROR:
+    case PrintfSeverity::WARNING:
+      return !info.locations.empty();
+  }
+  return false;
+}
+
+// Replays a single record; returns false if it is malformed.
+static bool replay_record(Kind kind,
+                          Decoder &dec,
+                          Output &out,
+                          std::unordered_map<uint32_t, PrintfSchema> &schemas,
+                          const PrintfFormatter &format)
+{
+  switch (kind) {
+    case Kind::START: {
+      // Only the first one is checked by the caller; later ones start over.
+      schemas.clear();
+      return true;
+    }
+    case Kind::PRINTF_SCHEMA: {
+      uint32_t id = 0;
+      PrintfSchema schema;
+      uint8_t severity = 0;
+      if (!dec.u32(id) || !dec.string(schema.format) ||
+          !dec.strings(schema.types) || !dec.u8(severity) ||
+          !dec.source_info(schema.info) ||
+          !valid_severity(severity, schema.info)) {
+        return false;
+      }
+      schema.severity = static_cast<PrintfSeverity>(severity);
+      schemas[id] = std::move(schema);
+      return true;
+    }
+    case Kind::PRINTF: {
+      uint32_t id = 0;
+      std::vector<Primitive> args;
+      if (!dec.u32(id) || !dec.primitives(args, 0)) {
+        return false;
+      }
+      auto it = schemas.find(id);
+      if (it == schemas.end()) {
+        return false;
+      }
+      const auto &schema = it->second;
+      out.printf(format(schema, args), schema.info, schema.severity);
+      return true;
+    }
+    case Kind::PRINTF_STRING: {
+      uint8_t severity = 0;
+      std::string str;
+      SourceInfo info;
+      if (!dec.u8(severity) || !dec.string(str) || !dec.source_info(info) ||
+          !valid_severity(severity, info)) {
+        return false;
+      }
+      out.printf(str, info, static_cast<PrintfSeverity>(severity));
+      return true;
+    }
+    case Kind::MAP: {
+      std::string name;
+      if (!dec.string(name)) {
+        return false;
+      }
+      auto value = dec.value(0);
+      if (!value) {
+        return false;
+      }
+      out.map(name, *value);
+      return true;
+    }
+    case Kind::VALUE: {
+      auto value = dec.value(0);
+      if (!value) {
+        return false;
+      }
+      out.value(*value);
+      return true;
+    }
+    case Kind::TIME:
+    case Kind::CAT:
+    case Kind::JOIN:
+    case Kind::SYSCALL: {
+      std::string str;
+      if (!dec.string(str)) {
+        return false;
+      }
+      if (kind == Kind::TIME) {
+        out.time(str);
+      } else if (kind == Kind::CAT) {
+        out.cat(str);
+      } else if (kind == Kind::JOIN) {
+        out.join(str);
+      } else {
+        out.syscall(str);
+      }
+      return true;
+    }
+    case Kind::END: {
+      out.end();
+      return true;
+    }
+    case Kind::LOST_EVENTS: {
+      LostEvents lost;
+      uint32_t count = 0;
+      if (!dec.u64(lost.count) || !dec.u32(count)) {
+        return false;
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        LostEvents::Source source;
+        if (!dec.string(source.probe) || !dec.string(source.event) ||
+            !dec.string(source.location) || !dec.u64(source.count) ||
+            !dec.u64(source.rate)) {
+          return false;
+        }
+        lost.sources.emplace_back(std::move(source));
+      }
+      uint8_t has_occupancy = 0;
+      if (!dec.u8(has_occupancy)) {
+        return false;
+      }
+      if (has_occupancy) {
+        uint64_t occupancy = 0;
+        if (!dec.u64(occupancy)) {
+          return false;
+        }
+        lost.ring_occupancy = occupancy;
+      }
+      out.lost_events(lost);
+      return true;
+    }
+    case Kind::ATTACHED_PROBES: {
+      uint64_t num_probes = 0;
+      if (!dec.u64(num_probes)) {
+        return false;
+      }
+      out.attached_probes(num_probes);
+      return true;
+    }
+    case Kind::PROBE_STATS: {
+      ProbeStats stats;
+      uint8_t total = 0;
+      uint32_t count = 0;
+      if (!dec.u64(stats.interval_ns) || !dec.u8(total) || !dec.u32(count)) {
+        return false;
+      }
+      stats.total = total != 0;
+      for (uint32_t i = 0; i < count; i++) {
+        ProbeStats::Probe probe;
+        uint64_t cpu_share = 0;
+        if (!dec.string(probe.name) || !dec.u64(probe.events) ||
+            !dec.u64(probe.run_time_ns) || !dec.u64(probe.recursion_misses) ||
+            !dec.u64(probe.ns_per_event) || !dec.u64(probe.events_per_sec) ||
+            !dec.u64(cpu_share)) {
+          return false;
+        }
+        probe.cpu_share = std::bit_cast<double>(cpu_share);
+        stats.probes.emplace_back(std::move(probe));
+      }
+      if (!dec.u64(stats.ringbuf_wakeups) ||
+          !dec.u64(stats.ringbuf_wakeups_per_sec) ||
+          !dec.u64(stats.ringbuf_timer_flushes)) {
+        return false;
+      }
+      out.probe_stats(stats);
+      return true;
+    }
+    case Kind::RUNTIME_ERROR: {
+      int32_t retcode = 0;
+      uint8_t error_id = 0;
+      uint32_t func_id = 0;
+      RuntimeErrorInfo info;
+      if (!dec.integer(retcode) || !dec.u8(error_id) || !dec.u32(func_id) ||
+          !dec.source_info(info) || info.locations.empty()) {
+        return false;
+      }
+      info.error_id = static_cast<RuntimeErrorId>(error_id);
+      info.func_id = static_cast<bpf_func_id>(func_id);
+      out.runtime_error(retcode, info);
+      return true;
+    }
+    case Kind::TEST_RESULT: {
+      std::vector<std::string> all_tests;
+      uint64_t index = 0;
+      int64_t duration = 0;
+      uint32_t count = 0;
+      if (!dec.strings(all_tests) || !dec.u64(index) || !dec.i64(duration) ||
+          !dec.u32(count)) {
+        return false;
+      }
+      std::vector<bool> passed;
+      for (uint32_t i = 0; i < count; i++) {
+        uint8_t p = 0;
+        if (!dec.u8(p)) {
+          return false;
+        }
+        passed.push_back(p != 0);
+      }
+      std::string output;
+      if (!dec.string(output) || index >= all_tests.size() ||
+          index >= passed.size()) {
+        return false;
+      }
+      out.test_result(all_tests,
+                      index,
+                      std::chrono::nanoseconds(duration),
+                      passed,
+                      std::move(output));
+      return true;
+    }
+    case Kind::BENCHMARK_RESULT: {
+      std::vector<std::string> all_benches;
+      uint64_t index = 0;
+      int64_t average = 0;
+      uint64_t iters = 0;
+      if (!dec.strings(all_benches) || !dec.u64(index) || !dec.i64(average) ||
+          !dec.u64(iters) || index >= all_benches.size()) {
+        return false;
+      }
+      out.benchmark_result(all_benches,
+                           index,
+                           std::chrono::nanoseconds(average),
+                           iters);
+      return true;
+    }
+  }
+
+  // Records of a kind added later are skipped.
+  return true;
+}
+
+Result<> replay_binary(std::istream &in,
+                       Output &out,
+                       const PrintfFormatter &format)
+{
+  std::unordered_map<uint32_t, PrintfSchema> schemas;
+  std::string record;
+  for (size_t n = 0;; n++) {
+    char len_buf[sizeof(uint32_t)];
+    in.read(len_buf, sizeof(len_buf));
+    if (in.gcount() == 0 && in.eof()) {
+      if (n == 0) {
+        return make_error<BinaryFormatError>("empty stream");
+      }
+      return OK();
+    }
+    uint32_t len = 0;
+    if (in.gcount() != sizeof(len_buf) ||
+        !Decoder(std::string_view(len_buf, sizeof(len_buf))).u32(len) ||
+        len == 0) {
+      return make_error<BinaryFormatError>("truncated record " +
+                                           std::to_string(n));
+    }
+    // The length isn't trusted until the data is there, so the record is
+    // read in chunks rather than allocated upfront.
+    record.clear();
+    while (record.size() < len) {
+      size_t offset = record.size();
+      size_t chunk = std::min<size_t>(len - offset, 1 << 20);
+      record.resize(offset + chunk);
+      in.read(record.data() + offset, chunk);
+      if (static_cast<size_t>(in.gcount()) != chunk) {
+        return make_error<BinaryFormatError>("truncated record " +
+                                             std::to_string(n));
+      }
+    }
+
+    Decoder dec(record);
+    uint8_t raw_kind = 0;
+    dec.u8(raw_kind);
+    auto kind = static_cast<Kind>(raw_kind);
+    if (n == 0) {
+      // The stream must start with the magic, and a version we can read.
+      std::string_view magic(record.data() + 1,
+                             std::min<size_t>(len - 1, sizeof(binary::MAGIC)));
+      Decoder header(std::string_view(record).substr(1 + magic.size()));
+      uint32_t version = 0;
+      if (kind != Kind::START ||
+          magic != std::string_view(binary::MAGIC, sizeof(binary::MAGIC)) ||
+          !header.u32(version)) {
+        return make_error<BinaryFormatError>("not a bpftrace binary stream");
+      }
+      if (version != binary::VERSION) {
+        return make_error<BinaryFormatError>("unsupported version " +
+                                             std::to_string(version));
+      }
+      continue;
+    }
+    if (!replay_record(kind, dec, out, schemas, format)) {
+      return make_error<BinaryFormatError>("bad record " + std::to_string(n));
+    }
+  }
+}
+
+} // namespace bpftrace::output
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "output/output.h"
+#include "util/result.h"
+
+namespace bpftrace::output {
+
+// The encoding of BinaryOutput, which is read back by `replay_binary`.
+//
+// The stream is a sequence of records, each a u32 length followed by that many
+// bytes: a u8 kind and its body. All integers are little-endian, since the
+// stream is meant to be shipped to other hosts. Bump the version whenever the
+// encoding changes; readers skip records of kinds they don't know.
+//
+//   string:    u32 length, followed by `length` bytes
+//   list:      u32 count, followed by `count` entries
+//   primitive: u8 tag, followed by the value (see `Tag`)
+//
+// Every stream starts with a `START` record; a later one (e.g. when the
+// output of a new version of a script is appended with --watch) invalidates
+// the printf schemas read so far. The schema of a printf call site is written
+// once, before its first event, so that events only carry the site and the
+// raw arguments.
+namespace binary {
+
+constexpr char MAGIC[8] = { 'B', 'T', 'O', 'U', 'T', 'P', 'U', 'T' };
+constexpr uint32_t VERSION = 1;
+
+enum class Kind : uint8_t {
+  START = 0,             // magic, u32 version
+  PRINTF_SCHEMA = 1,     // u32 site, schema
+  PRINTF = 2,            // u32 site, list of primitives
+  PRINTF_STRING = 3,     // u8 severity, string, source info
+  MAP = 4,               // string name, value
+  VALUE = 5,             // value
+  TIME = 6,              // string
+  CAT = 7,               // string
+  JOIN = 8,              // string
+  SYSCALL = 9,           // string
+  END = 10,              // (empty)
+  LOST_EVENTS = 11,      // see `BinaryOutput::lost_events`
+  ATTACHED_PROBES = 12,  // u64 count
+  PROBE_STATS = 13,      // see `BinaryOutput::probe_stats`
+  RUNTIME_ERROR = 14,    // i32 retcode, u8 error id, u32 func id, source info
+  TEST_RESULT = 15,      // see `BinaryOutput::test_result`
+  BENCHMARK_RESULT = 16, // see `BinaryOutput::benchmark_result`
+};
+
+enum class Tag : uint8_t {
+  // Primitives.
+  NONE = 0,
+  BOOL = 1,           // u8
+  INT64 = 2,          // i64
+  UINT64 = 3,         // u64
+  DOUBLE = 4,         // IEEE 754 bits as u64
+  STRING = 5,         // string
+  ARRAY = 6,          // list of primitives
+  BUFFER = 7,         // string
+  TUPLE = 8,          // list of primitives
+  RECORD = 9,         // list of (string, primitive)
+  SYMBOLIC = 10,      // string, u64
+  TIMESTAMP = 11,     // i64 nanoseconds since the epoch
+  DURATION = 12,      // u64 nanoseconds
+
+  // Values that aren't primitives.
+  HISTOGRAM = 0x20,   // u8 has min, [primitive], primitives, list of u64
+  VECTOR = 0x21,      // list of values
+  ORDERED_MAP = 0x22, // list of (primitive, value)
+  STATS = 0x23,       // an ordered map or primitive value
+  TIME_SERIES = 0x24, // list of (i64 timestamp, primitive)
+};
+
+} // namespace binary
+
+// PrintfSchema describes a printf call site, so that its events can be
+// formatted when they are read back.
+struct PrintfSchema {
+  std::string format;
+  // The bpftrace type of each argument, for consumers of the raw events.
+  std::vector<std::string> types;
+  PrintfSeverity severity = PrintfSeverity::NONE;
+  SourceInfo info;
+};
+
+// BinaryOutput writes a compact, length-prefixed encoding of the output,
+// rather than rendering it as text. It is meant for exporting high rates of
+// events to a collector, which can decode them without parsing text; the
+// stream can also be converted to text or JSON with `bpftrace --decode`.
+class BinaryOutput : public Output {
+public:
+  // The schemas are indexed by the printf call site.
+  BinaryOutput(std::ostream &out, std::vector<PrintfSchema> schemas);
+
+  void map(const std::string &name, const Value &value) override;
+  void value(const Value &value) override;
+  void printf(const std::string &str,
+              const SourceInfo &info,
+              PrintfSeverity severity) override;
+  bool printf_args(size_t id, const std::vector<Primitive> &args) override;
+  void time(const std::string &time) override;
+  void cat(const std::string &cat) override;
+  void join(const std::string &join) override;
+  void syscall(const std::string &syscall) override;
+
+  void lost_events(const LostEvents &lost) override;
+  void attached_probes(uint64_t num_probes) override;
+  void probe_stats(const ProbeStats &stats) override;
+  void runtime_error(int retcode, const RuntimeErrorInfo &info) override;
+  void end() override;
+
+  void test_result(const std::vector<std::string> &all_tests,
+                   size_t index,
+                   std::chrono::nanoseconds duration,
+                   const std::vector<bool> &passed,
+                   std::string output) override;
+
+  void benchmark_result(const std::vector<std::string> &all_benches,
+                        size_t index,
+                        std::chrono::nanoseconds average,
+                        size_t iters) override;
+
+private:
+  std::ostream &out_;
+  std::vector<PrintfSchema> schemas_;
+  // Whether the schema of each call site has been written.
+  std::vector<bool> written_;
+
+  // The record being encoded, kept across records to reuse its memory.
+  std::string buf_;
+
+  // Starts a record of the given kind in `buf_`.
+  void begin(binary::Kind kind);
+  // Fills in the length of the record and writes it out.
+  void write();
+};
+
+class BinaryFormatError : public ErrorInfo<BinaryFormatError> {
+public:
+  BinaryFormatError(std::string msg) : msg_(std::move(msg)) {};
+  static char ID;
+  void log(llvm::raw_ostream &OS) const override;
+
+private:
+  std::string msg_;
+};
+
+// Formats the arguments of a printf call site.
+using PrintfFormatter = std::function<
+    std::string(const PrintfSchema &schema, const std::vector<Primitive> &args)>;
+
+// Reads a stream written by BinaryOutput and replays it on the given output,
+// e.g. to convert it to text or JSON. Printf events are formatted with the
+// given function, as the output library doesn't know how to.
+Result<> replay_binary(std::istream &in,
+                       Output &out,
+                       const PrintfFormatter &format);
+
+} // namespace bpftrace::output
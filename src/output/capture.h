@@ -63,11 +63,15 @@ public:
   {
     nested_.end();
   }
+  void probe_stats(const ProbeStats &stats) override
+  {
+    nested_.probe_stats(stats);
+  }
 
   // Increment our counters.
-  void lost_events(uint64_t lost) override
+  void lost_events(const LostEvents &lost) override
   {
-    lost_events_count += lost;
+    lost_events_count += lost.count;
     nested_.lost_events(lost);
   }
   void attached_probes(uint64_t num_probes) override
@@ -49,12 +49,15 @@ public:
   void end() override
   {
   }
-  void lost_events([[maybe_unused]] uint64_t lost) override
+  void lost_events([[maybe_unused]] const LostEvents &lost) override
   {
   }
   void attached_probes([[maybe_unused]] uint64_t num_probes) override
   {
   }
+  void probe_stats([[maybe_unused]] const ProbeStats &stats) override
+  {
+  }
   void runtime_error([[maybe_unused]] int retcode,
                      [[maybe_unused]] const RuntimeErrorInfo &info) override
   {
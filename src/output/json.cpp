@@ -1,63 +1,141 @@
-#include <iomanip>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <string_view>
 
 #include "output/json.h"
 
 namespace bpftrace::output {
 
+// Messages are rendered into a string, which is then written to the stream
+// with a single write. Nothing here flushes the stream: when the output
+// reaches the file is up to the stream's buffering mode.
+
+template <typename T>
+static std::string to_text(const T &v)
+{
+  std::ostringstream ss;
+  ss << v; // Use default representation.
+  return ss.str();
+}
+
+template <typename T>
+static void append_chars(std::string &out, T v, auto... format)
+{
+  // Large enough for any double in fixed notation, e.g. DBL_MAX has 309
+  // digits before the decimal point.
+  char buf[std::numeric_limits<double>::max_exponent10 + 32];
+  auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v, format...);
+  if (ec != std::errc()) {
+    out += to_text(v);
+    return;
+  }
+  out.append(buf, end);
+}
+
+// Doubles are formatted as std::to_string does, i.e. as %f.
+static void append_fixed(std::string &out, double v)
+{
+  append_chars(out, v, std::chars_format::fixed, 6);
+}
+
+// Doubles are formatted as std::ostream does by default, i.e. as %g.
+static void append_general(std::string &out, double v)
+{
+  append_chars(out, v, std::chars_format::general, 6);
+}
+
+static bool needs_escape(char c)
+{
+  return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+// Returns the length of the prefix of `s` that needs no escaping. Strings are
+// mostly plain, so this checks eight bytes at a time.
+static size_t plain_prefix(std::string_view s)
+{
+  constexpr uint64_t ones = 0x0101010101010101ULL;
+  constexpr uint64_t highs = 0x8080808080808080ULL;
+  // Sets the high bit of the bytes below n (for n <= 128) if there are any.
+  auto has_less = [&](uint64_t x, uint64_t n) {
+    return (x - (ones * n)) & ~x & highs;
+  };
+
+  size_t i = 0;
+  for (; i + 8 <= s.size(); i += 8) {
+    uint64_t w;
+    std::memcpy(&w, s.data() + i, sizeof(w));
+    if (has_less(w, 0x20) || has_less(w ^ (ones * '"'), 1) ||
+        has_less(w ^ (ones * '\\'), 1)) {
+      break;
+    }
+  }
+  while (i < s.size() && !needs_escape(s[i])) {
+    i++;
+  }
+  return i;
+}
+
 template <typename T>
 struct JsonEmitter;
 
 template <>
 struct JsonEmitter<bool> {
-  static void emit(std::ostream &out, const bool &v)
+  static void emit(std::string &out, const bool &v)
   {
     if (v) {
-      out << "true";
+      out += "true";
     } else {
-      out << "false";
+      out += "false";
     }
   }
 };
 
 template <>
 struct JsonEmitter<std::string> {
-  static void emit(std::ostream &out, const std::string &s)
+  static void emit(std::string &out, std::string_view s)
   {
-    out << "\"";
-    for (const char c : s) {
+    static constexpr char hex[] = "0123456789abcdef";
+    out.reserve(out.size() + s.size() + 2);
+    out += '"';
+    while (!s.empty()) {
+      auto n = plain_prefix(s);
+      out.append(s.data(), n);
+      if (n == s.size()) {
+        break;
+      }
+      const char c = s[n];
       switch (c) {
         case '"':
-          out << "\\\"";
+          out += "\\\"";
           break;
 
         case '\\':
-          out << "\\\\";
+          out += "\\\\";
           break;
 
         case '\n':
-          out << "\\n";
+          out += "\\n";
           break;
 
         case '\r':
-          out << "\\r";
+          out += "\\r";
           break;
 
         case '\t':
-          out << "\\t";
+          out += "\\t";
           break;
 
         default:
-          // c always >= '\x00'
-          if (c <= '\x1f') {
-            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
-                << static_cast<int>(c);
-          } else {
-            out << c;
-          }
+          out += "\\u00";
+          out += hex[(c >> 4) & 0xf];
+          out += hex[c & 0xf];
       }
+      s.remove_prefix(n + 1);
     }
-    out << "\"";
+    out += '"';
   }
 };
 
@@ -66,42 +144,45 @@ template <typename T>
            std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t> ||
            std::is_same_v<T, double> || std::is_same_v<T, char>)
 struct JsonEmitter<T> {
-  static void emit(std::ostream &out, const T &v)
+  static void emit(std::string &out, const T &v)
   {
-    // JSON does not support numbers other than floating point, therefore
-    // we emit int64_t as a string if it is not representable as a 64-bit
-    // floating point. This is encoded in the spec in RFC 8259, and is a
-    // common footgun people encounter at some point after choosing JSON.
-    auto s = std::to_string(v);
-    if constexpr (!std::is_same_v<T, double>) {
+    if constexpr (std::is_same_v<T, double>) {
+      append_fixed(out, v);
+    } else if constexpr (std::is_same_v<T, char>) {
+      append_chars(out, static_cast<int>(v));
+    } else {
+      // JSON does not support numbers other than floating point, therefore
+      // we emit int64_t as a string if it is not representable as a 64-bit
+      // floating point. This is encoded in the spec in RFC 8259, and is a
+      // common footgun people encounter at some point after choosing JSON.
       if (static_cast<T>(static_cast<double>(v)) != v) {
-        return JsonEmitter<std::string>::emit(out, s);
+        out += '"';
+        append_chars(out, v);
+        out += '"';
+        return;
       }
+      append_chars(out, v);
     }
-    out << s;
   }
 };
 
 template <typename K, typename V>
 struct JsonEmitter<std::vector<std::pair<K, V>>> {
-  static void emit(std::ostream &out, const std::vector<std::pair<K, V>> &m)
+  static void emit(std::string &out, const std::vector<std::pair<K, V>> &m)
   {
-    out << "{";
+    out += '{';
     bool first = true;
     for (const auto &[key, value] : m) {
       if (!first) {
-        out << ", "; // N.B. Objects are spaced, see below.
+        out += ", "; // N.B. Objects are spaced, see below.
       }
 
       // Keys are always converted to strings. If this corresponds to a tuple
       // string (e.g. "(1, 2)"), then we explicitly strip off the parentheses.
-      std::string s;
       if constexpr (std::is_same_v<std::decay_t<decltype(key)>, std::string>) {
-        s = key;
+        JsonEmitter<std::string>::emit(out, key);
       } else {
-        std::stringstream ss;
-        ss << Primitive(key);
-        s = ss.str();
+        std::string s = to_text(Primitive(key));
         if (s.size() >= 2 && s[0] == '(' && s[s.size() - 1] == ')') {
           s = s.substr(1, s.size() - 2);
         }
@@ -109,38 +190,38 @@ struct JsonEmitter<std::vector<std::pair<K, V>>> {
         // that this is different from the text representation, which does
         // still include spaces for most tuples.
         std::erase(s, ' ');
+        JsonEmitter<std::string>::emit(out, s);
       }
-      JsonEmitter<std::string>::emit(out, s);
 
       // Leave the values as they are.
-      out << ": ";
+      out += ": ";
       JsonEmitter<std::decay_t<decltype(value)>>::emit(out, value);
       first = false;
     }
-    out << "}";
+    out += '}';
   }
 };
 
 template <typename T>
 struct JsonEmitter<std::vector<T>> {
-  static void emit(std::ostream &out, const std::vector<T> &v)
+  static void emit(std::string &out, const std::vector<T> &v)
   {
-    out << "[";
+    out += '[';
     bool first = true;
     for (const auto &elem : v) {
       if (!first) {
-        out << ","; // N.B. Arrays are unspaced, see above.
+        out += ','; // N.B. Arrays are unspaced, see above.
       }
       JsonEmitter<T>::emit(out, elem);
       first = false;
     }
-    out << "]";
+    out += ']';
   }
 };
 
 template <typename... Types>
 struct JsonEmitter<std::variant<Types...>> {
-  static void emit(std::ostream &out, const std::variant<Types...> &v)
+  static void emit(std::string &out, const std::variant<Types...> &v)
   {
     std::visit(
         [&](const auto &v) {
@@ -152,15 +233,15 @@ struct JsonEmitter<std::variant<Types...>> {
 
 template <>
 struct JsonEmitter<std::monostate> {
-  static void emit(std::ostream &out, [[maybe_unused]] const std::monostate &v)
+  static void emit(std::string &out, [[maybe_unused]] const std::monostate &v)
   {
-    out << "null";
+    out += "null";
   }
 };
 
 template <>
 struct JsonEmitter<Primitive> {
-  static void emit(std::ostream &out, const Primitive &v)
+  static void emit(std::string &out, const Primitive &v)
   {
     JsonEmitter<Primitive::Variant>::emit(out, v.variant);
   }
@@ -168,7 +249,7 @@ struct JsonEmitter<Primitive> {
 
 template <>
 struct JsonEmitter<Primitive::Record> {
-  static void emit(std::ostream &out, const Primitive::Record &v)
+  static void emit(std::string &out, const Primitive::Record &v)
   {
     JsonEmitter<std::decay_t<decltype(v.fields)>>::emit(out, v.fields);
   }
@@ -176,7 +257,7 @@ struct JsonEmitter<Primitive::Record> {
 
 template <>
 struct JsonEmitter<Primitive::Array> {
-  static void emit(std::ostream &out, const Primitive::Array &v)
+  static void emit(std::string &out, const Primitive::Array &v)
   {
     JsonEmitter<std::vector<Primitive>>::emit(out, v.values);
   }
@@ -184,7 +265,7 @@ struct JsonEmitter<Primitive::Array> {
 
 template <>
 struct JsonEmitter<Primitive::Buffer> {
-  static void emit(std::ostream &out, const Primitive::Buffer &v)
+  static void emit(std::string &out, const Primitive::Buffer &v)
   {
     JsonEmitter<std::vector<char>>::emit(out, v.data);
   }
@@ -192,7 +273,7 @@ struct JsonEmitter<Primitive::Buffer> {
 
 template <>
 struct JsonEmitter<Primitive::Tuple> {
-  static void emit(std::ostream &out, const Primitive::Tuple &v)
+  static void emit(std::string &out, const Primitive::Tuple &v)
   {
     JsonEmitter<std::vector<Primitive>>::emit(out, v.values);
   }
@@ -200,7 +281,7 @@ struct JsonEmitter<Primitive::Tuple> {
 
 template <>
 struct JsonEmitter<Primitive::Symbolic> {
-  static void emit(std::ostream &out, const Primitive::Symbolic &v)
+  static void emit(std::string &out, const Primitive::Symbolic &v)
   {
     // JSON does not emit symbolic values.
     JsonEmitter<uint64_t>::emit(out, v.numeric);
@@ -209,21 +290,17 @@ struct JsonEmitter<Primitive::Symbolic> {
 
 template <>
 struct JsonEmitter<Primitive::Timestamp> {
-  static void emit(std::ostream &out, const Primitive::Timestamp &v)
+  static void emit(std::string &out, const Primitive::Timestamp &v)
   {
-    std::stringstream ss;
-    ss << v; // Use default representation.
-    JsonEmitter<std::string>::emit(out, ss.str());
+    JsonEmitter<std::string>::emit(out, to_text(v));
   }
 };
 
 template <>
 struct JsonEmitter<Primitive::Duration> {
-  static void emit(std::ostream &out, const Primitive::Duration &v)
+  static void emit(std::string &out, const Primitive::Duration &v)
   {
-    std::stringstream ss;
-    ss << v; // Use default representation.
-    JsonEmitter<std::string>::emit(out, ss.str());
+    JsonEmitter<std::string>::emit(out, to_text(v));
   }
 };
 
@@ -253,23 +330,23 @@ std::optional<int64_t> one_less(const T &v)
 
 template <>
 struct JsonEmitter<Value::Histogram> {
-  static void emit(std::ostream &out, const Value::Histogram &hist)
+  static void emit(std::string &out, const Value::Histogram &hist)
   {
-    out << "[";
+    out += '[';
     bool first = true;
     for (size_t i = 0; i < hist.counts.size(); i++) {
       if (!first) {
-        out << ",";
+        out += ',';
       }
-      out << "{";
+      out += '{';
       if (i == 0 && hist.lower_bound) {
-        out << "\"min\": ";
+        out += "\"min\": ";
         JsonEmitter<Primitive>::emit(out, *hist.lower_bound);
-        out << ", ";
+        out += ", ";
       } else if (i > 0) {
-        out << "\"min\": ";
+        out += "\"min\": ";
         JsonEmitter<Primitive>::emit(out, hist.labels[i - 1]);
-        out << ", ";
+        out += ", ";
       }
       if (i < hist.labels.size()) {
         // For whatever reason, the open-intervals for the JSON encoding are
@@ -278,26 +355,27 @@ struct JsonEmitter<Value::Histogram> {
         //
         // If we can't find a suitable "one less" representation, then we
         // just emit the label as is (be it string, whatever).
-        out << "\"max\": ";
+        out += "\"max\": ";
         auto v = one_less(hist.labels[i]);
         if (v) {
           JsonEmitter<int64_t>::emit(out, *v);
         } else {
           JsonEmitter<Primitive>::emit(out, hist.labels[i]);
         }
-        out << ", ";
+        out += ", ";
       }
-      out << "\"count\": " << hist.counts[i];
-      out << "}";
+      out += "\"count\": ";
+      append_chars(out, hist.counts[i]);
+      out += '}';
       first = false;
     }
-    out << "]";
+    out += ']';
   }
 };
 
 template <>
 struct JsonEmitter<Value::OrderedMap> {
-  static void emit(std::ostream &out, const Value::OrderedMap &m)
+  static void emit(std::string &out, const Value::OrderedMap &m)
   {
     JsonEmitter<std::decay_t<decltype(m.values)>>::emit(out, m.values);
   }
@@ -305,7 +383,7 @@ struct JsonEmitter<Value::OrderedMap> {
 
 template <>
 struct JsonEmitter<Value::Stats> {
-  static void emit(std::ostream &out, const Value::Stats &s)
+  static void emit(std::string &out, const Value::Stats &s)
   {
     JsonEmitter<std::decay_t<decltype(s.value)>>::emit(out, s.value);
   }
@@ -313,10 +391,10 @@ struct JsonEmitter<Value::Stats> {
 
 template <>
 struct JsonEmitter<Value::TimeSeries> {
-  static void emit(std::ostream &out, const Value::TimeSeries &tseries)
+  static void emit(std::string &out, const Value::TimeSeries &tseries)
   {
     bool first = true;
-    out << "[";
+    out += '[';
     for (const auto &[ts, value] : tseries.values) {
       if (std::holds_alternative<std::monostate>(value.variant)) {
         continue;
@@ -324,39 +402,56 @@ struct JsonEmitter<Value::TimeSeries> {
       if (first) {
         first = false;
       } else {
-        out << ",";
+        out += ',';
       }
-      out << R"({"interval_start":")" << ts << R"(","value":)" << value << "}";
+      out += R"({"interval_start":")";
+      out += to_text(ts);
+      out += R"(","value":)";
+      out += to_text(value);
+      out += '}';
     }
-    out << "]";
+    out += ']';
   }
 };
 
 template <>
 struct JsonEmitter<Value> {
-  static void emit(std::ostream &out, const Value &v)
+  static void emit(std::string &out, const Value &v)
   {
     JsonEmitter<Value::Variant>::emit(out, v.variant);
   }
 };
 
 template <typename T>
-void emit_data(std::ostream &out,
-               const std::string &type,
-               std::optional<std::string> &&name,
-               const T &v)
+static void emit_data(std::string &out,
+                      std::string_view type,
+                      std::optional<std::string> &&name,
+                      const T &v)
 {
-  out << R"({"type": ")" << type << R"(", "data": )";
+  out += R"({"type": ")";
+  out += type;
+  out += R"(", "data": )";
   if (name) {
-    out << "{";
+    out += '{';
     JsonEmitter<std::string>::emit(out, *name);
-    out << ": ";
+    out += ": ";
   }
   JsonEmitter<T>::emit(out, v);
   if (name) {
-    out << "}";
+    out += '}';
   }
-  out << "}" << std::endl;
+  out += '}';
+}
+
+// Emits the location of an error. Json only prints the top level location.
+static void emit_location(std::string &out, const SourceInfo &info)
+{
+  out += R"(, "filename": )";
+  JsonEmitter<std::string>::emit(out, info.locations.begin()->filename);
+  out += R"(, "line": )";
+  JsonEmitter<uint64_t>::emit(out, info.locations.begin()->line);
+  out += R"(, "col": )";
+  JsonEmitter<uint64_t>::emit(out, info.locations.begin()->column);
 }
 
 template <typename T>
@@ -380,6 +475,13 @@ bool has_type(const Value &value)
   return false;
 }
 
+void JsonOutput::write()
+{
+  buf_ += '\n';
+  out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+  buf_.clear();
+}
+
 void JsonOutput::map(const std::string &name, const Value &value)
 {
   if (std::holds_alternative<Value::OrderedMap>(value.variant)) {
@@ -391,7 +493,7 @@ void JsonOutput::map(const std::string &name, const Value &value)
   // If the value is a histogram, or a map of histograms, then we set the type
   // to `hist`. If it is explicitly a `stats` map, then set that type.
   // Otherwise, just set the message type to `map`.
-  std::string type = "map";
+  std::string_view type = "map";
   if (has_type<Value::Stats>(value)) {
     type = "stats";
   } else if (has_type<Value::TimeSeries>(value)) {
@@ -399,12 +501,14 @@ void JsonOutput::map(const std::string &name, const Value &value)
   } else if (has_type<Value::Histogram>(value)) {
     type = "hist";
   }
-  emit_data(out_, type, name, value);
+  emit_data(buf_, type, name, value);
+  write();
 }
 
 void JsonOutput::value(const Value &value)
 {
-  emit_data(out_, "value", std::nullopt, value);
+  emit_data(buf_, "value", std::nullopt, value);
+  write();
 }
 
 void JsonOutput::printf(const std::string &str,
@@ -413,25 +517,19 @@ void JsonOutput::printf(const std::string &str,
 {
   switch (severity) {
     case PrintfSeverity::NONE: {
-      emit_data(out_, "printf", std::nullopt, str);
+      emit_data(buf_, "printf", std::nullopt, str);
+      write();
       return;
     }
     case PrintfSeverity::WARNING:
     case PrintfSeverity::ERROR: {
       bool is_error = severity == PrintfSeverity::ERROR;
-      out_ << R"({"type": ")" << (is_error ? "errorf" : "warnf") << "\"";
-      out_ << R"(, "msg": )";
-      std::stringstream ss;
-      ss << str;
-      JsonEmitter<std::string>::emit(out_, ss.str());
-      // Json only prints the top level location
-      out_ << R"(, "filename": )";
-      JsonEmitter<std::string>::emit(out_, info.locations.begin()->filename);
-      out_ << R"(, "line": )";
-      JsonEmitter<uint64_t>::emit(out_, info.locations.begin()->line);
-      out_ << R"(, "col": )";
-      JsonEmitter<uint64_t>::emit(out_, info.locations.begin()->column);
-      out_ << R"(})" << std::endl;
+      buf_ += is_error ? R"({"type": "errorf")" : R"({"type": "warnf")";
+      buf_ += R"(, "msg": )";
+      JsonEmitter<std::string>::emit(buf_, str);
+      emit_location(buf_, info);
+      buf_ += '}';
+      write();
       return;
     }
   }
@@ -439,72 +537,142 @@ void JsonOutput::printf(const std::string &str,
 
 void JsonOutput::time(const std::string &time)
 {
-  emit_data(out_, "time", std::nullopt, time);
+  emit_data(buf_, "time", std::nullopt, time);
+  write();
 }
 
 void JsonOutput::cat(const std::string &cat)
 {
-  emit_data(out_, "cat", std::nullopt, cat);
+  emit_data(buf_, "cat", std::nullopt, cat);
+  write();
 }
 
 void JsonOutput::join(const std::string &join)
 {
-  emit_data(out_, "join", std::nullopt, join);
+  emit_data(buf_, "join", std::nullopt, join);
+  write();
 }
 
 void JsonOutput::syscall(const std::string &syscall)
 {
-  emit_data(out_, "syscall", std::nullopt, syscall);
+  emit_data(buf_, "syscall", std::nullopt, syscall);
+  write();
 }
 
-void JsonOutput::lost_events(uint64_t lost)
+void JsonOutput::lost_events(const LostEvents &lost)
 {
   // This is a special case, it emits both a count and the `data` field.
-  out_ << R"({"type": "lost_events", "count": )" << lost
-       << R"(, "data": {"events": )" << lost << "}}" << std::endl;
+  buf_ += R"({"type": "lost_events", "count": )";
+  append_chars(buf_, lost.count);
+  buf_ += R"(, "data": {"events": )";
+  append_chars(buf_, lost.count);
+  if (!lost.sources.empty()) {
+    buf_ += R"(, "sources": [)";
+    bool first = true;
+    for (const auto &source : lost.sources) {
+      if (!first) {
+        buf_ += ", ";
+      }
+      first = false;
+      buf_ += R"({"probe": )";
+      JsonEmitter<std::string>::emit(buf_, source.probe);
+      buf_ += R"(, "event": )";
+      JsonEmitter<std::string>::emit(buf_, source.event);
+      if (!source.location.empty()) {
+        buf_ += R"(, "location": )";
+        JsonEmitter<std::string>::emit(buf_, source.location);
+      }
+      buf_ += R"(, "count": )";
+      append_chars(buf_, source.count);
+      buf_ += R"(, "rate": )";
+      append_chars(buf_, source.rate);
+      buf_ += '}';
+    }
+    buf_ += ']';
+  }
+  if (lost.ring_occupancy) {
+    buf_ += R"(, "ring_occupancy": )";
+    append_chars(buf_, *lost.ring_occupancy);
+  }
+  buf_ += "}}";
+  write();
 }
 
 void JsonOutput::attached_probes(uint64_t num_probes)
 {
   // As with lost_events, this is a special case, we do a `count` and `data`
   // field.
-  out_ << R"({"type": "attached_probes", "count": )" << num_probes
-       << R"(, "data": {"probes": )" << num_probes << "}}" << std::endl;
+  buf_ += R"({"type": "attached_probes", "count": )";
+  append_chars(buf_, num_probes);
+  buf_ += R"(, "data": {"probes": )";
+  append_chars(buf_, num_probes);
+  buf_ += "}}";
+  write();
+}
+
+void JsonOutput::probe_stats(const ProbeStats &stats)
+{
+  buf_ += R"({"type": "probe_stats", "data": {"interval_ns": )";
+  append_chars(buf_, stats.interval_ns);
+  buf_ += R"(, "total": )";
+  buf_ += stats.total ? "true" : "false";
+  buf_ += R"(, "probes": [)";
+  bool first = true;
+  for (const auto &probe : stats.probes) {
+    if (!first) {
+      buf_ += ", ";
+    }
+    first = false;
+    buf_ += R"({"probe": )";
+    JsonEmitter<std::string>::emit(buf_, probe.name);
+    buf_ += R"(, "events": )";
+    append_chars(buf_, probe.events);
+    buf_ += R"(, "run_time_ns": )";
+    append_chars(buf_, probe.run_time_ns);
+    buf_ += R"(, "recursion_misses": )";
+    append_chars(buf_, probe.recursion_misses);
+    buf_ += R"(, "ns_per_event": )";
+    append_chars(buf_, probe.ns_per_event);
+    buf_ += R"(, "events_per_sec": )";
+    append_chars(buf_, probe.events_per_sec);
+    buf_ += R"(, "cpu_share": )";
+    append_general(buf_, probe.cpu_share);
+    buf_ += '}';
+  }
+  buf_ += R"(], "ringbuf_wakeups": )";
+  append_chars(buf_, stats.ringbuf_wakeups);
+  buf_ += R"(, "ringbuf_wakeups_per_sec": )";
+  append_chars(buf_, stats.ringbuf_wakeups_per_sec);
+  buf_ += R"(, "ringbuf_timer_flushes": )";
+  append_chars(buf_, stats.ringbuf_timer_flushes);
+  buf_ += "}}";
+  write();
 }
 
 void JsonOutput::runtime_error(int retcode, const RuntimeErrorInfo &info)
 {
   switch (info.error_id) {
     case RuntimeErrorId::HELPER_ERROR: {
-      out_ << R"({"type": "helper_error")";
-      out_ << R"(, "msg": )";
-      JsonEmitter<std::string>::emit(out_, strerror(-retcode));
-      out_ << R"(, "helper": )";
-      std::stringstream ss;
-      ss << info.func_id;
-      JsonEmitter<std::string>::emit(out_, ss.str());
-      out_ << R"(, "retcode": )";
-      JsonEmitter<int64_t>::emit(out_, retcode);
+      buf_ += R"({"type": "helper_error")";
+      buf_ += R"(, "msg": )";
+      JsonEmitter<std::string>::emit(buf_, strerror(-retcode));
+      buf_ += R"(, "helper": )";
+      JsonEmitter<std::string>::emit(buf_, to_text(info.func_id));
+      buf_ += R"(, "retcode": )";
+      JsonEmitter<int64_t>::emit(buf_, retcode);
       break;
     }
     default: {
-      out_ << R"({"type": "runtime_error")";
-      out_ << R"(, "msg": )";
-      std::stringstream ss;
-      ss << info;
-      JsonEmitter<std::string>::emit(out_, ss.str());
+      buf_ += R"({"type": "runtime_error")";
+      buf_ += R"(, "msg": )";
+      JsonEmitter<std::string>::emit(buf_, to_text(info));
       break;
     }
   }
 
-  // Json only prints the top level location
-  out_ << R"(, "filename": )";
-  JsonEmitter<std::string>::emit(out_, info.locations.begin()->filename);
-  out_ << R"(, "line": )";
-  JsonEmitter<uint64_t>::emit(out_, info.locations.begin()->line);
-  out_ << R"(, "col": )";
-  JsonEmitter<uint64_t>::emit(out_, info.locations.begin()->column);
-  out_ << R"(})" << std::endl;
+  emit_location(buf_, info);
+  buf_ += '}';
+  write();
 }
 
 void JsonOutput::test_result(const std::vector<std::string> &all_tests,
@@ -517,7 +685,8 @@ void JsonOutput::test_result(const std::vector<std::string> &all_tests,
   result.fields.emplace_back("duration", duration.count());
   result.fields.emplace_back("passed", passed[index]);
   result.fields.emplace_back("output", output);
-  emit_data(out_, "test_result", all_tests[index], result);
+  emit_data(buf_, "test_result", all_tests[index], result);
+  write();
 }
 
 void JsonOutput::benchmark_result(const std::vector<std::string> &all_benches,
@@ -528,7 +697,8 @@ void JsonOutput::benchmark_result(const std::vector<std::string> &all_benches,
   Primitive::Record result;
   result.fields.emplace_back("average", average.count());
   result.fields.emplace_back("iters", static_cast<uint64_t>(iters));
-  emit_data(out_, "benchmark_result", all_benches[index], result);
+  emit_data(buf_, "benchmark_result", all_benches[index], result);
+  write();
 }
 
 void JsonOutput::end()
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 
 #include "output/output.h"
 
@@ -8,7 +9,10 @@ namespace bpftrace::output {
 
 class JsonOutput : public Output {
 public:
-  explicit JsonOutput(std::ostream &out = std::cout) : out_(out) {};
+  explicit JsonOutput(std::ostream &out = std::cout) : out_(out)
+  {
+    buf_.reserve(4096);
+  }
 
   void map(const std::string &name, const Value &value) override;
   void value(const Value &value) override;
@@ -20,8 +24,9 @@ public:
   void join(const std::string &join) override;
   void syscall(const std::string &syscall) override;
 
-  void lost_events(uint64_t lost) override;
+  void lost_events(const LostEvents &lost) override;
   void attached_probes(uint64_t num_probes) override;
+  void probe_stats(const ProbeStats &stats) override;
   void runtime_error(int retcode, const RuntimeErrorInfo &info) override;
   void end() override;
 
@@ -38,6 +43,12 @@ public:
 
 private:
   std::ostream &out_;
+
+  // The message being rendered, kept across messages to reuse its memory.
+  std::string buf_;
+
+  // Writes out the message being rendered.
+  void write();
 };
 
 } // namespace bpftrace::output
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <cstdint>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
@@ -129,6 +130,51 @@ struct Value {
   Variant variant;
 };
 
+// LostEvents describes events that could not be sent to userspace because the
+// ring buffer was full. The breakdown by source and the ring occupancy are
+// only filled in when the event loss counters are polled, and are not
+// necessarily available for all kinds of loss.
+struct LostEvents {
+  struct Source {
+    std::string probe;
+    std::string event;
+    std::string location; // Source location of the call.
+    uint64_t count;
+    uint64_t rate; // Lost events per second, since the previous report.
+  };
+
+  uint64_t count = 0;
+  std::vector<Source> sources;
+  std::optional<uint64_t> ring_occupancy; // Percentage of the ring in use.
+};
+
+// ProbeStats describes how much time the kernel spent running each probe's
+// program, as reported with BPF_ENABLE_STATS, and how often bpftrace was woken
+// up to read the ring buffer. The rates cover `interval_ns`, which is either
+// the last reporting interval or, for the `total` report made at exit, the
+// whole run.
+struct ProbeStats {
+  struct Probe {
+    std::string name;
+    uint64_t events;
+    uint64_t run_time_ns;
+    uint64_t recursion_misses;
+    uint64_t ns_per_event;
+    uint64_t events_per_sec;
+    double cpu_share; // Percentage of a single CPU.
+  };
+
+  uint64_t interval_ns = 0;
+  bool total = false;
+  std::vector<Probe> probes;
+
+  uint64_t ringbuf_wakeups = 0;
+  uint64_t ringbuf_wakeups_per_sec = 0;
+  // Reads of events which were below the wakeup threshold, when the poll timed
+  // out. See the `ringbuf_wakeup_threshold` config.
+  uint64_t ringbuf_timer_flushes = 0;
+};
+
 // Abstract class for output.
 //
 // This should be overriden by individual implementations.
@@ -151,6 +197,14 @@ public:
   virtual void printf(const std::string& str,
                       const SourceInfo& info,
                       PrintfSeverity severity) = 0;
+  // Print the arguments of a printf call site (by its index in the printf
+  // resources) without formatting them. Returns false if the output needs the
+  // formatted string instead, in which case `printf` is called.
+  virtual bool printf_args([[maybe_unused]] size_t id,
+                           [[maybe_unused]] const std::vector<Primitive>& args)
+  {
+    return false;
+  }
   virtual void time(const std::string& time) = 0;
   virtual void cat(const std::string& cat) = 0;
   virtual void join(const std::string& join) = 0;
@@ -158,8 +212,9 @@ public:
   virtual void end() = 0;
 
   // General events.
-  virtual void lost_events(uint64_t lost) = 0;
+  virtual void lost_events(const LostEvents& lost) = 0;
   virtual void attached_probes(uint64_t num_probes) = 0;
+  virtual void probe_stats(const ProbeStats& stats) = 0;
   virtual void runtime_error(int retcode, const RuntimeErrorInfo& info) = 0;
 
   // Testing hooks.
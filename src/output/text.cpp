@@ -594,9 +594,10 @@ void TextOutput::syscall(const std::string &syscall)
   out_ << syscall << std::endl;
 }
 
-void TextOutput::lost_events(uint64_t lost)
+void TextOutput::lost_events(const LostEvents &lost)
 {
-  err_ << "Lost " << lost << " events" << std::endl;
+  // The per-source breakdown is logged separately in verbose mode.
+  err_ << "Lost " << lost.count << " events" << std::endl;
 }
 
 void TextOutput::attached_probes(uint64_t num_probes)
@@ -607,6 +608,29 @@ void TextOutput::attached_probes(uint64_t num_probes)
     err_ << "Attached " << num_probes << " probes" << std::endl;
 }
 
+void TextOutput::probe_stats(const ProbeStats &stats)
+{
+  auto flags = err_.flags();
+  auto precision = err_.precision();
+  err_ << (stats.total ? "Probe profile (total, " : "Probe profile (")
+       << stats.interval_ns / 1000000 << "ms):" << std::endl;
+  for (const auto &probe : stats.probes) {
+    err_ << "  " << probe.name << ": " << probe.events << " events, "
+         << probe.events_per_sec << " events/s, " << probe.ns_per_event
+         << " ns/event, " << std::fixed << std::setprecision(2)
+         << probe.cpu_share << "% CPU";
+    if (probe.recursion_misses > 0) {
+      err_ << ", " << probe.recursion_misses << " recursion misses";
+    }
+    err_ << std::endl;
+  }
+  err_ << "  ring buffer: " << stats.ringbuf_wakeups << " wakeups, "
+       << stats.ringbuf_wakeups_per_sec << " wakeups/s, "
+       << stats.ringbuf_timer_flushes << " timer flushes" << std::endl;
+  err_.flags(flags);
+  err_.precision(precision);
+}
+
 void TextOutput::runtime_error(int retcode, const RuntimeErrorInfo &info)
 {
   switch (info.error_id) {
@@ -22,8 +22,9 @@ public:
   void join(const std::string &join) override;
   void syscall(const std::string &syscall) override;
 
-  void lost_events(uint64_t lost) override;
+  void lost_events(const LostEvents &lost) override;
   void attached_probes(uint64_t num_probes) override;
+  void probe_stats(const ProbeStats &stats) override;
   void runtime_error(int retcode, const RuntimeErrorInfo &info) override;
   void end() override;
 
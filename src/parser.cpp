@@ -57,6 +57,15 @@ std::optional<Expression> Parser::parse_expr()
   return std::nullopt;
 }
 
+Macro *Parser::parse_macro_at(size_t offset, int line, int column)
+{
+  input_ = &ctx_.source_->contents;
+  pos_ = offset;
+  line_ = line;
+  col_ = column;
+  return parse_macro();
+}
+
 Program *Parser::parse_program()
 {
   PARSE_TRACE("parse_program");
@@ -3323,6 +3332,7 @@ bool Parser::is_builtin(std::string_view name)
     "__builtin_cpu",
     "__builtin_dw_ustack",
     "__builtin_elapsed",
+    "__builtin_filter_pid",
     "__builtin_func",
     "__builtin_ncpus",
     "__builtin_probe",
@@ -23,6 +23,11 @@ public:
   ast::Program *parse();
   std::optional<ast::Expression> parse_expr();
 
+  // Parses the single macro definition that starts at the given offset,
+  // which must correspond to the given line and column. This is used to load
+  // standard library macros on demand, without parsing the whole file.
+  ast::Macro *parse_macro_at(size_t offset, int line, int column);
+
 private:
   // Root-level grammar
   ast::Program *parse_program();
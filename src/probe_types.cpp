@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "probe_types.h"
+#include "util/bpf_names.h"
 #include "util/strings.h"
 
 namespace bpftrace {
@@ -30,6 +31,13 @@ ProbeType probetype(const std::string &probeName)
   return retType;
 }
 
+std::string get_program_name(const Probe &probe)
+{
+  if (!probe.shared_prog_name.empty())
+    return probe.shared_prog_name;
+  return util::get_function_name_for_probe(probe.name, probe.index);
+}
+
 std::string expand_probe_name(const std::string &orig_name)
 {
   std::string expanded_name = util::to_lower(orig_name);
@@ -121,6 +121,9 @@ struct Probe {
   uint64_t bpf_prog_id = 0;
   std::set<std::string> funcs;
   bool is_session = false;
+  // Set if the probe has no program of its own and is instead attached with
+  // the (identical) program generated for another probe.
+  std::string shared_prog_name;
 
 private:
   friend class cereal::access;
@@ -141,8 +144,12 @@ private:
             mode,
             address,
             func_offset,
-            funcs);
+            funcs,
+            shared_prog_name);
   }
 };
 
+// Returns the name of the BPF program that is attached for the probe.
+std::string get_program_name(const Probe &probe);
+
 } // namespace bpftrace
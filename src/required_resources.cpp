@@ -43,6 +43,17 @@ void RequiredResources::load_state(const uint8_t *ptr, size_t len)
   archive(*this);
 }
 
+const FieldRelocation *RequiredResources::find_field_relocation(
+    const std::string &type_name,
+    const std::string &field) const
+{
+  for (const auto &reloc : field_relocations) {
+    if (reloc.type_name == type_name && reloc.field == field)
+      return &reloc;
+  }
+  return nullptr;
+}
+
 std::ostream &operator<<(std::ostream &os, const RuntimeErrorInfo &info)
 {
   switch (info.error_id) {
@@ -65,6 +65,8 @@ struct SourceLocation {
   std::string source_location;
   std::vector<std::string> source_context;
 
+  bool operator==(const SourceLocation &other) const = default;
+
 private:
   friend class cereal::access;
   template <typename Archive>
@@ -97,6 +99,8 @@ public:
 
   SourceInfo() = default;
 
+  bool operator==(const SourceInfo &other) const = default;
+
   std::vector<SourceLocation> locations;
 
 private:
@@ -140,6 +144,29 @@ private:
 
 std::ostream &operator<<(std::ostream &os, const RuntimeErrorInfo &info);
 
+// A field of a vmlinux struct or union that an AOT program reads. Rather than
+// embedding the field's offset on the build host, the program loads it from a
+// read-only global, which is set to the field's offset on the running kernel
+// before the program is loaded. See `aot::relocate_fields`.
+struct FieldRelocation {
+  std::string type_name;
+  std::string field;
+  // The field's layout, on the build host until relocated.
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  std::string global_var;
+
+  bool operator==(const FieldRelocation &other) const = default;
+
+private:
+  friend class cereal::access;
+  template <typename Archive>
+  void serialize(Archive &archive)
+  {
+    archive(type_name, field, offset, size, global_var);
+  }
+};
+
 // This class contains script-specific metadata that bpftrace's runtime needs.
 //
 // This class is intended to completely encapsulate all of a script's runtime
@@ -189,13 +216,12 @@ public:
   std::unordered_map<ast::Call *, size_t> non_map_print_args_id_map;
   std::vector<std::tuple<std::string, long>> skboutput_args_;
   std::unordered_map<ast::Call *, size_t> skboutput_args_id_map;
-  // While max fmtstring args size is not used at runtime, the size
-  // calculation requires taking into account struct alignment semantics,
-  // and that is tricky enough that we want to minimize repetition of
-  // such logic in the codebase. So keep it in resource analysis
-  // rather than duplicating it in CodegenResources.
-  uint64_t max_fmtstring_args_size = 0;
-
+  // Event loss counter slots, as (probe name, output call, call site location)
+  // tuples. Each slot has its own per-CPU counter so userspace can attribute
+  // lost events.
+  std::vector<std::tuple<std::string, std::string, std::string>>
+      event_loss_sources;
+  std::unordered_map<ast::Call *, size_t> event_loss_sources_id_map;
   // Required for sizing of tuple/record scratch buffer
   size_t anon_struct_buffers = 0;
   size_t max_anon_struct_size = 0;
@@ -220,8 +246,6 @@ public:
   size_t map_key_buffers = 0;
   size_t max_map_key_size = 0;
 
-  size_t join_value_size = 0;
-
   // Async argument metadata that codegen creates. Ideally ResourceAnalyser
   // pass should be collecting this, but it's complex to move the logic.
   //
@@ -234,6 +258,12 @@ public:
   globalvars::GlobalVars global_vars;
   bool using_skboutput = false;
   bool needs_elapsed_map = false;
+  bool needs_mapping_snapshots = false;
+
+  // Fields whose offsets are relocated at load time (AOT only)
+  std::vector<FieldRelocation> field_relocations;
+  const FieldRelocation *find_field_relocation(const std::string &type_name,
+                                               const std::string &field) const;
 
   // Probe metadata
   //
@@ -269,12 +299,15 @@ private:
             strftime_args,
             cat_args,
             non_map_print_args,
+            event_loss_sources,
             runtime_error_info,
             printf_args,
             probe_ids,
             maps_info,
             global_vars,
             using_skboutput,
+            needs_mapping_snapshots,
+            field_relocations,
             probes,
             signal_probes,
             begin_probes,
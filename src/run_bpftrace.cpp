@@ -6,8 +6,11 @@
 #include <optional>
 #include <sys/syscall.h>
 #include <sys/utsname.h>
+#include <unordered_map>
 
+#include "format_string.h"
 #include "log.h"
+#include "output/binary.h"
 #include "output/buffer_mode.h"
 #include "output/json.h"
 #include "output/text.h"
@@ -136,6 +139,23 @@ private:
   std::streambuf *dest_;
   OutputBufferConfig mode_;
 };
+
+// The schemas of the printf call sites, for the binary output.
+std::vector<output::PrintfSchema> printf_schemas(
+    const RequiredResources &resources)
+{
+  std::vector<output::PrintfSchema> schemas;
+  for (const auto &[fmt, args, severity, info] : resources.printf_args) {
+    auto &schema = schemas.emplace_back();
+    schema.format = fmt.str();
+    for (const auto &arg : args) {
+      schema.types.emplace_back(typestr(arg.type));
+    }
+    schema.severity = severity;
+    schema.info = info;
+  }
+  return schemas;
+}
 } // namespace
 
 int run_bpftrace(BPFtrace &bpftrace,
@@ -191,7 +211,9 @@ int run_bpftrace(BPFtrace &bpftrace,
   std::ostream *os = &std::cout;
   std::ofstream outputstream;
   if (!output_file.empty()) {
-    outputstream.open(output_file);
+    // With --watch, later versions of the script append to the output.
+    outputstream.open(output_file,
+                      bpftrace.previous_ ? std::ios::app : std::ios::out);
     if (outputstream.fail()) {
       LOG(ERROR) << "Failed to open output file: \"" << output_file
                  << "\": " << strerror(errno);
@@ -201,6 +223,12 @@ int run_bpftrace(BPFtrace &bpftrace,
   }
   std::unique_ptr<output::Output> output;
 
+  // Binary output has no lines, so it is fully buffered unless told otherwise.
+  if (output_format == "binary" &&
+      out_buf_config == OutputBufferConfig::UNSET) {
+    out_buf_config = OutputBufferConfig::FULL;
+  }
+
   // Optionally wrap the output stream to control flushing behavior.
   // Keep these local so their lifetime covers the entire execution.
   std::optional<flushing_streambuf> fsb;
@@ -216,9 +244,12 @@ int run_bpftrace(BPFtrace &bpftrace,
     output = std::make_unique<output::TextOutput>(*os);
   } else if (output_format == "json") {
     output = std::make_unique<output::JsonOutput>(*os);
+  } else if (output_format == "binary") {
+    output = std::make_unique<output::BinaryOutput>(
+        *os, printf_schemas(bpftrace.resources));
   } else {
     LOG(ERROR) << "Invalid output format \"" << output_format << "\"\n"
-               << "Valid formats: 'text', 'json'";
+               << "Valid formats: 'text', 'json', 'binary'";
     return 1;
   }
 
@@ -254,3 +285,62 @@ int run_bpftrace(BPFtrace &bpftrace,
 
   return bpftrace.exit_code;
 }
+
+int decode_binary(const std::string &input_file,
+                  const std::string &output_file,
+                  const std::string &output_format)
+{
+  std::istream *is = &std::cin;
+  std::ifstream inputstream;
+  if (input_file != "-") {
+    inputstream.open(input_file, std::ios::binary);
+    if (inputstream.fail()) {
+      LOG(ERROR) << "Failed to open input file: \"" << input_file
+                 << "\": " << strerror(errno);
+      return 1;
+    }
+    is = &inputstream;
+  }
+
+  std::ostream *os = &std::cout;
+  std::ofstream outputstream;
+  if (!output_file.empty()) {
+    outputstream.open(output_file);
+    if (outputstream.fail()) {
+      LOG(ERROR) << "Failed to open output file: \"" << output_file
+                 << "\": " << strerror(errno);
+      return 1;
+    }
+    os = &outputstream;
+  }
+
+  std::unique_ptr<output::Output> output;
+  if (output_format.empty() || output_format == "text") {
+    output = std::make_unique<output::TextOutput>(*os);
+  } else if (output_format == "json") {
+    output = std::make_unique<output::JsonOutput>(*os);
+  } else {
+    LOG(ERROR) << "Invalid output format \"" << output_format << "\"\n"
+               << "Valid formats for --decode: 'text', 'json'";
+    return 1;
+  }
+
+  // Parsing a format string is much slower than applying it, so each is
+  // parsed once.
+  std::unordered_map<std::string, FormatString> formats;
+  auto format = [&](const output::PrintfSchema &schema,
+                    const std::vector<output::Primitive> &args) {
+    auto it = formats.find(schema.format);
+    if (it == formats.end()) {
+      it = formats.emplace(schema.format, FormatString(schema.format)).first;
+    }
+    return it->second.format(args);
+  };
+
+  auto ok = output::replay_binary(*is, *output, format);
+  if (!ok) {
+    LOG(ERROR) << ok.takeError();
+    return 1;
+  }
+  return 0;
+}
@@ -14,3 +14,9 @@ int run_bpftrace(bpftrace::BPFtrace &bpftrace,
                  std::vector<std::string> &&named_params,
                  bpftrace::OutputBufferConfig out_buf_config =
                      bpftrace::OutputBufferConfig::UNSET);
+
+// Converts the output of a run with `-f binary`, read from the given file (or
+// stdin for "-"), to the given output format.
+int decode_binary(const std::string &input_file,
+                  const std::string &output_file,
+                  const std::string &output_format);
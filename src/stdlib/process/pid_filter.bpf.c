@@ -0,0 +1,48 @@
+#define __KERNEL__
+#include <vmlinux.h>
+
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+
+// Set of tgids that probes are filtered on when running with --pid-tree.
+//
+// User space seeds the set with the target process and its existing
+// descendants; the sched_process_fork/exit probes injected by the PidFilter
+// pass keep it up to date afterwards. The map can also be updated externally
+// (e.g. with bpftool) while the script is running.
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __uint(max_entries, 65536);
+  __type(key, __u32);
+  __type(value, __u8);
+} pid_filter SEC(".maps");
+
+_Bool __pid_filter_match() {
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    return bpf_map_lookup_elem(&pid_filter, &tgid) != 0;
+}
+
+void __pid_filter_add(__u32 pid) {
+    __u8 one = 1;
+    bpf_map_update_elem(&pid_filter, &pid, &one, BPF_ANY);
+}
+
+// Called from sched_process_exit, which fires for every exiting thread.
+void __pid_filter_remove() {
+    __u64 pid_tgid = bpf_get_current_pid_tgid();
+    __u32 tid = pid_tgid;
+    __u32 tgid = pid_tgid >> 32;
+
+    // sched_process_fork also fires for new threads, which adds their tid.
+    if (tid != tgid)
+        bpf_map_delete_elem(&pid_filter, &tid);
+
+    // The exiting thread has already been taken off signal->live, so the
+    // process is only gone once it drops to zero. Other threads of the group
+    // (including those started after the main thread exited) must still
+    // match until then.
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    if (BPF_CORE_READ(task, signal, live.counter) != 0)
+        return;
+    bpf_map_delete_elem(&pid_filter, &tgid);
+}
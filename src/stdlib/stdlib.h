@@ -2,6 +2,8 @@
 
 #include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace bpftrace::stdlib {
 
@@ -11,6 +13,15 @@ public:
   static const std::map<std::string, std::string_view> c_files;
   static const std::map<std::string, std::string_view> bt_files;
   static const std::map<std::string, std::string> macro_to_file;
+
+  // Where each definition of a macro starts within its file in `bt_files`.
+  // This allows for macros to be parsed individually, as they are used.
+  struct MacroDef {
+    size_t offset;
+    int line;
+    int column;
+  };
+  static const std::map<std::string, std::vector<MacroDef>> macro_defs;
 };
 
 } // namespace bpftrace::stdlib
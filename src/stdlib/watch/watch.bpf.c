@@ -0,0 +1,24 @@
+#define __KERNEL__
+#include <linux/types.h>
+#include <stddef.h>
+
+#include <bpf/bpf_helpers.h>
+
+// The version of the script that is active with --watch.
+//
+// Every version of the script shares this map, and its probes only run while
+// it holds their version. When a new version takes over, it is attached while
+// still inactive and then activated with a single update, so that each event
+// is handled by exactly one version.
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, __u64);
+} watch_version SEC(".maps");
+
+_Bool __watch_active(__u64 version) {
+    __u32 key = 0;
+    __u64 *active = bpf_map_lookup_elem(&watch_version, &key);
+    return active && *active == version;
+}
@@ -0,0 +1,292 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scopeguard.h"
+#include "symbols/catalogue.h"
+#include "util/fd.h"
+#include "util/strings.h"
+#include "util/temp.h"
+
+namespace bpftrace::symbols {
+
+// The catalogue is a header followed by four sections: the modules, the
+// functions, the raw tracepoints and the tracepoints. The modules section is
+// a list of strings; the others are a list of (key, list of strings) pairs.
+// All integers are in host order, since the file never leaves the host.
+//
+//   list:   u32 count, followed by `count` entries
+//   string: u32 length, followed by `length` bytes
+//
+// Bump the version whenever the format or the contents change.
+static constexpr char CATALOGUE_MAGIC[8] = { 'B', 'T', 'C', 'A',
+                                             'T', 'A', 'L', 'G' };
+static constexpr uint32_t CATALOGUE_VERSION = 1;
+
+namespace {
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  char boot_id[40];
+  uint64_t modules_hash;
+  uint64_t size;
+};
+
+class Writer {
+public:
+  void u32(uint32_t value)
+  {
+    buf_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void string(const std::string &value)
+  {
+    u32(value.size());
+    buf_.append(value);
+  }
+
+  void set(const FunctionSet &values)
+  {
+    u32(values.size());
+    for (const auto &value : values) {
+      string(value);
+    }
+  }
+
+  void map(const ModulesFuncsMap &values)
+  {
+    u32(values.size());
+    for (const auto &[key, set_values] : values) {
+      string(key);
+      set(*set_values);
+    }
+  }
+
+  std::string &buf()
+  {
+    return buf_;
+  }
+
+private:
+  std::string buf_;
+};
+
+class Reader {
+public:
+  Reader(const char *data, size_t size) : data_(data), size_(size) {};
+
+  bool u32(uint32_t &value)
+  {
+    if (size_ - offset_ < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, data_ + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return true;
+  }
+
+  bool string(std::string_view &value)
+  {
+    uint32_t len = 0;
+    if (!u32(len) || size_ - offset_ < len) {
+      return false;
+    }
+    value = std::string_view(data_ + offset_, len);
+    offset_ += len;
+    return true;
+  }
+
+  bool set(FunctionSet &values)
+  {
+    uint32_t count = 0;
+    if (!u32(count)) {
+      return false;
+    }
+    // Entries are written in order, so each can be appended at the end.
+    for (uint32_t i = 0; i < count; i++) {
+      std::string_view value;
+      if (!string(value)) {
+        return false;
+      }
+      values.emplace_hint(values.end(), value);
+    }
+    return true;
+  }
+
+  bool map(ModulesFuncsMap &values)
+  {
+    uint32_t count = 0;
+    if (!u32(count)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      std::string_view key;
+      auto set_values = std::make_shared<FunctionSet>();
+      if (!string(key) || !set(*set_values)) {
+        return false;
+      }
+      values.emplace_hint(values.end(), key, std::move(set_values));
+    }
+    return true;
+  }
+
+  bool done() const
+  {
+    return offset_ == size_;
+  }
+
+private:
+  const char *data_;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+} // namespace
+
+Result<CatalogueKey> catalogue_key(const ModuleSet &modules)
+{
+  std::ifstream file("/proc/sys/kernel/random/boot_id");
+  std::string boot_id;
+  if (file.fail() || !std::getline(file, boot_id)) {
+    return make_error<SystemError>("unable to read the boot id");
+  }
+
+  // FNV-1a, which is stable across builds (unlike std::hash). The set is
+  // ordered, so the hash doesn't depend on the order in /proc/modules.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const auto &mod : modules) {
+    for (char c : mod + "\n") {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 0x100000001b3ULL;
+    }
+  }
+
+  return CatalogueKey{ .boot_id = util::trim(boot_id), .modules_hash = hash };
+}
+
+std::filesystem::path cache_dir()
+{
+  const char *dir = std::getenv("BPFTRACE_CACHE_DIR");
+  return dir != nullptr ? dir : "/run/bpftrace";
+}
+
+std::filesystem::path catalogue_path()
+{
+  return cache_dir() / "kernel.catalogue";
+}
+
+bool catalogue_writable(const std::filesystem::path &path)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  return !ec && access(path.parent_path().c_str(), W_OK) == 0;
+}
+
+Result<Catalogue> read_catalogue(const std::filesystem::path &path,
+                                 const CatalogueKey &key)
+{
+  int raw_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (raw_fd < 0) {
+    return make_error<SystemError>("unable to open " + path.string());
+  }
+  auto fd = util::FD(raw_fd);
+
+  // The catalogue decides what may be traced, so only trust one that was
+  // written by the same user.
+  struct stat st = {};
+  if (fstat(fd, &st) != 0) {
+    return make_error<SystemError>("unable to stat " + path.string());
+  }
+  if (st.st_uid != geteuid()) {
+    return make_error<SystemError>(path.string() + " is not owned by us",
+                                   EPERM);
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    return make_error<SystemError>("unable to map " + path.string());
+  }
+  SCOPE_EXIT
+  {
+    munmap(addr, size);
+  };
+  const auto *data = static_cast<const char *>(addr);
+
+  Header header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, CATALOGUE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CATALOGUE_VERSION || header.size != size) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+  header.boot_id[sizeof(header.boot_id) - 1] = '\0';
+  if (key != CatalogueKey{ .boot_id = header.boot_id,
+                           .modules_hash = header.modules_hash }) {
+    return make_error<SystemError>(path.string() + " is stale", ESTALE);
+  }
+
+  Catalogue catalogue;
+  Reader reader(data + sizeof(header), size - sizeof(header));
+  if (!reader.set(catalogue.modules) || !reader.map(catalogue.functions) ||
+      !reader.map(catalogue.raw_tracepoints) ||
+      !reader.map(catalogue.tracepoints) || !reader.done()) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+  return catalogue;
+}
+
+Result<OK> write_catalogue(const std::filesystem::path &path,
+                           const CatalogueKey &key,
+                           const Catalogue &catalogue)
+{
+  Header header = {};
+  std::memcpy(header.magic, CATALOGUE_MAGIC, sizeof(header.magic));
+  header.version = CATALOGUE_VERSION;
+  std::strncpy(header.boot_id,
+               key.boot_id.c_str(),
+               sizeof(header.boot_id) - 1);
+  header.modules_hash = key.modules_hash;
+
+  Writer writer;
+  writer.buf().append(reinterpret_cast<const char *>(&header), sizeof(header));
+  writer.set(catalogue.modules);
+  writer.map(catalogue.functions);
+  writer.map(catalogue.raw_tracepoints);
+  writer.map(catalogue.tracepoints);
+
+  auto &buf = writer.buf();
+  uint64_t size = buf.size();
+  std::memcpy(buf.data() + offsetof(Header, size), &size, sizeof(size));
+
+  // Concurrent runs may race to write the catalogue; each writes its own
+  // temporary file and the last rename wins, which is fine since they are
+  // identical.
+  auto file = util::TempFile::create(path.string() + ".XXXXXX");
+  if (!file) {
+    return file.takeError();
+  }
+  auto ok = file->write_all(buf);
+  if (!ok) {
+    return ok.takeError();
+  }
+  std::error_code ec;
+  std::filesystem::rename(file->path(), path, ec);
+  if (ec) {
+    return make_error<SystemError>("unable to rename to " + path.string(),
+                                   ec.value());
+  }
+  return OK();
+}
+
+} // namespace bpftrace::symbols
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "symbols/kernel.h"
+#include "util/result.h"
+
+namespace bpftrace::symbols {
+
+// Catalogue is a snapshot of everything that KernelInfoImpl reads from the
+// kernel in order to match probes: the loaded modules, the traceable functions
+// (with the blocklist already applied), the raw tracepoints and the
+// tracepoints.
+//
+// None of these change until the next reboot or module (un)load, so the
+// catalogue is saved to disk and shared between runs. It is keyed by the boot
+// id and a hash of the loaded modules, and a catalogue with a different key is
+// never used.
+struct Catalogue {
+  ModuleSet modules;
+  ModulesFuncsMap functions;
+  ModulesFuncsMap raw_tracepoints;
+  ModulesFuncsMap tracepoints;
+};
+
+struct CatalogueKey {
+  std::string boot_id;
+  uint64_t modules_hash = 0;
+
+  bool operator==(const CatalogueKey &other) const = default;
+};
+
+// Returns the key for the running kernel with the given modules loaded.
+Result<CatalogueKey> catalogue_key(const ModuleSet &modules);
+
+// Returns the directory for files shared between runs: `BPFTRACE_CACHE_DIR`
+// if set, or /run/bpftrace otherwise (which does not survive a reboot).
+std::filesystem::path cache_dir();
+
+// Returns the path of the catalogue, in the cache directory.
+std::filesystem::path catalogue_path();
+
+// Returns true if the file at the given path (the catalogue, or another file
+// in the cache directory) can be written, creating its directory if needed.
+bool catalogue_writable(const std::filesystem::path &path);
+
+// Reads the catalogue at the given path. Fails if the catalogue is missing,
+// malformed, not owned by the current user or has a different key.
+Result<Catalogue> read_catalogue(const std::filesystem::path &path,
+                                 const CatalogueKey &key);
+
+// Writes the catalogue to the given path (whose directory must exist),
+// atomically replacing any existing catalogue.
+Result<OK> write_catalogue(const std::filesystem::path &path,
+                           const CatalogueKey &key,
+                           const Catalogue &catalogue);
+
+} // namespace bpftrace::symbols
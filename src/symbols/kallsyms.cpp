@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <array>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <linux/bpf.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "scopeguard.h"
+#include "symbols/kallsyms.h"
+#include "util/fd.h"
+#include "util/temp.h"
+
+namespace bpftrace::symbols {
+
+// The table is a header, followed by `count` addresses (u64, sorted), `count`
+// name offsets (u32) and `names_size` bytes of NUL-terminated names. The
+// header is a multiple of 8 bytes, so the addresses are aligned in a mapped
+// file. All integers are in host order, since the file never leaves the host.
+//
+// Bump the version whenever the format or the contents change.
+static constexpr char KALLSYMS_MAGIC[8] = { 'B', 'T', 'K', 'S',
+                                            'Y', 'M', 'S', '\0' };
+static constexpr uint32_t KALLSYMS_VERSION = 1;
+
+namespace {
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  char boot_id[40];
+  uint64_t modules_hash;
+  uint64_t count;
+  uint64_t names_size;
+  uint64_t size;
+};
+static_assert(sizeof(Header) % alignof(uint64_t) == 0);
+
+constexpr size_t ENTRY_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+} // namespace
+
+KernelSymbols::KernelSymbols(std::shared_ptr<const char> data, size_t size)
+    : data_(std::move(data)), size_(size)
+{
+  Header header;
+  std::memcpy(&header, data_.get(), sizeof(header));
+  const char *p = data_.get() + sizeof(header);
+  addrs_ = { reinterpret_cast<const uint64_t *>(p), header.count };
+  p += header.count * sizeof(uint64_t);
+  name_offsets_ = { reinterpret_cast<const uint32_t *>(p), header.count };
+  p += header.count * sizeof(uint32_t);
+  names_ = { p, header.names_size };
+}
+
+Result<KernelSymbols> KernelSymbols::parse(std::istream &kallsyms)
+{
+  std::string content(std::istreambuf_iterator<char>(kallsyms), {});
+
+  struct Entry {
+    uint64_t addr;
+    std::string_view name;
+  };
+  std::vector<Entry> entries;
+  std::string_view rest(content);
+  while (!rest.empty()) {
+    auto eol = rest.find('\n');
+    auto line = rest.substr(0, eol);
+    rest = eol == std::string_view::npos ? std::string_view()
+                                         : rest.substr(eol + 1);
+
+    // Format: address type name [\t[module]]
+    auto space = line.find(' ');
+    if (space == std::string_view::npos || space + 3 > line.size()) {
+      continue;
+    }
+    uint64_t addr = 0;
+    auto [_, ec] = std::from_chars(line.data(), line.data() + space, addr, 16);
+    if (ec != std::errc() || addr == 0) {
+      continue;
+    }
+    auto name = line.substr(space + 3);
+    auto tab = name.find('\t');
+    if (tab != std::string_view::npos) {
+      if (name.substr(tab + 1) == "[bpf]") {
+        continue;
+      }
+      name = name.substr(0, tab);
+    }
+    entries.push_back({ .addr = addr, .name = name });
+  }
+  if (entries.empty()) {
+    return make_error<SystemError>("no kernel symbol addresses available",
+                                   EPERM);
+  }
+  // Only the first name listed is kept for aliases (e.g. _text and
+  // startup_64), as only one of them can be printed.
+  std::ranges::stable_sort(entries, {}, &Entry::addr);
+  auto aliases = std::ranges::unique(entries, {}, &Entry::addr);
+  entries.erase(aliases.begin(), aliases.end());
+
+  std::string names;
+  std::vector<uint32_t> name_offsets;
+  name_offsets.reserve(entries.size());
+  for (const auto &entry : entries) {
+    if (names.size() + entry.name.size() >=
+        std::numeric_limits<uint32_t>::max()) {
+      return make_error<SystemError>("too many kernel symbols", E2BIG);
+    }
+    name_offsets.push_back(names.size());
+    names.append(entry.name);
+    names.push_back('\0');
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, KALLSYMS_MAGIC, sizeof(header.magic));
+  header.version = KALLSYMS_VERSION;
+  header.count = entries.size();
+  header.names_size = names.size();
+  header.size = sizeof(header) + (entries.size() * ENTRY_SIZE) + names.size();
+
+  std::shared_ptr<char> data(new char[header.size],
+                             std::default_delete<char[]>());
+  char *p = data.get();
+  std::memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  for (const auto &entry : entries) {
+    std::memcpy(p, &entry.addr, sizeof(entry.addr));
+    p += sizeof(entry.addr);
+  }
+  std::memcpy(p, name_offsets.data(), name_offsets.size() * sizeof(uint32_t));
+  p += name_offsets.size() * sizeof(uint32_t);
+  std::memcpy(p, names.data(), names.size());
+  return KernelSymbols(std::move(data), header.size);
+}
+
+Result<KernelSymbols> KernelSymbols::read(const std::filesystem::path &path,
+                                          const CatalogueKey &key)
+{
+  int raw_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (raw_fd < 0) {
+    return make_error<SystemError>("unable to open " + path.string());
+  }
+  auto fd = util::FD(raw_fd);
+
+  // Symbols end up in the output, so only trust a table that was written by
+  // the same user.
+  struct stat st = {};
+  if (fstat(fd, &st) != 0) {
+    return make_error<SystemError>("unable to stat " + path.string());
+  }
+  if (st.st_uid != geteuid()) {
+    return make_error<SystemError>(path.string() + " is not owned by us",
+                                   EPERM);
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    return make_error<SystemError>("unable to map " + path.string());
+  }
+  std::shared_ptr<const char> data(static_cast<const char *>(addr),
+                                   [size](const char *p) {
+                                     munmap(const_cast<char *>(p), size);
+                                   });
+
+  Header header;
+  std::memcpy(&header, data.get(), sizeof(header));
+  if (std::memcmp(header.magic, KALLSYMS_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != KALLSYMS_VERSION || header.size != size ||
+      header.count > size / ENTRY_SIZE || header.names_size > size ||
+      sizeof(header) + (header.count * ENTRY_SIZE) + header.names_size !=
+          size) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+  header.boot_id[sizeof(header.boot_id) - 1] = '\0';
+  if (key != CatalogueKey{ .boot_id = header.boot_id,
+                           .modules_hash = header.modules_hash }) {
+    return make_error<SystemError>(path.string() + " is stale", ESTALE);
+  }
+
+  KernelSymbols symbols(std::move(data), size);
+  if (symbols.names_.empty() || symbols.names_.back() != '\0' ||
+      !std::ranges::is_sorted(symbols.addrs_) ||
+      std::ranges::any_of(symbols.name_offsets_, [&](uint32_t offset) {
+        return offset >= symbols.names_.size();
+      })) {
+    return make_error<SystemError>(path.string() + " is malformed", EINVAL);
+  }
+  return symbols;
+}
+
+Result<OK> KernelSymbols::write(const std::filesystem::path &path,
+                                const CatalogueKey &key) const
+{
+  Header header;
+  std::memcpy(&header, data_.get(), sizeof(header));
+  std::memset(header.boot_id, 0, sizeof(header.boot_id));
+  std::strncpy(header.boot_id,
+               key.boot_id.c_str(),
+               sizeof(header.boot_id) - 1);
+  header.modules_hash = key.modules_hash;
+
+  // As with the catalogue, concurrent runs write their own temporary file and
+  // the last rename wins.
+  auto file = util::TempFile::create(path.string() + ".XXXXXX");
+  if (!file) {
+    return file.takeError();
+  }
+  auto ok = file->write_all(
+      { reinterpret_cast<const char *>(&header), sizeof(header) });
+  if (!ok) {
+    return ok.takeError();
+  }
+  ok = file->write_all(
+      { data_.get() + sizeof(header), size_ - sizeof(header) });
+  if (!ok) {
+    return ok.takeError();
+  }
+  std::error_code ec;
+  std::filesystem::rename(file->path(), path, ec);
+  if (ec) {
+    return make_error<SystemError>("unable to rename to " + path.string(),
+                                   ec.value());
+  }
+  return OK();
+}
+
+std::optional<KernelSymbol> KernelSymbols::resolve(uint64_t addr) const
+{
+  auto it = std::ranges::upper_bound(addrs_, addr);
+  if (it == addrs_.begin()) {
+    return std::nullopt;
+  }
+  size_t i = std::distance(addrs_.begin(), it) - 1;
+  return KernelSymbol{ .name = names_.data() + name_offsets_[i],
+                       .offset = addr - addrs_[i] };
+}
+
+std::vector<BpfProgSymbol> bpf_prog_symbols()
+{
+  std::vector<BpfProgSymbol> result;
+  __u32 id = 0;
+  while (bpf_prog_get_next_id(id, &id) == 0) {
+    int raw_fd = bpf_prog_get_fd_by_id(id);
+    if (raw_fd < 0) {
+      continue;
+    }
+    auto fd = util::FD(raw_fd);
+
+    struct bpf_prog_info info = {};
+    __u32 info_len = sizeof(info);
+    if (bpf_prog_get_info_by_fd(fd, &info, &info_len) != 0 ||
+        info.nr_jited_ksyms == 0) {
+      continue;
+    }
+
+    // Fetch the address, size and tag of each function, and the BTF function
+    // info that names them.
+    std::string prog_name = info.name;
+    std::array<uint8_t, BPF_TAG_SIZE> prog_tag;
+    std::memcpy(prog_tag.data(), info.tag, BPF_TAG_SIZE);
+    __u32 btf_id = info.btf_id;
+    std::vector<__u64> addrs(info.nr_jited_ksyms);
+    std::vector<__u32> sizes(info.nr_jited_func_lens);
+    std::vector<std::array<uint8_t, BPF_TAG_SIZE>> tags(info.nr_prog_tags);
+    std::vector<struct bpf_func_info> func_info(info.nr_func_info);
+
+    info = {};
+    info.nr_jited_ksyms = addrs.size();
+    info.jited_ksyms = reinterpret_cast<__u64>(addrs.data());
+    info.nr_jited_func_lens = sizes.size();
+    info.jited_func_lens = reinterpret_cast<__u64>(sizes.data());
+    info.nr_prog_tags = tags.size();
+    info.prog_tags = reinterpret_cast<__u64>(tags.data());
+    info.nr_func_info = func_info.size();
+    info.func_info_rec_size = sizeof(struct bpf_func_info);
+    info.func_info = reinterpret_cast<__u64>(func_info.data());
+    info_len = sizeof(info);
+    if (bpf_prog_get_info_by_fd(fd, &info, &info_len) != 0) {
+      continue;
+    }
+
+    struct btf *btf = btf_id != 0 && !func_info.empty()
+                          ? btf__load_from_kernel_by_id(btf_id)
+                          : nullptr;
+    SCOPE_EXIT
+    {
+      btf__free(btf);
+    };
+
+    for (size_t i = 0; i < addrs.size() && i < sizes.size(); i++) {
+      std::string func_name = prog_name;
+      if (btf != nullptr && i < func_info.size()) {
+        const auto *t = btf__type_by_id(btf, func_info[i].type_id);
+        if (t != nullptr) {
+          func_name = btf__name_by_offset(btf, t->name_off);
+        }
+      }
+      const auto &tag = i < tags.size() ? tags[i] : prog_tag;
+      std::ostringstream name;
+      name << "bpf_prog_";
+      for (uint8_t byte : tag) {
+        name << std::hex << std::setw(2) << std::setfill('0')
+             << static_cast<int>(byte);
+      }
+      if (!func_name.empty()) {
+        name << "_" << func_name;
+      }
+      result.push_back(
+          { .addr = addrs[i], .size = sizes[i], .name = name.str() });
+    }
+  }
+
+  std::ranges::sort(result, {}, &BpfProgSymbol::addr);
+  return result;
+}
+
+Result<KernelSymbols> load_kernel_symbols()
+{
+  // Modules are identified by their address as well as their name, since a
+  // module that is reloaded is most likely at a different address.
+  ModuleSet modules;
+  std::ifstream modules_file("/proc/modules");
+  for (std::string line; std::getline(modules_file, line);) {
+    // Format: name size refcount deps state address
+    std::istringstream fields(line);
+    std::string name, size, refcount, deps, state, address;
+    if (fields >> name >> size >> refcount >> deps >> state >> address) {
+      modules.insert(name + " " + address);
+    }
+  }
+
+  auto path = cache_dir() / "kernel.symbols";
+  auto key = catalogue_key(modules);
+  if (key) {
+    auto symbols = KernelSymbols::read(path, *key);
+    if (symbols) {
+      return symbols;
+    }
+    LOG(V1) << "Not using the cached kernel symbols: " << symbols.takeError();
+  } else {
+    LOG(V1) << "Not using the cached kernel symbols: " << key.takeError();
+  }
+
+  std::ifstream kallsyms("/proc/kallsyms");
+  if (kallsyms.fail()) {
+    return make_error<SystemError>("unable to read /proc/kallsyms");
+  }
+  auto symbols = KernelSymbols::parse(kallsyms);
+  if (!symbols) {
+    return symbols.takeError();
+  }
+  if (key && catalogue_writable(path)) {
+    auto ok = symbols->write(path, *key);
+    if (!ok) {
+      LOG(V1) << "Unable to save the kernel symbols: " << ok.takeError();
+    }
+  }
+  return symbols;
+}
+
+} // namespace bpftrace::symbols
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "symbols/catalogue.h"
+#include "util/result.h"
+
+namespace bpftrace::symbols {
+
+struct KernelSymbol {
+  std::string_view name;
+  uint64_t offset;
+};
+
+// KernelSymbols resolves addresses in the kernel and its modules.
+//
+// Rather than an object per symbol, the table is a sorted array of addresses,
+// a parallel array of offsets into a blob of NUL-terminated names, and a
+// header. The same layout is used in memory and on disk, so a table read from
+// the cache is used in place without being parsed or copied.
+class KernelSymbols {
+public:
+  // Parses symbols in the /proc/kallsyms format. Symbols of BPF programs are
+  // skipped, since they come and go; see `bpf_prog_symbols`. Fails if there
+  // are no symbols with a non-zero address (e.g. if kptr_restrict hides them).
+  static Result<KernelSymbols> parse(std::istream &kallsyms);
+
+  // Reads a table written by `write`. Fails if the table is missing,
+  // malformed, not owned by the current user or has a different key.
+  static Result<KernelSymbols> read(const std::filesystem::path &path,
+                                   const CatalogueKey &key);
+
+  // Writes the table to the given path (whose directory must exist),
+  // atomically replacing any existing table.
+  Result<OK> write(const std::filesystem::path &path,
+                   const CatalogueKey &key) const;
+
+  // Returns the closest symbol at or below the given address.
+  std::optional<KernelSymbol> resolve(uint64_t addr) const;
+
+  size_t size() const
+  {
+    return addrs_.size();
+  }
+
+private:
+  KernelSymbols(std::shared_ptr<const char> data, size_t size);
+
+  // The whole table, header included, either on the heap or mapped.
+  std::shared_ptr<const char> data_;
+  size_t size_;
+
+  std::span<const uint64_t> addrs_;
+  std::span<const uint32_t> name_offsets_;
+  std::string_view names_;
+};
+
+struct BpfProgSymbol {
+  uint64_t addr;
+  uint32_t size;
+  std::string name;
+};
+
+// Returns the symbols of the JITed BPF programs (and their subprograms) that
+// are currently loaded, sorted by address. These are named as in
+// /proc/kallsyms, i.e. bpf_prog_<tag>_<function>.
+std::vector<BpfProgSymbol> bpf_prog_symbols();
+
+// Returns the kernel symbol table, from the cache directory if a previous run
+// saved one since the last boot or module (un)load, or from /proc/kallsyms
+// otherwise (in which case it is saved for the next run).
+Result<KernelSymbols> load_kernel_symbols();
+
+} // namespace bpftrace::symbols
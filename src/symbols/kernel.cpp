@@ -28,6 +28,7 @@
 #include "debugfs/debugfs.h"
 #include "log.h"
 #include "scopeguard.h"
+#include "symbols/catalogue.h"
 #include "symbols/kernel.h"
 #include "tracefs/tracefs.h"
 #include "util/fd.h"
@@ -302,51 +303,6 @@ static Result<ModulesFuncsMap> parse_tracepoints()
   return result;
 }
 
-static Result<std::map<std::string, btf::Types>> parse_btf()
-{
-  std::map<std::string, btf::Types> result;
-
-  // Load the vmlnux BTF.
-  auto *vmlinux_btf = btf__load_vmlinux_btf();
-  if (!vmlinux_btf) {
-    return make_error<SystemError>("failed to load vmlinux BTF");
-  }
-  btf::Types vmlinux(vmlinux_btf);
-  result.emplace("vmlinux", vmlinux);
-
-  // Load all available BTFs from the host kernel.
-  char name[64];
-  struct bpf_btf_info info = {};
-  info.name = reinterpret_cast<uintptr_t>(&name[0]);
-  info.name_len = sizeof(name);
-  __u32 id = 0, info_len = sizeof(info);
-
-  while (true) {
-    int err = bpf_btf_get_next_id(id, &id);
-    if (err != 0 && errno == ENOENT) {
-      break;
-    } else if (err != 0) {
-      return make_error<SystemError>("bpf_btf_get_next_id failed");
-    }
-    int fd = bpf_btf_get_fd_by_id(id);
-    if (fd < 0) {
-      return make_error<SystemError>("bpf_btf_get_fd_by_id failed");
-    }
-    if (bpf_obj_get_info_by_fd(fd, &info, &info_len) != 0) {
-      return make_error<SystemError>("bpf_obj_get_info_by_fd failed");
-    }
-    if (info.kernel_btf) {
-      auto *mod_btf = btf__load_from_kernel_by_id_split(id, vmlinux_btf);
-      if (!mod_btf) {
-        return make_error<SystemError>("failed to load module BTF");
-      }
-      result.emplace(std::string(reinterpret_cast<const char *>(&name[0])),
-                     btf::Types(mod_btf, vmlinux));
-    }
-  }
-  return result;
-}
-
 KConfig::KConfig()
 {
   std::vector<std::string> config_locs;
@@ -706,26 +662,92 @@ ModulesFuncsMap KernelInfoImpl::get_tracepoints(
   return filter(tracepoints_, category_name);
 }
 
-Result<btf::Types> KernelInfoImpl::load_btf(const std::string &mod_name) const
+Result<uint32_t> KernelInfoImpl::find_btf_id(const std::string &mod_name) const
 {
-  // We only load once, because they will all be split BTFs.
-  if (btf_.empty()) {
-    auto result = parse_btf();
-    if (!result) {
-      return result.takeError();
+  // BTF objects are scanned incrementally, in the same way as the available
+  // functions: we only read as far as needed to find the requested module,
+  // and remember the ids of all the modules seen along the way. Only the
+  // object info is read here, the BTF itself is loaded by the caller.
+  while (!btf_ids_complete_) {
+    auto it = btf_ids_.find(mod_name);
+    if (it != btf_ids_.end()) {
+      return it->second;
+    }
+
+    int err = bpf_btf_get_next_id(last_btf_id_, &last_btf_id_);
+    if (err != 0 && errno == ENOENT) {
+      btf_ids_complete_ = true;
+      break;
+    } else if (err != 0) {
+      return make_error<SystemError>("bpf_btf_get_next_id failed");
+    }
+    int raw_fd = bpf_btf_get_fd_by_id(last_btf_id_);
+    if (raw_fd < 0) {
+      // The object may have been released since it was listed.
+      continue;
+    }
+    auto fd = util::FD(raw_fd);
+
+    char name[64] = {};
+    struct bpf_btf_info info = {};
+    info.name = reinterpret_cast<uintptr_t>(&name[0]);
+    info.name_len = sizeof(name);
+    __u32 info_len = sizeof(info);
+    if (bpf_obj_get_info_by_fd(fd, &info, &info_len) != 0) {
+      return make_error<SystemError>("bpf_obj_get_info_by_fd failed");
+    }
+    if (info.kernel_btf) {
+      btf_ids_.emplace(std::string(&name[0]), last_btf_id_);
     }
-    btf_ = std::move(*result);
   }
 
-  // Check to see if this BTF exists.
-  auto it = btf_.find(mod_name);
-  if (it == btf_.end()) {
+  auto it = btf_ids_.find(mod_name);
+  if (it == btf_ids_.end()) {
     return make_error<SystemError>("no BTF available", ENOENT);
   }
-
   return it->second;
 }
 
+Result<btf::Types> KernelInfoImpl::load_btf(const std::string &mod_name) const
+{
+  auto it = btf_.find(mod_name);
+  if (it != btf_.end()) {
+    return it->second;
+  }
+
+  // Module BTFs are split BTFs on top of vmlinux, so vmlinux is always
+  // loaded first.
+  if (!vmlinux_btf_) {
+    auto *vmlinux_btf = btf__load_vmlinux_btf();
+    if (!vmlinux_btf) {
+      return make_error<SystemError>("failed to load vmlinux BTF");
+    }
+    vmlinux_btf_ = vmlinux_btf;
+    btf_.emplace("vmlinux", btf::Types(vmlinux_btf));
+  }
+  if (mod_name == "vmlinux") {
+    return btf_.at("vmlinux");
+  }
+
+  // Modules are loaded individually on first use, since loading all of them
+  // is expensive on hosts with many modules loaded.
+  if (!modules_loaded_.contains(mod_name)) {
+    return make_error<SystemError>("no BTF available", ENOENT);
+  }
+  auto id = find_btf_id(mod_name);
+  if (!id) {
+    return id.takeError();
+  }
+  auto *mod_btf = btf__load_from_kernel_by_id_split(*id, vmlinux_btf_);
+  if (!mod_btf) {
+    return make_error<SystemError>("failed to load module BTF");
+  }
+  LOG(V1) << "Loaded BTF for module " << mod_name;
+  auto [mod_it, _] = btf_.emplace(mod_name,
+                                  btf::Types(mod_btf, btf_.at("vmlinux")));
+  return mod_it->second;
+}
+
 Result<KernelInfoImpl> KernelInfoImpl::open(
     const std::string &traceable_functions_file)
 {
@@ -738,6 +760,26 @@ Result<KernelInfoImpl> KernelInfoImpl::open(
   }
   info.modules_loaded_ = std::move(*modules);
 
+  // Everything else is the same until the next reboot or module (un)load, so
+  // use the catalogue saved by a previous run if it's still valid. This is
+  // skipped for a user-provided file, which may differ from the kernel's.
+  bool has_user_provided_file = !traceable_functions_file.empty();
+  std::optional<CatalogueKey> save_key;
+  if (!has_user_provided_file) {
+    auto key = catalogue_key(info.modules_loaded_);
+    if (key) {
+      auto catalogue = read_catalogue(catalogue_path(), *key);
+      if (catalogue) {
+        info.load_catalogue(std::move(*catalogue));
+        return info;
+      }
+      LOG(V1) << "Not using the kernel catalogue: " << catalogue.takeError();
+      save_key = std::move(*key);
+    } else {
+      LOG(V1) << "Not using the kernel catalogue: " << key.takeError();
+    }
+  }
+
   // Load the list of available tracepoints.
   auto tracepoints = parse_tracepoints();
   if (!tracepoints) {
@@ -747,7 +789,6 @@ Result<KernelInfoImpl> KernelInfoImpl::open(
 
   // Open the filter file. Use the file provided by the user, otherwise fall
   // back to tracefs.
-  bool has_user_provided_file = !traceable_functions_file.empty();
   const std::string path = has_user_provided_file
                                ? traceable_functions_file
                                : tracefs::available_filter_functions();
@@ -787,9 +828,43 @@ Result<KernelInfoImpl> KernelInfoImpl::open(
     }
   }
 
+  // Save a catalogue for future runs. This requires reading all of the
+  // functions now rather than lazily, so it is only done if it can be saved.
+  if (save_key && info.available_filter_functions_.is_open()) {
+    auto path = catalogue_path();
+    if (catalogue_writable(path)) {
+      info.populate_lazy();
+      auto ok = write_catalogue(path, *save_key, info.save_catalogue());
+      if (!ok) {
+        LOG(V1) << "Unable to save the kernel catalogue: " << ok.takeError();
+      }
+    }
+  }
+
   return info;
 }
 
+void KernelInfoImpl::load_catalogue(Catalogue &&catalogue)
+{
+  modules_loaded_ = std::move(catalogue.modules);
+  modules_ = std::move(catalogue.functions);
+  raw_tracepoints_ = std::move(catalogue.raw_tracepoints);
+  tracepoints_ = std::move(catalogue.tracepoints);
+
+  // Everything has been populated, so the functions file is never read.
+  modules_populated_ = modules_loaded_;
+}
+
+Catalogue KernelInfoImpl::save_catalogue() const
+{
+  return Catalogue{
+    .modules = modules_loaded_,
+    .functions = modules_,
+    .raw_tracepoints = raw_tracepoints_,
+    .tracepoints = tracepoints_,
+  };
+}
+
 // Helper function for get_bpf_progs.
 static std::string get_prog_full_name(const struct bpf_prog_info *prog_info,
                                       int prog_fd)
@@ -14,6 +14,8 @@
 
 namespace bpftrace::symbols {
 
+struct Catalogue;
+
 enum KernelVersionMethod { vDSO, UTS, File, None };
 uint32_t kernel_version(KernelVersionMethod method);
 
@@ -55,7 +57,8 @@ public:
       const std::string &func_name,
       const std::optional<std::string> &mod_name = std::nullopt) const = 0;
 
-  // Loads the BTF for the given modules.
+  // Loads the BTF for the given module (or "vmlinux"). Implementations are
+  // expected to load and cache module BTF on first use.
   virtual Result<btf::Types> load_btf(const std::string &mod_name) const = 0;
 
   // Returns true if the given function is traceable.
@@ -147,6 +150,9 @@ private:
   ModulesFuncsMap filter_funcs(
       const ModulesFuncsMap &source,
       const std::optional<std::string> &mod_name = std::nullopt) const;
+  Result<uint32_t> find_btf_id(const std::string &mod_name) const;
+  void load_catalogue(Catalogue &&catalogue);
+  Catalogue save_catalogue() const;
 
   mutable std::ifstream available_filter_functions_;
   mutable std::string last_checked_line_;
@@ -157,6 +163,12 @@ private:
   mutable ModulesFuncsMap modules_;
   mutable ModulesFuncsMap raw_tracepoints_;
   mutable std::map<std::string, btf::Types> btf_;
+  // Owned by the "vmlinux" entry in `btf_`, and used as the base when
+  // loading module BTF.
+  mutable struct btf *vmlinux_btf_ = nullptr;
+  mutable std::map<std::string, uint32_t> btf_ids_;
+  mutable uint32_t last_btf_id_ = 0;
+  mutable bool btf_ids_complete_ = false;
   ModulesFuncsMap blocklist_;
 };
 
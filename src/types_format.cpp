@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iomanip>
+#include <span>
 #include <string>
 #include <utility>
 
@@ -574,6 +575,23 @@ static output::Value::TimeSeries build_time_series(
   return tseries;
 }
 
+// Array maps are indexed by a u32, whatever the map's key type is.
+static OpaqueValue array_map_key(const SizedType &key_type,
+                                 const OpaqueValue &key)
+{
+  auto idx = key.bitcast<uint32_t>();
+  switch (key_type.GetSize()) {
+    case 1:
+      return OpaqueValue::from(static_cast<uint8_t>(idx));
+    case 2:
+      return OpaqueValue::from(static_cast<uint16_t>(idx));
+    case 4:
+      return OpaqueValue::from(idx);
+    default:
+      return OpaqueValue::from(static_cast<uint64_t>(idx));
+  }
+}
+
 Result<output::Value> format(BPFtrace &bpftrace,
                              const ast::CDefinitions &c_definitions,
                              const BpfMap &map,
@@ -709,6 +727,17 @@ Result<output::Value> format(BPFtrace &bpftrace,
     return values_by_key.takeError();
   }
 
+  // Every index of an array map is present. For count(), those that were
+  // never counted are all zeroes: skip them so that array and hash maps print
+  // the same. Other values may legitimately be zero.
+  if (map.is_array_type() && value_type.IsCountTy()) {
+    std::erase_if(*values_by_key, [](const auto &entry) {
+      const auto &value = entry.second;
+      return std::ranges::all_of(std::span(value.data(), value.size()),
+                                 [](char c) { return c == 0; });
+    });
+  }
+
   bool stats = false;
   if (value_type.IsCountTy() || value_type.IsSumTy() || value_type.IsIntTy()) {
     bool is_signed = value_type.IsSigned();
@@ -764,7 +793,12 @@ Result<output::Value> format(BPFtrace &bpftrace,
       return std::move(*val_res);
     }
 
-    auto key_res = format(bpftrace, c_definitions, key_type, key);
+    auto key_res = map.is_array_type()
+                       ? format(bpftrace,
+                                c_definitions,
+                                key_type,
+                                array_map_key(key_type, key))
+                       : format(bpftrace, c_definitions, key_type, key);
     if (!key_res) {
       return key_res.takeError();
     }
@@ -3,8 +3,10 @@
 #include <bcc/bcc_syms.h>
 #include <fstream>
 #include <sstream>
+#include <sys/stat.h>
 
 #include "config.h"
+#include "cxxdemangler/cxxdemangler.h"
 #include "log.h"
 #include "scopeguard.h"
 #include "usyms.h"
@@ -153,7 +155,83 @@ void Usyms::cache_bcc(const std::string &elf_file, std::optional<int> opt_pid)
       return;
     }
     for (int pid : *pids) {
-      pid_sym_[pid] = bcc_symcache_new(pid, &get_symbol_opts());
+      shared_cache().preload(pid);
+    }
+  }
+}
+
+void Usyms::snapshot(int pid)
+{
+  // A process that execs keeps its pid, so the mappings are always reloaded.
+  // If the process is already gone, whatever was loaded before is kept. This
+  // runs for every snapshot event, so symbol tables are left to the first
+  // lookup.
+  shared_cache().reload(pid);
+  if (!snapshots_.insert(pid).second) {
+    return;
+  }
+  snapshot_order_.push_back(pid);
+  if (snapshot_order_.size() > MAX_SNAPSHOTS) {
+    int oldest = snapshot_order_.front();
+    snapshot_order_.pop_front();
+    snapshots_.erase(oldest);
+    shared_cache().forget(oldest);
+  }
+}
+
+UserSymbolCache &Usyms::shared_cache()
+{
+  if (!shared_cache_) {
+    shared_cache_ = std::make_unique<UserSymbolCache>(
+        config_.max_user_symbol_cache_bytes, get_symbol_opts());
+    for (const auto &[build_id, symbols] : precomputed_) {
+      shared_cache_->add_precomputed(build_id, symbols);
+    }
+  }
+  return *shared_cache_;
+}
+
+void Usyms::add_precomputed(const std::string &build_id,
+                            std::shared_ptr<const ElfSymbols> symbols)
+{
+  if (shared_cache_) {
+    shared_cache_->add_precomputed(build_id, symbols);
+  }
+  precomputed_[build_id] = std::move(symbols);
+}
+
+// Processes come and go, so drop the per-process state of those that have
+// exited, and reload the mappings of those that have exec'd. This is checked
+// at most once a second, rather than on every lookup.
+void Usyms::refresh_pids()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_exit_check_ < std::chrono::seconds(1)) {
+    return;
+  }
+  last_exit_check_ = now;
+
+  auto exited = [](int pid) {
+    struct stat st;
+    return stat(("/proc/" + std::to_string(pid)).c_str(), &st) != 0 &&
+           errno == ENOENT;
+  };
+  for (int pid : shared_cache().pids()) {
+    if (exited(pid)) {
+      if (!snapshots_.contains(pid)) {
+        shared_cache().forget(pid);
+      }
+    } else {
+      shared_cache().refresh(pid);
+    }
+  }
+  for (auto it = pid_sym_.begin(); it != pid_sym_.end();) {
+    if (exited(it->first)) {
+      if (it->second)
+        bcc_free_symcache(it->second, it->first);
+      it = pid_sym_.erase(it);
+    } else {
+      ++it;
     }
   }
 }
@@ -271,6 +349,14 @@ std::string Usyms::resolve_bcc(uint64_t addr,
       psyms = exe_sym_[pid_exe].second;
     }
   } else if (cache_type == UserSymbolCacheType::per_pid) {
+    // Addresses in file-backed mappings are resolved through the shared
+    // tables. Anything else (e.g. JIT code with a perf map, or the vDSO) falls
+    // back to a bcc cache for the process.
+    refresh_pids();
+    if (auto sym = shared_cache().resolve(pid, addr)) {
+      return format_symbol(*sym, show_offset, perf_mode);
+    }
+
     // cache user symbols per pid
     if (!pid_sym_.contains(pid)) {
       // not cached, create new ProcSyms cache
@@ -420,6 +506,25 @@ std::vector<std::string> Usyms::resolve_blazesym(uint64_t addr,
 }
 #endif
 
+std::string Usyms::format_symbol(const UserSymbol &sym,
+                                 bool show_offset,
+                                 bool perf_mode) const
+{
+  std::ostringstream symbol;
+  if (config_.cpp_demangle) {
+    char *demangled = cxxdemangle(sym.name.c_str());
+    symbol << (demangled ? demangled : sym.name);
+    ::free(demangled);
+  } else {
+    symbol << sym.name;
+  }
+  if (show_offset)
+    symbol << "+" << sym.offset;
+  if (perf_mode)
+    symbol << " (" << sym.module << ")";
+  return symbol.str();
+}
+
 std::vector<std::string> Usyms::resolve(uint64_t addr,
                                         int32_t pid,
                                         const std::string &pid_exe,
@@ -427,6 +532,13 @@ std::vector<std::string> Usyms::resolve(uint64_t addr,
                                         bool perf_mode,
                                         [[maybe_unused]] bool show_debug_info)
 {
+  // Snapshotted processes may be gone by now, so their mappings are used
+  // whatever the symbolizer, falling back to it for anything else.
+  if (snapshots_.contains(pid)) {
+    if (auto sym = shared_cache().resolve(pid, addr)) {
+      return { format_symbol(*sym, show_offset, perf_mode) };
+    }
+  }
 #ifdef HAVE_BLAZESYM
   if (config_.use_blazesym)
     return resolve_blazesym(
@@ -2,14 +2,20 @@
 
 #include <bcc/bcc_elf.h>
 #include <bcc/bcc_syms.h>
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifdef HAVE_BLAZESYM
 #include <blazesym.h>
 #endif
 
+#include "usyms_cache.h"
 #include "util/symbols.h"
 
 namespace bpftrace {
@@ -20,6 +26,9 @@ class Config;
 
 class Usyms {
 public:
+  // Maximum number of processes with snapshotted mappings.
+  static constexpr size_t MAX_SNAPSHOTS = 65536;
+
   Usyms(const Config& config);
   ~Usyms();
 
@@ -27,6 +36,15 @@ public:
   Usyms& operator=(const Usyms&) = delete;
 
   void cache(const std::string& elf_file, std::optional<int> pid);
+  // Records the mappings of a process, so that its addresses can still be
+  // resolved once it has exited. Taking a new snapshot (e.g. after an exec)
+  // replaces the previous one. Symbol tables are only read when needed, and
+  // so from the object's path once the process is gone.
+  void snapshot(int pid);
+  // Uses the given symbol table for objects with this build id. Only the
+  // shared cache (used for per-pid caching without blazesym) consults these.
+  void add_precomputed(const std::string& build_id,
+                       std::shared_ptr<const ElfSymbols> symbols);
   std::vector<std::string> resolve(uint64_t addr,
                                    int32_t pid,
                                    const std::string& pid_exe,
@@ -41,7 +59,22 @@ private:
   std::map<int, void*> pid_sym_;                         // pid -> cache
   std::map<std::string, std::map<uintptr_t, elf_symbol, std::greater<>>>
       symbol_table_cache_;
+  // Shared symbol tables for per-pid caching. Created on first use, since the
+  // config is not final at construction.
+  std::unique_ptr<UserSymbolCache> shared_cache_;
+  std::unordered_map<std::string, std::shared_ptr<const ElfSymbols>>
+      precomputed_;
+  std::chrono::steady_clock::time_point last_exit_check_;
+  // Processes with snapshotted mappings, which are kept after they exit. The
+  // oldest are dropped first once there are too many.
+  std::unordered_set<int> snapshots_;
+  std::deque<int> snapshot_order_;
 
+  UserSymbolCache& shared_cache();
+  void refresh_pids();
+  std::string format_symbol(const UserSymbol& sym,
+                            bool show_offset,
+                            bool perf_mode) const;
   void cache_bcc(const std::string& elf_file, std::optional<int> opt_pid);
   std::string resolve_bcc(uint64_t addr,
                           int32_t pid,
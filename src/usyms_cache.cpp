@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <bcc/bcc_elf.h>
+#include <bcc/bcc_syms.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <gelf.h>
+#include <libelf.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "log.h"
+#include "scopeguard.h"
+#include "usyms_cache.h"
+#include "util/fd.h"
+
+namespace bpftrace {
+
+// Reads the PT_LOAD segments and the build id (if any) of an ELF object.
+static bool read_elf(const std::string &path,
+                     std::vector<ElfSymbols::Segment> &segments,
+                     std::string &build_id)
+{
+  int raw_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (raw_fd < 0) {
+    return false;
+  }
+  auto fd = util::FD(raw_fd);
+
+  if (elf_version(EV_CURRENT) == EV_NONE) {
+    return false;
+  }
+  Elf *elf = elf_begin(fd, ELF_C_READ, nullptr);
+  if (elf == nullptr) {
+    return false;
+  }
+  SCOPE_EXIT
+  {
+    elf_end(elf);
+  };
+  if (elf_kind(elf) != ELF_K_ELF) {
+    return false;
+  }
+
+  size_t n = 0;
+  if (elf_getphdrnum(elf, &n) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    GElf_Phdr phdr;
+    if (gelf_getphdr(elf, i, &phdr) == nullptr) {
+      return false;
+    }
+    if (phdr.p_type == PT_LOAD) {
+      segments.push_back({ .vaddr = phdr.p_vaddr,
+                           .offset = phdr.p_offset,
+                           .size = phdr.p_filesz });
+    }
+  }
+
+  Elf_Scn *scn = nullptr;
+  while ((scn = elf_nextscn(elf, scn)) != nullptr) {
+    GElf_Shdr shdr;
+    if (gelf_getshdr(scn, &shdr) == nullptr || shdr.sh_type != SHT_NOTE) {
+      continue;
+    }
+    Elf_Data *data = elf_getdata(scn, nullptr);
+    if (data == nullptr) {
+      continue;
+    }
+    GElf_Nhdr nhdr;
+    size_t offset = 0, name_offset = 0, desc_offset = 0;
+    while ((offset = gelf_getnote(
+                data, offset, &nhdr, &name_offset, &desc_offset)) > 0) {
+      const auto *buf = static_cast<const char *>(data->d_buf);
+      if (nhdr.n_type != NT_GNU_BUILD_ID || nhdr.n_namesz != 4 ||
+          std::memcmp(buf + name_offset, "GNU", 4) != 0) {
+        continue;
+      }
+      static constexpr char hex[] = "0123456789abcdef";
+      for (size_t i = 0; i < nhdr.n_descsz; i++) {
+        auto byte = static_cast<unsigned char>(buf[desc_offset + i]);
+        build_id += hex[byte >> 4];
+        build_id += hex[byte & 0xf];
+      }
+      return true;
+    }
+  }
+  return true;
+}
+
+// Reads the symbols of an ELF object into the given table.
+static void read_symbols(const std::string &path,
+                         const bcc_symbol_option &opts,
+                         ElfSymbols &symbols)
+{
+  bcc_elf_symcb callback = [](const char *name,
+                              uint64_t start,
+                              uint64_t length,
+                              void *payload) {
+    auto *symbols = static_cast<ElfSymbols *>(payload);
+    auto [_, inserted] = symbols->symbols.insert(
+        { start,
+          { .name = std::string(name),
+            .start = start,
+            .end = start + length } });
+    if (inserted) {
+      symbols->bytes += sizeof(util::elf_symbol) + (4 * sizeof(void *)) +
+                        std::strlen(name);
+    }
+    return 0;
+  };
+  bcc_elf_foreach_sym(path.c_str(),
+                      callback,
+                      const_cast<bcc_symbol_option *>(&opts),
+                      &symbols);
+}
+
+std::shared_ptr<ElfSymbols> read_elf_symbols(const std::string &path,
+                                             const bcc_symbol_option &opts,
+                                             std::string &build_id)
+{
+  auto symbols = std::make_shared<ElfSymbols>();
+  if (!read_elf(path, symbols->segments, build_id)) {
+    return nullptr;
+  }
+  read_symbols(path, opts, *symbols);
+  return symbols;
+}
+
+UserSymbolCache::UserSymbolCache(size_t budget, const bcc_symbol_option &opts)
+    : opts_(opts), budget_(budget)
+{
+}
+
+std::optional<UserSymbolCache::ObjectId> UserSymbolCache::exe_id(int pid)
+{
+  struct stat st;
+  if (stat(("/proc/" + std::to_string(pid) + "/exe").c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+  return ObjectId{ .dev = st.st_dev, .ino = st.st_ino };
+}
+
+const std::vector<UserSymbolCache::Mapping> *UserSymbolCache::load_mappings(
+    int pid)
+{
+  // Read before the mappings, so that an exec in between is noticed on the
+  // next refresh.
+  auto exe = exe_id(pid);
+
+  std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+  if (maps.fail()) {
+    return nullptr;
+  }
+
+  std::vector<Mapping> mappings;
+  for (std::string line; std::getline(maps, line);) {
+    // Format: start-end perms offset major:minor inode path
+    uint64_t start, end, offset, inode;
+    unsigned int major, minor;
+    int path_pos = 0;
+    if (sscanf(line.c_str(),
+               "%" SCNx64 "-%" SCNx64 " %*s %" SCNx64 " %x:%x %" SCNu64 " %n",
+               &start,
+               &end,
+               &offset,
+               &major,
+               &minor,
+               &inode,
+               &path_pos) != 6 ||
+        inode == 0) {
+      continue;
+    }
+    std::string path = line.substr(path_pos);
+    if (!path.starts_with("/") || path.ends_with(" (deleted)")) {
+      continue;
+    }
+    mappings.push_back({ .start = start,
+                         .end = end,
+                         .offset = offset,
+                         .id = { .dev = makedev(major, minor), .ino = inode },
+                         .path = std::move(path) });
+  }
+
+  // Objects mapped both before and after (e.g. after an exec) keep their key.
+  for (const auto &mapping : mappings) {
+    objects_[mapping.id].mappings++;
+  }
+  auto &process = processes_[pid];
+  release(process.mappings);
+  process.exe = exe;
+  process.mappings = std::move(mappings);
+  return &process.mappings;
+}
+
+void UserSymbolCache::release(const std::vector<Mapping> &mappings)
+{
+  for (const auto &mapping : mappings) {
+    auto it = objects_.find(mapping.id);
+    if (it != objects_.end() && --it->second.mappings == 0) {
+      objects_.erase(it);
+    }
+  }
+}
+
+std::shared_ptr<const ElfSymbols> UserSymbolCache::load_table(
+    int pid,
+    const Mapping &mapping)
+{
+  auto touch = [&](Table &table) {
+    lru_.splice(lru_.begin(), lru_, table.lru);
+    return table.symbols;
+  };
+
+  auto &object = objects_[mapping.id];
+  if (!object.key.empty()) {
+    auto pre = precomputed_.find(object.key);
+    if (pre != precomputed_.end()) {
+      return pre->second;
+    }
+    auto it = tables_.find(object.key);
+    if (it != tables_.end()) {
+      return touch(it->second);
+    }
+  }
+
+  // Objects are opened through the process' root, so that objects in other
+  // mount namespaces are found. Once the process has exited (e.g. for
+  // snapshotted mappings), fall back to our own root, but only if the path
+  // still leads to the same object.
+  auto path = "/proc/" + std::to_string(pid) + "/root" + mapping.path;
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 && stat(mapping.path.c_str(), &st) == 0 &&
+      st.st_ino == mapping.id.ino) {
+    path = mapping.path;
+  }
+  auto symbols = std::make_shared<ElfSymbols>();
+  std::string build_id;
+  if (!read_elf(path, symbols->segments, build_id)) {
+    return nullptr;
+  }
+
+  // Identical objects with different inodes (e.g. in different containers)
+  // share a table if they have a build id.
+  std::string key = !build_id.empty()
+                        ? build_id
+                        : std::to_string(mapping.id.dev) + ":" +
+                              std::to_string(mapping.id.ino);
+  object.key = key;
+  auto pre = precomputed_.find(key);
+  if (pre != precomputed_.end()) {
+    LOG(V1) << "Using precomputed symbols for " << mapping.path;
+    return pre->second;
+  }
+  auto it = tables_.find(key);
+  if (it != tables_.end()) {
+    return touch(it->second);
+  }
+
+  read_symbols(path, opts_, *symbols);
+  LOG(V1) << "Loaded " << symbols->symbols.size() << " symbols from "
+          << mapping.path;
+
+  lru_.push_front(key);
+  tables_.emplace(key, Table{ .symbols = symbols, .lru = lru_.begin() });
+  bytes_ += symbols->bytes;
+
+  // Keep at least the table just loaded, even if it's over budget alone.
+  while (bytes_ > budget_ && lru_.size() > 1) {
+    auto evicted = tables_.find(lru_.back());
+    bytes_ -= evicted->second.symbols->bytes;
+    tables_.erase(evicted);
+    lru_.pop_back();
+  }
+  return symbols;
+}
+
+std::optional<UserSymbol> UserSymbolCache::resolve(int pid, uint64_t addr)
+{
+  auto it = processes_.find(pid);
+  const auto *mappings = it != processes_.end() ? &it->second.mappings
+                                                : load_mappings(pid);
+  if (mappings == nullptr) {
+    return std::nullopt;
+  }
+
+  auto mapping = std::ranges::find_if(*mappings, [&](const Mapping &m) {
+    return addr >= m.start && addr < m.end;
+  });
+  if (mapping == mappings->end()) {
+    return std::nullopt;
+  }
+  auto table = load_table(pid, *mapping);
+  if (!table) {
+    return std::nullopt;
+  }
+
+  uint64_t file_offset = addr - mapping->start + mapping->offset;
+  auto segment = std::ranges::find_if(table->segments, [&](const auto &s) {
+    return file_offset >= s.offset && file_offset < s.offset + s.size;
+  });
+  if (segment == table->segments.end()) {
+    return std::nullopt;
+  }
+  uint64_t vaddr = file_offset - segment->offset + segment->vaddr;
+
+  // The address has to be either the start of the symbol (for symbols of
+  // length 0) or in [start, end).
+  auto sym = table->symbols.lower_bound(vaddr);
+  if (sym == table->symbols.end() ||
+      (vaddr != sym->second.start && vaddr >= sym->second.end)) {
+    return std::nullopt;
+  }
+  return UserSymbol{ .name = sym->second.name,
+                     .offset = vaddr - sym->second.start,
+                     .module = mapping->path };
+}
+
+void UserSymbolCache::refresh(int pid)
+{
+  auto it = processes_.find(pid);
+  if (it == processes_.end()) {
+    return;
+  }
+  // Once the process has exited, the last mappings are kept (see
+  // Usyms::snapshot).
+  auto exe = exe_id(pid);
+  if (exe && exe != it->second.exe) {
+    LOG(V1) << "Reloading the mappings of pid " << pid << ", which has exec'd";
+    load_mappings(pid);
+  }
+}
+
+void UserSymbolCache::reload(int pid)
+{
+  load_mappings(pid);
+}
+
+void UserSymbolCache::preload(int pid)
+{
+  const auto *mappings = load_mappings(pid);
+  if (mappings == nullptr) {
+    return;
+  }
+  for (const auto &mapping : *mappings) {
+    load_table(pid, mapping);
+  }
+}
+
+void UserSymbolCache::add_precomputed(const std::string &build_id,
+                                      std::shared_ptr<const ElfSymbols> symbols)
+{
+  precomputed_[build_id] = std::move(symbols);
+}
+
+void UserSymbolCache::forget(int pid)
+{
+  auto it = processes_.find(pid);
+  if (it == processes_.end()) {
+    return;
+  }
+  release(it->second.mappings);
+  processes_.erase(it);
+}
+
+std::vector<int> UserSymbolCache::pids() const
+{
+  std::vector<int> result;
+  for (const auto &[pid, _] : processes_) {
+    result.push_back(pid);
+  }
+  return result;
+}
+
+} // namespace bpftrace
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include "util/symbols.h"
+
+struct bcc_symbol_option;
+
+namespace bpftrace {
+
+// A symbol table for a single ELF object, shared by every process that maps
+// it. Symbols are indexed by the object's virtual addresses.
+struct ElfSymbols {
+  // PT_LOAD segments, which translate file offsets into virtual addresses.
+  struct Segment {
+    uint64_t vaddr;
+    uint64_t offset;
+    uint64_t size;
+  };
+  std::vector<Segment> segments;
+  std::map<uintptr_t, util::elf_symbol, std::greater<>> symbols;
+
+  // Approximate memory used by the table, for the cache budget.
+  size_t bytes = 0;
+};
+
+// Reads the symbol table of the ELF object at the given path, and its build id
+// (empty if it has none). Returns nothing if the object can't be read.
+std::shared_ptr<ElfSymbols> read_elf_symbols(const std::string &path,
+                                             const bcc_symbol_option &opts,
+                                             std::string &build_id);
+
+struct UserSymbol {
+  std::string name;
+  uint64_t offset;
+  std::string module;
+};
+
+// UserSymbolCache resolves user space addresses for any number of processes,
+// sharing the symbol tables of the ELF objects they map.
+//
+// Each process only has a thin list of its file-backed mappings, which is
+// reloaded when the process execs another executable (see refresh()). Symbol
+// tables are only loaded when an address in the object is first resolved, and
+// are keyed by the object's build id (or its device and inode if it has none),
+// so an object is parsed once however many processes map it, even from
+// different mount namespaces. Tables are evicted least recently used first
+// once their total size exceeds the budget, and are reloaded if needed again.
+class UserSymbolCache {
+public:
+  UserSymbolCache(size_t budget, const bcc_symbol_option &opts);
+
+  // Resolves an address in the given process. Returns nothing if the address
+  // is not in a file-backed mapping, or has no symbol.
+  //
+  // The mappings are loaded on the first lookup in a process, and aren't
+  // checked against exec on each lookup, see refresh().
+  std::optional<UserSymbol> resolve(int pid, uint64_t addr);
+
+  // Reloads the mappings of the given process if it has exec'd since they
+  // were loaded. Nothing happens if it has exited.
+  void refresh(int pid);
+
+  // Loads the mappings of the given process, replacing those loaded before.
+  // The symbol tables of the objects it maps are only loaded on first lookup.
+  void reload(int pid);
+
+  // Loads the mappings of the given process, and the symbol tables of all the
+  // objects it maps.
+  void preload(int pid);
+
+  // Uses the given table for objects with this build id instead of reading
+  // their symbols. Such tables are not counted against the budget.
+  void add_precomputed(const std::string &build_id,
+                       std::shared_ptr<const ElfSymbols> symbols);
+
+  // Drops the mappings of the given process.
+  void forget(int pid);
+
+  // Returns the pids of all processes with mappings.
+  std::vector<int> pids() const;
+
+  // Returns the total size of the symbol tables currently held.
+  size_t bytes() const
+  {
+    return bytes_;
+  }
+
+private:
+  struct ObjectId {
+    dev_t dev;
+    ino_t ino;
+
+    auto operator<=>(const ObjectId &other) const = default;
+  };
+
+  struct Mapping {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    ObjectId id;
+    std::string path;
+  };
+
+  struct Process {
+    // The executable, as the pid stays the same across exec but the mappings
+    // don't. Nothing if it couldn't be read.
+    std::optional<ObjectId> exe;
+    // Sorted by start address.
+    std::vector<Mapping> mappings;
+  };
+
+  struct Table {
+    std::shared_ptr<const ElfSymbols> symbols;
+    std::list<std::string>::iterator lru;
+  };
+
+  const bcc_symbol_option &opts_;
+  size_t budget_;
+  size_t bytes_ = 0;
+
+  std::map<int, Process> processes_;
+
+  // Tables by key (the build id or device and inode), with the most recently
+  // used key at the front of `lru_`.
+  std::unordered_map<std::string, Table> tables_;
+  std::list<std::string> lru_;
+
+  // Precomputed tables by build id.
+  std::unordered_map<std::string, std::shared_ptr<const ElfSymbols>>
+      precomputed_;
+
+  // The objects mapped by the processes above, with their key once known so
+  // that the build id is only read once. Dropped once no mapping refers to
+  // them anymore.
+  struct Object {
+    std::string key;
+    size_t mappings = 0;
+  };
+  std::map<ObjectId, Object> objects_;
+
+  const std::vector<Mapping> *load_mappings(int pid);
+  void release(const std::vector<Mapping> &mappings);
+  // The executable the process is currently running.
+  static std::optional<ObjectId> exe_id(int pid);
+  std::shared_ptr<const ElfSymbols> load_table(int pid,
+                                               const Mapping &mapping);
+};
+
+} // namespace bpftrace
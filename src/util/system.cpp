@@ -313,4 +313,50 @@ Result<std::vector<int>> get_process_tids(pid_t pid)
   return tids;
 }
 
+Result<std::vector<int>> get_process_descendants(pid_t pid)
+{
+  auto pids = get_all_running_pids();
+  if (!pids) {
+    return pids.takeError();
+  }
+
+  // Build the parent -> children relation from /proc/[pid]/stat. The comm
+  // field may contain spaces and parentheses, so the ppid is located after
+  // the last ')'.
+  std::map<int, std::vector<int>> children;
+  for (auto child : *pids) {
+    std::ifstream file("/proc/" + std::to_string(child) + "/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) {
+      continue; // May have exited.
+    }
+    auto pos = stat.rfind(')');
+    if (pos == std::string::npos) {
+      continue;
+    }
+    std::istringstream fields(stat.substr(pos + 1));
+    char state;
+    int ppid;
+    if (fields >> state >> ppid) {
+      children[ppid].push_back(child);
+    }
+  }
+
+  std::vector<int> descendants;
+  std::vector<int> pending = { pid };
+  while (!pending.empty()) {
+    int parent = pending.back();
+    pending.pop_back();
+    auto it = children.find(parent);
+    if (it == children.end()) {
+      continue;
+    }
+    for (auto child : it->second) {
+      descendants.push_back(child);
+      pending.push_back(child);
+    }
+  }
+  return descendants;
+}
+
 } // namespace bpftrace::util
@@ -23,4 +23,8 @@ Result<uint64_t> get_available_mem_kb();
 
 Result<std::vector<int>> get_process_tids(pid_t pid);
 
+// Returns the pids of all processes currently descending from `pid`, not
+// including `pid` itself.
+Result<std::vector<int>> get_process_descendants(pid_t pid);
+
 } // namespace bpftrace::util
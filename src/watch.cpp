@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <system_error>
+
+#include "ast/ast.h"
+#include "ast/context.h"
+#include "ast/passes/printer.h"
+#include "log.h"
+#include "parser.h"
+#include "watch.h"
+
+namespace bpftrace::watch {
+
+// The file is not checked more often than this, regardless of how often the
+// event loop polls.
+static constexpr auto CHECK_INTERVAL = std::chrono::milliseconds(500);
+
+// Comments and spacing are held by the context that was parsed, rather than
+// the nodes themselves. Printing through an empty context drops them.
+template <typename T>
+static size_t hash_node(T *node)
+{
+  ast::ASTContext bare;
+  std::stringstream ss;
+  ast::Printer printer(bare, ss, ast::FormatMode::Minimal);
+  printer.visit(node);
+  return std::hash<std::string>()(ss.str());
+}
+
+std::optional<ScriptHashes> hash_script(const std::string &filename,
+                                        const std::string &contents)
+{
+  ast::ASTContext ast(filename, contents);
+  Parser parser(ast);
+  ast.root = parser.parse();
+  if (ast.root == nullptr || !ast.diagnostics().ok()) {
+    return std::nullopt;
+  }
+
+  ScriptHashes hashes;
+  hashes.program = hash_node(ast.root);
+  for (auto *probe : ast.root->probes) {
+    hashes.probes.push_back(hash_node(probe));
+  }
+  return hashes;
+}
+
+size_t changed_probes(const ScriptHashes &prev, const ScriptHashes &next)
+{
+  return std::ranges::count_if(next.probes, [&](size_t hash) {
+    return std::ranges::find(prev.probes, hash) == prev.probes.end();
+  });
+}
+
+ScriptWatcher::ScriptWatcher(std::filesystem::path path,
+                             const std::string &contents)
+    : path_(std::move(path)), last_check_(std::chrono::steady_clock::now())
+{
+  std::error_code ec;
+  mtime_ = std::filesystem::last_write_time(path_, ec);
+  hashes_ = hash_script(path_.string(), contents);
+}
+
+std::optional<std::string> ScriptWatcher::poll()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_check_ < CHECK_INTERVAL) {
+    return std::nullopt;
+  }
+  last_check_ = now;
+
+  // Editors commonly replace the file rather than writing it in place, so
+  // the file may briefly not exist. This is simply checked again later.
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(path_, ec);
+  if (ec || mtime == mtime_) {
+    return std::nullopt;
+  }
+  std::ifstream file(path_);
+  if (file.fail()) {
+    return std::nullopt;
+  }
+  std::stringstream buf;
+  buf << file.rdbuf();
+
+  // The modification time is recorded even if the new version is never
+  // accepted, so that a script which fails to compile is only retried once
+  // it is modified again.
+  mtime_ = mtime;
+
+  auto hashes = hash_script(path_.string(), buf.str());
+  if (hashes && hashes_) {
+    if (*hashes == *hashes_) {
+      LOG(V1) << "Script " << path_ << " was modified, but is unchanged";
+      return std::nullopt;
+    }
+    LOG(V1) << "Script " << path_ << " was modified, "
+            << changed_probes(*hashes_, *hashes) << " of "
+            << hashes->probes.size() << " probes changed";
+  }
+  return buf.str();
+}
+
+void ScriptWatcher::accept(const std::string &contents)
+{
+  hashes_ = hash_script(path_.string(), contents);
+}
+
+} // namespace bpftrace::watch
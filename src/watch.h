@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bpftrace::watch {
+
+// Hashes of a parsed script, used by --watch to decide whether a modified
+// script needs to be reloaded at all, and to report which probes changed.
+//
+// Hashes are computed over the minimal printed form of the AST, so changes
+// to comments or formatting alone do not cause a reload.
+struct ScriptHashes {
+  size_t program = 0;
+  std::vector<size_t> probes;
+
+  bool operator==(const ScriptHashes &other) const = default;
+};
+
+// Parses the script and returns its hashes, or nothing if the script fails to
+// parse (in which case the full compilation is left to report the errors).
+std::optional<ScriptHashes> hash_script(const std::string &filename,
+                                        const std::string &contents);
+
+// Returns the number of probes in `next` that have no identical probe in
+// `prev`, i.e. those that were added or modified.
+size_t changed_probes(const ScriptHashes &prev, const ScriptHashes &next);
+
+// ScriptWatcher checks a script file for modifications.
+class ScriptWatcher {
+public:
+  ScriptWatcher(std::filesystem::path path, const std::string &contents);
+
+  // Returns the new contents of the script if it has been modified since the
+  // last time it was accepted. Checks are rate-limited, so this is cheap to
+  // call from the event loop.
+  std::optional<std::string> poll();
+
+  // Marks the given contents (as returned by `poll`) as the current version
+  // of the script, which future modifications are compared against.
+  void accept(const std::string &contents);
+
+private:
+  std::filesystem::path path_;
+  std::optional<ScriptHashes> hashes_;
+  std::filesystem::file_time_type mtime_;
+  std::chrono::steady_clock::time_point last_check_;
+};
+
+} // namespace bpftrace::watch
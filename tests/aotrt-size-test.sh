@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+
+# Checks that bpftrace-aotrt stays small and fast to start, i.e. that it doesn't
+# pull in clang or LLVM's code generation.
+#
+# Usage: aotrt-size-test.sh <bpftrace-aotrt> <strip> <max size in KiB> \
+#            <max startup in ms>
+
+set -u
+
+BIN=$1
+STRIP=$2
+MAX_SIZE_KB=$3
+MAX_STARTUP_MS=$4
+EXIT_STATUS=0
+
+# Measure the stripped binary, so that debug info doesn't count against the
+# budget.
+STRIPPED=$(mktemp)
+trap 'rm -f "$STRIPPED"' EXIT
+if ! "$STRIP" -o "$STRIPPED" "$BIN"; then
+  echo "FAIL: could not strip $BIN"
+  exit 1
+fi
+size_kb=$(( $(stat -c %s "$STRIPPED") / 1024 ))
+echo "size: ${size_kb} KiB stripped (budget ${MAX_SIZE_KB} KiB)"
+if (( size_kb > MAX_SIZE_KB )); then
+  echo "FAIL: $BIN is over its size budget"
+  EXIT_STATUS=1
+fi
+
+# Look for clang and LLVM's code generation in both the static and the dynamic
+# symbols, whether they are linked in statically or imported from a library.
+# Other parts of LLVM (e.g. its error handling) are fine.
+if command -v nm >/dev/null; then
+  codegen_syms=$({ nm -C "$BIN"; nm -C -D "$BIN"; } 2>/dev/null |
+    grep -E '(clang::|llvm::(LLVMContext|Module::|IRBuilderBase|TargetMachine|PassBuilder|legacy::|MCContext|orc::))' |
+    head -n 10)
+  if [[ -n "$codegen_syms" ]]; then
+    echo "FAIL: $BIN contains clang or LLVM code generation, e.g.:"
+    echo "$codegen_syms"
+    EXIT_STATUS=1
+  fi
+fi
+
+# Take the best of a few runs, so that a busy machine doesn't fail the test.
+best_ms=
+for _ in 1 2 3 4 5; do
+  start=$(date +%s%N)
+  if ! "$BIN" --version >/dev/null; then
+    echo "FAIL: $BIN --version failed"
+    exit 1
+  fi
+  end=$(date +%s%N)
+  ms=$(( (end - start) / 1000000 ))
+  if [[ -z "$best_ms" ]] || (( ms < best_ms )); then
+    best_ms=$ms
+  fi
+done
+echo "startup: ${best_ms} ms (budget ${MAX_STARTUP_MS} ms)"
+if (( best_ms > MAX_STARTUP_MS )); then
+  echo "FAIL: $BIN is over its startup budget"
+  EXIT_STATUS=1
+fi
+
+exit $EXIT_STATUS
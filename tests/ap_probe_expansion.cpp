@@ -128,6 +128,33 @@ TEST(ap_probe_expansion, probe_builtin)
        true);
 }
 
+TEST(ap_probe_expansion, probe_groups)
+{
+  auto bpftrace = get_mock_bpftrace();
+  ast::ASTContext ast("stdin",
+                      "kprobe:func_1,kprobe:func_2 { __builtin_probe } "
+                      "kprobe:sys_read {}");
+
+  ast::PassManager pm;
+  pm.put(ast)
+      .put<BPFtrace>(*bpftrace)
+      .put(get_mock_function_info())
+      .add(CreateParsePass())
+      .add(ast::CreateParseAttachpointsPass())
+      .add(ast::CreateProbeAndApExpansionPass());
+  auto result = pm.run();
+  ASSERT_TRUE(result && ast.diagnostics().ok());
+  ASSERT_EQ(ast.root->probes.size(), 3);
+
+  auto &expansions = result->get<ast::ExpansionResult>();
+  auto group = expansions.get_probe_group(*ast.root->probes.at(0));
+  ASSERT_TRUE(group.has_value());
+  EXPECT_EQ(expansions.get_probe_group(*ast.root->probes.at(1)), group);
+  EXPECT_EQ(expansions.get_probe_group_name(*group),
+            "kprobe:func_1,kprobe:func_2");
+  EXPECT_FALSE(expansions.get_probe_group(*ast.root->probes.at(2)));
+}
+
 TEST(ap_probe_expansion, kprobe_wildcard_no_matches)
 {
   test("kprobe:sys_read,kprobe:not_here_*,kprobe:sys_write {}",
@@ -9,7 +9,8 @@
 
 namespace bpftrace::test::bpfbytecode {
 
-BpfBytecode codegen(const std::string &input)
+BpfBytecode codegen(const std::string &input,
+                    RequiredResources *resources = nullptr)
 {
   auto bpftrace = get_mock_bpftrace();
 
@@ -32,6 +33,9 @@ BpfBytecode codegen(const std::string &input)
   std::stringstream out;
   ast.diagnostics().emit(out);
   EXPECT_TRUE(ast.diagnostics().ok()) << out.str();
+  if (resources) {
+    *resources = bpftrace->resources;
+  }
   auto &output = ok->get<BpfBytecode>();
   return std::move(output);
 }
@@ -53,4 +57,82 @@ TEST(bpfbytecode, create_programs)
             "s_kprobe_f_1");
 }
 
+static std::vector<char> parallel_object(const std::string &input,
+                                         size_t max_threads)
+{
+  auto bpftrace = get_mock_bpftrace();
+
+  ast::ASTContext ast("stdin", input);
+
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put<BPFtrace>(*bpftrace)
+                .put(get_mock_function_info())
+                .add(ast::AllParsePasses())
+                .add(ast::CreateLLVMInitPass())
+                .add(ast::CreateClangBuildPass())
+                .add(ast::CreateTypeSystemPass())
+                .add(ast::CreateTypeResolverPass())
+                .add(ast::CreateCompilePass())
+                .add(ast::CreateLinkBitcodePass())
+                .add(ast::CreateParallelObjectPass(max_threads))
+                .run();
+  if (!ok) {
+    EXPECT_TRUE(bool(ok)) << ok.takeError();
+    return {};
+  }
+  // 32 programs are split into 4 partitions, whatever the number of threads.
+  EXPECT_EQ(ok->get<ast::CompileContext>().partitions.size(), 4UL);
+  return ok->get<ast::BpfObject>().data;
+}
+
+TEST(bpfbytecode, parallel_object)
+{
+  std::string input;
+  for (int i = 1; i <= 32; i++) {
+    auto n = std::to_string(i);
+    input += "interval:s:" + n + " { @[" + n + "] = count(); }\n";
+  }
+
+  // The output must not depend on how the threads are scheduled, nor on how
+  // many there are.
+  auto object = parallel_object(input, 4);
+  EXPECT_EQ(object, parallel_object(input, 4));
+  EXPECT_EQ(object, parallel_object(input, 1));
+  EXPECT_EQ(object, parallel_object(input, 3));
+
+  // All programs end up in the object, sharing a single map.
+  BpfBytecode bytecode(object);
+  EXPECT_TRUE(bytecode.hasMap("@"));
+  for (int i : { 1, 32 }) {
+    Probe probe;
+    probe.type = ProbeType::interval;
+    probe.name = "interval:s:" + std::to_string(i);
+    probe.index = i;
+    auto &program = bytecode.getProgramForProbe(probe);
+    EXPECT_EQ(std::string_view{ bpf_program__name(program.bpf_prog()) },
+              "interval_s_" + std::to_string(i) + "_" + std::to_string(i));
+  }
+}
+
+TEST(bpfbytecode, reusable_maps)
+{
+  RequiredResources prev_resources;
+  auto prev = codegen("kprobe:f { @same = count(); @key[1] = 1; @value = 1; "
+                      "@size[1] = 1; @gone = 1; }",
+                      &prev_resources);
+  RequiredResources resources;
+  auto next = codegen("kprobe:f { @same = count(); @key[\"a\"] = 1; "
+                      "@value = \"a\"; @size[1] = hist(1); @new = 1; }",
+                      &resources);
+
+  // Only maps with the same name and layout are kept, not those whose key or
+  // value types changed or which only exist in one of the versions.
+  EXPECT_EQ(next.reusable_maps(resources, prev, prev_resources),
+            std::vector<std::string>({ "@same" }));
+  EXPECT_EQ(prev.reusable_maps(prev_resources, prev, prev_resources),
+            std::vector<std::string>(
+                { "@gone", "@key", "@same", "@size", "@value" }));
+}
+
 } // namespace bpftrace::test::bpfbytecode
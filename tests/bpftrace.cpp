@@ -253,6 +253,20 @@ TEST(bpftrace, add_probes_multiple)
   check_kprobe(bpftrace->get_probes().at(1), "sys_write");
 }
 
+TEST(bpftrace, add_probes_shared_program)
+{
+  auto bpftrace = get_strict_mock_bpftrace();
+  parse_probe("kprobe:sys_read,kprobe:sys_write,tracepoint:sched:sched_one{}",
+              *bpftrace);
+  ASSERT_EQ(3U, bpftrace->get_probes().size());
+
+  auto probes = bpftrace->get_probes();
+  EXPECT_TRUE(probes.at(0).shared_prog_name.empty());
+  EXPECT_EQ(probes.at(1).shared_prog_name, get_program_name(probes.at(0)));
+  // Probes of different types never share a program.
+  EXPECT_TRUE(probes.at(2).shared_prog_name.empty());
+}
+
 TEST(bpftrace, add_probes_kernel_module)
 {
   auto bpftrace = get_strict_mock_bpftrace();
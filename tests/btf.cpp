@@ -1,9 +1,12 @@
 #include <string>
 #include <unordered_set>
 
+#include "btf.h"
 #include "btf/btf.h"
 #include "btf/helpers.h"
+#include "btf_common.h"
 #include "data/data_source_btf.h"
+#include "mocks.h"
 #include "gtest/gtest.h"
 
 namespace bpftrace::test::btf {
@@ -549,4 +552,51 @@ TEST(btf, helper_functions)
   EXPECT_TRUE(retrieved_info->value.is<Integer>());
 }
 
+class btf_vmlinux : public test_btf {};
+
+TEST_F(btf_vmlinux, field)
+{
+  auto bpftrace = get_mock_bpftrace();
+  auto &btf = *bpftrace->btf_;
+
+  auto c = btf.vmlinux_field("struct Foo1", "c");
+  ASSERT_TRUE(c.has_value());
+  EXPECT_EQ(c->offset, 8);
+  EXPECT_EQ(c->size, 8);
+  EXPECT_FALSE(c->bitfield);
+
+  // Fields of anonymous members are found through the parent type.
+  auto g = btf.vmlinux_field("struct Foo2", "g");
+  ASSERT_TRUE(g.has_value());
+  EXPECT_EQ(g->offset, 8);
+  EXPECT_EQ(g->size, 1);
+
+  auto f = btf.vmlinux_field("struct Foo2", "f");
+  ASSERT_TRUE(f.has_value());
+  EXPECT_EQ(f->size, 16);
+
+  auto a = btf.vmlinux_field("struct Foo4", "a");
+  ASSERT_TRUE(a.has_value());
+  EXPECT_TRUE(a->bitfield);
+
+  EXPECT_FALSE(btf.vmlinux_field("struct Foo1", "d").has_value());
+  EXPECT_FALSE(btf.vmlinux_field("struct Foo5", "a").has_value());
+  EXPECT_FALSE(btf.vmlinux_field("union Foo1", "a").has_value());
+}
+
+TEST_F(btf_vmlinux, type_size)
+{
+  auto bpftrace = get_mock_bpftrace();
+  auto &btf = *bpftrace->btf_;
+
+  EXPECT_EQ(btf.vmlinux_type_size("struct Foo1"), 16);
+  EXPECT_EQ(btf.vmlinux_type_size("struct task_struct"), 8);
+  // Typedefs are resolved, but only to structs and unions.
+  EXPECT_EQ(btf.vmlinux_type_size("AnonStructTypedef"), 4);
+  EXPECT_FALSE(btf.vmlinux_type_size("size_t").has_value());
+
+  EXPECT_FALSE(btf.vmlinux_type_size("struct Foo5").has_value());
+  EXPECT_FALSE(btf.vmlinux_type_size("union Foo1").has_value());
+}
+
 } // namespace bpftrace::test::btf
@@ -0,0 +1,101 @@
+#include <fstream>
+
+#include "symbols/catalogue.h"
+#include "util/temp.h"
+#include "gtest/gtest.h"
+
+namespace bpftrace::test::catalogue {
+
+using namespace bpftrace::symbols;
+
+static Catalogue make_catalogue()
+{
+  Catalogue catalogue;
+  catalogue.modules = { "vmlinux", "kvm" };
+  catalogue.functions.emplace(
+      "vmlinux", std::make_shared<FunctionSet>(FunctionSet{ "f", "g" }));
+  catalogue.functions.emplace(
+      "kvm", std::make_shared<FunctionSet>(FunctionSet{ "kvm_exit" }));
+  catalogue.raw_tracepoints.emplace(
+      "vmlinux", std::make_shared<FunctionSet>(FunctionSet{ "sys_enter" }));
+  catalogue.tracepoints.emplace(
+      "sched",
+      std::make_shared<FunctionSet>(FunctionSet{ "sched_switch", "" }));
+  return catalogue;
+}
+
+static void expect_eq(const ModulesFuncsMap &a, const ModulesFuncsMap &b)
+{
+  ASSERT_EQ(a.size(), b.size());
+  for (const auto &[key, funcs] : a) {
+    auto it = b.find(key);
+    ASSERT_NE(it, b.end()) << key;
+    EXPECT_EQ(*funcs, *it->second) << key;
+  }
+}
+
+static void expect_fails(Result<Catalogue> result)
+{
+  ASSERT_FALSE(bool(result));
+  llvm::consumeError(result.takeError());
+}
+
+TEST(catalogue, round_trip)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.catalogue";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+
+  auto catalogue = make_catalogue();
+  ASSERT_TRUE(bool(write_catalogue(path, key, catalogue)));
+
+  auto read = read_catalogue(path, key);
+  ASSERT_TRUE(bool(read));
+  EXPECT_EQ(read->modules, catalogue.modules);
+  expect_eq(read->functions, catalogue.functions);
+  expect_eq(read->raw_tracepoints, catalogue.raw_tracepoints);
+  expect_eq(read->tracepoints, catalogue.tracepoints);
+}
+
+TEST(catalogue, stale)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.catalogue";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+  ASSERT_TRUE(bool(write_catalogue(path, key, make_catalogue())));
+
+  expect_fails(
+      read_catalogue(path, { .boot_id = "5678", .modules_hash = 42 }));
+  expect_fails(
+      read_catalogue(path, { .boot_id = "1234", .modules_hash = 43 }));
+  expect_fails(read_catalogue(dir->path() / "missing", key));
+}
+
+TEST(catalogue, malformed)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.catalogue";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+  ASSERT_TRUE(bool(write_catalogue(path, key, make_catalogue())));
+
+  // Truncating the file must be detected, rather than read past the end.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  expect_fails(read_catalogue(path, key));
+}
+
+TEST(catalogue, key_ignores_module_order)
+{
+  auto a = catalogue_key({ "vmlinux", "kvm", "xfs" });
+  auto b = catalogue_key({ "xfs", "vmlinux", "kvm" });
+  auto c = catalogue_key({ "vmlinux", "kvm" });
+  ASSERT_TRUE(bool(a));
+  ASSERT_TRUE(bool(b));
+  ASSERT_TRUE(bool(c));
+  EXPECT_EQ(*a, *b);
+  EXPECT_NE(a->modules_hash, c->modules_hash);
+}
+
+} // namespace bpftrace::test::catalogue
@@ -0,0 +1,561 @@
+// Compile pipeline benchmark.
+//
+// Runs the full compile pipeline, from parsing to the linked object, over a
+// set of scripts and records the time spent in each pass and the peak RSS as
+// JSON. Nothing is loaded into the kernel, so this doesn't require root. By
+// default, kernel functions and types come from the same mocks and BTF as the
+// unit tests, so that results are comparable between machines; scripts which
+// need more than the mocks provide fail to compile. With --kernel, the running
+// kernel's functions and BTF are used instead.
+//
+// Given a baseline (a previous output), scripts whose total time or peak RSS
+// grew by more than the threshold are reported. The exit status is non-zero
+// if any script fails to compile or regressed, or if a script of the baseline
+// has no result.
+
+#include <algorithm>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "ast/pass_manager.h"
+#include "ast/passes/clang_build.h"
+#include "ast/passes/codegen_llvm.h"
+#include "ast/passes/link.h"
+#include "ast/passes/parse_passes.h"
+#include "ast/passes/resource_analyser.h"
+#include "ast/passes/types/pre_type_check.h"
+#include "ast/passes/types/type_resolver.h"
+#include "ast/passes/types/type_system.h"
+#include "data/data_source_btf.h"
+#include "mocks.h"
+#include "util/temp.h"
+
+namespace bpftrace::test::compile_bench {
+
+struct PassTime {
+  std::string name;
+  int64_t ns = 0;
+
+  template <typename Archive>
+  void serialize(Archive &archive)
+  {
+    archive(CEREAL_NVP(name), CEREAL_NVP(ns));
+  }
+};
+
+struct ScriptResult {
+  std::string name;
+  // Empty if the script compiled successfully.
+  std::string error;
+  std::vector<PassTime> passes;
+  int64_t total_ns = 0;
+  int64_t peak_rss_kb = 0;
+
+  template <typename Archive>
+  void serialize(Archive &archive)
+  {
+    archive(CEREAL_NVP(name),
+            CEREAL_NVP(error),
+            CEREAL_NVP(passes),
+            CEREAL_NVP(total_ns),
+            CEREAL_NVP(peak_rss_kb));
+  }
+};
+
+struct Script {
+  std::string name;
+  std::string source;
+  // Synthetic scripts only use what the mocks provide, so failing to compile
+  // them is always an error. Other scripts may need functions or libraries
+  // that the mocks lack, and only fail the run if they regressed.
+  bool synthetic = false;
+};
+
+struct Options {
+  std::string output;
+  std::string baseline;
+  double threshold = 0.1;
+  int iterations = 3;
+  bool kernel = false;
+  bool synthetic = true;
+  std::vector<std::string> paths;
+};
+
+static void usage(std::ostream &out)
+{
+  out << "USAGE: bpftrace_compile_bench [options] [SCRIPT|DIR]..." << std::endl;
+  out << std::endl;
+  out << "Compiles each script, and each *.bt file in each DIR, and reports"
+      << std::endl;
+  out << "the time spent in each pass and the peak RSS as JSON." << std::endl;
+  out << std::endl;
+  out << "OPTIONS:" << std::endl;
+  out << "    -o, --output FILE     write the results to FILE" << std::endl;
+  out << "    -b, --baseline FILE   compare the results against FILE"
+      << std::endl;
+  out << "    -t, --threshold PCT   regression threshold (default: 10)"
+      << std::endl;
+  out << "    -n, --iterations N    compile each script N times, keeping the"
+      << std::endl;
+  out << "                          fastest time of each pass (default: 3)"
+      << std::endl;
+  out << "    --kernel              use the running kernel's functions and BTF"
+      << std::endl;
+  out << "    --no-synthetic        skip the synthetic stress scripts"
+      << std::endl;
+}
+
+static std::vector<Script> synthetic_scripts()
+{
+  std::vector<Script> scripts;
+
+  // Many probes, each with its own program.
+  std::string probes;
+  for (int i = 1; i <= 10000; i++) {
+    auto n = std::to_string(i);
+    probes += "interval:us:" + n + " { @[" + n + "] = count(); }\n";
+  }
+  scripts.push_back(
+      { .name = "synthetic:probes", .source = probes, .synthetic = true });
+
+  // Deeply nested macros.
+  std::string macros = "macro m0(x) { x + 1 }\n";
+  for (int i = 1; i < 64; i++) {
+    macros += "macro m" + std::to_string(i) + "(x) { m" +
+              std::to_string(i - 1) + "(x) + 1 }\n";
+  }
+  macros += "begin { print(m63(1)); }\n";
+  scripts.push_back(
+      { .name = "synthetic:macros", .source = macros, .synthetic = true });
+
+  // Many maps, with large keys and values.
+  std::string maps = "interval:s:1 {\n";
+  for (int i = 0; i < 500; i++) {
+    auto n = std::to_string(i);
+    maps += "  @s" + n + "[pid, tid, comm, cpu] = stats(nsecs);\n";
+    maps += "  @h" + n + "[comm, kstack] = hist(nsecs);\n";
+    maps += "  @t" + n + "[comm] = (comm, comm, comm, pid, nsecs);\n";
+  }
+  maps += "}\n";
+  scripts.push_back(
+      { .name = "synthetic:maps", .source = maps, .synthetic = true });
+
+  return scripts;
+}
+
+static std::optional<Script> read_script(const std::filesystem::path &path)
+{
+  std::ifstream file(path);
+  if (file.fail()) {
+    std::cerr << "failed to open " << path << ": " << std::strerror(errno)
+              << std::endl;
+    return std::nullopt;
+  }
+  std::stringstream buf;
+  buf << file.rdbuf();
+  return Script{ .name = path.filename().string(), .source = buf.str() };
+}
+
+static ast::FunctionInfo &function_info(bool kernel)
+{
+  if (!kernel) {
+    return get_mock_function_info();
+  }
+  static auto kernel_info = symbols::KernelInfoImpl::open("");
+  if (!kernel_info) {
+    std::cerr << "failed to open kernel function info: "
+              << kernel_info.takeError() << std::endl;
+    exit(1);
+  }
+  static symbols::UserInfoImpl user_info;
+  static ast::FunctionInfo info(*kernel_info, user_info);
+  return info;
+}
+
+// Compiles the script, keeping the fastest time of each pass over all the
+// iterations.
+static ScriptResult compile(const Script &script, const Options &opts)
+{
+  ScriptResult result{ .name = script.name };
+
+  for (int i = 0; i < opts.iterations; i++) {
+    std::unique_ptr<BPFtrace> bpftrace;
+    if (opts.kernel) {
+      bpftrace = std::make_unique<BPFtrace>();
+    } else {
+      bpftrace = get_mock_bpftrace();
+    }
+    ast::ASTContext ast(script.name, script.source);
+
+    ast::PassManager pm;
+    pm.put(ast);
+    pm.put<BPFtrace>(*bpftrace);
+    pm.put(function_info(opts.kernel));
+    pm.add(ast::AllParsePasses());
+    pm.add(ast::CreateLLVMInitPass());
+    pm.add(ast::CreateClangBuildPass());
+    pm.add(ast::CreateTypeSystemPass());
+    pm.add(ast::CreatePreTypeCheckPass());
+    pm.add(ast::CreateTypeResolverPass());
+    pm.add(ast::CreateResourcePass());
+    pm.add(ast::CreateCompilePass());
+    pm.add(ast::CreateLinkBitcodePass());
+    pm.add(ast::CreateParallelObjectPass(std::thread::hardware_concurrency()));
+    pm.add(ast::CreateExternObjectPass());
+    pm.add(ast::CreateLinkPass());
+
+    ast::PassContext ctx;
+    size_t index = 0;
+    auto ok = pm.foreach([&](const ast::Pass &pass) -> Result<> {
+      if (!ctx.ok()) {
+        return OK();
+      }
+      auto start = std::chrono::steady_clock::now();
+      auto ok = pass.run(ctx);
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+      if (index == result.passes.size()) {
+        result.passes.push_back({ .name = pass.name(), .ns = ns });
+      } else {
+        result.passes[index].ns = std::min(result.passes[index].ns, ns);
+      }
+      index++;
+      return ok;
+    });
+
+    std::stringstream err;
+    if (!ok) {
+      err << ok.takeError();
+    } else if (!ast.diagnostics().ok()) {
+      ast.diagnostics().emit(err);
+    }
+    if (!err.str().empty()) {
+      result.error = err.str();
+      result.passes.clear();
+      return result;
+    }
+  }
+
+  for (const auto &pass : result.passes) {
+    result.total_ns += pass.ns;
+  }
+  return result;
+}
+
+// Compiles the script in a child process, so that its peak RSS can be
+// measured separately from the other scripts.
+static ScriptResult compile_isolated(const Script &script, const Options &opts)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork: " << std::strerror(errno) << std::endl;
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    std::stringstream out;
+    {
+      cereal::JSONOutputArchive archive(out);
+      archive(cereal::make_nvp("result", compile(script, opts)));
+    }
+    auto data = out.str();
+    size_t written = 0;
+    while (written < data.size()) {
+      auto n = write(fds[1], data.data() + written, data.size() - written);
+      if (n <= 0) {
+        _exit(1);
+      }
+      written += n;
+    }
+    _exit(0);
+  }
+
+  close(fds[1]);
+  std::string data;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+    data.append(buf, n);
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage = {};
+  wait4(pid, &status, 0, &usage);
+
+  ScriptResult result{ .name = script.name };
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    result.error = "compilation did not complete (status " +
+                   std::to_string(status) + ")";
+  } else {
+    std::stringstream in(data);
+    cereal::JSONInputArchive archive(in);
+    archive(cereal::make_nvp("result", result));
+  }
+  result.peak_rss_kb = usage.ru_maxrss;
+  return result;
+}
+
+// Reports the scripts that regressed compared to the baseline, and returns
+// how many did. Scripts of the baseline without a result count as regressed,
+// so that they can't silently drop out of the comparison.
+static int compare(const std::vector<ScriptResult> &results,
+                   const std::vector<ScriptResult> &baseline,
+                   double threshold)
+{
+  int regressions = 0;
+  for (const auto &base : baseline) {
+    if (std::ranges::none_of(results, [&](const auto &result) {
+          return result.name == base.name;
+        })) {
+      std::cerr << base.name << ": no result to compare with the baseline"
+                << std::endl;
+      regressions++;
+    }
+  }
+  for (const auto &result : results) {
+    auto base = std::ranges::find_if(baseline, [&](const auto &base) {
+      return base.name == result.name;
+    });
+    if (!result.error.empty()) {
+      if (base != baseline.end() && base->error.empty()) {
+        std::cerr << result.name << ": no longer compiles" << std::endl;
+        regressions++;
+      }
+      continue;
+    }
+    if (base == baseline.end()) {
+      std::cerr << result.name << ": not in the baseline" << std::endl;
+      continue;
+    }
+    if (!base->error.empty()) {
+      continue;
+    }
+
+    auto grew = [&](int64_t before, int64_t after) {
+      return static_cast<double>(after) >
+             static_cast<double>(before) * (1 + threshold);
+    };
+    bool regressed = false;
+    if (grew(base->total_ns, result.total_ns)) {
+      std::cerr << result.name << ": total time " << base->total_ns << "ns -> "
+                << result.total_ns << "ns" << std::endl;
+      regressed = true;
+    }
+    if (grew(base->peak_rss_kb, result.peak_rss_kb)) {
+      std::cerr << result.name << ": peak RSS " << base->peak_rss_kb
+                << "kB -> " << result.peak_rss_kb << "kB" << std::endl;
+      regressed = true;
+    }
+    if (regressed) {
+      // Point at the passes responsible.
+      for (const auto &pass : result.passes) {
+        auto base_pass = std::ranges::find_if(
+            base->passes,
+            [&](const auto &base_pass) { return base_pass.name == pass.name; });
+        if (base_pass != base->passes.end() &&
+            grew(base_pass->ns, pass.ns)) {
+          std::cerr << "  " << pass.name << ": " << base_pass->ns << "ns -> "
+                    << pass.ns << "ns" << std::endl;
+        }
+      }
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+static Options parse_args(int argc, char *argv[])
+{
+  enum {
+    KERNEL = 1000,
+    NO_SYNTHETIC,
+  };
+  const char *const short_options = "o:b:t:n:h";
+  option long_options[] = {
+    option{ .name = "output",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = 'o' },
+    option{ .name = "baseline",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = 'b' },
+    option{ .name = "threshold",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = 't' },
+    option{ .name = "iterations",
+            .has_arg = required_argument,
+            .flag = nullptr,
+            .val = 'n' },
+    option{ .name = "kernel",
+            .has_arg = no_argument,
+            .flag = nullptr,
+            .val = KERNEL },
+    option{ .name = "no-synthetic",
+            .has_arg = no_argument,
+            .flag = nullptr,
+            .val = NO_SYNTHETIC },
+    option{ .name = "help", .has_arg = no_argument, .flag = nullptr, .val = 'h' },
+    option{ .name = nullptr, .has_arg = 0, .flag = nullptr, .val = 0 },
+  };
+
+  Options opts;
+  int c;
+  while ((c = getopt_long(argc, argv, short_options, long_options, nullptr)) !=
+         -1) {
+    switch (c) {
+      case 'o':
+        opts.output = optarg;
+        break;
+      case 'b':
+        opts.baseline = optarg;
+        break;
+      case 't':
+        opts.threshold = std::stod(optarg) / 100;
+        break;
+      case 'n':
+        opts.iterations = std::max(1, std::stoi(optarg));
+        break;
+      case KERNEL:
+        opts.kernel = true;
+        break;
+      case NO_SYNTHETIC:
+        opts.synthetic = false;
+        break;
+      case 'h':
+        usage(std::cout);
+        exit(0);
+      default:
+        usage(std::cerr);
+        exit(1);
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    opts.paths.emplace_back(argv[i]);
+  }
+  return opts;
+}
+
+static int run(int argc, char *argv[])
+{
+  auto opts = parse_args(argc, argv);
+
+  std::vector<Script> scripts;
+  if (opts.synthetic) {
+    scripts = synthetic_scripts();
+  }
+  // Scripts which can't be read fail the run, after the results of the others
+  // are written. Of the scripts which don't compile, only the synthetic ones
+  // do: the others are excluded from the comparison, unless they compiled in
+  // the baseline.
+  int errors = 0;
+  for (const auto &path : opts.paths) {
+    if (std::filesystem::is_directory(path)) {
+      std::vector<std::filesystem::path> files;
+      for (const auto &entry : std::filesystem::directory_iterator(path)) {
+        if (entry.path().extension() == ".bt") {
+          files.push_back(entry.path());
+        }
+      }
+      std::ranges::sort(files);
+      for (const auto &file : files) {
+        if (auto script = read_script(file)) {
+          scripts.push_back(std::move(*script));
+        } else {
+          errors++;
+        }
+      }
+    } else if (auto script = read_script(path)) {
+      scripts.push_back(std::move(*script));
+    } else {
+      errors++;
+    }
+  }
+
+  // The mocks use the same BTF as the unit tests.
+  std::optional<util::TempFile> btf;
+  if (!opts.kernel) {
+    auto file = util::TempFile::create();
+    if (!file ||
+        !file->write_all({ reinterpret_cast<const char *>(btf_data),
+                           sizeof(btf_data) })) {
+      std::cerr << "failed to write the mock BTF" << std::endl;
+      return 1;
+    }
+    setenv("BPFTRACE_BTF", file->path().c_str(), true);
+    btf.emplace(std::move(*file));
+  }
+
+  std::vector<ScriptResult> results;
+  for (const auto &script : scripts) {
+    results.push_back(compile_isolated(script, opts));
+    const auto &result = results.back();
+    if (result.error.empty()) {
+      std::cerr << result.name << ": " << result.total_ns / 1000 << "us, "
+                << result.peak_rss_kb << "kB" << std::endl;
+    } else {
+      std::cerr << result.name << ": error: " << result.error << std::endl;
+      if (script.synthetic) {
+        errors++;
+      }
+    }
+  }
+
+  {
+    std::ofstream file;
+    if (!opts.output.empty()) {
+      file.open(opts.output);
+      if (file.fail()) {
+        std::cerr << "failed to open " << opts.output << ": "
+                  << std::strerror(errno) << std::endl;
+        return 1;
+      }
+    }
+    cereal::JSONOutputArchive archive(opts.output.empty() ? std::cout : file);
+    archive(cereal::make_nvp("scripts", results));
+  }
+
+  if (!opts.baseline.empty()) {
+    std::ifstream file(opts.baseline);
+    if (file.fail()) {
+      std::cerr << "failed to open " << opts.baseline << ": "
+                << std::strerror(errno) << std::endl;
+      return 1;
+    }
+    std::vector<ScriptResult> baseline;
+    cereal::JSONInputArchive archive(file);
+    archive(cereal::make_nvp("scripts", baseline));
+    if (compare(results, baseline, opts.threshold) > 0) {
+      return 1;
+    }
+  }
+  return errors > 0 ? 1 : 0;
+}
+
+} // namespace bpftrace::test::compile_bench
+
+int main(int argc, char *argv[])
+{
+  return bpftrace::test::compile_bench::run(argc, argv);
+}
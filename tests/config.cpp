@@ -29,6 +29,13 @@ TEST(Config, set)
   EXPECT_FALSE(bool(config.set("log_size", "invalid")));
   EXPECT_EQ(config.log_size, 101);
 
+  // Check that bounded int parsing works.
+  EXPECT_TRUE(bool(config.set("ringbuf_wakeup_threshold", "100")));
+  EXPECT_EQ(config.ringbuf_wakeup_threshold, 100);
+  EXPECT_FALSE(bool(config.set("ringbuf_wakeup_threshold", "101")));
+  EXPECT_FALSE(bool(config.set("ringbuf_wakeup_threshold", 200)));
+  EXPECT_EQ(config.ringbuf_wakeup_threshold, 100);
+
   // Check that string parsing works.
   EXPECT_TRUE(bool(config.set("str_trunc_trailer", "oh, no! we lost bytes!")));
   EXPECT_EQ(config.str_trunc_trailer, "oh, no! we lost bytes!");
@@ -63,6 +70,24 @@ TEST(Config, key_finding)
   EXPECT_TRUE(bool(config.set("BPFTRACE_LOG_SIZE", 0)));
 }
 
+TEST(Config, is_set)
+{
+  Config config;
+
+  EXPECT_FALSE(config.is_set("use_blazesym"));
+  EXPECT_FALSE(bool(config.set("use_blazesym", "invalid")));
+  EXPECT_FALSE(config.is_set("use_blazesym"));
+  EXPECT_TRUE(bool(config.set("BPFTRACE_USE_BLAZESYM", "false")));
+  EXPECT_TRUE(config.is_set("use_blazesym"));
+  EXPECT_FALSE(config.is_set("cache_user_symbols"));
+
+  setenv("BPFTRACE_CACHE_USER_SYMBOLS", "NONE", 1);
+  EXPECT_TRUE(bool(config.load_environment("cache_user_symbols")));
+  unsetenv("BPFTRACE_CACHE_USER_SYMBOLS");
+  EXPECT_TRUE(config.is_set("cache_user_symbols"));
+  EXPECT_EQ(config.user_symbol_cache_type, UserSymbolCacheType::none);
+}
+
 static void test_lookup_error(const std::string &key,
                               uint64_t v,
                               const std::string &err)
@@ -186,6 +186,28 @@ void tcp_shutdown(struct sock *sk, int how)
 {
 }
 
+// tracepoint records
+struct trace_entry {
+  unsigned short type;
+  unsigned char flags;
+  unsigned char preempt_count;
+  int pid;
+};
+
+struct trace_event_raw_sched_btf_args {
+  struct trace_entry ent;
+  int prev_pid;
+  char prev_comm[16];
+  unsigned int __data_loc_name;
+  char __data[];
+};
+
+struct syscall_trace_exit {
+  struct trace_entry ent;
+  int nr;
+  long ret;
+};
+
 // kernel percpu variables
 __attribute__((section(".data..percpu"))) unsigned long process_counts;
 
@@ -199,6 +221,8 @@ int main(void)
   struct bpf_map bpf_map;
   struct sock sk;
   enum FooEnum e;
+  struct trace_event_raw_sched_btf_args tp_args;
+  struct syscall_trace_exit tp_sys_exit;
 
   func_1(0, 0, 0, 0, 0);
 
@@ -436,6 +436,60 @@ TEST_F(field_analyser_btf, btf_anon_union_first_in_struct)
   EXPECT_EQ(record->GetField("c").offset, 4);
 }
 
+TEST_F(field_analyser_btf, btf_tracepoint_args)
+{
+  auto bpftrace = get_mock_bpftrace();
+  test(*bpftrace,
+       "tracepoint:sched:sched_btf_args { $x = args.prev_pid; }\n"
+       "tracepoint:syscalls:sys_exit_read { $x = args.ret; }");
+
+  auto name = "struct tracepoint:sched:sched_btf_args_args";
+  ASSERT_TRUE(bpftrace->structs.Has(name));
+  auto record = bpftrace->structs.Lookup(name).lock();
+  EXPECT_TRUE(record->is_tracepoint_args);
+  ASSERT_EQ(record->fields.size(), 7U);
+
+  ASSERT_TRUE(record->HasField("common_type"));
+  EXPECT_EQ(record->GetField("common_type").type.GetSize(), 2U);
+  EXPECT_EQ(record->GetField("common_type").offset, 0);
+  ASSERT_TRUE(record->HasField("common_pid"));
+  EXPECT_TRUE(record->GetField("common_pid").type.IsSigned());
+  EXPECT_EQ(record->GetField("common_pid").offset, 4);
+
+  ASSERT_TRUE(record->HasField("prev_pid"));
+  EXPECT_TRUE(record->GetField("prev_pid").type.IsIntTy());
+  EXPECT_EQ(record->GetField("prev_pid").type.GetAS(), AddrSpace::kernel);
+  EXPECT_EQ(record->GetField("prev_pid").offset, 8);
+
+  ASSERT_TRUE(record->HasField("prev_comm"));
+  EXPECT_TRUE(record->GetField("prev_comm").type.IsStringTy());
+  EXPECT_EQ(record->GetField("prev_comm").offset, 12);
+
+  ASSERT_TRUE(record->HasField("name"));
+  EXPECT_TRUE(record->GetField("name").is_data_loc);
+  EXPECT_EQ(record->GetField("name").offset, 28);
+  EXPECT_FALSE(record->HasField("__data"));
+
+  name = "struct tracepoint:syscalls:sys_exit_read_args";
+  ASSERT_TRUE(bpftrace->structs.Has(name));
+  record = bpftrace->structs.Lookup(name).lock();
+  ASSERT_TRUE(record->HasField("__syscall_nr"));
+  EXPECT_EQ(record->GetField("__syscall_nr").offset, 8);
+  ASSERT_TRUE(record->HasField("ret"));
+  EXPECT_EQ(record->GetField("ret").type.GetSize(), 8U);
+  EXPECT_EQ(record->GetField("ret").offset, 16);
+}
+
+TEST_F(field_analyser_btf, btf_tracepoint_args_missing_field)
+{
+  // The BTF record lacks the field, so the tracefs format file is read
+  // instead, which doesn't exist in tests.
+  test("tracepoint:sched:sched_btf_args { $x = args.next_pid; }", false);
+  test("tracepoint:sched:sched_btf_args { $x = args.prev_pid; }\n"
+       "tracepoint:sched:sched_btf_args { $x = args.next_pid; }",
+       false);
+}
+
 #ifdef HAVE_LIBDW
 
 class field_analyser_dwarf : public test_dwarf {};
@@ -0,0 +1,197 @@
+#include <algorithm>
+
+#include <llvm/IR/Instructions.h>
+
+#include "aot/aot.h"
+#include "ast/passes/clang_build.h"
+#include "ast/passes/codegen_llvm.h"
+#include "ast/passes/field_relocation.h"
+#include "ast/passes/parse_passes.h"
+#include "ast/passes/resource_analyser.h"
+#include "ast/passes/types/type_resolver.h"
+#include "ast/passes/types/type_system.h"
+#include "btf_common.h"
+#include "mocks.h"
+#include "gtest/gtest.h"
+
+namespace bpftrace::test::field_relocation {
+
+class field_relocation : public test_btf {};
+
+static void test(BPFtrace &bpftrace,
+                 const std::string &input,
+                 bool expected_result = true)
+{
+  ast::ASTContext ast("stdin", input);
+  std::stringstream msg;
+  msg << "\nInput:\n" << input << "\n\nOutput:\n";
+
+  ast::TypeMetadata no_types; // No external types defined.
+
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put(bpftrace)
+                .put(get_mock_function_info())
+                .put(no_types)
+                .add(ast::AllParsePasses())
+                .add(ast::CreateTypeResolverPass())
+                .add(ast::CreateResourcePass())
+                .add(ast::CreateFieldRelocationPass())
+                .run();
+  ASSERT_TRUE(bool(ok)) << msg.str();
+  ast.diagnostics().emit(msg);
+  EXPECT_EQ(ast.diagnostics().ok(), expected_result) << msg.str();
+}
+
+static void test(const std::string &input, bool expected_result = true)
+{
+  auto bpftrace = get_mock_bpftrace();
+  test(*bpftrace, input, expected_result);
+}
+
+TEST_F(field_relocation, fields)
+{
+  auto bpftrace = get_mock_bpftrace();
+  test(*bpftrace,
+       "kprobe:f { @a = curtask->pgid + curtask->pgid; "
+       "@b = ((struct Foo1 *)arg0)->c; }");
+
+  // Each field is only relocated once.
+  const auto &relocations = bpftrace->resources.field_relocations;
+  ASSERT_EQ(relocations.size(), 2UL);
+  EXPECT_EQ(relocations[0],
+            (FieldRelocation{ .type_name = "struct task_struct",
+                              .field = "pgid",
+                              .offset = 4,
+                              .size = 4,
+                              .global_var = "__bt__field_offset_0" }));
+  EXPECT_EQ(relocations[1],
+            (FieldRelocation{ .type_name = "struct Foo1",
+                              .field = "c",
+                              .offset = 8,
+                              .size = 8,
+                              .global_var = "__bt__field_offset_1" }));
+}
+
+TEST_F(field_relocation, nested_fields)
+{
+  auto bpftrace = get_mock_bpftrace();
+  test(*bpftrace, "kprobe:f { @ = ((struct Foo2 *)arg0)->f.c; }");
+
+  const auto &relocations = bpftrace->resources.field_relocations;
+  ASSERT_EQ(relocations.size(), 2UL);
+  EXPECT_EQ(relocations[0].type_name, "struct Foo2");
+  EXPECT_EQ(relocations[0].field, "f");
+  EXPECT_EQ(relocations[1].type_name, "struct Foo1");
+  EXPECT_EQ(relocations[1].field, "c");
+}
+
+TEST_F(field_relocation, not_kernel_memory)
+{
+  auto bpftrace = get_mock_bpftrace();
+  test(*bpftrace,
+       "fentry:func_1 { $x = args.a; } begin { $r = (a=1); @ = $r.a; }");
+  EXPECT_TRUE(bpftrace->resources.field_relocations.empty());
+}
+
+TEST_F(field_relocation, bitfields)
+{
+  test("kprobe:f { @ = ((struct Foo4 *)arg0)->a; }", false);
+  test("kprobe:f { @ = ((struct Foo4 *)arg0)->pid; }");
+}
+
+TEST_F(field_relocation, whole_structs)
+{
+  test("kprobe:f { print(*curtask); }", false);
+  test("kprobe:f { $t = *curtask; }", false);
+  test("kprobe:f { @ = *((struct Foo1 *)arg0); }", false);
+  test("kprobe:f { print(((struct Foo2 *)arg0)->f); }", false);
+
+  test("kprobe:f { print(curtask); }");
+  test("kprobe:f { print((*curtask).pid); }");
+}
+
+TEST_F(field_relocation, strides)
+{
+  test("kprobe:f { $p = (struct Foo1 *)arg0; @ = $p[1].a; }", false);
+  test("kprobe:f { $p = (struct Foo1 *)arg0 + 1; }", false);
+  test("kprobe:f { $p = (struct Foo1 *)arg0; $p++; }", false);
+
+  test("kprobe:f { $p = (int32 *)arg0; @ = $p[1]; }");
+  test("kprobe:f { $p = (int32 *)arg0 + 1; }");
+}
+
+TEST_F(field_relocation, codegen)
+{
+  auto bpftrace = get_mock_bpftrace();
+  ast::ASTContext ast("stdin", "kprobe:f { @ = curtask->pgid; }");
+
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put<BPFtrace>(*bpftrace)
+                .put(get_mock_function_info())
+                .add(ast::AllParsePasses())
+                .add(ast::CreateLLVMInitPass())
+                .add(ast::CreateClangBuildPass())
+                .add(ast::CreateTypeSystemPass())
+                .add(ast::CreateTypeResolverPass())
+                .add(ast::CreateResourcePass())
+                .add(ast::CreateFieldRelocationPass())
+                .add(ast::CreateCompilePass())
+                .run();
+  ASSERT_TRUE(bool(ok));
+  ASSERT_TRUE(ast.diagnostics().ok());
+
+  // The offset is loaded from the global, rather than embedded.
+  auto &module = *ok->get<ast::CompiledModule>().module;
+  auto *offset = module.getGlobalVariable("__bt__field_offset_0");
+  ASSERT_NE(offset, nullptr);
+  EXPECT_TRUE(std::ranges::any_of(offset->users(), [](const llvm::User *user) {
+    return llvm::isa<llvm::LoadInst>(user);
+  }));
+}
+
+static FieldRelocation relocation(std::string type_name,
+                                  std::string field,
+                                  uint64_t offset,
+                                  uint64_t size)
+{
+  return FieldRelocation{ .type_name = std::move(type_name),
+                          .field = std::move(field),
+                          .offset = offset,
+                          .size = size,
+                          .global_var = "__bt__field_offset_0" };
+}
+
+TEST_F(field_relocation, relocate_fields)
+{
+  auto bpftrace = get_mock_bpftrace();
+  auto &relocations = bpftrace->resources.field_relocations;
+
+  // The offsets on the build host differ from those of the running kernel.
+  relocations = { relocation("struct Foo1", "c", 16, 8),
+                  relocation("struct Foo2", "g", 0, 1) };
+  EXPECT_EQ(aot::relocate_fields(*bpftrace), 0);
+  EXPECT_EQ(relocations[0].offset, 8);
+  EXPECT_EQ(relocations[1].offset, 8);
+}
+
+TEST_F(field_relocation, relocate_fields_incompatible)
+{
+  auto bpftrace = get_mock_bpftrace();
+  auto &relocations = bpftrace->resources.field_relocations;
+
+  relocations = { relocation("struct Foo1", "d", 8, 8) };
+  EXPECT_EQ(aot::relocate_fields(*bpftrace), 1);
+
+  relocations = { relocation("struct Foo1", "c", 8, 4) };
+  EXPECT_EQ(aot::relocate_fields(*bpftrace), 1);
+
+  relocations = { relocation("struct Foo4", "a", 8, 4) };
+  EXPECT_EQ(aot::relocate_fields(*bpftrace), 1);
+
+  relocations = { relocation("struct Foo5", "a", 0, 4) };
+  EXPECT_EQ(aot::relocate_fields(*bpftrace), 1);
+}
+
+} // namespace bpftrace::test::field_relocation
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <filesystem>
 #include <optional>
+#include <set>
 #include <sstream>
 
+#include "ast/ast.h"
 #include "ast/passes/parse_passes.h"
 #include "ast/passes/resolve_imports.h"
 #include "mocks.h"
@@ -159,6 +162,27 @@ TEST_F(ImportTest, stdlib_implicit_rules)
     EXPECT_TRUE(imports.scripts.contains("stdlib/base.bt"));
   });
 
+  // Only the referenced macros are parsed, not the whole file. Overloads are
+  // all parsed together.
+  test(R"(begin { print(cpu()); @a[1] = 1; delete(@a, 1); })",
+       { dir->path() },
+       [](Imports &imports) {
+         const auto &ast = imports.scripts.at("stdlib/base.bt").ast;
+         std::set<std::string> names;
+         for (const auto *macro : ast.root->macros) {
+           EXPECT_TRUE(macro->is_stdlib);
+           names.insert(macro->name);
+         }
+         EXPECT_TRUE(names.contains("cpu"));
+         EXPECT_TRUE(names.contains("delete"));
+         EXPECT_FALSE(names.contains("comm"));
+         EXPECT_EQ(std::ranges::count_if(ast.root->macros,
+                                         [](const auto *macro) {
+                                           return macro->name == "delete";
+                                         }),
+                   4);
+       });
+
   // This test is to illustrate something that can be improved later. The `cpu`
   // macro takes no arguments but the call to `cpu` in this test passes
   // arguments meaning that if another `cpu` marco is defined by the user that
@@ -0,0 +1,114 @@
+#include <sstream>
+
+#include "symbols/kallsyms.h"
+#include "util/temp.h"
+#include "gtest/gtest.h"
+
+namespace bpftrace::test::kallsyms {
+
+using namespace bpftrace::symbols;
+
+static const std::string KALLSYMS = R"(ffffffff81000000 T _text
+ffffffff81000000 T startup_64
+ffffffff81001000 t do_one_initcall
+ffffffff81002000 T vfs_read
+0000000000000000 A fixed_percpu_data
+ffffffffc0001000 t ext4_read_folio	[ext4]
+ffffffffc0002000 t bpf_prog_0123456789abcdef_handler	[bpf]
+ffffffffc0003000 t ext4_writepages	[ext4]
+)";
+
+static KernelSymbols parse(const std::string &input)
+{
+  std::istringstream stream(input);
+  auto symbols = KernelSymbols::parse(stream);
+  EXPECT_TRUE(bool(symbols));
+  return std::move(*symbols);
+}
+
+static void expect_resolves(const KernelSymbols &symbols,
+                            uint64_t addr,
+                            const std::string &name,
+                            uint64_t offset)
+{
+  auto sym = symbols.resolve(addr);
+  ASSERT_TRUE(sym.has_value()) << std::hex << addr;
+  EXPECT_EQ(sym->name, name);
+  EXPECT_EQ(sym->offset, offset);
+}
+
+static void expect_fails(Result<KernelSymbols> result)
+{
+  ASSERT_FALSE(bool(result));
+  llvm::consumeError(result.takeError());
+}
+
+TEST(kallsyms, resolve)
+{
+  auto symbols = parse(KALLSYMS);
+
+  // Symbols without an address, aliases and BPF programs are skipped.
+  EXPECT_EQ(symbols.size(), 5);
+
+  EXPECT_FALSE(symbols.resolve(0xffffffff80000000).has_value());
+  expect_resolves(symbols, 0xffffffff81000000, "_text", 0);
+  expect_resolves(symbols, 0xffffffff81001010, "do_one_initcall", 0x10);
+  expect_resolves(symbols, 0xffffffff81002fff, "vfs_read", 0xfff);
+  expect_resolves(symbols, 0xffffffffc0001004, "ext4_read_folio", 4);
+  expect_resolves(symbols, 0xffffffffc0002000, "ext4_read_folio", 0x1000);
+  expect_resolves(symbols, 0xffffffffc0003000, "ext4_writepages", 0);
+}
+
+TEST(kallsyms, no_addresses)
+{
+  // This is what is seen without the privileges to read addresses.
+  std::istringstream stream("0000000000000000 T _text\n"
+                            "0000000000000000 T vfs_read\n");
+  expect_fails(KernelSymbols::parse(stream));
+}
+
+TEST(kallsyms, round_trip)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.symbols";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+
+  ASSERT_TRUE(bool(parse(KALLSYMS).write(path, key)));
+
+  auto read = KernelSymbols::read(path, key);
+  ASSERT_TRUE(bool(read));
+  EXPECT_EQ(read->size(), 5);
+  expect_resolves(*read, 0xffffffff81002004, "vfs_read", 4);
+  expect_resolves(*read, 0xffffffffc0003010, "ext4_writepages", 0x10);
+}
+
+TEST(kallsyms, stale)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.symbols";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+  ASSERT_TRUE(bool(parse(KALLSYMS).write(path, key)));
+
+  expect_fails(
+      KernelSymbols::read(path, { .boot_id = "5678", .modules_hash = 42 }));
+  expect_fails(
+      KernelSymbols::read(path, { .boot_id = "1234", .modules_hash = 43 }));
+  expect_fails(KernelSymbols::read(dir->path() / "missing", key));
+}
+
+TEST(kallsyms, malformed)
+{
+  auto dir = util::TempDir::create();
+  ASSERT_TRUE(bool(dir));
+  auto path = dir->path() / "kernel.symbols";
+  CatalogueKey key{ .boot_id = "1234", .modules_hash = 42 };
+  ASSERT_TRUE(bool(parse(KALLSYMS).write(path, key)));
+
+  // Truncating the file must be detected, rather than read past the end.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  expect_fails(KernelSymbols::read(path, key));
+}
+
+} // namespace bpftrace::test::kallsyms
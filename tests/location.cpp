@@ -74,4 +74,37 @@ TEST(Location, multi_line_trailing_newline)
             }));
 }
 
+TEST(Location, interned)
+{
+  ast::ASTContext ast("testfile", test);
+
+  ast::SourceLocation loc(ast.source());
+  loc.begin = { .line = 3, .column = 9 };
+  loc.end = { .line = 3, .column = 13 };
+  ast::SourceLocation other(ast.source());
+  other.begin = { .line = 4, .column = 3 };
+  other.end = { .line = 4, .column = 8 };
+
+  auto &a = *ast.make_node<ast::Call>(loc, "foo", ast::ExpressionList({}));
+  auto &b = *ast.make_node<ast::Call>(loc, "bar", ast::ExpressionList({}));
+  auto &c = *ast.make_node<ast::Call>(other, "baz", ast::ExpressionList({}));
+  EXPECT_EQ(a.loc.get(), b.loc.get());
+  EXPECT_NE(a.loc.get(), c.loc.get());
+
+  // Context added to one diagnostic is not visible from another diagnostic
+  // that happens to share the same location.
+  auto &err = a.addError();
+  err.addContext(c.loc) << "context";
+  auto &other_err = b.addError();
+  EXPECT_EQ(err.contexts().size(), 1);
+  EXPECT_TRUE(other_err.contexts().empty());
+
+  // Clearing the context releases all nodes.
+  EXPECT_EQ(ast.node_count(), 3);
+  ast.clear();
+  EXPECT_EQ(ast.node_count(), 0);
+  auto &d = *ast.make_node<ast::Call>(loc, "foo", ast::ExpressionList({}));
+  EXPECT_EQ(d.loc->source_location(), "testfile:3:9-13");
+}
+
 } // namespace bpftrace::test::location
@@ -1,7 +1,11 @@
+#include <limits>
 #include <sstream>
 
 #include "bpfmap.h"
+#include "format_string.h"
 #include "mocks.h"
+#include "output/binary.h"
+#include "output/json.h"
 #include "output/text.h"
 #include "types_format.h"
 #include "gtest/gtest.h"
@@ -156,4 +160,170 @@ TEST(TextOutput, lhist_underflow_only)
             out.str());
 }
 
+TEST(JsonOutput, escaping)
+{
+  std::stringstream out;
+  ::bpftrace::output::JsonOutput output(out);
+
+  output.printf("plain text that is longer than a word",
+                SourceInfo(),
+                PrintfSeverity::NONE);
+  output.printf("q\"b\\n\nr\rt\tc\x01\x1f end",
+                SourceInfo(),
+                PrintfSeverity::NONE);
+  // Anything else (e.g. UTF-8) is left as is.
+  output.printf("utf-8 \xc3\xa9", SourceInfo(), PrintfSeverity::NONE);
+
+  EXPECT_EQ(R"({"type": "printf", "data": "plain text that is longer than a word"}
+{"type": "printf", "data": "q\"b\\n\nr\rt\tc\u0001\u001f end"}
+)" + std::string("{\"type\": \"printf\", \"data\": \"utf-8 \xc3\xa9\"}\n"),
+            out.str());
+}
+
+TEST(JsonOutput, numbers)
+{
+  std::stringstream out;
+  ::bpftrace::output::JsonOutput output(out);
+
+  using ::bpftrace::output::Primitive;
+  Primitive::Tuple tuple;
+  tuple.values.emplace_back(static_cast<int64_t>(-5));
+  tuple.values.emplace_back(static_cast<uint64_t>(9007199254740993ULL));
+  tuple.values.emplace_back(1.5);
+  tuple.values.emplace_back(true);
+  output.value(Primitive(std::move(tuple)));
+
+  EXPECT_EQ(R"({"type": "value", "data": [-5,"9007199254740993",1.500000,true]}
+)",
+            out.str());
+}
+
+TEST(JsonOutput, large_double)
+{
+  std::stringstream out;
+  ::bpftrace::output::JsonOutput output(out);
+
+  // Doubles this large have hundreds of digits in fixed notation.
+  using ::bpftrace::output::Primitive;
+  Primitive::Tuple tuple;
+  tuple.values.emplace_back(std::numeric_limits<double>::max());
+  tuple.values.emplace_back(-1e300);
+  output.value(Primitive(std::move(tuple)));
+
+  EXPECT_EQ(R"({"type": "value", "data": [)" +
+                std::to_string(std::numeric_limits<double>::max()) + "," +
+                std::to_string(-1e300) + "]}\n",
+            out.str());
+}
+
+// Emits the same output on both the given output and as the binary one would
+// be replayed, i.e. with printf events formatted by the reader.
+static void emit_all(::bpftrace::output::Output &output, bool binary)
+{
+  using ::bpftrace::output::Primitive;
+  using ::bpftrace::output::Value;
+  FormatString fmt("%d %s\n");
+  std::vector<Primitive> args = { static_cast<int64_t>(-7),
+                                  std::string("a\nb") };
+  if (!binary || !output.printf_args(0, args)) {
+    output.printf(fmt.format(args), SourceInfo(), PrintfSeverity::NONE);
+  }
+  args = { static_cast<int64_t>(42), std::string("c") };
+  if (!binary || !output.printf_args(0, args)) {
+    output.printf(fmt.format(args), SourceInfo(), PrintfSeverity::NONE);
+  }
+
+  Value::Histogram hist;
+  hist.lower_bound.emplace(static_cast<uint64_t>(0));
+  hist.labels = { static_cast<uint64_t>(1), static_cast<uint64_t>(2) };
+  hist.counts = { 3, 4, 5 };
+  Value::OrderedMap m;
+  m.values.emplace_back(Primitive(std::string("key")), std::move(hist));
+  output.map("@h", std::move(m));
+
+  Primitive::Tuple tuple;
+  tuple.values.emplace_back(1.5);
+  tuple.values.emplace_back(Primitive::Symbolic("sym", 3));
+  tuple.values.emplace_back(Primitive::Buffer{ .data = { 'x', '\0' } });
+  output.value(Primitive(std::move(tuple)));
+
+  ::bpftrace::output::LostEvents lost;
+  lost.count = 12;
+  lost.ring_occupancy = 90;
+  output.lost_events(lost);
+
+  ::bpftrace::output::ProbeStats stats;
+  stats.interval_ns = 1000000000;
+  stats.probes.push_back({ .name = "interval:s:1",
+                           .events = 1,
+                           .run_time_ns = 250,
+                           .recursion_misses = 0,
+                           .ns_per_event = 250,
+                           .events_per_sec = 1,
+                           .cpu_share = 0.000025 });
+  stats.ringbuf_wakeups = 3;
+  stats.ringbuf_wakeups_per_sec = 3;
+  stats.ringbuf_timer_flushes = 1;
+  output.probe_stats(stats);
+  output.end();
+}
+
+TEST(BinaryOutput, round_trip)
+{
+  std::stringstream binary;
+  ::bpftrace::output::BinaryOutput output(
+      binary,
+      { ::bpftrace::output::PrintfSchema{ .format = "%d %s\n",
+                                          .types = { "int64", "string" } } });
+  emit_all(output, true);
+
+  std::stringstream expected;
+  ::bpftrace::output::JsonOutput json(expected);
+  emit_all(json, false);
+
+  std::stringstream decoded;
+  ::bpftrace::output::JsonOutput replayed(decoded);
+  auto ok = ::bpftrace::output::replay_binary(
+      binary,
+      replayed,
+      [](const ::bpftrace::output::PrintfSchema &schema,
+         const std::vector<::bpftrace::output::Primitive> &args) {
+        return FormatString(schema.format).format(args);
+      });
+  ASSERT_TRUE(bool(ok));
+  EXPECT_EQ(expected.str(), decoded.str());
+}
+
+static void expect_fails(Result<> result)
+{
+  ASSERT_FALSE(bool(result));
+  llvm::consumeError(result.takeError());
+}
+
+TEST(BinaryOutput, malformed)
+{
+  auto format = [](const ::bpftrace::output::PrintfSchema &,
+                   const std::vector<::bpftrace::output::Primitive> &) {
+    return std::string();
+  };
+  std::stringstream discard;
+  ::bpftrace::output::JsonOutput json(discard);
+
+  std::stringstream binary;
+  ::bpftrace::output::BinaryOutput output(binary, {});
+  output.time("12:00:00\n");
+
+  // A truncated record.
+  auto data = binary.str();
+  std::stringstream truncated(data.substr(0, data.size() - 1));
+  expect_fails(::bpftrace::output::replay_binary(truncated, json, format));
+
+  // Not a binary stream at all.
+  std::stringstream text("hello world\n");
+  expect_fails(::bpftrace::output::replay_binary(text, json, format));
+
+  std::stringstream full(data);
+  EXPECT_TRUE(bool(::bpftrace::output::replay_binary(full, json, format)));
+}
+
 } // namespace bpftrace::test::output
@@ -9,11 +9,14 @@
 
 namespace bpftrace::test::pid_filter_pass {
 
+using bpftrace::test::Call;
 using bpftrace::test::ExprStatement;
 using bpftrace::test::If;
 using bpftrace::test::Integer;
 using bpftrace::test::ProbeMatcher;
 using bpftrace::test::Program;
+using bpftrace::test::StatementImport;
+using bpftrace::test::Unop;
 
 using ::testing::_;
 using ::testing::HasSubstr;
@@ -104,4 +107,86 @@ TEST(pid_filter_pass, no_add_filter)
   }
 }
 
+TEST(pid_filter_pass, pid_tree)
+{
+  auto mock_bpftrace = get_mock_bpftrace();
+  BPFtrace& bpftrace = *mock_bpftrace;
+  bpftrace.procmon_ = std::make_unique<MockProcMon>(1);
+  bpftrace.pid_tree_ = true;
+
+  std::string input = "kprobe:f { 1 } uprobe:/bin/sh:f { 1 } "
+                      "usdt:sh:probe { 1 }";
+  ast::ASTContext ast("stdin", input);
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put(bpftrace)
+                .put(get_mock_function_info())
+                .add(CreateParsePass())
+                .add(ast::CreatePidTreePass())
+                .add(ast::CreateParseAttachpointsPass())
+                .add(ast::CreateProbeAndApExpansionPass())
+                .add(ast::CreateFieldAnalyserPass())
+                .add(ast::CreatePidFilterPass())
+                .run();
+  ASSERT_TRUE(ok && ast.diagnostics().ok());
+
+  auto filtered = [](const std::vector<std::string>& attach_points) {
+    return ProbeMatcher()
+        .WithAttachPoints(attach_points)
+        .WithBody(Block({ StatementImport("stdlib/process/pid_filter.bpf.c") },
+                        If(Unop(Operator::LNOT, Call("__pid_filter_match", {})),
+                           _,
+                           _)));
+  };
+  EXPECT_THAT(
+      ast,
+      Program().WithProbes({
+          filtered({ "kprobe:f" }),
+          filtered({ "uprobe:/bin/sh:f" }),
+          ProbeMatcher().WithStatements({ ExprStatement(Integer(1)) }),
+          filtered({ "tracepoint:sched:sched_process_fork" }),
+          filtered({ "tracepoint:sched:sched_process_exit" }),
+      }));
+}
+
+TEST(pid_filter_pass, aot)
+{
+  // The pid is only known when the program is loaded, so it doesn't matter
+  // whether one is given when compiling.
+  auto mock_bpftrace = get_mock_bpftrace();
+  std::string input = "kprobe:f { 1 } uprobe:/bin/sh:f { 1 } begin { 1 }";
+  ast::ASTContext ast("stdin", input);
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put<BPFtrace>(*mock_bpftrace)
+                .put(get_mock_function_info())
+                .add(CreateParsePass())
+                .add(ast::CreateParseAttachpointsPass())
+                .add(ast::CreateProbeAndApExpansionPass())
+                .add(ast::CreateFieldAnalyserPass())
+                .add(ast::CreateAotPidFilterPass())
+                .run();
+  ASSERT_TRUE(ok && ast.diagnostics().ok());
+
+  auto unfiltered = ProbeMatcher().WithStatements(
+      { ExprStatement(Integer(1)) });
+  EXPECT_THAT(
+      ast,
+      Program().WithProbes({
+          ProbeMatcher().WithBody(Block(
+              {},
+              If(Binop(Operator::LAND,
+                       Binop(Operator::NE,
+                             Builtin("__builtin_filter_pid"),
+                             Integer(0)),
+                       Binop(Operator::NE,
+                             Builtin("pid"),
+                             Builtin("__builtin_filter_pid"))),
+                 _,
+                 _))),
+          unfiltered,
+          unfiltered,
+      }));
+}
+
 } // namespace bpftrace::test::pid_filter_pass
@@ -8,6 +8,7 @@
 #include "ast/passes/named_param.h"
 #include "ast/passes/types/type_resolver.h"
 #include "ast/passes/types/type_system.h"
+#include "btf.h"
 #include "btf_common.h"
 #include "mocks.h"
 #include "parser.h"
@@ -42,8 +43,8 @@ void test(BPFtrace &bpftrace, const std::string &input, int expected_result = 0)
                 .add(ast::CreateMapSugarPass())
                 .add(ast::CreateFieldAnalyserPass())
                 .add(ast::CreateNamedParamsPass())
-                .add(ast::CreateTypeResolverPass())
                 .add(ast::CreatePortabilityPass())
+                .add(ast::CreateTypeResolverPass())
                 .run();
   ASSERT_TRUE(bool(ok));
   EXPECT_EQ(int(!ast.diagnostics().ok()), expected_result) << msg.str();
@@ -55,9 +56,9 @@ void test(const std::string &input, int expected_result = 0)
   test(*bpftrace, input, expected_result);
 }
 
-TEST(portability_analyser, generic_field_access_disabled)
+TEST(portability_analyser, generic_field_access)
 {
-  test("struct Foo { int x;} begin { $f = (struct Foo *)0; $f->x; }", 1);
+  test("struct Foo { int x;} begin { $f = (struct Foo *)0; $f->x; }", 0);
 }
 
 class portability_analyser_btf : public test_btf {};
@@ -82,10 +83,29 @@ TEST(portability_analyser, positional_params_disabled)
   test(*bpftrace, "begin { str($2) }", 1);
 }
 
-TEST(portability_analyser, curtask_disabled)
+TEST(portability_analyser, curtask)
+{
+  test("begin { curtask }", 0);
+  test("struct task_struct { char comm[16]; } begin { curtask->comm }", 0);
+}
+
+TEST_F(portability_analyser_btf, sizeof_offsetof)
 {
-  test("begin { curtask }", 1);
-  test("struct task_struct { char comm[16]; } begin { curtask->comm }", 1);
+  // These are folded into constants with the layout of the build host.
+  test("begin { sizeof(struct Foo1) }", 1);
+  test("begin { sizeof(AnonStructTypedef) }", 1);
+  test("begin { offsetof(struct Foo1, c) }", 1);
+  test("begin { sizeof(*curtask) }", 1);
+  test("begin { sizeof(curtask->pid) }", 1);
+  test("begin { $t = curtask; offsetof(*$t, pid) }", 1);
+
+  test("begin { sizeof(struct Foo1 *) }", 0);
+  test("begin { sizeof(uint64) }", 0);
+  test("begin { sizeof(size_t) }", 0);
+  test("begin { $x = 1; sizeof($x) }", 0);
+  test("begin { $x = (1, 2); sizeof($x.0) }", 0);
+  test("begin { @x = 1; sizeof(@x) }", 0);
+  test("begin { sizeof(str(\"abc\")) }", 0);
 }
 
 } // namespace bpftrace::test::portability_analyser
@@ -7,6 +7,7 @@
 #include "ast/passes/macro_expansion.h"
 #include "ast/passes/map_sugar.h"
 #include "ast/passes/named_param.h"
+#include "ast/passes/parse_btf.h"
 #include "ast/passes/resolve_imports.h"
 #include "ast/passes/resource_analyser.h"
 #include "ast/passes/types/type_resolver.h"
@@ -46,7 +47,7 @@ void gen_bytecode(const std::string &input, std::stringstream &out)
                 .add(ast::CreateControlFlowPass())
                 .add(ast::CreateProbeAndApExpansionPass())
                 .add(ast::CreateMacroExpansionPass())
-                .add(CreateParseBTFPass())
+                .add(ast::CreateParseBTFPass())
                 .add(ast::CreateMapSugarPass())
                 .add(ast::CreateFieldAnalyserPass())
                 .add(ast::CreateNamedParamsPass())
@@ -66,67 +66,105 @@ TEST(resource_analyser, printf_in_subprog)
   test(R"(fn greet(): void { printf("Hello, world\n"); })", true);
 }
 
-TEST(resource_analyser, fmt_string_args_size_ints)
-{
-  RequiredResources resources;
-  test(R"(begin { printf("%d %d", 3, 4) })", true, &resources);
-  EXPECT_EQ(resources.max_fmtstring_args_size, 16);
-}
-
-TEST(resource_analyser, fmt_string_args_below_on_stack_limit)
+TEST(resource_analyser, print_non_map_print_correct_args_order)
 {
   RequiredResources resources;
-  test(R"(begin { printf("%d %d", 3, 4) })", true, &resources, 32);
-  EXPECT_EQ(resources.max_fmtstring_args_size, 0);
-}
+  test(R"(begin { print({ $x = 1; print("bob"); $x > 1}) })", true, &resources);
 
-TEST(resource_analyser, fmt_string_args_size_arrays)
-{
-  RequiredResources resources;
-  test(
-      R"(struct Foo { int a; char b[10]; } begin { $foo = (struct Foo *)0; $foo2 = (struct Foo *)1; printf("%d %s %d %s\n", $foo->a, $foo->b, $foo2->a, $foo2->b) })",
-      true,
-      &resources);
-  EXPECT_EQ(resources.max_fmtstring_args_size, 40);
+  EXPECT_THAT(resources.non_map_print_args,
+              ElementsAre(SizedType(Type::string, 4),
+                          SizedType(Type::boolean, 1)));
 }
 
-TEST(resource_analyser, fmt_string_args_size_strings)
+TEST(resource_analyser, event_loss_sources)
 {
   RequiredResources resources;
-  test(
-      R"(begin { printf("%dst: %sa; %dnd: %sb;; %drd: %sc;;; %dth: %sd;;;;\n", 1, "a", 2, "ab", 3, "abc", 4, "abcd") })",
-      true,
-      &resources);
-  EXPECT_EQ(resources.max_fmtstring_args_size, 32);
+  test(R"(begin { printf("a"); printf("b"); exit(); } end { printf("c"); })",
+       true,
+       &resources);
+
+  // Each call site has its own slot, even for calls of the same kind.
+  using Source = std::tuple<std::string, std::string, std::string>;
+  EXPECT_THAT(resources.event_loss_sources,
+              ElementsAre(Source("", "other", ""),
+                          Source("begin", "printf", "stdin:1:9-20"),
+                          Source("begin", "printf", "stdin:1:22-33"),
+                          Source("begin", "exit", "stdin:1:35-41"),
+                          Source("end", "printf", "stdin:1:51-62")));
+  EXPECT_EQ(resources.event_loss_sources_id_map.size(), 4);
 }
 
-TEST(resource_analyser, fmt_string_args_non_map_print_int)
+TEST(resource_analyser, probe_group_call_ids)
 {
   RequiredResources resources;
-  test(R"(begin { print(5) })", true, &resources);
-  EXPECT_EQ(resources.max_fmtstring_args_size, 17);
+  test(R"(kprobe:sys_read,kprobe:sys_write { printf("%d\n", 1); exit(); })",
+       true,
+       &resources);
+
+  // Both probes use the same printf and event loss slot.
+  EXPECT_EQ(resources.printf_args.size(), 1);
+  EXPECT_EQ(resources.printf_args_id_map.size(), 2);
+  using Source = std::tuple<std::string, std::string, std::string>;
+  EXPECT_THAT(
+      resources.event_loss_sources,
+      ElementsAre(Source("", "other", ""),
+                  Source("kprobe:sys_read,kprobe:sys_write",
+                         "printf",
+                         "stdin:1:36-53"),
+                  Source("kprobe:sys_read,kprobe:sys_write",
+                         "exit",
+                         "stdin:1:55-61")));
 }
 
-TEST(resource_analyser, fmt_string_args_non_map_print_arr)
+TEST(resource_analyser, array_map_for_bounded_keys)
 {
   RequiredResources resources;
-  test(
-      R"(struct Foo { char a[24]; } begin { print(5); $foo = (struct Foo *)0; print($foo->a) })",
-      true,
-      &resources);
-
-  // See clang_parser.cpp; the increase signal well-formedness.
-  EXPECT_EQ(resources.max_fmtstring_args_size, 40U + 1U);
+  test(R"(begin { @a = count(); @b[cpu] = count(); @c[(uint8)nsecs] = count();
+                  @d[nsecs] = count(); @e[1] = count(); delete(@e, 1);
+                  @f[(uint8)nsecs] = sum(1); @g[4096] = count();
+                  @h[0xffffffffffffffff] = count();
+                  @i[cpu] = count(); @i[4000] = count(); })",
+       true,
+       &resources);
+
+  EXPECT_EQ(resources.maps_info["@a"].bpf_type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  EXPECT_EQ(resources.maps_info["@a"].max_entries, 1);
+  EXPECT_EQ(resources.maps_info["@b"].bpf_type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  EXPECT_TRUE(resources.maps_info["@b"].keyed_by_cpu);
+  EXPECT_EQ(resources.maps_info["@b"].min_entries, 0);
+  EXPECT_EQ(resources.maps_info["@c"].bpf_type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  EXPECT_EQ(resources.maps_info["@c"].max_entries, 256);
+  EXPECT_EQ(resources.maps_info["@d"].bpf_type, BPF_MAP_TYPE_PERCPU_HASH);
+  EXPECT_EQ(resources.maps_info["@e"].bpf_type, BPF_MAP_TYPE_PERCPU_HASH);
+
+  // Zero is a valid sum, so it can't mark untouched array entries.
+  EXPECT_EQ(resources.maps_info["@f"].bpf_type, BPF_MAP_TYPE_PERCPU_HASH);
+
+  // Literal keys must be below max_map_keys.
+  EXPECT_EQ(resources.maps_info["@g"].bpf_type, BPF_MAP_TYPE_PERCPU_HASH);
+  EXPECT_EQ(resources.maps_info["@h"].bpf_type, BPF_MAP_TYPE_PERCPU_HASH);
+
+  // Maps keyed by cpu keep room for their other keys when resized.
+  EXPECT_EQ(resources.maps_info["@i"].bpf_type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  EXPECT_TRUE(resources.maps_info["@i"].keyed_by_cpu);
+  EXPECT_EQ(resources.maps_info["@i"].min_entries, 4001);
+  EXPECT_GE(resources.maps_info["@i"].max_entries, 4001);
 }
 
-TEST(resource_analyser, print_non_map_print_correct_args_order)
+TEST(resource_analyser, mapping_snapshots)
 {
-  RequiredResources resources;
-  test(R"(begin { print({ $x = 1; print("bob"); $x > 1}) })", true, &resources);
-
-  EXPECT_THAT(resources.non_map_print_args,
-              ElementsAre(SizedType(Type::string, 4),
-                          SizedType(Type::boolean, 1)));
+  auto snapshots = [](const std::string &input, bool enabled) {
+    auto bpftrace = get_mock_bpftrace();
+    bpftrace->config_->snapshot_user_mappings = enabled;
+    RequiredResources resources;
+    test(*bpftrace, input, true, &resources);
+    return resources.needs_mapping_snapshots;
+  };
+
+  EXPECT_TRUE(snapshots("kprobe:f { @[ustack] = count(); }", true));
+  EXPECT_TRUE(snapshots("kprobe:f { @[ustack(perf)] = count(); }", true));
+  EXPECT_FALSE(snapshots("kprobe:f { @[kstack] = count(); }", true));
+  EXPECT_FALSE(snapshots("kprobe:f { @[ustack] = count(); }", false));
 }
 
 } // namespace bpftrace::test::resource_analyser
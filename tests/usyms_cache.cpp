@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <bcc/bcc_syms.h>
+#include <chrono>
+#include <csignal>
+#include <dlfcn.h>
+#include <filesystem>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "usyms_cache.h"
+#include "gtest/gtest.h"
+
+extern "C" __attribute__((noinline)) int usyms_cache_test_function(int x)
+{
+  return x + 1;
+}
+
+namespace bpftrace::test::usyms_cache {
+
+static bcc_symbol_option opts = {
+  .use_debug_file = 0,
+  .check_debug_file_crc = 0,
+  .lazy_symbolize = 0,
+  .use_symbol_type = BCC_SYM_ALL_TYPES,
+};
+
+static uint64_t test_function_addr()
+{
+  return reinterpret_cast<uint64_t>(&usyms_cache_test_function);
+}
+
+TEST(usyms_cache, resolve)
+{
+  UserSymbolCache cache(1 << 30, opts);
+  auto sym = cache.resolve(getpid(), test_function_addr() + 1);
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "usyms_cache_test_function");
+  EXPECT_EQ(sym->offset, 1);
+  EXPECT_GT(cache.bytes(), 0);
+}
+
+TEST(usyms_cache, not_file_backed)
+{
+  UserSymbolCache cache(1 << 30, opts);
+  int on_stack = 0;
+  EXPECT_FALSE(
+      cache.resolve(getpid(), reinterpret_cast<uint64_t>(&on_stack)).has_value());
+}
+
+TEST(usyms_cache, eviction)
+{
+  auto *libc_fn = dlsym(RTLD_DEFAULT, "getpid");
+  ASSERT_NE(libc_fn, nullptr);
+  auto libc_addr = reinterpret_cast<uint64_t>(libc_fn);
+
+  UserSymbolCache unbounded(1 << 30, opts);
+  ASSERT_TRUE(unbounded.resolve(getpid(), test_function_addr()).has_value());
+  auto own_bytes = unbounded.bytes();
+  ASSERT_TRUE(unbounded.resolve(getpid(), libc_addr).has_value());
+  auto libc_bytes = unbounded.bytes() - own_bytes;
+
+  // With no budget, only the most recently used table is kept, and others
+  // are reloaded when needed again.
+  UserSymbolCache cache(0, opts);
+  for (int i = 0; i < 2; i++) {
+    auto sym = cache.resolve(getpid(), test_function_addr());
+    ASSERT_TRUE(sym.has_value());
+    EXPECT_EQ(sym->name, "usyms_cache_test_function");
+    EXPECT_EQ(cache.bytes(), own_bytes);
+
+    ASSERT_TRUE(cache.resolve(getpid(), libc_addr).has_value());
+    EXPECT_EQ(cache.bytes(), libc_bytes);
+  }
+}
+
+TEST(usyms_cache, forget)
+{
+  UserSymbolCache cache(1 << 30, opts);
+  ASSERT_TRUE(cache.resolve(getpid(), test_function_addr()).has_value());
+  EXPECT_EQ(cache.pids(), std::vector<int>{ getpid() });
+  cache.forget(getpid());
+  EXPECT_TRUE(cache.pids().empty());
+
+  // The tables outlive the process, but its objects are looked up again.
+  auto sym = cache.resolve(getpid(), test_function_addr());
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "usyms_cache_test_function");
+}
+
+TEST(usyms_cache, reload)
+{
+  // Only the mappings are loaded, the tables wait for the first lookup.
+  UserSymbolCache cache(1 << 30, opts);
+  cache.reload(getpid());
+  EXPECT_EQ(cache.pids(), std::vector<int>{ getpid() });
+  EXPECT_EQ(cache.bytes(), 0);
+
+  auto sym = cache.resolve(getpid(), test_function_addr());
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "usyms_cache_test_function");
+  EXPECT_GT(cache.bytes(), 0);
+}
+
+TEST(usyms_cache, exec)
+{
+  if (!std::filesystem::exists("/bin/sleep")) {
+    GTEST_SKIP() << "/bin/sleep not found";
+  }
+
+  int pipefd[2];
+  ASSERT_EQ(pipe(pipefd), 0);
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    // Wait for the parent to resolve our mappings, then exec.
+    char c;
+    close(pipefd[1]);
+    if (read(pipefd[0], &c, 1) == 1) {
+      execl("/bin/sleep", "sleep", "10", nullptr);
+    }
+    _exit(1);
+  }
+  close(pipefd[0]);
+
+  // The child is a copy of this process until it execs.
+  UserSymbolCache cache(1 << 30, opts);
+  auto sym = cache.resolve(child, test_function_addr());
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "usyms_cache_test_function");
+
+  ASSERT_EQ(write(pipefd[1], "x", 1), 1);
+  close(pipefd[1]);
+  auto self = std::filesystem::read_symlink("/proc/self/exe");
+  auto exe = "/proc/" + std::to_string(child) + "/exe";
+  for (int i = 0; i < 500; i++) {
+    std::error_code ec;
+    if (std::filesystem::read_symlink(exe, ec) != self && !ec) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // Lookups keep using the mappings loaded before the exec until refreshed.
+  sym = cache.resolve(child, test_function_addr());
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "usyms_cache_test_function");
+
+  // The address now belongs to another executable, if any.
+  cache.refresh(child);
+  sym = cache.resolve(child, test_function_addr());
+  EXPECT_TRUE(!sym.has_value() || sym->name != "usyms_cache_test_function");
+
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+}
+
+TEST(usyms_cache, precomputed)
+{
+  std::string build_id;
+  auto symbols = read_elf_symbols("/proc/self/exe", opts, build_id);
+  ASSERT_NE(symbols, nullptr);
+  if (build_id.empty()) {
+    GTEST_SKIP() << "test binary has no build id";
+  }
+
+  // Rename the symbol, to tell the precomputed table from the object's.
+  auto it = std::ranges::find_if(symbols->symbols, [](const auto &entry) {
+    return entry.second.name == "usyms_cache_test_function";
+  });
+  ASSERT_NE(it, symbols->symbols.end());
+  it->second.name = "precomputed_test_function";
+
+  UserSymbolCache cache(1 << 30, opts);
+  cache.add_precomputed(build_id, symbols);
+  auto sym = cache.resolve(getpid(), test_function_addr() + 1);
+  ASSERT_TRUE(sym.has_value());
+  EXPECT_EQ(sym->name, "precomputed_test_function");
+  EXPECT_EQ(sym->offset, 1);
+  EXPECT_EQ(cache.bytes(), 0);
+}
+
+} // namespace bpftrace::test::usyms_cache
@@ -0,0 +1,49 @@
+#include "watch.h"
+#include "gtest/gtest.h"
+
+namespace bpftrace::test::watch {
+
+using bpftrace::watch::changed_probes;
+using bpftrace::watch::hash_script;
+
+TEST(watch, ignores_comments_and_formatting)
+{
+  auto a = hash_script("test.bt", "i:s:1 { print(1); }");
+  auto b = hash_script("test.bt",
+                       "// A comment.\n"
+                       "i:s:1 {\n"
+                       "  print(1); // Another one.\n"
+                       "}\n");
+  ASSERT_TRUE(a.has_value());
+  ASSERT_TRUE(b.has_value());
+  EXPECT_EQ(*a, *b);
+}
+
+TEST(watch, detects_changes)
+{
+  auto a = hash_script("test.bt", "i:s:1 { print(1); }");
+  auto b = hash_script("test.bt", "i:s:1 { print(2); }");
+  ASSERT_TRUE(a.has_value());
+  ASSERT_TRUE(b.has_value());
+  EXPECT_NE(*a, *b);
+}
+
+TEST(watch, changed_probes)
+{
+  auto a = hash_script("test.bt", "i:s:1 { print(1); } i:s:2 { print(2); }");
+  auto b = hash_script("test.bt",
+                       "i:s:1 { print(1); } i:s:2 { print(3); } "
+                       "i:s:3 { print(3); }");
+  ASSERT_TRUE(a.has_value());
+  ASSERT_TRUE(b.has_value());
+  EXPECT_EQ(changed_probes(*a, *a), 0U);
+  EXPECT_EQ(changed_probes(*a, *b), 2U);
+  EXPECT_EQ(changed_probes(*b, *a), 1U);
+}
+
+TEST(watch, parse_error)
+{
+  EXPECT_FALSE(hash_script("test.bt", "i:s:1 { print(1) ").has_value());
+}
+
+} // namespace bpftrace::test::watch
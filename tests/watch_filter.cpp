@@ -0,0 +1,66 @@
+#include "ast/passes/watch_filter.h"
+#include "ast/passes/attachpoint_passes.h"
+#include "ast_matchers.h"
+#include "mocks.h"
+#include "parser.h"
+#include "gtest/gtest.h"
+
+namespace bpftrace::test::watch_filter {
+
+using bpftrace::test::Call;
+using bpftrace::test::ExprStatement;
+using bpftrace::test::If;
+using bpftrace::test::Integer;
+using bpftrace::test::ProbeMatcher;
+using bpftrace::test::Program;
+using bpftrace::test::StatementImport;
+using bpftrace::test::Unop;
+
+using ::testing::_;
+
+TEST(watch_filter, watch)
+{
+  auto mock_bpftrace = get_mock_bpftrace();
+  BPFtrace& bpftrace = *mock_bpftrace;
+  bpftrace.watch_version_ = 2;
+
+  std::string input = "begin { 1 } kprobe:f { 1 } interval:s:1 { 1 }";
+  ast::ASTContext ast("stdin", input);
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put(bpftrace)
+                .put(get_mock_function_info())
+                .add(CreateParsePass())
+                .add(ast::CreateParseAttachpointsPass())
+                .add(ast::CreateWatchFilterPass())
+                .run();
+  ASSERT_TRUE(ok && ast.diagnostics().ok());
+
+  // Every probe only runs while its version is active.
+  auto filtered = ProbeMatcher().WithBody(
+      Block({ StatementImport("stdlib/watch/watch.bpf.c") },
+            If(Unop(Operator::LNOT, Call("__watch_active", { Integer(2) })),
+               _,
+               _)));
+  EXPECT_THAT(ast, Program().WithProbes({ filtered, filtered, filtered }));
+}
+
+TEST(watch_filter, no_watch)
+{
+  auto mock_bpftrace = get_mock_bpftrace();
+  ast::ASTContext ast("stdin", "kprobe:f { 1 }");
+  auto ok = ast::PassManager()
+                .put(ast)
+                .put<BPFtrace>(*mock_bpftrace)
+                .put(get_mock_function_info())
+                .add(CreateParsePass())
+                .add(ast::CreateParseAttachpointsPass())
+                .add(ast::CreateWatchFilterPass())
+                .run();
+  ASSERT_TRUE(ok && ast.diagnostics().ok());
+  EXPECT_THAT(ast,
+              Program().WithProbes({ ProbeMatcher().WithStatements(
+                  { ExprStatement(Integer(1)) }) }));
+}
+
+} // namespace bpftrace::test::watch_filter